@@ -35,6 +35,7 @@
 #include <botan/dl_group.h>
 #include <botan/dsa.h>
 #include <botan/ecdsa.h>
+#include <botan/ed25519.h>
 #include <botan/rsa.h>
 
 #include <memory>
@@ -83,6 +84,10 @@ std::unique_ptr<Private_Key> OpenSshKeyFileReader::privateKey() const
         const BigInt &value = m_parameters.first();
         const EC_Group group(SshCapabilities::oid(m_keyType));
         return std::make_unique<ECDSA_PrivateKey>(m_rng, group, value);
+    } else if (m_keyType == SshCapabilities::PubKeyEd25519) {
+        const secure_vector<uint8_t> secretKey(m_ed25519SecretKey.cbegin(),
+                                               m_ed25519SecretKey.cend());
+        return std::make_unique<Ed25519_PrivateKey>(secretKey);
     }
     QSSH_ASSERT_AND_RETURN_VALUE(false, nullptr);
 }
@@ -93,8 +98,10 @@ QList<BigInt> OpenSshKeyFileReader::publicParameters() const
         return m_parameters.mid(0, 2);
     if (m_keyType == SshCapabilities::PubKeyDss)
         return m_parameters.mid(0, 4);
-    if (m_keyType.startsWith(SshCapabilities::PubKeyEcdsaPrefix))
+    if (m_keyType.startsWith(SshCapabilities::PubKeyEcdsaPrefix)
+            || m_keyType == SshCapabilities::PubKeyEd25519) {
         return QList<BigInt>();
+    }
     QSSH_ASSERT_AND_RETURN_VALUE(false, QList<BigInt>());
 }
 
@@ -185,6 +192,12 @@ void OpenSshKeyFileReader::parsePrivateKeyList()
         SshPacketParser::asString(m_privateKeyList, &offset); // name
         SshPacketParser::asString(m_privateKeyList, &offset); // pubkey representation
         m_parameters = {SshPacketParser::asBigInt(m_privateKeyList, &offset)};
+    } else if (m_keyType == SshCapabilities::PubKeyEd25519) {
+        SshPacketParser::asString(m_privateKeyList, &offset); // public key
+        m_ed25519SecretKey = SshPacketParser::asString(m_privateKeyList, &offset);
+        if (m_ed25519SecretKey.size() != 64)
+            throwException(SSH_TR("Invalid Ed25519 key size %1.").arg(m_ed25519SecretKey.size()));
+        m_parameters.clear();
     } else {
         throwException(SSH_TR("Private key type '%1' is not supported.")
                        .arg(QString::fromLatin1(m_keyType)));
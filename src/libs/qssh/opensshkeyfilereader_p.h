@@ -61,6 +61,7 @@ private:
     Botan::RandomNumberGenerator &m_rng;
     QByteArray m_keyType;
     QList<Botan::BigInt> m_parameters;
+    QByteArray m_ed25519SecretKey; // Seed followed by the public key, as stored by OpenSSH.
     QByteArray m_cipherName;
     QByteArray m_kdf;
     QByteArray m_salt;
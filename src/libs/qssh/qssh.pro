@@ -6,6 +6,9 @@ DEFINES += QTCSSH_LIBRARY
 #Enable debug log
 #DEFINES += CREATOR_SSH_DEBUG
 
+# Entry points for tests/benchmarks, see tests/tests.pro.
+qssh_benchmarks: DEFINES += QSSH_BENCHMARK_HOOKS
+
 INCLUDEPATH += $$QSSH_PREFIX/include/botan-2/
 DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x050F00
 
@@ -33,6 +36,7 @@ SOURCES = $$PWD/sshsendfacility.cpp \
     $$PWD/sshremoteprocess.cpp \
     $$PWD/sshpacketparser.cpp \
     $$PWD/sshpacket.cpp \
+    $$PWD/sshpackettrace.cpp \
     $$PWD/sshoutgoingpacket.cpp \
     $$PWD/sshkeygenerator.cpp \
     $$PWD/sshkeyexchange.cpp \
@@ -41,18 +45,24 @@ SOURCES = $$PWD/sshsendfacility.cpp \
     $$PWD/sshconnection.cpp \
     $$PWD/sshchannelmanager.cpp \
     $$PWD/sshchannel.cpp \
+    $$PWD/sshchunkedbuffer.cpp \
     $$PWD/sshcapabilities.cpp \
     $$PWD/sftppacket.cpp \
     $$PWD/sftpoutgoingpacket.cpp \
     $$PWD/sftpoperation.cpp \
+    $$PWD/sftprequesttable.cpp \
     $$PWD/sftpincomingpacket.cpp \
     $$PWD/sftpdefs.cpp \
     $$PWD/sftpchannel.cpp \
     $$PWD/sshremoteprocessrunner.cpp \
+    $$PWD/sshbatchrunner.cpp \
+    $$PWD/sshlatencyhistogram.cpp \
     $$PWD/sshconnectionmanager.cpp \
     $$PWD/sshkeypasswordretriever.cpp \
     $$PWD/sftpfilesystemmodel.cpp \
     $$PWD/sshdirecttcpiptunnel.cpp \
+    $$PWD/sshdirectorytransfer.cpp \
+    $$PWD/sshtararchive.cpp \
     $$PWD/sshhostkeydatabase.cpp \
     $$PWD/sshlogging.cpp \
     $$PWD/sshtcpipforwardserver.cpp \
@@ -70,10 +80,13 @@ PUBLIC_HEADERS = \
     $$PWD/sftpchannel.h \
     $$PWD/sshkeygenerator.h \
     $$PWD/sshremoteprocessrunner.h \
+    $$PWD/sshbatchrunner.h \
+    $$PWD/sshlatencyhistogram.h \
     $$PWD/sshconnectionmanager.h \
     $$PWD/sshpseudoterminal.h \
     $$PWD/sftpfilesystemmodel.h \
     $$PWD/sshdirecttcpiptunnel.h \
+    $$PWD/sshdirectorytransfer.h \
     $$PWD/sshtcpipforwardserver.h \
     $$PWD/sshhostkeydatabase.h \
     $$PWD/sshforwardedtcpiptunnel.h \
@@ -85,6 +98,7 @@ HEADERS = $$PUBLIC_HEADERS \
     $$PWD/sshremoteprocess_p.h \
     $$PWD/sshpacketparser_p.h \
     $$PWD/sshpacket_p.h \
+    $$PWD/sshpackettrace_p.h \
     $$PWD/sshoutgoingpacket_p.h \
     $$PWD/sshkeyexchange_p.h \
     $$PWD/sshincomingpacket_p.h \
@@ -93,15 +107,20 @@ HEADERS = $$PUBLIC_HEADERS \
     $$PWD/sshconnection_p.h \
     $$PWD/sshchannelmanager_p.h \
     $$PWD/sshchannel_p.h \
+    $$PWD/sshchunkedbuffer_p.h \
+    $$PWD/sshbyteview_p.h \
     $$PWD/sshcapabilities_p.h \
     $$PWD/sshbotanconversions_p.h \
     $$PWD/sftppacket_p.h \
     $$PWD/sftpoutgoingpacket_p.h \
     $$PWD/sftpoperation_p.h \
+    $$PWD/sftprequesttable_p.h \
     $$PWD/sftpincomingpacket_p.h \
     $$PWD/sftpchannel_p.h \
     $$PWD/sshkeypasswordretriever_p.h \
     $$PWD/sshdirecttcpiptunnel_p.h \
+    $$PWD/sshdirectorytransfer_p.h \
+    $$PWD/sshtararchive_p.h \
     $$PWD/sshlogging_p.h \
     $$PWD/sshtcpipforwardserver_p.h \
     $$PWD/sshtcpiptunnel_p.h \
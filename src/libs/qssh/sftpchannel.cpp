@@ -123,6 +123,8 @@ SftpChannel::SftpChannel(quint32 channelId,
             this, &SftpChannel::closed, Qt::QueuedConnection);
     connect(d, &Internal::SftpChannelPrivate::transferProgress,
             this, &SftpChannel::transferProgress, Qt::QueuedConnection);
+    connect(d, &Internal::SftpChannelPrivate::jobStatisticsAvailable,
+            this, &SftpChannel::jobStatisticsAvailable, Qt::QueuedConnection);
 }
 
 SftpChannel::State SftpChannel::state() const
@@ -254,6 +256,7 @@ SftpJobId SftpChannel::uploadDir(const QString &localDirPath,
         new Internal::SftpMakeDir(++d->m_nextJobId, remoteDirPath, uploadDirOp));
     uploadDirOp->mkdirsInProgress.insert(mkdirOp,
         Internal::SftpUploadDir::Dir(localDirPath, remoteDirPath));
+    d->startJobTelemetry(uploadDirOp->jobId);
     d->createJob(mkdirOp);
     return uploadDirOp->jobId;
 }
@@ -271,10 +274,16 @@ SftpJobId SftpChannel::downloadDir(const QString &remoteDirPath,
         new Internal::SftpListDir(++d->m_nextJobId, remoteDirPath, downloadDirOp));
     downloadDirOp->lsdirsInProgress.insert(lsdirOp,
        Internal::SftpDownloadDir::Dir(localDirPath, remoteDirPath));
+    d->startJobTelemetry(downloadDirOp->jobId);
     d->createJob(lsdirOp);
     return downloadDirOp->jobId;
 }
 
+SftpJobStatistics SftpChannel::jobStatistics(SftpJobId job) const
+{
+    return d->jobStatistics(job);
+}
+
 SftpChannel::~SftpChannel()
 {
     delete d;
@@ -291,17 +300,40 @@ SftpChannelPrivate::SftpChannelPrivate(quint32 channelId,
     : AbstractSshChannel(channelId, sendFacility),
       m_nextJobId(0), m_sftpState(Inactive), m_sftp(sftp)
 {
+    connect(this, &AbstractSshChannel::bytesWritten,
+            this, &SftpChannelPrivate::handleBytesWritten, Qt::QueuedConnection);
+
+    // Connected first, so the statistics get queued ahead of the public finished() signal.
+    connect(this, &SftpChannelPrivate::finished, this, &SftpChannelPrivate::handleJobFinished);
+    m_clock.start();
 }
 
 SftpJobId SftpChannelPrivate::createJob(const AbstractSftpOperation::Ptr &job)
 {
    if (m_sftp->state() != SftpChannel::Initialized)
        return SftpInvalidJob;
+   if (job->publicJobId == job->jobId)
+       startJobTelemetry(job->jobId);
    m_jobs.insert(job->jobId, job);
-   sendData(job->initialPacket(m_outgoingPacket).rawData());
+   sendRequest(job->initialPacket(m_outgoingPacket));
    return job->jobId;
 }
 
+void SftpChannelPrivate::sendRequest(const SftpOutgoingPacket &packet)
+{
+    const JobMap::Iterator it = m_jobs.find(packet.requestId());
+    if (it != m_jobs.end()) {
+        const auto telemetry = m_jobTelemetry.find(it.value()->publicJobId);
+        if (telemetry != m_jobTelemetry.end()) {
+            countRequestsInFlight(telemetry.value(), 1);
+            JobMap::Request &request = it.request();
+            request.type = packet.type();
+            request.sendTime = m_clock.nsecsElapsed();
+        }
+    }
+    sendData(packet.rawData());
+}
+
 void SftpChannelPrivate::handleChannelSuccess()
 {
     if (channelState() == CloseRequested)
@@ -324,12 +356,12 @@ void SftpChannelPrivate::handleChannelFailure()
     closeChannel();
 }
 
-void SftpChannelPrivate::handleChannelDataInternal(const QByteArray &data)
+void SftpChannelPrivate::handleChannelDataInternal(const SshByteView &data)
 {
     if (channelState() == CloseRequested)
         return;
 
-    m_incomingData += data;
+    m_incomingData.append(data.data(), data.size());
     m_incomingPacket.consumeData(m_incomingData);
     while (m_incomingPacket.isComplete()) {
         handleCurrentPacket();
@@ -339,10 +371,10 @@ void SftpChannelPrivate::handleChannelDataInternal(const QByteArray &data)
 }
 
 void SftpChannelPrivate::handleChannelExtendedDataInternal(quint32 type,
-    const QByteArray &data)
+    const SshByteView &data)
 {
     qCWarning(sshLog, "Unexpected extended data '%s' of type %d on SFTP channel.",
-              data.data(), type);
+              data.toByteArray().constData(), type);
 }
 
 void SftpChannelPrivate::handleExitStatus(const SshChannelExitStatus &exitStatus)
@@ -368,11 +400,21 @@ void SftpChannelPrivate::handleExitSignal(const SshChannelExitSignal &signal)
 
 void SftpChannelPrivate::handleCurrentPacket()
 {
-    qCDebug(sshLog, "Handling SFTP packet of type %d", m_incomingPacket.type());
-    switch (m_incomingPacket.type()) {
-    case SSH_FXP_VERSION:
+    const SftpPacketType type = m_incomingPacket.type();
+    qCDebug(sshLog, "Handling SFTP packet of type %d", type);
+    if (type == SSH_FXP_VERSION) {
         handleServerVersion();
-        break;
+        return;
+    }
+
+    handleResponse(m_incomingPacket.requestId());
+
+    // Read data dominates during downloads; test for it before entering the jump table.
+    if (type == SSH_FXP_DATA) {
+        handleReadData();
+        return;
+    }
+    switch (type) {
     case SSH_FXP_HANDLE:
         handleHandle();
         break;
@@ -382,16 +424,13 @@ void SftpChannelPrivate::handleCurrentPacket()
     case SSH_FXP_STATUS:
         handleStatus();
         break;
-    case SSH_FXP_DATA:
-        handleReadData();
-        break;
     case SSH_FXP_ATTRS:
         handleAttrs();
         break;
     default:
         throw SshServerException(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Unexpected packet.",
-            tr("Unexpected packet of type %1.").arg(m_incomingPacket.type()));
+            tr("Unexpected packet of type %1.").arg(type));
     }
 }
 
@@ -419,12 +458,12 @@ void SftpChannelPrivate::handleHandle()
 {
     const SftpHandleResponse &response = m_incomingPacket.asHandleResponse();
     JobMap::Iterator it = lookupJob(response.requestId);
-    const QSharedPointer<AbstractSftpOperationWithHandle> job
-        = it.value().dynamicCast<AbstractSftpOperationWithHandle>();
-    if (job.isNull()) {
+    if (!it.value()->hasHandle()) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Unexpected SSH_FXP_HANDLE packet.");
     }
+    const AbstractSftpOperationWithHandle::Ptr job
+        = it.value().staticCast<AbstractSftpOperationWithHandle>();
     if (job->state != AbstractSftpOperationWithHandle::OpenRequested) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Unexpected SSH_FXP_HANDLE packet.");
@@ -453,22 +492,22 @@ void SftpChannelPrivate::handleHandle()
 void SftpChannelPrivate::handleLsHandle(JobMap::Iterator it)
 {
     SftpListDir::Ptr op = it.value().staticCast<SftpListDir>();
-    sendData(m_outgoingPacket.generateReadDir(op->remoteHandle,
-        op->jobId).rawData());
+    sendRequest(m_outgoingPacket.generateReadDir(op->remoteHandle,
+        op->jobId));
 }
 
 void SftpChannelPrivate::handleCreateFileHandle(JobMap::Iterator it)
 {
     SftpCreateFile::Ptr op = it.value().staticCast<SftpCreateFile>();
-    sendData(m_outgoingPacket.generateCloseHandle(op->remoteHandle,
-        op->jobId).rawData());
+    sendRequest(m_outgoingPacket.generateCloseHandle(op->remoteHandle,
+        op->jobId));
 }
 
 void SftpChannelPrivate::handleGetHandle(JobMap::Iterator it)
 {
     SftpDownload::Ptr op = it.value().staticCast<SftpDownload>();
-    sendData(m_outgoingPacket.generateFstat(op->remoteHandle,
-        op->jobId).rawData());
+    sendRequest(m_outgoingPacket.generateFstat(op->remoteHandle,
+        op->jobId));
     op->statRequested = true;
 }
 
@@ -481,8 +520,8 @@ void SftpChannelPrivate::handlePutHandle(JobMap::Iterator it)
     // OpenSSH does not implement the RFC's append functionality, so we
     // have to emulate it.
     if (op->mode == SftpAppendToExisting) {
-        sendData(m_outgoingPacket.generateFstat(op->remoteHandle,
-            op->jobId).rawData());
+        sendRequest(m_outgoingPacket.generateFstat(op->remoteHandle,
+            op->jobId));
         op->statRequested = true;
     } else {
         spawnWriteRequests(it);
@@ -623,8 +662,8 @@ void SftpChannelPrivate::handleLsStatus(JobMap::Iterator it,
                 errorMessage(response.errorString,
                 tr("Failed to list remote directory contents.")));
         op->state = SftpListDir::CloseRequested;
-        sendData(m_outgoingPacket.generateCloseHandle(op->remoteHandle,
-            op->jobId).rawData());
+        sendRequest(m_outgoingPacket.generateCloseHandle(op->remoteHandle,
+            op->jobId));
         break;
     case SftpListDir::CloseRequested:
         if (op->hasError || (op->parentJob && op->parentJob->hasError)) {
@@ -820,8 +859,8 @@ void SftpChannelPrivate::handleName()
             emit fileInfoAvailable(op->jobId, fileInfoList);
         }
 
-        sendData(m_outgoingPacket.generateReadDir(op->remoteHandle,
-            op->jobId).rawData());
+        sendRequest(m_outgoingPacket.generateReadDir(op->remoteHandle,
+            op->jobId));
         break;
     }
     default:
@@ -845,31 +884,22 @@ void SftpChannelPrivate::handleReadData()
         return;
     }
 
-    if (!op->localFile->isOpen()) {
-        QFile *fileDevice = qobject_cast<QFile*>(op->localFile.data());
-        if (fileDevice){
-            if (!Internal::openFile(fileDevice, op->mode)) {
-                reportRequestError(op, SftpError::GenericFailure, tr("Cannot open file ") + fileDevice->fileName());
-                finishTransferRequest(it);
-                return;
-            }
-        } else {
-            reportRequestError(op, SftpError::GenericFailure, tr("File to upload is not open"));
-            finishTransferRequest(it);
-            return;
-        }
-    }
-
-    if (!op->localFile->seek(op->offsets[response.requestId])) {
-        reportRequestError(op, SftpError::GenericFailure, op->localFile->errorString());
+    const qint64 ioStartTime = m_clock.nsecsElapsed();
+    const quint64 offset = it.request().offset;
+    const QString ioError = writeDownloadedData(op, offset, response);
+    addLocalIoTime(op->publicJobId, m_clock.nsecsElapsed() - ioStartTime);
+    if (!ioError.isEmpty()) {
+        reportRequestError(op, SftpError::GenericFailure, ioError);
         finishTransferRequest(it);
         return;
     }
 
-    if (op->localFile->write(response.data) != response.data.size()) {
-        reportRequestError(op, SftpError::GenericFailure, op->localFile->errorString());
-        finishTransferRequest(it);
-        return;
+    addTransferredBytes(op->publicJobId, response.data.size());
+    const quint64 endOfData = offset + response.data.size();
+    if (response.data.size() < AbstractSftpPacket::MaxDataSize && endOfData < op->fileSize) {
+        const auto telemetry = m_jobTelemetry.find(op->publicJobId);
+        if (telemetry != m_jobTelemetry.end())
+            ++telemetry->statistics.shortReads;
     }
 
     emit transferProgress(op->jobId, op->localFile->pos(), op->fileSize);
@@ -877,7 +907,28 @@ void SftpChannelPrivate::handleReadData()
     if (op->offset >= op->fileSize && op->fileSize != 0)
         finishTransferRequest(it);
     else
-        sendReadRequest(op, response.requestId);
+        sendReadRequest(it);
+}
+
+QString SftpChannelPrivate::writeDownloadedData(const SftpDownload::Ptr &job, quint64 offset,
+    const SftpDataResponse &response)
+{
+    if (!job->localFile->isOpen()) {
+        QFile *fileDevice = qobject_cast<QFile*>(job->localFile.data());
+        if (!fileDevice)
+            return tr("File to upload is not open");
+        if (!Internal::openFile(fileDevice, job->mode))
+            return tr("Cannot open file ") + fileDevice->fileName();
+    }
+
+    if (!job->localFile->seek(offset))
+        return job->localFile->errorString();
+
+    if (job->localFile->write(response.data.data(), response.data.size())
+            != qint64(response.data.size())) {
+        return job->localFile->errorString();
+    }
+    return QString();
 }
 
 void SftpChannelPrivate::handleAttrs()
@@ -885,8 +936,8 @@ void SftpChannelPrivate::handleAttrs()
     const SftpAttrsResponse &response = m_incomingPacket.asAttrsResponse();
     JobMap::Iterator it = lookupJob(response.requestId);
 
-    SftpStatFile::Ptr statOp = it.value().dynamicCast<SftpStatFile>();
-    if (statOp) {
+    if (it.value()->type() == AbstractSftpOperation::StatFile) {
+        const SftpStatFile::Ptr statOp = it.value().staticCast<SftpStatFile>();
         SftpFileInfo fileInfo;
         fileInfo.name = QFileInfo(statOp->path).fileName();
         attributesToFileInfo(response.attrs, fileInfo);
@@ -896,10 +947,12 @@ void SftpChannelPrivate::handleAttrs()
         return;
     }
 
-    AbstractSftpTransfer::Ptr transfer
-        = it.value().dynamicCast<AbstractSftpTransfer>();
-    if (!transfer || transfer->state != AbstractSftpTransfer::Open
-        || !transfer->statRequested) {
+    if (!it.value()->isTransfer()) {
+        throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
+            "Unexpected SSH_FXP_ATTRS packet.");
+    }
+    AbstractSftpTransfer::Ptr transfer = it.value().staticCast<AbstractSftpTransfer>();
+    if (transfer->state != AbstractSftpTransfer::Open || !transfer->statRequested) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Unexpected SSH_FXP_ATTRS packet.");
     }
@@ -995,9 +1048,12 @@ SftpChannelPrivate::JobMap::Iterator SftpChannelPrivate::lookupJob(SftpJobId id)
 
 void SftpChannelPrivate::closeHook()
 {
-    for (JobMap::ConstIterator it = m_jobs.constBegin(); it != m_jobs.constEnd(); ++it)
-        emit finished(it.key(), SftpError::EndOfFile, tr("SFTP channel closed unexpectedly."));
+    const QList<quint32> requestIds = m_jobs.keys();
+    for (const quint32 requestId : requestIds)
+        emit finished(requestId, SftpError::EndOfFile, tr("SFTP channel closed unexpectedly."));
     m_jobs.clear();
+    m_jobTelemetry.clear();
+    m_deferredWriteRequests.clear();
     m_incomingData.clear();
     m_incomingPacket.clear();
     emit closed();
@@ -1019,13 +1075,14 @@ void SftpChannelPrivate::handleOpenFailureInternal(const QString &reason)
     emit channelError(tr("Server could not start session: %1").arg(reason));
 }
 
-void SftpChannelPrivate::sendReadRequest(const SftpDownload::Ptr &job,
-    quint32 requestId)
+void SftpChannelPrivate::sendReadRequest(JobMap::Iterator it)
 {
+    const quint32 requestId = it.key();
+    SftpDownload * const job = static_cast<SftpDownload *>(it.value().data());
     Q_ASSERT(job->eofId == SftpInvalidJob);
-    sendData(m_outgoingPacket.generateReadFile(job->remoteHandle, job->offset,
-        AbstractSftpPacket::MaxDataSize, requestId).rawData());
-    job->offsets[requestId] = job->offset;
+    it.request().offset = job->offset;
+    sendRequest(m_outgoingPacket.generateReadFile(job->remoteHandle, job->offset,
+        AbstractSftpPacket::MaxDataSize, requestId));
     job->offset += AbstractSftpPacket::MaxDataSize;
     if (job->offset >= job->fileSize)
         job->eofId = requestId;
@@ -1035,27 +1092,20 @@ void SftpChannelPrivate::reportRequestError(const AbstractSftpOperationWithHandl
     const SftpError errorType,
     const QString &error)
 {
-    // andres.pagliano TODO refactor
-
-    // Report list error during download dir
-    SftpListDir::Ptr lsjob = job.dynamicCast<SftpListDir>();
-    if (!lsjob.isNull() && lsjob->parentJob) {
-        if (!lsjob->parentJob->hasError) {
-            emit finished(lsjob->parentJob->jobId, errorType, error);
-            lsjob->parentJob->hasError = true;
+    // Errors in the parts of a recursive download are reported for the download as a whole.
+    SftpDownloadDir *parentJob = nullptr;
+    if (job->type() == AbstractSftpOperation::ListDir)
+        parentJob = static_cast<SftpListDir *>(job.data())->parentJob.data();
+    else if (job->type() == AbstractSftpOperation::Download)
+        parentJob = static_cast<SftpDownload *>(job.data())->parentJob.data();
+
+    if (parentJob) {
+        if (!parentJob->hasError) {
+            emit finished(parentJob->jobId, errorType, error);
+            parentJob->hasError = true;
         }
     } else {
-        // Report download error during recursive download dir
-        SftpDownload::Ptr djob = job.dynamicCast<SftpDownload>();
-        if (!djob.isNull() && djob->parentJob) {
-            if (!djob->parentJob->hasError) {
-                emit finished(djob->parentJob->jobId, errorType, error);
-                djob->parentJob->hasError = true;
-            }
-        } else {
-            // Other error
-            emit finished(job->jobId, errorType, error);
-        }
+        emit finished(job->jobId, errorType, error);
     }
     job->hasError = true;
 }
@@ -1072,8 +1122,8 @@ void SftpChannelPrivate::finishTransferRequest(JobMap::Iterator it)
 void SftpChannelPrivate::sendTransferCloseHandle(const AbstractSftpTransfer::Ptr &job,
     quint32 requestId)
 {
-    sendData(m_outgoingPacket.generateCloseHandle(job->remoteHandle,
-       requestId).rawData());
+    sendRequest(m_outgoingPacket.generateCloseHandle(job->remoteHandle,
+       requestId));
     job->state = SftpDownload::CloseRequested;
 }
 
@@ -1129,11 +1179,19 @@ void SftpChannelPrivate::removeTransferRequest(JobMap::Iterator it)
 
 void SftpChannelPrivate::sendWriteRequest(JobMap::Iterator it)
 {
+    // Do not read ahead of the network; the request is resumed in handleBytesWritten().
+    if (sendBufferIsFull()) {
+        m_deferredWriteRequests << it.key();
+        return;
+    }
+
     SftpUploadFile::Ptr job = it.value().staticCast<SftpUploadFile>();
 
     emit transferProgress(job->jobId, job->localFile->pos(), job->localFile->size());
 
+    const qint64 ioStartTime = m_clock.nsecsElapsed();
     QByteArray data = job->localFile->read(AbstractSftpPacket::MaxDataSize);
+    addLocalIoTime(job->publicJobId, m_clock.nsecsElapsed() - ioStartTime);
 
     QFileDevice *fileDevice = qobject_cast<QFileDevice*>(job->localFile.data());
     if (fileDevice && fileDevice->error() != QFileDevice::NoError) {
@@ -1145,9 +1203,26 @@ void SftpChannelPrivate::sendWriteRequest(JobMap::Iterator it)
     } else if (data.isEmpty()) {
         finishTransferRequest(it);
     } else {
-        sendData(m_outgoingPacket.generateWriteFile(job->remoteHandle,
-            job->offset, data, it.key()).rawData());
+        sendRequest(m_outgoingPacket.generateWriteFile(job->remoteHandle,
+            job->offset, data, it.key()));
         job->offset += AbstractSftpPacket::MaxDataSize;
+        addTransferredBytes(job->publicJobId, data.size());
+    }
+}
+
+void SftpChannelPrivate::handleBytesWritten()
+{
+    while (!m_deferredWriteRequests.isEmpty() && !sendBufferIsFull()) {
+        const JobMap::Iterator it = m_jobs.find(m_deferredWriteRequests.takeFirst());
+        if (it == m_jobs.end())
+            continue;
+        SftpUploadFile::Ptr job = it.value().staticCast<SftpUploadFile>();
+        if (job->hasError || (job->parentJob && job->parentJob->hasError)) {
+            job->hasError = true;
+            finishTransferRequest(it);
+        } else {
+            sendWriteRequest(it);
+        }
     }
 }
 
@@ -1163,12 +1238,113 @@ void SftpChannelPrivate::spawnWriteRequests(JobMap::Iterator it)
 void SftpChannelPrivate::spawnReadRequests(const SftpDownload::Ptr &job)
 {
     job->calculateInFlightCount(AbstractSftpPacket::MaxDataSize);
-    sendReadRequest(job, job->jobId);
-    for (int i = 1; i < job->inFlightCount; ++i) {
-        const quint32 requestId = ++m_nextJobId;
-        m_jobs.insert(requestId, job);
-        sendReadRequest(job, requestId);
+    sendReadRequest(m_jobs.find(job->jobId));
+    for (int i = 1; i < job->inFlightCount; ++i)
+        sendReadRequest(m_jobs.insert(++m_nextJobId, job));
+}
+
+void SftpChannelPrivate::startJobTelemetry(SftpJobId jobId)
+{
+    JobTelemetry telemetry;
+    telemetry.statistics.jobId = jobId;
+    telemetry.startTime = m_clock.nsecsElapsed();
+    telemetry.lastChange = telemetry.startTime;
+    m_jobTelemetry.insert(jobId, telemetry);
+}
+
+void SftpChannelPrivate::countRequestsInFlight(JobTelemetry &telemetry, int change)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    const qint64 elapsed = now - telemetry.lastChange;
+    telemetry.inFlightTime += telemetry.requestsInFlight * elapsed;
+    if (telemetry.requestsInFlight > 0)
+        telemetry.serverWaitTime += elapsed;
+    telemetry.lastChange = now;
+    telemetry.requestsInFlight += change;
+}
+
+void SftpChannelPrivate::handleResponse(quint32 requestId)
+{
+    const JobMap::Iterator job = m_jobs.find(requestId);
+    if (job == m_jobs.end())
+        return;
+    JobMap::Request &request = job.request();
+    if (request.sendTime == -1)
+        return;
+    const qint64 sendTime = request.sendTime;
+    request.sendTime = -1;
+    const auto it = m_jobTelemetry.find(request.op->publicJobId);
+    if (it == m_jobTelemetry.end())
+        return;
+
+    JobTelemetry &telemetry = it.value();
+    countRequestsInFlight(telemetry, -1);
+    const qint64 roundTripTime = (telemetry.lastChange - sendTime) / 1000;
+    switch (request.type) {
+    case SSH_FXP_READ:
+        telemetry.statistics.readLatency.add(roundTripTime);
+        break;
+    case SSH_FXP_WRITE:
+        telemetry.statistics.writeLatency.add(roundTripTime);
+        break;
+    case SSH_FXP_STAT:
+    case SSH_FXP_LSTAT:
+    case SSH_FXP_FSTAT:
+        telemetry.statistics.statLatency.add(roundTripTime);
+        break;
+    default:
+        break;
+    }
+}
+
+void SftpChannelPrivate::addLocalIoTime(SftpJobId publicJobId, qint64 nsecs)
+{
+    const auto it = m_jobTelemetry.find(publicJobId);
+    if (it != m_jobTelemetry.end())
+        it->localIoTime += nsecs;
+}
+
+void SftpChannelPrivate::addTransferredBytes(SftpJobId publicJobId, quint64 bytes)
+{
+    const auto it = m_jobTelemetry.find(publicJobId);
+    if (it != m_jobTelemetry.end())
+        it->statistics.bytesTransferred += bytes;
+}
+
+SftpJobStatistics SftpChannelPrivate::jobStatistics(SftpJobId jobId) const
+{
+    const auto it = m_jobTelemetry.constFind(jobId);
+    if (it == m_jobTelemetry.constEnd())
+        return SftpJobStatistics();
+
+    // Account for the time since the last change in the number of requests in flight.
+    const JobTelemetry &telemetry = it.value();
+    const qint64 now = m_clock.nsecsElapsed();
+    const qint64 sinceLastChange = now - telemetry.lastChange;
+    const qint64 inFlightTime = telemetry.inFlightTime
+            + telemetry.requestsInFlight * sinceLastChange;
+    const qint64 serverWaitTime = telemetry.serverWaitTime
+            + (telemetry.requestsInFlight > 0 ? sinceLastChange : 0);
+    const qint64 duration = now - telemetry.startTime;
+
+    SftpJobStatistics statistics = telemetry.statistics;
+    statistics.duration = duration / 1000;
+    statistics.serverWaitTime = serverWaitTime / 1000;
+    statistics.localIoTime = telemetry.localIoTime / 1000;
+    if (duration > 0) {
+        statistics.bytesPerSecond = statistics.bytesTransferred * 1e9 / duration;
+        statistics.averageRequestsInFlight = double(inFlightTime) / duration;
     }
+    return statistics;
+}
+
+void SftpChannelPrivate::handleJobFinished(SftpJobId jobId)
+{
+    if (!m_jobTelemetry.contains(jobId))
+        return;
+    const SftpJobStatistics statistics = jobStatistics(jobId);
+    m_jobTelemetry.remove(jobId);
+    emit jobStatisticsAvailable(statistics);
 }
 
 } // namespace Internal
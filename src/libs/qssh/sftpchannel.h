@@ -218,6 +218,15 @@ public:
     SftpJobId downloadDir(const QString &remoteDirPath,
         const QString &localDirPath, SftpOverwriteMode mode);
 
+    /*!
+     * \brief Returns the telemetry gathered so far for a job that is still running
+     * Shows where a transfer spends its time: waiting for the server, as the round-trip
+     * times tell, or reading and writing local data. The final figures of a job are
+     * delivered with jobStatisticsAvailable().
+     * \param job The ID of the job
+     */
+    SftpJobStatistics jobStatistics(SftpJobId job) const;
+
     ~SftpChannel();
 
 signals:
@@ -252,6 +261,11 @@ signals:
      */
     void transferProgress(QSsh::SftpJobId job, quint64 progress, quint64 total);
 
+    /*!
+     * Emitted with the final figures of a job, right before its finished() signal
+     */
+    void jobStatisticsAvailable(const QSsh::SftpJobStatistics &statistics);
+
 private:
     SftpChannel(quint32 channelId, Internal::SshSendFacility &sendFacility);
 
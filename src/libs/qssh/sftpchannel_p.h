@@ -35,10 +35,13 @@
 #include "sftpincomingpacket_p.h"
 #include "sftpoperation_p.h"
 #include "sftpoutgoingpacket_p.h"
+#include "sftprequesttable_p.h"
 #include "sshchannel_p.h"
 
 #include <QByteArray>
-#include <QMap>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
 
 namespace QSsh {
 class SftpChannel;
@@ -59,22 +62,35 @@ signals:
     void dataAvailable(QSsh::SftpJobId job, const QString &data);
     void fileInfoAvailable(QSsh::SftpJobId job, const QList<QSsh::SftpFileInfo> &fileInfoList);
     void transferProgress(QSsh::SftpJobId job, quint64 progress, quint64 total);
+    void jobStatisticsAvailable(const QSsh::SftpJobStatistics &statistics);
 
 private:
-    typedef QMap<SftpJobId, AbstractSftpOperation::Ptr> JobMap;
+    typedef SftpRequestTable JobMap;
+
+    // Times are in nanoseconds on m_clock.
+    struct JobTelemetry {
+        SftpJobStatistics statistics;
+        qint64 startTime = 0;
+        qint64 lastChange = 0;     // Of requestsInFlight.
+        qint64 inFlightTime = 0;   // requestsInFlight integrated over time.
+        qint64 serverWaitTime = 0;
+        qint64 localIoTime = 0;
+        int requestsInFlight = 0;
+    };
 
     SftpChannelPrivate(quint32 channelId, SshSendFacility &sendFacility,
         SftpChannel *sftp);
     SftpJobId createJob(const AbstractSftpOperation::Ptr &job);
+    void sendRequest(const SftpOutgoingPacket &packet);
 
     virtual void handleChannelSuccess();
     virtual void handleChannelFailure();
 
     virtual void handleOpenSuccessInternal();
     virtual void handleOpenFailureInternal(const QString &reason);
-    virtual void handleChannelDataInternal(const QByteArray &data);
+    virtual void handleChannelDataInternal(const SshByteView &data);
     virtual void handleChannelExtendedDataInternal(quint32 type,
-        const QByteArray &data);
+        const SshByteView &data);
     virtual void handleExitStatus(const SshChannelExitStatus &exitStatus);
     virtual void handleExitSignal(const SshChannelExitSignal &signal);
 
@@ -108,8 +124,9 @@ private:
 
     void spawnReadRequests(const SftpDownload::Ptr &job);
     void spawnWriteRequests(JobMap::Iterator it);
-    void sendReadRequest(const SftpDownload::Ptr &job, quint32 requestId);
+    void sendReadRequest(JobMap::Iterator it);
     void sendWriteRequest(JobMap::Iterator it);
+    void handleBytesWritten();
     void finishTransferRequest(JobMap::Iterator it);
     void removeTransferRequest(JobMap::Iterator it);
     void reportRequestError(const AbstractSftpOperationWithHandle::Ptr &job, const SftpError errorType,
@@ -117,16 +134,31 @@ private:
     void sendTransferCloseHandle(const AbstractSftpTransfer::Ptr &job,
         quint32 requestId);
 
+    QString writeDownloadedData(const SftpDownload::Ptr &job, quint64 offset,
+        const SftpDataResponse &response);
+
     void attributesToFileInfo(const SftpFileAttributes &attributes, SftpFileInfo &fileInfo) const;
 
+    void startJobTelemetry(SftpJobId jobId);
+    void countRequestsInFlight(JobTelemetry &telemetry, int change);
+    void handleResponse(quint32 requestId);
+    void addLocalIoTime(SftpJobId publicJobId, qint64 nsecs);
+    void addTransferredBytes(SftpJobId publicJobId, quint64 bytes);
+    SftpJobStatistics jobStatistics(SftpJobId jobId) const;
+    void handleJobFinished(SftpJobId jobId);
+
     JobMap::Iterator lookupJob(SftpJobId id);
     JobMap m_jobs;
+    QList<SftpJobId> m_deferredWriteRequests;
     SftpOutgoingPacket m_outgoingPacket;
     SftpIncomingPacket m_incomingPacket;
     QByteArray m_incomingData;
     SftpJobId m_nextJobId;
     SftpState m_sftpState;
     SftpChannel *m_sftp;
+
+    QElapsedTimer m_clock;
+    QHash<SftpJobId, JobTelemetry> m_jobTelemetry;
 };
 
 } // namespace Internal
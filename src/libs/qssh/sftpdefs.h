@@ -32,6 +32,7 @@
 #define SFTPDEFS_H
 
 #include "ssh_global.h"
+#include "sshlatencyhistogram.h"
 
 #include <QFile>
 #include <QString>
@@ -114,6 +115,37 @@ public:
     bool permissionsValid = false;
 };
 
+/*!
+    \brief Telemetry of one SFTP job, see SftpChannel::jobStatistics().
+
+    For uploadDir() and downloadDir(), this covers all the files and directories involved.
+    Times are in microseconds.
+*/
+struct SftpJobStatistics
+{
+    SftpJobId jobId = SftpInvalidJob;
+    qint64 duration = 0;
+
+    quint64 bytesTransferred = 0;
+    double bytesPerSecond = 0;
+
+    /// Time-weighted average of the requests the server had not answered yet.
+    double averageRequestsInFlight = 0;
+
+    /// Time with at least one request outstanding.
+    qint64 serverWaitTime = 0;
+
+    /// Time spent reading from or writing to the local device.
+    qint64 localIoTime = 0;
+
+    /// Read replies that came back with less data than requested before the end of the file.
+    quint32 shortReads = 0;
+
+    SshLatencyHistogram readLatency; ///< Request round-trip times.
+    SshLatencyHistogram writeLatency;
+    SshLatencyHistogram statLatency;
+};
+
 } // namespace QSsh
 
 #endif // SFTPDEFS_H
@@ -66,7 +66,7 @@ void SftpIncomingPacket::consumeData(QByteArray &newData)
 void SftpIncomingPacket::moveFirstBytes(QByteArray &target, QByteArray &source,
     int n)
 {
-    target.append(source.left(n));
+    target.append(source.constData(), n);
     source.remove(0, n);
 }
 
@@ -119,7 +119,7 @@ SftpStatusResponse SftpIncomingPacket::asStatusResponse() const
         response.requestId = SshPacketParser::asUint32(m_data, &offset);
         response.status = static_cast<SftpStatusCode>(SshPacketParser::asUint32(m_data, &offset));
         response.errorString = SshPacketParser::asUserString(m_data, &offset);
-        response.language = SshPacketParser::asString(m_data, &offset);
+        response.language = SshPacketParser::asStringView(m_data, &offset);
         return response;
     } catch (const SshPacketParseException &) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
@@ -136,6 +136,10 @@ SftpNameResponse SftpIncomingPacket::asNameResponse() const
         quint32 offset = RequestIdOffset;
         response.requestId = SshPacketParser::asUint32(m_data, &offset);
         const quint32 count = SshPacketParser::asUint32(m_data, &offset);
+
+        // Each entry takes at least twelve bytes, which keeps a bogus count from making us
+        // reserve lots of memory.
+        response.files.reserve(qMin<quint32>(count, (dataSize() - offset) / 12));
         for (quint32 i = 0; i < count; ++i)
             response.files << asFile(offset);
         return response;
@@ -153,7 +157,7 @@ SftpDataResponse SftpIncomingPacket::asDataResponse() const
         SftpDataResponse response;
         quint32 offset = RequestIdOffset;
         response.requestId = SshPacketParser::asUint32(m_data, &offset);
-        response.data = SshPacketParser::asString(m_data, &offset);
+        response.data = SshPacketParser::asStringView(m_data, &offset);
         return response;
     } catch (const SshPacketParseException &) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
@@ -180,10 +184,9 @@ SftpAttrsResponse SftpIncomingPacket::asAttrsResponse() const
 SftpFile SftpIncomingPacket::asFile(quint32 &offset) const
 {
     SftpFile file;
-    file.fileName
-        = QString::fromUtf8(SshPacketParser::asString(m_data, &offset));
-    file.longName
-        = QString::fromUtf8(SshPacketParser::asString(m_data, &offset));
+    const SshByteView fileName = SshPacketParser::asStringView(m_data, &offset);
+    file.fileName = QString::fromUtf8(fileName.data(), fileName.size());
+    SshPacketParser::asStringView(m_data, &offset); // Long name; not present in later RFCs.
     file.attributes = asFileAttributes(offset);
     return file;
 }
@@ -212,8 +215,8 @@ SftpFileAttributes SftpIncomingPacket::asFileAttributes(quint32 &offset) const
     if (flags & SSH_FILEXFER_ATTR_EXTENDED) {
         const quint32 count = SshPacketParser::asUint32(m_data, &offset);
         for (quint32 i = 0; i < count; ++i) {
-            SshPacketParser::asString(m_data, &offset);
-            SshPacketParser::asString(m_data, &offset);
+            SshPacketParser::asStringView(m_data, &offset);
+            SshPacketParser::asStringView(m_data, &offset);
         }
     }
     return attributes;
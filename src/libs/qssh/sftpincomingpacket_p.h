@@ -32,6 +32,9 @@
 #define SFTPINCOMINGPACKET_P_H
 
 #include "sftppacket_p.h"
+#include "sshbyteview_p.h"
+
+#include <QVector>
 
 namespace QSsh {
 namespace Internal {
@@ -45,7 +48,7 @@ struct SftpStatusResponse {
     quint32 requestId;
     SftpStatusCode status;
     QString errorString;
-    QByteArray language;
+    SshByteView language;
 };
 
 struct SftpFileAttributes {
@@ -63,18 +66,18 @@ struct SftpFileAttributes {
 
 struct SftpFile {
     QString fileName;
-    QString longName; // Not present in later RFCs, so we don't expose this to the user.
     SftpFileAttributes attributes;
 };
 
 struct SftpNameResponse {
     quint32 requestId;
-    QList<SftpFile> files;
+    QVector<SftpFile> files;
 };
 
+// Points into the packet it was extracted from.
 struct SftpDataResponse {
     quint32 requestId;
-    QByteArray data;
+    SshByteView data;
 };
 
 struct SftpAttrsResponse {
@@ -82,7 +85,7 @@ struct SftpAttrsResponse {
     SftpFileAttributes attrs;
 };
 
-class SftpIncomingPacket : public AbstractSftpPacket
+class QSSH_EXPORT SftpIncomingPacket : public AbstractSftpPacket
 {
 public:
     SftpIncomingPacket();
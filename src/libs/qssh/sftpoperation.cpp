@@ -37,7 +37,8 @@
 namespace QSsh {
 namespace Internal {
 
-AbstractSftpOperation::AbstractSftpOperation(SftpJobId jobId) : jobId(jobId)
+AbstractSftpOperation::AbstractSftpOperation(SftpJobId jobId)
+    : jobId(jobId), publicJobId(jobId)
 {
 }
 
@@ -58,6 +59,8 @@ SftpMakeDir::SftpMakeDir(SftpJobId jobId, const QString &path,
     const SftpUploadDir::Ptr &parentJob)
     : AbstractSftpOperation(jobId), parentJob(parentJob), remoteDir(path)
 {
+    if (parentJob)
+        publicJobId = parentJob->jobId;
 }
 
 SftpOutgoingPacket &SftpMakeDir::initialPacket(SftpOutgoingPacket &packet)
@@ -123,6 +126,8 @@ SftpListDir::SftpListDir(SftpJobId jobId, const QString &path,
     const QSharedPointer<SftpDownloadDir> &parentJob)
     : AbstractSftpOperationWithHandle(jobId, path), parentJob(parentJob)
 {
+    if (parentJob)
+        publicJobId = parentJob->jobId;
 }
 
 SftpOutgoingPacket &SftpListDir::initialPacket(SftpOutgoingPacket &packet)
@@ -178,6 +183,8 @@ SftpDownload::SftpDownload(SftpJobId jobId, const QString &remotePath,
     : AbstractSftpTransfer(jobId, remotePath, localFile), eofId(SftpInvalidJob), mode(mode),
       parentJob(parentJob)
 {
+    if (parentJob)
+        publicJobId = parentJob->jobId;
 }
 
 SftpOutgoingPacket &SftpDownload::initialPacket(SftpOutgoingPacket &packet)
@@ -194,6 +201,8 @@ SftpUploadFile::SftpUploadFile(SftpJobId jobId, const QString &remotePath,
       parentJob(parentJob), mode(mode)
 {
     fileSize = localFile->size();
+    if (parentJob)
+        publicJobId = parentJob->jobId;
 }
 
 SftpOutgoingPacket &SftpUploadFile::initialPacket(SftpOutgoingPacket &packet)
@@ -59,8 +59,16 @@ struct AbstractSftpOperation
     virtual Type type() const = 0;
     virtual SftpOutgoingPacket &initialPacket(SftpOutgoingPacket &packet) = 0;
 
+    // Use these rather than dynamic casts.
+    bool isTransfer() const { return type() == Download || type() == UploadFile; }
+    bool hasHandle() const { return isTransfer() || type() == ListDir || type() == CreateFile; }
+
     const SftpJobId jobId;
 
+    // The job the caller knows about. Differs from jobId for the parts of uploadDir() and
+    // downloadDir(); their statistics are accounted to the composite job.
+    SftpJobId publicJobId;
+
 private:
     AbstractSftpOperation(const AbstractSftpOperation &);
     AbstractSftpOperation &operator=(const AbstractSftpOperation &);
@@ -206,7 +214,6 @@ struct SftpDownload : public AbstractSftpTransfer
     virtual Type type() const { return Download; }
     virtual SftpOutgoingPacket &initialPacket(SftpOutgoingPacket &packet);
 
-    QMap<quint32, quint64> offsets;
     SftpJobId eofId;
     SftpOverwriteMode mode;
     const QSharedPointer<QSsh::Internal::SftpDownloadDir> parentJob;
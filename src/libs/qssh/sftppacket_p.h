@@ -31,6 +31,8 @@
 #ifndef SFTPPACKET_P_H
 #define SFTPPACKET_P_H
 
+#include "ssh_global.h"
+
 #include <QByteArray>
 #include <QList>
 #include <QString>
@@ -90,7 +92,7 @@ enum SftpAttributeType {
     SSH_FILEXFER_ATTR_EXTENDED = 0x80000000
 };
 
-class AbstractSftpPacket
+class QSSH_EXPORT AbstractSftpPacket
 {
 public:
     AbstractSftpPacket();
@@ -0,0 +1,163 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sftprequesttable_p.h"
+
+#include <algorithm>
+
+namespace QSsh {
+namespace Internal {
+
+static const int MinCapacity = 64;
+
+SftpRequestTable::Request &SftpRequestTable::Iterator::request() const
+{
+    if (m_generation != m_table->m_generation) {
+        m_index = m_table->indexOf(m_key);
+        m_generation = m_table->m_generation;
+    }
+    Q_ASSERT(m_index != -1);
+    return m_table->m_slots[m_index].request;
+}
+
+SftpRequestTable::Iterator SftpRequestTable::insert(quint32 key,
+                                                    const AbstractSftpOperation::Ptr &op)
+{
+    // Keep at least a quarter of the slots free, so that probe sequences stay short.
+    if ((m_count + m_erasedCount + 1) * 4 > m_slots.count() * 3) {
+        int capacity = qMax(MinCapacity, m_slots.count());
+        while ((m_count + 1) * 2 > capacity)
+            capacity *= 2;
+        rehash(capacity);
+    }
+
+    const int mask = m_slots.count() - 1;
+    int firstErased = -1;
+    int i = key & mask;
+    for (;; i = (i + 1) & mask) {
+        Slot &slot = m_slots[i];
+        if (slot.state == Free)
+            break;
+        if (slot.state == Erased) {
+            if (firstErased == -1)
+                firstErased = i;
+        } else if (slot.key == key) {
+            slot.request = Request();
+            slot.request.op = op;
+            return Iterator(this, key, i);
+        }
+    }
+
+    if (firstErased != -1) {
+        i = firstErased;
+        --m_erasedCount;
+    }
+    Slot &slot = m_slots[i];
+    slot.key = key;
+    slot.state = Used;
+    slot.request.op = op;
+    ++m_count;
+    return Iterator(this, key, i);
+}
+
+SftpRequestTable::Iterator SftpRequestTable::find(quint32 key)
+{
+    const int index = indexOf(key);
+    return index == -1 ? end() : Iterator(this, key, index);
+}
+
+void SftpRequestTable::erase(const Iterator &it)
+{
+    Q_ASSERT(it.m_table == this);
+    it.request(); // Updates the index.
+    Slot &slot = m_slots[it.m_index];
+    slot.state = Erased;
+    slot.request = Request();
+    --m_count;
+    ++m_erasedCount;
+}
+
+AbstractSftpOperation::Ptr SftpRequestTable::value(quint32 key) const
+{
+    const int index = indexOf(key);
+    return index == -1 ? AbstractSftpOperation::Ptr() : m_slots.at(index).request.op;
+}
+
+QList<quint32> SftpRequestTable::keys() const
+{
+    QList<quint32> keys;
+    keys.reserve(m_count);
+    for (const Slot &slot : m_slots) {
+        if (slot.state == Used)
+            keys << slot.key;
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+void SftpRequestTable::clear()
+{
+    m_slots.clear();
+    m_count = 0;
+    m_erasedCount = 0;
+    ++m_generation;
+}
+
+int SftpRequestTable::indexOf(quint32 key) const
+{
+    if (m_slots.isEmpty())
+        return -1;
+    const int mask = m_slots.count() - 1;
+    for (int i = key & mask;; i = (i + 1) & mask) {
+        const Slot &slot = m_slots.at(i);
+        if (slot.state == Free)
+            return -1;
+        if (slot.state == Used && slot.key == key)
+            return i;
+    }
+}
+
+void SftpRequestTable::rehash(int capacity)
+{
+    QVector<Slot> oldSlots(capacity);
+    oldSlots.swap(m_slots);
+    const int mask = capacity - 1;
+    for (Slot &oldSlot : oldSlots) {
+        if (oldSlot.state != Used)
+            continue;
+        int i = oldSlot.key & mask;
+        while (m_slots.at(i).state != Free)
+            i = (i + 1) & mask;
+        Slot &slot = m_slots[i];
+        slot.key = oldSlot.key;
+        slot.state = Used;
+        slot.request = std::move(oldSlot.request);
+    }
+    m_erasedCount = 0;
+    ++m_generation;
+}
+
+} // namespace Internal
+} // namespace QSsh
@@ -0,0 +1,113 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "sftpoperation_p.h"
+#include "sftppacket_p.h"
+#include "ssh_global.h"
+
+#include <QList>
+#include <QVector>
+
+namespace QSsh {
+namespace Internal {
+
+/*
+ * Maps the ids of outstanding SFTP requests to the operations they belong to, along with
+ * the per-request bookkeeping. This is an open-addressed table with linear probing: Entries
+ * live inline in one array, so requests come and go without touching the allocator, and
+ * since request ids are handed out sequentially, the low bits of the id make for a hash
+ * function without collisions in the common case.
+ */
+class QSSH_EXPORT SftpRequestTable
+{
+public:
+    struct Request {
+        AbstractSftpOperation::Ptr op;
+        quint64 offset = 0;   // Into the remote file, for reads.
+        qint64 sendTime = -1; // For the job telemetry; -1 if not measured.
+        SftpPacketType type = SSH_FXP_INIT;
+    };
+
+    /*
+     * Refers to an entry by its key, so unlike a QHash iterator, it remains usable while
+     * other entries are inserted. It must not be used after its own entry was erased.
+     */
+    class Iterator
+    {
+    public:
+        Iterator() = default;
+
+        quint32 key() const { return m_key; }
+        Request &request() const;
+        const AbstractSftpOperation::Ptr &value() const { return request().op; }
+
+        bool operator==(const Iterator &other) const {
+            return m_table == other.m_table && (!m_table || m_key == other.m_key);
+        }
+        bool operator!=(const Iterator &other) const { return !(*this == other); }
+
+    private:
+        friend class SftpRequestTable;
+        Iterator(SftpRequestTable *table, quint32 key, int index)
+            : m_table(table), m_key(key), m_index(index), m_generation(table->m_generation) {}
+
+        SftpRequestTable *m_table = nullptr;
+        quint32 m_key = 0;
+        mutable int m_index = -1;
+        mutable quint32 m_generation = 0;
+    };
+
+    Iterator insert(quint32 key, const AbstractSftpOperation::Ptr &op);
+    Iterator find(quint32 key);
+    Iterator end() const { return Iterator(); }
+    void erase(const Iterator &it);
+    AbstractSftpOperation::Ptr value(quint32 key) const;
+
+    int count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+    QList<quint32> keys() const; // In ascending order.
+    void clear();
+
+private:
+    enum SlotState : quint8 { Free, Used, Erased };
+    struct Slot {
+        quint32 key = 0;
+        SlotState state = Free;
+        Request request;
+    };
+
+    int indexOf(quint32 key) const;
+    void rehash(int capacity);
+
+    QVector<Slot> m_slots; // The size is zero or a power of two.
+    int m_count = 0;
+    int m_erasedCount = 0;
+    quint32 m_generation = 0; // Incremented whenever entries move.
+};
+
+} // namespace Internal
+} // namespace QSsh
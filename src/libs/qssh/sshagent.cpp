@@ -24,11 +24,13 @@
 ****************************************************************************/
 #include "sshagent_p.h"
 
+#include "sshcapabilities_p.h"
 #include "sshlogging_p.h"
 #include "sshpacket_p.h"
 #include "sshpacketparser_p.h"
 #include "ssh_global.h"
 
+#include <QThreadStorage>
 #include <QTimer>
 #include <QtEndian>
 
@@ -46,11 +48,11 @@ enum PacketType {
     SSH2_AGENT_SIGN_RESPONSE = 14,
 };
 
-// TODO: Remove once we require 5.7, where the endianness functions have a sane input type.
-template<typename T> static T fromBigEndian(const QByteArray &ba)
-{
-    return qFromBigEndian<T>(reinterpret_cast<const uchar *>(ba.constData()));
-}
+// https://tools.ietf.org/html/draft-miller-ssh-agent-04#section-4.5.1
+enum SignatureFlag {
+    SSH_AGENT_RSA_SHA2_256 = 2,
+    SSH_AGENT_RSA_SHA2_512 = 4,
+};
 
 void SshAgent::refreshKeysImpl()
 {
@@ -62,55 +64,50 @@ void SshAgent::refreshKeysImpl()
         qCDebug(sshLog) << "keys request already pending, not adding another one";
         return;
     }
-    qCDebug(sshLog) << "queueing keys request";
-    m_pendingRequests << Request();
-    sendNextRequest();
+    sendRequest(Request());
 }
 
 void SshAgent::requestSignatureImpl(const QByteArray &key, uint token)
 {
     if (state() != Connected)
         return;
-    const QByteArray data = m_dataToSign.take(qMakePair(key, token));
-    QSSH_ASSERT(!data.isEmpty());
-    qCDebug(sshLog) << "queueing signature request";
-    m_pendingRequests.enqueue(Request(key, data, token));
-    sendNextRequest();
+    const Request stored = m_dataToSign.take(qMakePair(key, token));
+    QSSH_ASSERT(!stored.dataToSign.isEmpty());
+    sendRequest(Request(key, stored.dataToSign, stored.flags, token));
 }
 
-void SshAgent::sendNextRequest()
+void SshAgent::sendRequest(const Request &request)
 {
-    if (m_pendingRequests.isEmpty())
-        return;
-    if (m_outgoingPacket.isComplete())
-        return;
     if (hasError())
         return;
-    const Request &request = m_pendingRequests.head();
-    m_outgoingPacket = request.isKeysRequest() ? generateKeysPacket() : generateSigPacket(request);
-    sendPacket();
+    QByteArray packet = request.isKeysRequest() ? generateKeysPacket()
+                                                : generateSigPacket(request);
+    AbstractSshPacket::setLengthField(packet);
+    m_pendingRequests.enqueue(request);
+    m_agentSocket.write(packet);
+    qCDebug(sshLog) << m_pendingRequests.count() << "agent request(s) in flight";
 }
 
-SshAgent::Packet SshAgent::generateKeysPacket()
+// The packets start with a placeholder for the length field.
+QByteArray SshAgent::generateKeysPacket()
 {
     qCDebug(sshLog) << "requesting keys from agent";
-    Packet p;
-    p.size = 1;
-    p.data += char(SSH2_AGENTC_REQUEST_IDENTITIES);
-    return p;
+    QByteArray packet(4, 0);
+    packet += char(SSH2_AGENTC_REQUEST_IDENTITIES);
+    return packet;
 }
 
-SshAgent::Packet SshAgent::generateSigPacket(const SshAgent::Request &request)
+QByteArray SshAgent::generateSigPacket(const SshAgent::Request &request)
 {
     qCDebug(sshLog) << "requesting signature from agent for key" << request.key << "and token"
                     << request.token;
-    Packet p;
-    p.data += char(SSH2_AGENTC_SIGN_REQUEST);
-    p.data += AbstractSshPacket::encodeString(request.key);
-    p.data += AbstractSshPacket::encodeString(request.dataToSign);
-    p.data += AbstractSshPacket::encodeInt(quint32(0));
-    p.size = p.data.count();
-    return p;
+    QByteArray packet(4, 0);
+    packet.reserve(4 + 1 + 4 + request.key.count() + 4 + request.dataToSign.count() + 4);
+    packet += char(SSH2_AGENTC_SIGN_REQUEST);
+    packet += AbstractSshPacket::encodeString(request.key);
+    packet += AbstractSshPacket::encodeString(request.dataToSign);
+    packet += AbstractSshPacket::encodeInt(request.flags);
+    return packet;
 }
 
 SshAgent::~SshAgent()
@@ -118,9 +115,19 @@ SshAgent::~SshAgent()
     m_agentSocket.disconnect(this);
 }
 
-void SshAgent::storeDataToSign(const QByteArray &key, const QByteArray &data, uint token)
+void SshAgent::storeDataToSign(const QByteArray &key, const QByteArray &data, quint32 flags,
+                               uint token)
+{
+    instance().m_dataToSign.insert(qMakePair(key, token), Request(key, data, flags, token));
+}
+
+quint32 SshAgent::signatureFlags(const QByteArray &signatureAlgorithm)
 {
-    instance().m_dataToSign.insert(qMakePair(key, token), data);
+    if (signatureAlgorithm == SshCapabilities::PubKeyRsaSha256)
+        return SSH_AGENT_RSA_SHA2_256;
+    if (signatureAlgorithm == SshCapabilities::PubKeyRsaSha512)
+        return SSH_AGENT_RSA_SHA2_512;
+    return 0;
 }
 
 void SshAgent::removeDataToSign(const QByteArray &key, uint token)
@@ -128,10 +135,15 @@ void SshAgent::removeDataToSign(const QByteArray &key, uint token)
     instance().m_dataToSign.remove(qMakePair(key, token));
 }
 
+// There is one agent connection per thread. A QLocalSocket must not be used from other threads
+// anyway, and this way connections set up in parallel, e.g. by SshBatchRunner's workers, do not
+// all have to wait for the same socket.
 SshAgent &QSsh::Internal::SshAgent::instance()
 {
-    static SshAgent agent;
-    return agent;
+    static QThreadStorage<SshAgent *> agents;
+    if (!agents.hasLocalData())
+        agents.setLocalData(new SshAgent);
+    return *agents.localData();
 }
 
 SshAgent::SshAgent()
@@ -181,36 +193,49 @@ void SshAgent::handleSocketError()
 void SshAgent::handleIncomingData()
 {
     qCDebug(sshLog) << "getting data from agent";
-    m_incomingData += m_agentSocket.readAll();
-    while (!hasError() && !m_incomingData.isEmpty()) {
-        if (m_incomingPacket.size == 0) {
-            if (m_incomingData.count() < int(sizeof m_incomingPacket.size))
-                break;
-            m_incomingPacket.size = fromBigEndian<quint32>(m_incomingData);
-            m_incomingData.remove(0, sizeof m_incomingPacket.size);
+    if (m_incomingData.isEmpty())
+        m_incomingData = m_agentSocket.readAll();
+    else
+        m_incomingData += m_agentSocket.readAll();
+
+    // The packets are handed out as views into the buffer, which is compacted only once
+    // all complete packets are done.
+    int offset = 0;
+    while (!hasError()) {
+        const int available = m_incomingData.count() - offset;
+        if (available < int(sizeof(quint32)))
+            break;
+        const quint32 packetSize
+                = qFromBigEndian<quint32>(m_incomingData.constData() + offset);
+        if (packetSize == 0) {
+            qCWarning(sshLog) << "received empty packet from agent";
+            handleProtocolError();
+            break;
         }
-        const int bytesToTake = qMin<quint32>(m_incomingPacket.size - m_incomingPacket.data.count(),
-                                              m_incomingData.count());
-        m_incomingPacket.data += m_incomingData.left(bytesToTake);
-        m_incomingData.remove(0, bytesToTake);
-        if (m_incomingPacket.isComplete())
-            handleIncomingPacket();
-        else
+        if (quint32(available) - sizeof packetSize < packetSize)
             break;
+        const QByteArray packet = QByteArray::fromRawData(
+                    m_incomingData.constData() + offset + sizeof packetSize, int(packetSize));
+        offset += sizeof packetSize + packetSize;
+        handleIncomingPacket(packet);
     }
+    if (offset == m_incomingData.count())
+        m_incomingData.clear();
+    else
+        m_incomingData.remove(0, offset);
 }
 
-void SshAgent::handleIncomingPacket()
+void SshAgent::handleIncomingPacket(const QByteArray &packet)
 {
     try {
-        qCDebug(sshLog) << "received packet from agent:" << m_incomingPacket.data.toHex();
-        const char messageType = m_incomingPacket.data.at(0);
+        qCDebug(sshLog) << "received packet from agent:" << packet.toHex();
+        const char messageType = packet.at(0);
         switch (messageType) {
         case SSH2_AGENT_IDENTITIES_ANSWER:
-            handleIdentitiesPacket();
+            handleIdentitiesPacket(packet);
             break;
         case SSH2_AGENT_SIGN_RESPONSE:
-            handleSignaturePacket();
+            handleSignaturePacket(packet);
             break;
         case SSH_AGENT_FAILURE:
             if (m_pendingRequests.isEmpty()) {
@@ -237,13 +262,9 @@ void SshAgent::handleIncomingPacket()
         qCWarning(sshLog()) << "received malformed packet from agent";
         handleProtocolError();
     }
-    m_incomingPacket.invalidate();
-    m_incomingPacket.size = 0;
-    m_outgoingPacket.invalidate();
-    sendNextRequest();
 }
 
-void SshAgent::handleIdentitiesPacket()
+void SshAgent::handleIdentitiesPacket(const QByteArray &packet)
 {
     qCDebug(sshLog) << "got keys packet from agent";
     if (m_pendingRequests.isEmpty() || !m_pendingRequests.dequeue().isKeysRequest()) {
@@ -252,15 +273,15 @@ void SshAgent::handleIdentitiesPacket()
         return;
     }
     quint32 offset = 1;
-    const auto keyCount = SshPacketParser::asUint32(m_incomingPacket.data, &offset);
+    const auto keyCount = SshPacketParser::asUint32(packet, &offset);
     qCDebug(sshLog) << "packet contains" << keyCount << "keys";
     QList<QByteArray> newKeys;
     for (quint32 i = 0; i < keyCount; ++i) {
-        const QByteArray key = SshPacketParser::asString(m_incomingPacket.data, &offset);
+        const QByteArray key = SshPacketParser::asString(packet, &offset);
         quint32 keyOffset = 0;
         const QByteArray algoName = SshPacketParser::asString(key, &keyOffset);
         SshPacketParser::asString(key, &keyOffset); // rest of key blob
-        SshPacketParser::asString(m_incomingPacket.data, &offset); // comment
+        SshPacketParser::asStringView(packet, &offset); // comment
         qCDebug(sshLog) << "adding key of type" << algoName;
         newKeys << key;
     }
@@ -269,7 +290,7 @@ void SshAgent::handleIdentitiesPacket()
     emit keysUpdated();
 }
 
-void SshAgent::handleSignaturePacket()
+void SshAgent::handleSignaturePacket(const QByteArray &packet)
 {
     qCDebug(sshLog) << "got signature packet from agent";
     if (m_pendingRequests.isEmpty()) {
@@ -283,7 +304,7 @@ void SshAgent::handleSignaturePacket()
         handleProtocolError();
         return;
     }
-    const QByteArray signature = SshPacketParser::asString(m_incomingPacket.data, 1);
+    const QByteArray signature = SshPacketParser::asString(packet, 1);
     qCDebug(sshLog) << "signature for key" << request.key.toHex() << "is" << signature.toHex();
     emit signatureAvailable(request.key, signature, request.token);
 }
@@ -301,12 +322,5 @@ void SshAgent::setDisconnected()
     emit errorOccurred();
 }
 
-void SshAgent::sendPacket()
-{
-    const quint32 sizeMsb = qToBigEndian(m_outgoingPacket.size);
-    m_agentSocket.write(reinterpret_cast<const char *>(&sizeMsb), sizeof sizeMsb);
-    m_agentSocket.write(m_outgoingPacket.data);
-}
-
 } // namespace Internal
 } // namespace QSsh
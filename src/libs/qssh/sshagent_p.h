@@ -50,7 +50,8 @@ public:
     static QList<QByteArray> publicKeys() { return instance().m_keys; }
 
     static void refreshKeys() { instance().refreshKeysImpl(); }
-    static void storeDataToSign(const QByteArray &key, const QByteArray &data, uint token);
+    static void storeDataToSign(const QByteArray &key, const QByteArray &data, quint32 flags,
+                                uint token);
     static void removeDataToSign(const QByteArray &key, uint token);
     static void requestSignature(const QByteArray &key, uint token) {
         instance().requestSignatureImpl(key, token);
@@ -58,6 +59,9 @@ public:
 
     static SshAgent &instance();
 
+    // The sign request flags selecting the given signature algorithm.
+    static quint32 signatureFlags(const QByteArray &signatureAlgorithm);
+
 signals:
     void errorOccurred();
     void keysUpdated();
@@ -68,56 +72,47 @@ signals:
 private:
     struct Request {
         Request() { }
-        Request(const QByteArray &k, const QByteArray &d, uint t)
-            : key(k), dataToSign(d), token(t) { }
+        Request(const QByteArray &k, const QByteArray &d, quint32 f, uint t)
+            : key(k), dataToSign(d), flags(f), token(t) { }
 
         bool isKeysRequest() const { return !isSignatureRequest(); }
         bool isSignatureRequest() const { return !key.isEmpty(); }
 
         QByteArray key;
         QByteArray dataToSign;
+        quint32 flags = 0;
         uint token = 0;
     };
 
-    struct Packet {
-        bool isComplete() const { return size != 0 && int(size) == data.count(); }
-        void invalidate() { size = 0; data.clear(); }
-
-        quint32 size = 0;
-        QByteArray data;
-    };
-
     SshAgent();
     void connectToServer();
     void refreshKeysImpl();
     void requestSignatureImpl(const QByteArray &key, uint token);
 
-    void sendNextRequest();
-    Packet generateKeysPacket();
-    Packet generateSigPacket(const Request &request);
+    void sendRequest(const Request &request);
+    QByteArray generateKeysPacket();
+    QByteArray generateSigPacket(const Request &request);
 
     void handleConnected();
     void handleDisconnected();
     void handleSocketError();
     void handleIncomingData();
-    void handleIncomingPacket();
-    void handleIdentitiesPacket();
-    void handleSignaturePacket();
+    void handleIncomingPacket(const QByteArray &packet);
+    void handleIdentitiesPacket(const QByteArray &packet);
+    void handleSignaturePacket(const QByteArray &packet);
 
     void handleProtocolError();
     void setDisconnected();
 
-    void sendPacket();
-
     State m_state = Unconnected;
     QString m_error;
     QList<QByteArray> m_keys;
-    QHash<QPair<QByteArray, uint>, QByteArray> m_dataToSign;
+    QHash<QPair<QByteArray, uint>, Request> m_dataToSign;
     QLocalSocket m_agentSocket;
     QByteArray m_incomingData;
-    Packet m_incomingPacket;
-    Packet m_outgoingPacket;
 
+    // Sent, but not yet answered. The agent replies in order, so any number of requests
+    // can be in flight.
     QQueue<Request> m_pendingRequests;
 };
 
@@ -0,0 +1,336 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sshbatchrunner.h"
+
+#include "sshremoteprocessrunner.h"
+
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QThread>
+#include <QTimer>
+
+#include <functional>
+
+namespace QSsh {
+
+namespace Internal {
+namespace {
+
+typedef std::function<void(const SshBatchResult &)> ResultReporter;
+
+// One host, processed in a worker thread.
+class BatchJob : public QObject
+{
+public:
+    BatchJob(const SshConnectionParameters &sshParams, int timeout,
+             const ResultReporter &reporter, QObject *parent)
+        : QObject(parent), m_reporter(reporter)
+    {
+        m_result.parameters = sshParams;
+        m_clock.start();
+
+        connect(&m_runner, &SshRemoteProcessRunner::connectionError, this, [this] {
+            m_result.errorString = m_runner.lastConnectionErrorString();
+            finish(SshBatchResult::ConnectionFailed);
+        });
+        connect(&m_runner, &SshRemoteProcessRunner::processStarted, this, [this] {
+            m_result.startLatency = m_clock.elapsed();
+        });
+        connect(&m_runner, &SshRemoteProcessRunner::readyReadStandardOutput, this, [this] {
+            m_result.standardOutput += m_runner.readAllStandardOutput();
+        });
+        connect(&m_runner, &SshRemoteProcessRunner::readyReadStandardError, this, [this] {
+            m_result.standardError += m_runner.readAllStandardError();
+        });
+        connect(&m_runner, &SshRemoteProcessRunner::processClosed,
+                this, &BatchJob::handleProcessClosed);
+
+        if (timeout > 0) {
+            m_timeoutTimer.setSingleShot(true);
+            connect(&m_timeoutTimer, &QTimer::timeout, this, [this] {
+                m_result.errorString = SshBatchRunner::tr("Timeout waiting for host.");
+                finish(SshBatchResult::TimedOut);
+            });
+            m_timeoutTimer.start(timeout);
+        }
+    }
+
+    void start(const QByteArray &command) { m_runner.run(command, m_result.parameters); }
+    void cancel() { finish(SshBatchResult::Canceled); }
+
+private:
+    void handleProcessClosed(int exitStatus)
+    {
+        m_result.errorString = m_runner.processErrorString();
+        switch (exitStatus) {
+        case SshRemoteProcess::FailedToStart:
+            finish(SshBatchResult::StartFailed);
+            break;
+        case SshRemoteProcess::CrashExit:
+            m_result.exitSignal = m_runner.processExitSignal();
+            finish(SshBatchResult::Crashed);
+            break;
+        default:
+            m_result.exitCode = m_runner.processExitCode();
+            finish(m_result.exitCode == 0 ? SshBatchResult::Success : SshBatchResult::NonZeroExit);
+            break;
+        }
+    }
+
+    void finish(SshBatchResult::Outcome outcome)
+    {
+        if (m_finished)
+            return;
+        m_finished = true;
+        m_timeoutTimer.stop();
+        m_result.standardOutput += m_runner.readAllStandardOutput();
+        m_result.standardError += m_runner.readAllStandardError();
+        m_runner.cancel(); // Releases the connection right away.
+        m_result.outcome = outcome;
+        m_result.totalLatency = m_clock.elapsed();
+        m_reporter(m_result);
+        deleteLater();
+    }
+
+    SshRemoteProcessRunner m_runner;
+    QTimer m_timeoutTimer;
+    QElapsedTimer m_clock;
+    SshBatchResult m_result;
+    const ResultReporter m_reporter;
+    bool m_finished = false;
+};
+
+// Lives in a worker thread and owns the jobs running there.
+class BatchWorker : public QObject
+{
+public:
+    void startJob(const SshConnectionParameters &sshParams, const QByteArray &command,
+                  int timeout, const ResultReporter &reporter)
+    {
+        m_jobs.removeAll(QPointer<BatchJob>());
+        BatchJob * const job = new BatchJob(sshParams, timeout, reporter, this);
+        m_jobs << job;
+        job->start(command);
+    }
+
+    void cancelAll()
+    {
+        const QList<QPointer<BatchJob>> jobs = m_jobs;
+        m_jobs.clear();
+        for (const QPointer<BatchJob> &job : jobs) {
+            if (job)
+                job->cancel();
+        }
+    }
+
+private:
+    QList<QPointer<BatchJob>> m_jobs;
+};
+
+} // anonymous namespace
+
+class SshBatchRunnerPrivate
+{
+public:
+    SshBatchRunnerPrivate(SshBatchRunner *q) : q(q) {}
+
+    bool isRunning() const { return runningHosts > 0 || nextHost < hosts.count(); }
+
+    void startWorkers();
+    void stopWorkers();
+    void startJobs();
+    void handleResult(const SshBatchResult &result);
+    void reportFinished();
+
+    SshBatchRunner * const q;
+    int workerThreadCount = qBound(1, QThread::idealThreadCount() / 2, 4);
+    int maxConcurrency = 64;
+    int hostTimeout = 60000;
+
+    QList<QThread *> threads;
+    QList<BatchWorker *> workers;
+    int nextWorker = 0;
+
+    QList<SshConnectionParameters> hosts;
+    QByteArray command;
+    int nextHost = 0;
+    int runningHosts = 0;
+    bool finishReported = false;
+    SshBatchStatistics statistics;
+};
+
+void SshBatchRunnerPrivate::startWorkers()
+{
+    if (threads.count() == workerThreadCount)
+        return;
+    stopWorkers();
+    for (int i = 0; i < workerThreadCount; ++i) {
+        QThread * const thread = new QThread;
+        thread->setObjectName(QString::fromLatin1("QSsh batch worker %1").arg(i));
+        BatchWorker * const worker = new BatchWorker;
+        worker->moveToThread(thread);
+        QObject::connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread->start();
+        threads << thread;
+        workers << worker;
+    }
+}
+
+void SshBatchRunnerPrivate::stopWorkers()
+{
+    // Quitting from inside the worker's thread makes sure the jobs are gone by then.
+    for (BatchWorker * const worker : qAsConst(workers)) {
+        QMetaObject::invokeMethod(worker, [worker] {
+            worker->cancelAll();
+            QThread::currentThread()->quit();
+        }, Qt::QueuedConnection);
+    }
+    for (QThread * const thread : qAsConst(threads)) {
+        thread->wait();
+        delete thread;
+    }
+    threads.clear();
+    workers.clear();
+}
+
+void SshBatchRunnerPrivate::startJobs()
+{
+    while (runningHosts < maxConcurrency && nextHost < hosts.count()) {
+        const SshConnectionParameters sshParams = hosts.at(nextHost++);
+        --statistics.pendingHosts;
+        ++statistics.runningHosts;
+        ++runningHosts;
+
+        // Results are posted back to our thread. The workers are gone before we are.
+        SshBatchRunnerPrivate * const self = this;
+        const ResultReporter reporter = [self](const SshBatchResult &result) {
+            QMetaObject::invokeMethod(self->q, [self, result] { self->handleResult(result); },
+                                      Qt::QueuedConnection);
+        };
+        BatchWorker * const worker = workers.at(nextWorker++ % workers.count());
+        const QByteArray command = this->command;
+        const int timeout = hostTimeout;
+        QMetaObject::invokeMethod(worker, [worker, sshParams, command, timeout, reporter] {
+            worker->startJob(sshParams, command, timeout, reporter);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void SshBatchRunnerPrivate::handleResult(const SshBatchResult &result)
+{
+    --runningHosts;
+    --statistics.runningHosts;
+    ++statistics.finishedHosts;
+    ++statistics.outcomeCounts[result.outcome];
+    if (result.startLatency >= 0)
+        statistics.startLatencies.add(result.startLatency);
+    statistics.totalLatencies.add(result.totalLatency);
+
+    emit q->hostFinished(result);
+    startJobs();
+    if (!isRunning())
+        reportFinished();
+}
+
+// Clients may call cancel() from a slot connected to hostFinished(), which can then
+// already have reported the end of the batch.
+void SshBatchRunnerPrivate::reportFinished()
+{
+    if (finishReported)
+        return;
+    finishReported = true;
+    emit q->finished();
+}
+
+} // namespace Internal
+
+using namespace Internal;
+
+SshBatchRunner::SshBatchRunner(QObject *parent)
+    : QObject(parent), d(new SshBatchRunnerPrivate(this))
+{
+    qRegisterMetaType<QSsh::SshBatchResult>("QSsh::SshBatchResult");
+}
+
+SshBatchRunner::~SshBatchRunner()
+{
+    disconnect();
+    d->stopWorkers();
+    delete d;
+}
+
+void SshBatchRunner::setWorkerThreadCount(int count) { d->workerThreadCount = qMax(1, count); }
+int SshBatchRunner::workerThreadCount() const { return d->workerThreadCount; }
+void SshBatchRunner::setMaxConcurrency(int maxHosts) { d->maxConcurrency = qMax(1, maxHosts); }
+int SshBatchRunner::maxConcurrency() const { return d->maxConcurrency; }
+void SshBatchRunner::setHostTimeout(int msecs) { d->hostTimeout = qMax(0, msecs); }
+int SshBatchRunner::hostTimeout() const { return d->hostTimeout; }
+
+void SshBatchRunner::run(const QList<SshConnectionParameters> &hosts, const QByteArray &command)
+{
+    QSSH_ASSERT_AND_RETURN(!isRunning());
+
+    d->hosts = hosts;
+    d->command = command;
+    d->nextHost = 0;
+    d->finishReported = false;
+    d->statistics = SshBatchStatistics();
+    d->statistics.pendingHosts = hosts.count();
+    if (hosts.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this] { d->reportFinished(); }, Qt::QueuedConnection);
+        return;
+    }
+    d->startWorkers();
+    d->startJobs();
+}
+
+void SshBatchRunner::cancel()
+{
+    if (!isRunning())
+        return;
+
+    // The hosts we did not get to yet only show up in the outcome counts.
+    while (d->nextHost < d->hosts.count()) {
+        SshBatchResult result;
+        result.parameters = d->hosts.at(d->nextHost++);
+        result.outcome = SshBatchResult::Canceled;
+        --d->statistics.pendingHosts;
+        ++d->statistics.finishedHosts;
+        ++d->statistics.outcomeCounts[SshBatchResult::Canceled];
+        emit hostFinished(result);
+    }
+
+    // The running ones report back as usual.
+    for (BatchWorker * const worker : qAsConst(d->workers))
+        QMetaObject::invokeMethod(worker, [worker] { worker->cancelAll(); }, Qt::QueuedConnection);
+    if (!isRunning())
+        d->reportFinished();
+}
+
+bool SshBatchRunner::isRunning() const { return d->isRunning(); }
+SshBatchStatistics SshBatchRunner::statistics() const { return d->statistics; }
+
+} // namespace QSsh
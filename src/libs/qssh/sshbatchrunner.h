@@ -0,0 +1,125 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#ifndef SSHBATCHRUNNER_H
+#define SSHBATCHRUNNER_H
+
+#include "sshconnection.h"
+#include "sshlatencyhistogram.h"
+#include "sshremoteprocess.h"
+
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+
+namespace QSsh {
+namespace Internal {
+class SshBatchRunnerPrivate;
+} // namespace Internal
+
+class QSSH_EXPORT SshBatchResult
+{
+public:
+    enum Outcome {
+        Success,          // Exit code 0.
+        NonZeroExit,
+        Crashed,          // Killed by a signal, see exitSignal.
+        StartFailed,      // The command could not be run.
+        ConnectionFailed,
+        TimedOut,
+        Canceled,
+        OutcomeCount
+    };
+
+    SshConnectionParameters parameters;
+    Outcome outcome = Canceled;
+    int exitCode = -1;
+    SshRemoteProcess::Signal exitSignal = SshRemoteProcess::NoSignal;
+    QString errorString;
+    QByteArray standardOutput;
+    QByteArray standardError;
+    qint64 startLatency = -1; // Milliseconds until the remote process was running, -1 if it never was.
+    qint64 totalLatency = 0;  // Milliseconds until the host was done.
+};
+
+class QSSH_EXPORT SshBatchStatistics
+{
+public:
+    int outcomeCounts[SshBatchResult::OutcomeCount] = {};
+    SshLatencyHistogram startLatencies; // In milliseconds, like the results.
+    SshLatencyHistogram totalLatencies;
+    int pendingHosts = 0;
+    int runningHosts = 0;
+    int finishedHosts = 0;
+};
+
+/*!
+    \class QSsh::SshBatchRunner
+
+    \brief Runs the same command on many hosts at once.
+
+    The connections are driven by a small number of worker threads, each with its own
+    event loop. At most maxConcurrency() hosts are processed at the same time; the others
+    wait in order. Results are reported as soon as a host is done.
+*/
+
+class QSSH_EXPORT SshBatchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    SshBatchRunner(QObject *parent = nullptr);
+    ~SshBatchRunner();
+
+    // Only takes effect for the next run().
+    void setWorkerThreadCount(int count);
+    int workerThreadCount() const;
+
+    void setMaxConcurrency(int maxHosts);
+    int maxConcurrency() const;
+
+    // Covers connecting and running the command. 0 means no timeout.
+    void setHostTimeout(int msecs);
+    int hostTimeout() const;
+
+    void run(const QList<SshConnectionParameters> &hosts, const QByteArray &command);
+    void cancel(); // Remote processes are not stopped, see SshRemoteProcessRunner::cancel().
+    bool isRunning() const;
+
+    SshBatchStatistics statistics() const;
+
+signals:
+    void hostFinished(const QSsh::SshBatchResult &result);
+    void finished();
+
+private:
+    Internal::SshBatchRunnerPrivate * const d;
+};
+
+} // namespace QSsh
+
+Q_DECLARE_METATYPE(QSsh::SshBatchResult)
+
+#endif // SSHBATCHRUNNER_H
@@ -128,6 +128,12 @@ inline const char *botanEmsaAlgoName(const QByteArray &rfcAlgoName)
         return "EMSA1(SHA-1)";
     if (rfcAlgoName == SshCapabilities::PubKeyRsa)
         return "EMSA3(SHA-1)";
+    if (rfcAlgoName == SshCapabilities::PubKeyRsaSha256)
+        return "EMSA3(SHA-256)";
+    if (rfcAlgoName == SshCapabilities::PubKeyRsaSha512)
+        return "EMSA3(SHA-512)";
+    if (rfcAlgoName == SshCapabilities::PubKeyEd25519)
+        return "Pure";
     if (rfcAlgoName == SshCapabilities::PubKeyEcdsa256)
         return "EMSA1(SHA-256)";
     if (rfcAlgoName == SshCapabilities::PubKeyEcdsa384)
@@ -0,0 +1,73 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+
+#include <cstring>
+
+namespace QSsh {
+namespace Internal {
+
+// A non-owning reference to a range of bytes inside a packet buffer. It is only valid as long
+// as that buffer is neither modified nor destroyed; call toByteArray() to keep the data around
+// for longer. (QByteArrayView would do the job, but it does not exist in Qt 5.)
+class SshByteView
+{
+public:
+    SshByteView() : m_data(nullptr), m_size(0) {}
+    SshByteView(const char *data, quint32 size) : m_data(data), m_size(size) {}
+    SshByteView(const QByteArray &data) : m_data(data.constData()), m_size(data.size()) {}
+
+    const char *data() const { return m_data; }
+    quint32 size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+    QByteArray toByteArray() const { return QByteArray(m_data, m_size); }
+
+    friend bool operator==(const SshByteView &v1, const SshByteView &v2)
+    {
+        return v1.m_size == v2.m_size
+                && (v1.m_size == 0 || std::memcmp(v1.m_data, v2.m_data, v1.m_size) == 0);
+    }
+    friend bool operator!=(const SshByteView &v1, const SshByteView &v2) { return !(v1 == v2); }
+    friend bool operator==(const SshByteView &v, const char *s)
+    {
+        return v == SshByteView(s, quint32(std::strlen(s)));
+    }
+    friend bool operator!=(const SshByteView &v, const char *s) { return !(v == s); }
+    friend bool operator==(const SshByteView &v, const QByteArray &a) { return v == SshByteView(a); }
+    friend bool operator!=(const SshByteView &v, const QByteArray &a) { return !(v == a); }
+    friend bool operator==(const QByteArray &a, const SshByteView &v) { return v == a; }
+    friend bool operator!=(const QByteArray &a, const SshByteView &v) { return !(v == a); }
+
+private:
+    const char *m_data;
+    quint32 m_size;
+};
+
+} // namespace Internal
+} // namespace QSsh
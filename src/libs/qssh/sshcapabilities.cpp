@@ -58,7 +58,12 @@ const QByteArray SshCapabilities::EcdhKexNamePrefix("ecdh-sha2-nistp");
 const QByteArray SshCapabilities::EcdhNistp256 = EcdhKexNamePrefix + "256";
 const QByteArray SshCapabilities::EcdhNistp384 = EcdhKexNamePrefix + "384";
 const QByteArray SshCapabilities::EcdhNistp521 = EcdhKexNamePrefix + "521";
+const QByteArray SshCapabilities::Curve25519KexNamePrefix("curve25519-sha256");
+const QByteArray SshCapabilities::Curve25519Sha256 = Curve25519KexNamePrefix;
+const QByteArray SshCapabilities::Curve25519Sha256LibSsh = Curve25519KexNamePrefix + "@libssh.org";
 const QList<QByteArray> SshCapabilities::KeyExchangeMethods = QList<QByteArray>()
+        << SshCapabilities::Curve25519Sha256
+        << SshCapabilities::Curve25519Sha256LibSsh
         << SshCapabilities::EcdhNistp256
         << SshCapabilities::EcdhNistp384
         << SshCapabilities::EcdhNistp521
@@ -71,10 +76,16 @@ const QByteArray SshCapabilities::PubKeyEcdsaPrefix("ecdsa-sha2-nistp");
 const QByteArray SshCapabilities::PubKeyEcdsa256 = SshCapabilities::PubKeyEcdsaPrefix + "256";
 const QByteArray SshCapabilities::PubKeyEcdsa384 = SshCapabilities::PubKeyEcdsaPrefix + "384";
 const QByteArray SshCapabilities::PubKeyEcdsa521 = SshCapabilities::PubKeyEcdsaPrefix + "521";
+const QByteArray SshCapabilities::PubKeyEd25519("ssh-ed25519");
+const QByteArray SshCapabilities::PubKeyRsaSha256("rsa-sha2-256");
+const QByteArray SshCapabilities::PubKeyRsaSha512("rsa-sha2-512");
 const QList<QByteArray> SshCapabilities::PublicKeyAlgorithms = QList<QByteArray>()
+        << SshCapabilities::PubKeyEd25519
         << SshCapabilities::PubKeyEcdsa256
         << SshCapabilities::PubKeyEcdsa384
         << SshCapabilities::PubKeyEcdsa521
+        << SshCapabilities::PubKeyRsaSha512
+        << SshCapabilities::PubKeyRsaSha256
         << SshCapabilities::PubKeyRsa
         << SshCapabilities::PubKeyDss;
 
@@ -109,6 +120,9 @@ const QList<QByteArray> SshCapabilities::CompressionAlgorithms
 
 const QByteArray SshCapabilities::SshConnectionService("ssh-connection");
 
+const QByteArray SshCapabilities::ExtInfoClient("ext-info-c");
+const QByteArray SshCapabilities::ServerSigAlgsExtension("server-sig-algs");
+
 QList<QByteArray> SshCapabilities::commonCapabilities(const QList<QByteArray> &myCapabilities,
                                                const QList<QByteArray> &serverCapabilities, const QByteArray &group)
 {
@@ -137,7 +151,19 @@ QList<QByteArray> SshCapabilities::commonCapabilities(const QList<QByteArray> &m
 QByteArray SshCapabilities::findBestMatch(const QList<QByteArray> &myCapabilities,
     const QList<QByteArray> &serverCapabilities, const QByteArray &group)
 {
-    return commonCapabilities(myCapabilities, serverCapabilities, group).first();
+    // No need to compute the full intersection; our first match wins.
+    for (const QByteArray &myCapability : myCapabilities) {
+        if (serverCapabilities.contains(myCapability))
+            return myCapability;
+    }
+    return commonCapabilities(myCapabilities, serverCapabilities, group).first(); // Throws.
+}
+
+QByteArray SshCapabilities::publicKeyType(const QByteArray &publicKeyAlgo)
+{
+    if (publicKeyAlgo == PubKeyRsaSha256 || publicKeyAlgo == PubKeyRsaSha512)
+        return PubKeyRsa;
+    return publicKeyAlgo;
 }
 
 int SshCapabilities::ecdsaIntegerWidthInBytes(const QByteArray &ecdsaAlgo)
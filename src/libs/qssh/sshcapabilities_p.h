@@ -31,13 +31,15 @@
 #ifndef CAPABILITIES_P_H
 #define CAPABILITIES_P_H
 
+#include "ssh_global.h"
+
 #include <QByteArray>
 #include <QList>
 
 namespace QSsh {
 namespace Internal {
 
-class SshCapabilities
+class QSSH_EXPORT SshCapabilities
 {
 public:
     static const QByteArray DiffieHellmanGroup1Sha1;
@@ -46,6 +48,9 @@ public:
     static const QByteArray EcdhNistp256;
     static const QByteArray EcdhNistp384;
     static const QByteArray EcdhNistp521; // sic
+    static const QByteArray Curve25519KexNamePrefix;
+    static const QByteArray Curve25519Sha256;
+    static const QByteArray Curve25519Sha256LibSsh;
     static const QList<QByteArray> KeyExchangeMethods;
 
     static const QByteArray PubKeyDss;
@@ -54,8 +59,15 @@ public:
     static const QByteArray PubKeyEcdsa256;
     static const QByteArray PubKeyEcdsa384;
     static const QByteArray PubKeyEcdsa521;
+    static const QByteArray PubKeyEd25519;
+    static const QByteArray PubKeyRsaSha256;
+    static const QByteArray PubKeyRsaSha512;
     static const QList<QByteArray> PublicKeyAlgorithms;
 
+    // RFC 8308
+    static const QByteArray ExtInfoClient;
+    static const QByteArray ServerSigAlgsExtension;
+
     static const QByteArray CryptAlgo3DesCbc;
     static const QByteArray CryptAlgo3DesCtr;
     static const QByteArray CryptAlgoAes128Cbc;
@@ -80,6 +92,9 @@ public:
     static QByteArray findBestMatch(const QList<QByteArray> &myCapabilities,
         const QList<QByteArray> &serverCapabilities, const QByteArray &group);
 
+    // The key format for a host key or signature algorithm, e.g. "ssh-rsa" for "rsa-sha2-256".
+    static QByteArray publicKeyType(const QByteArray &publicKeyAlgo);
+
     static int ecdsaIntegerWidthInBytes(const QByteArray &ecdsaAlgo);
     static QByteArray ecdsaPubKeyAlgoForKeyWidth(int keyWidthInBytes);
     static const char *oid(const QByteArray &ecdsaAlgo);
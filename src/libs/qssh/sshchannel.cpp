@@ -48,7 +48,8 @@ AbstractSshChannel::AbstractSshChannel(quint32 channelId,
     : m_sendFacility(sendFacility),
       m_localChannel(channelId), m_remoteChannel(NoChannel),
       m_localWindowSize(initialWindowSize()), m_remoteWindowSize(0),
-      m_state(Inactive)
+      m_state(Inactive), m_priority(BulkPriority),
+      m_eofRequested(false), m_eofSent(false)
 {
     m_timeoutTimer.setTimerType(Qt::VeryCoarseTimer);
     m_timeoutTimer.setSingleShot(true);
@@ -63,6 +64,8 @@ AbstractSshChannel::~AbstractSshChannel()
 void AbstractSshChannel::setChannelState(ChannelState state)
 {
     m_state = state;
+    if (state == CloseRequested || state == Closed)
+        m_sendFacility.unscheduleChannel(this);
     if (state == Closed)
         closeHook();
 }
@@ -74,7 +77,7 @@ void AbstractSshChannel::requestSessionStart()
     // with our cryptography stuff, it would have hit us before, on
     // establishing the connection.
     try {
-        m_sendFacility.sendSessionPacket(m_localChannel, initialWindowSize(), maxPacketSize());
+        m_sendFacility.sendSessionPacket(m_localChannel, openingWindowSize(), maxPacketSize());
         setChannelState(SessionRequested);
         m_timeoutTimer.start(ReplyTimeout);
     }  catch (const std::exception &e) {
@@ -83,11 +86,20 @@ void AbstractSshChannel::requestSessionStart()
     }
 }
 
+quint32 AbstractSshChannel::openingWindowSize()
+{
+    const qint64 limit = receiveBufferLimit();
+    if (limit >= 0)
+        m_localWindowSize = qMin<qint64>(m_localWindowSize, limit);
+    return m_localWindowSize;
+}
+
 void AbstractSshChannel::sendData(const QByteArray &data)
 {
+    QSSH_ASSERT_AND_RETURN(!m_eofRequested);
     try {
         m_sendBuffer += data;
-        flushSendBuffer();
+        m_sendFacility.scheduleChannel(this);
     }  catch (const std::exception &e) {
         qCWarning(sshLog, "Botan error: %s", e.what());
         closeChannel();
@@ -115,21 +127,48 @@ void AbstractSshChannel::handleWindowAdjust(quint64 bytesToAdd)
     }
 
     m_remoteWindowSize = newValue;
-    flushSendBuffer();
+    if (m_remoteWindowSize > 0)
+        m_windowStalled = false;
+    m_sendFacility.scheduleChannel(this);
+}
+
+quint32 AbstractSshChannel::sendableDataSize() const
+{
+    return qMin<quint32>(m_remoteWindowSize, m_sendBuffer.size());
 }
 
-void AbstractSshChannel::flushSendBuffer()
+quint32 AbstractSshChannel::flushSendBuffer(quint32 maxBytes)
 {
-    while (true) {
-        const quint32 bytesToSend = qMin(m_remoteMaxPacketSize,
-                qMin<quint32>(m_remoteWindowSize, m_sendBuffer.size()));
-        if (bytesToSend == 0)
-            break;
-        const QByteArray &data = m_sendBuffer.left(bytesToSend);
-        m_sendFacility.sendChannelDataPacket(m_remoteChannel, data);
-        m_sendBuffer.remove(0, bytesToSend);
-        m_remoteWindowSize -= bytesToSend;
+    quint32 bytesSent = 0;
+    try {
+        while (bytesSent < maxBytes) {
+            const quint32 bytesToSend = qMin(qMin(m_remoteMaxPacketSize, maxBytes - bytesSent),
+                    sendableDataSize());
+            if (bytesToSend == 0)
+                break;
+            const QByteArray &data = m_sendBuffer.left(bytesToSend);
+            m_sendFacility.sendChannelDataPacket(m_remoteChannel, data);
+            m_sendBuffer.remove(0, bytesToSend);
+            m_remoteWindowSize -= bytesToSend;
+            bytesSent += bytesToSend;
+        }
+        if (m_remoteWindowSize == 0 && !m_sendBuffer.isEmpty() && !m_windowStalled) {
+            m_windowStalled = true;
+            ++m_windowStalls;
+            m_sendFacility.countWindowStall();
+        }
+        if (m_eofRequested && !m_eofSent && m_sendBuffer.isEmpty()) {
+            m_sendFacility.sendChannelEofPacket(m_remoteChannel);
+            m_eofSent = true;
+        }
+    }  catch (const std::exception &e) {
+        qCWarning(sshLog, "Botan error: %s", e.what());
+        m_sendBuffer.clear();
+        closeChannel();
     }
+    if (bytesSent > 0)
+        emit bytesWritten(bytesSent);
+    return bytesSent;
 }
 
 void AbstractSshChannel::handleOpenSuccess(quint32 remoteChannelId,
@@ -199,48 +238,82 @@ void AbstractSshChannel::handleChannelClose()
     setChannelState(Closed);
 }
 
-void AbstractSshChannel::handleChannelData(const QByteArray &data)
+void AbstractSshChannel::handleChannelData(const SshByteView &data)
 {
-    const int bytesToDeliver = handleChannelOrExtendedChannelData(data);
-    handleChannelDataInternal(bytesToDeliver == data.size()
-        ? data : data.left(bytesToDeliver));
+    const quint32 bytesToDeliver = handleChannelOrExtendedChannelData(data);
+    handleChannelDataInternal(SshByteView(data.data(), bytesToDeliver));
+    adjustLocalWindow(); // Only now is the data accounted for in the receive buffer.
 }
 
-void AbstractSshChannel::handleChannelExtendedData(quint32 type, const QByteArray &data)
+void AbstractSshChannel::handleChannelExtendedData(quint32 type, const SshByteView &data)
 {
-    const int bytesToDeliver = handleChannelOrExtendedChannelData(data);
-    handleChannelExtendedDataInternal(type, bytesToDeliver == data.size()
-        ? data : data.left(bytesToDeliver));
+    const quint32 bytesToDeliver = handleChannelOrExtendedChannelData(data);
+    handleChannelExtendedDataInternal(type, SshByteView(data.data(), bytesToDeliver));
+    adjustLocalWindow();
 }
 
 void AbstractSshChannel::handleChannelRequest(const SshIncomingPacket &packet)
 {
     checkChannelActive();
-    const QByteArray &requestType = packet.extractChannelRequestType();
+    const SshByteView requestType = packet.extractChannelRequestType();
     if (requestType == SshIncomingPacket::ExitStatusType)
         handleExitStatus(packet.extractChannelExitStatus());
     else if (requestType == SshIncomingPacket::ExitSignalType)
         handleExitSignal(packet.extractChannelExitSignal());
     else if (requestType != "eow@openssh.com") // Suppress warning for this one, as it's sent all the time.
-        qCWarning(sshLog, "Ignoring unknown request type '%s'", requestType.data());
+        qCWarning(sshLog, "Ignoring unknown request type '%s'",
+                  requestType.toByteArray().constData());
 }
 
-int AbstractSshChannel::handleChannelOrExtendedChannelData(const QByteArray &data)
+quint32 AbstractSshChannel::handleChannelOrExtendedChannelData(const SshByteView &data)
 {
     checkChannelActive();
 
-    const int bytesToDeliver = qMin<quint32>(data.size(), maxDataSize());
+    const quint32 bytesToDeliver = qMin(data.size(), maxDataSize());
     if (bytesToDeliver != data.size())
         qCWarning(sshLog, "Misbehaving server does not respect local window, clipping.");
 
     m_localWindowSize -= bytesToDeliver;
-    if (m_localWindowSize < maxPacketSize()) {
-        m_localWindowSize += maxPacketSize();
-        m_sendFacility.sendWindowAdjustPacket(m_remoteChannel, maxPacketSize());
-    }
     return bytesToDeliver;
 }
 
+void AbstractSshChannel::adjustLocalWindow()
+{
+    if (m_state != SessionEstablished)
+        return;
+    const quint32 bytesToAdd = windowAdjustment(m_localWindowSize, maxPacketSize(),
+                                                receiveBufferLimit(), receiveBufferedSize());
+    if (bytesToAdd > 0) {
+        m_localWindowSize += bytesToAdd;
+        m_sendFacility.sendWindowAdjustPacket(m_remoteChannel, bytesToAdd);
+    }
+}
+
+quint32 AbstractSshChannel::windowAdjustment(quint32 localWindowSize, quint32 packetSize,
+                                             qint64 limit, qint64 bufferedSize)
+{
+    if (localWindowSize >= packetSize)
+        return 0;
+    if (limit < 0)
+        return packetSize;
+
+    // Granting tiny amounts would make the server send tiny packets, so wait until there is
+    // room for a full packet, or for half the buffer if that is smaller.
+    const qint64 room = limit - bufferedSize - localWindowSize;
+    if (room <= 0 || room < qMin<qint64>(packetSize, limit / 2))
+        return 0;
+    return quint32(qMin<qint64>(room, packetSize));
+}
+
+void AbstractSshChannel::sendEof()
+{
+    if (m_state != SessionEstablished || m_eofRequested)
+        return;
+    m_eofRequested = true;
+    if (m_sendBuffer.isEmpty())
+        flushSendBuffer(); // Otherwise, this happens once the scheduler has drained the buffer.
+}
+
 void AbstractSshChannel::closeChannel()
 {
     if (m_state == CloseRequested) {
@@ -250,9 +323,12 @@ void AbstractSshChannel::closeChannel()
             setChannelState(Closed);
         } else {
             const ChannelState oldState = m_state;
+            if (m_remoteChannel != NoChannel)
+                flushSendBuffer(); // The EOF must not overtake data that is still queued.
             setChannelState(CloseRequested);
             if (m_remoteChannel != NoChannel) {
-                m_sendFacility.sendChannelEofPacket(m_remoteChannel);
+                if (!m_eofSent)
+                    m_sendFacility.sendChannelEofPacket(m_remoteChannel);
                 m_sendFacility.sendChannelClosePacket(m_remoteChannel);
             } else {
                 QSSH_ASSERT(oldState == SessionRequested);
@@ -31,6 +31,9 @@
 #ifndef SSHCHANNEL_P_H
 #define SSHCHANNEL_P_H
 
+#include "ssh_global.h"
+#include "sshbyteview_p.h"
+
 #include <QByteArray>
 #include <QObject>
 #include <QString>
@@ -44,14 +47,19 @@ struct SshChannelExitStatus;
 class SshIncomingPacket;
 class SshSendFacility;
 
-class AbstractSshChannel : public QObject
+class QSSH_EXPORT AbstractSshChannel : public QObject
 {
     Q_OBJECT
+    friend class SshSendFacility;
 public:
     enum ChannelState {
         Inactive, SessionRequested, SessionEstablished, CloseRequested, Closed
     };
 
+    // Determines how SshSendFacility interleaves the channel's data with that of other channels.
+    // Control messages are not affected; they are always sent right away.
+    enum Priority { InteractivePriority, BulkPriority, PriorityCount };
+
     quint32 localChannelId() const { return m_localChannel; }
     quint32 remoteChannel() const { return m_remoteChannel; }
 
@@ -64,20 +72,49 @@ public:
     void handleWindowAdjust(quint64 bytesToAdd);
     void handleChannelEof();
     void handleChannelClose();
-    void handleChannelData(const QByteArray &data);
-    void handleChannelExtendedData(quint32 type, const QByteArray &data);
+    void handleChannelData(const SshByteView &data);
+    void handleChannelExtendedData(quint32 type, const SshByteView &data);
     void handleChannelRequest(const SshIncomingPacket &packet);
 
     void closeChannel();
 
+    // Signals the end of our data. Anything still in the send buffer goes out first.
+    void sendEof();
+
     virtual ~AbstractSshChannel();
 
     static const int ReplyTimeout = 10000; // milli seconds
     ChannelState channelState() const { return m_state; }
 
+    Priority priority() const { return m_priority; }
+    void setPriority(Priority priority) { m_priority = priority; }
+
+    // Number of bytes that could be sent right now, i.e. as far as the remote window allows.
+    quint32 sendableDataSize() const;
+
+    // Producers should hold back while the buffer is full and continue on bytesWritten().
+    quint32 bufferedDataSize() const { return m_sendBuffer.size(); }
+    bool sendBufferIsFull() const { return bufferedDataSize() >= SendBufferHighWaterMark; }
+    static const quint32 SendBufferHighWaterMark = 1024 * 1024;
+
+    // How often the send buffer had data while the remote window was exhausted.
+    quint32 windowStalls() const { return m_windowStalls; }
+
+    // A request held back during the authentication only times out from when it went out.
+    void restartReplyTimeout() { if (m_timeoutTimer.isActive()) m_timeoutTimer.start(); }
+
+    // Sends at most maxBytes of buffered data. Returns the number of bytes sent.
+    quint32 flushSendBuffer(quint32 maxBytes = 0xffffffffu);
+
+    // The number of bytes by which to extend a local window of the given size. With a bounded
+    // receive buffer (limit >= 0), the window never exceeds the space left in the buffer.
+    static quint32 windowAdjustment(quint32 localWindowSize, quint32 packetSize, qint64 limit,
+                                    qint64 bufferedSize);
+
 signals:
     void timeout();
     void eof();
+    void bytesWritten(qint64 bytes);
 
 protected:
     AbstractSshChannel(quint32 channelId, SshSendFacility &sendFacility);
@@ -85,6 +122,9 @@ protected:
     void setChannelState(ChannelState state);
 
     void requestSessionStart();
+
+    // The window to announce when opening or confirming the channel, capped by the receive limit.
+    quint32 openingWindowSize();
     void sendData(const QByteArray &data);
 
     static quint32 initialWindowSize();
@@ -93,22 +133,28 @@ protected:
     quint32 maxDataSize() const;
     void checkChannelActive() const;
 
+    // Subclasses that buffer incoming data can bound the amount the remote side may send by
+    // returning a limit >= 0 here, and must call adjustLocalWindow() once they have drained it.
+    virtual qint64 receiveBufferLimit() const { return -1; }
+    virtual qint64 receiveBufferedSize() const { return 0; }
+    void adjustLocalWindow();
+
     SshSendFacility &m_sendFacility;
     QTimer m_timeoutTimer;
 
 private:
     virtual void handleOpenSuccessInternal() = 0;
     virtual void handleOpenFailureInternal(const QString &reason) = 0;
-    virtual void handleChannelDataInternal(const QByteArray &data) = 0;
+    // The data points into the incoming packet; implementations must copy what they keep.
+    virtual void handleChannelDataInternal(const SshByteView &data) = 0;
     virtual void handleChannelExtendedDataInternal(quint32 type,
-        const QByteArray &data) = 0;
+        const SshByteView &data) = 0;
     virtual void handleExitStatus(const SshChannelExitStatus &exitStatus) = 0;
     virtual void handleExitSignal(const SshChannelExitSignal &signal) = 0;
 
     virtual void closeHook() = 0;
 
-    void flushSendBuffer();
-    int handleChannelOrExtendedChannelData(const QByteArray &data);
+    quint32 handleChannelOrExtendedChannelData(const SshByteView &data);
 
     const quint32 m_localChannel;
     quint32 m_remoteChannel;
@@ -116,7 +162,13 @@ private:
     quint32 m_remoteWindowSize;
     quint32 m_remoteMaxPacketSize;
     ChannelState m_state;
+    Priority m_priority;
     QByteArray m_sendBuffer;
+    bool m_eofRequested;
+    bool m_eofSent;
+    bool m_windowStalled = false;
+    quint32 m_windowStalls = 0;
+    bool m_scheduled = false; // Queued in the send facility or being served by it.
 };
 
 } // namespace Internal
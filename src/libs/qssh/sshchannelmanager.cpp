@@ -32,6 +32,7 @@
 
 #include "sftpchannel.h"
 #include "sftpchannel_p.h"
+#include "sshconnection.h"
 #include "sshdirecttcpiptunnel.h"
 #include "sshdirecttcpiptunnel_p.h"
 #include "sshforwardedtcpiptunnel.h"
@@ -53,7 +54,7 @@ namespace Internal {
 
 SshChannelManager::SshChannelManager(SshSendFacility &sendFacility,
     QObject *parent)
-    : QObject(parent), m_sendFacility(sendFacility), m_nextLocalChannelId(0)
+    : QObject(parent), m_sendFacility(sendFacility), m_channelCount(0)
 {
 }
 
@@ -85,15 +86,15 @@ void SshChannelManager::handleChannelOpen(const SshIncomingPacket &packet)
 void SshChannelManager::handleChannelOpenFailure(const SshIncomingPacket &packet)
 {
    const SshChannelOpenFailure &failure = packet.extractChannelOpenFailure();
-   ChannelIterator it = lookupChannelAsIterator(failure.localChannel);
+   AbstractSshChannel * const channel = lookupChannel(failure.localChannel);
    try {
-       it.value()->handleOpenFailure(failure.reasonString);
+       channel->handleOpenFailure(failure.reasonString);
    } catch (const SshServerException &e) {
        Q_UNUSED(e);
-       removeChannel(it);
+       removeChannel(failure.localChannel);
        throw;
    }
-   removeChannel(it);
+   removeChannel(failure.localChannel);
 }
 
 void SshChannelManager::handleChannelOpenConfirmation(const SshIncomingPacket &packet)
@@ -144,10 +145,10 @@ void SshChannelManager::handleChannelClose(const SshIncomingPacket &packet)
 {
     const quint32 channelId = packet.extractRecipientChannel();
 
-    ChannelIterator it = lookupChannelAsIterator(channelId, true);
-    if (it != m_channels.end()) {
-        it.value()->handleChannelClose();
-        removeChannel(it);
+    AbstractSshChannel * const channel = lookupChannel(channelId, true);
+    if (channel) {
+        channel->handleChannelClose();
+        removeChannel(channelId);
     }
 }
 
@@ -184,28 +185,30 @@ void SshChannelManager::handleRequestFailure(const SshIncomingPacket &packet)
     tunnel->setClosed();
 }
 
-SshChannelManager::ChannelIterator SshChannelManager::lookupChannelAsIterator(quint32 channelId,
-    bool allowNotFound)
+quint32 SshChannelManager::allocateChannelId()
 {
-    ChannelIterator it = m_channels.find(channelId);
-    if (it == m_channels.end() && !allowNotFound) {
-        throw SshServerException(SSH_DISCONNECT_PROTOCOL_ERROR,
-            "Invalid channel id.",
-            tr("Invalid channel id %1").arg(channelId));
-    }
-    return it;
+    if (!m_freeChannelIds.isEmpty())
+        return m_freeChannelIds.takeLast();
+    m_channels.append(ChannelSlot());
+    return m_channels.count() - 1;
 }
 
 AbstractSshChannel *SshChannelManager::lookupChannel(quint32 channelId,
     bool allowNotFound)
 {
-    ChannelIterator it = lookupChannelAsIterator(channelId, allowNotFound);
-    return it == m_channels.end() ? nullptr : it.value();
+    AbstractSshChannel * const channel = channelId < quint32(m_channels.count())
+            ? m_channels.at(channelId).channel : nullptr;
+    if (!channel && !allowNotFound) {
+        throw SshServerException(SSH_DISCONNECT_PROTOCOL_ERROR,
+            "Invalid channel id.",
+            tr("Invalid channel id %1").arg(channelId));
+    }
+    return channel;
 }
 
 QSsh::SshRemoteProcess::Ptr SshChannelManager::createRemoteProcess(const QByteArray &command)
 {
-    SshRemoteProcess::Ptr proc(new SshRemoteProcess(command, m_nextLocalChannelId++, m_sendFacility));
+    SshRemoteProcess::Ptr proc(new SshRemoteProcess(command, allocateChannelId(), m_sendFacility));
     insertChannel(proc->d, proc);
     connect(proc->d, &SshRemoteProcessPrivate::destroyed, this, [this] {
         m_x11ForwardingRequests.removeOne(static_cast<SshRemoteProcessPrivate *>(sender()));
@@ -249,14 +252,14 @@ QSsh::SshRemoteProcess::Ptr SshChannelManager::createRemoteProcess(const QByteAr
 
 QSsh::SshRemoteProcess::Ptr SshChannelManager::createRemoteShell()
 {
-    SshRemoteProcess::Ptr proc(new SshRemoteProcess(m_nextLocalChannelId++, m_sendFacility));
+    SshRemoteProcess::Ptr proc(new SshRemoteProcess(allocateChannelId(), m_sendFacility));
     insertChannel(proc->d, proc);
     return proc;
 }
 
 QSsh::SftpChannel::Ptr SshChannelManager::createSftpChannel()
 {
-    SftpChannel::Ptr sftp(new SftpChannel(m_nextLocalChannelId++, m_sendFacility));
+    SftpChannel::Ptr sftp(new SftpChannel(allocateChannelId(), m_sendFacility));
     insertChannel(sftp->d, sftp);
     return sftp;
 }
@@ -264,7 +267,7 @@ QSsh::SftpChannel::Ptr SshChannelManager::createSftpChannel()
 SshDirectTcpIpTunnel::Ptr SshChannelManager::createDirectTunnel(const QString &originatingHost,
         quint16 originatingPort, const QString &remoteHost, quint16 remotePort)
 {
-    SshDirectTcpIpTunnel::Ptr tunnel(new SshDirectTcpIpTunnel(m_nextLocalChannelId++,
+    SshDirectTcpIpTunnel::Ptr tunnel(new SshDirectTcpIpTunnel(allocateChannelId(),
             originatingHost, originatingPort, remoteHost, remotePort, m_sendFacility));
     insertChannel(tunnel->d, tunnel);
     return tunnel;
@@ -296,8 +299,11 @@ void SshChannelManager::insertChannel(AbstractSshChannel *priv,
     const QSharedPointer<QObject> &pub)
 {
     connect(priv, &AbstractSshChannel::timeout, this, &SshChannelManager::timeout);
-    m_channels.insert(priv->localChannelId(), priv);
-    m_sessions.insert(priv, pub);
+    ChannelSlot &slot = m_channels[priv->localChannelId()];
+    QSSH_ASSERT_AND_RETURN(!slot.channel);
+    slot.channel = priv;
+    slot.session = pub;
+    ++m_channelCount;
 }
 
 void SshChannelManager::handleChannelOpenForwardedTcpIp(
@@ -331,18 +337,24 @@ void SshChannelManager::handleChannelOpenForwardedTcpIp(
         };
     }
 
-    if (server.isNull()) {
+    if (server.isNull() || !server->acceptsConnection()) {
+        SshOpenFailureType reason = SSH_OPEN_ADMINISTRATIVELY_PROHIBITED;
+        if (!server.isNull()) {
+            qCDebug(sshLog, "Rejecting forwarded connection: limit of %d reached.",
+                    server->maxConnections());
+            reason = SSH_OPEN_RESOURCE_SHORTAGE;
+            emit server->connectionRejected();
+        }
         try {
             m_sendFacility.sendChannelOpenFailurePacket(channelOpen.common.remoteChannel,
-                                                        SSH_OPEN_ADMINISTRATIVELY_PROHIBITED,
-                                                        QByteArray());
+                                                        reason, QByteArray());
         }  catch (const std::exception &e) {
             qCWarning(sshLog, "Botan error: %s", e.what());
         }
         return;
     }
 
-    SshForwardedTcpIpTunnel::Ptr tunnel(new SshForwardedTcpIpTunnel(m_nextLocalChannelId++,
+    SshForwardedTcpIpTunnel::Ptr tunnel(new SshForwardedTcpIpTunnel(allocateChannelId(),
                                                                     m_sendFacility));
     tunnel->d->handleOpenSuccess(channelOpen.common.remoteChannel,
                                  channelOpen.common.remoteWindowSize,
@@ -362,7 +374,7 @@ void SshChannelManager::handleChannelOpenX11(const SshChannelOpenGeneric &channe
                                    "Server attempted to open an unrequested X11 channel.");
     }
     SshX11Channel * const x11Channel = new SshX11Channel(m_x11DisplayInfo,
-                                                         m_nextLocalChannelId++,
+                                                         allocateChannelId(),
                                                          m_sendFacility);
     x11Channel->setParent(this);
     x11Channel->handleOpenSuccess(channelOpen.common.remoteChannel,
@@ -374,8 +386,10 @@ void SshChannelManager::handleChannelOpenX11(const SshChannelOpenGeneric &channe
 int SshChannelManager::closeAllChannels(CloseAllMode mode)
 {
     int count = 0;
-    for (ChannelIterator it = m_channels.begin(); it != m_channels.end(); ++it) {
-        AbstractSshChannel * const channel = it.value();
+    for (const ChannelSlot &slot : qAsConst(m_channels)) {
+        AbstractSshChannel * const channel = slot.channel;
+        if (!channel)
+            continue;
         QSSH_ASSERT(channel->channelState() != AbstractSshChannel::Closed);
         if (channel->channelState() != AbstractSshChannel::CloseRequested) {
             channel->closeChannel();
@@ -384,29 +398,56 @@ int SshChannelManager::closeAllChannels(CloseAllMode mode)
     }
     if (mode == CloseAllAndReset) {
         m_channels.clear();
-        m_sessions.clear();
+        m_freeChannelIds.clear();
+        m_channelCount = 0;
     }
     return count;
 }
 
+void SshChannelManager::restartReplyTimeouts()
+{
+    for (const ChannelSlot &slot : qAsConst(m_channels)) {
+        if (slot.channel)
+            slot.channel->restartReplyTimeout();
+    }
+}
+
 int SshChannelManager::channelCount() const
 {
-    return m_channels.count();
+    return m_channelCount;
 }
 
-void SshChannelManager::removeChannel(ChannelIterator it)
+QList<SshChannelStatistics> SshChannelManager::channelStatistics() const
 {
-    if (it == m_channels.end()) {
-        throw SshClientException(SshInternalError,
-                QLatin1String("Internal error: Unexpected channel lookup failure"));
+    QList<SshChannelStatistics> statistics;
+    statistics.reserve(m_channelCount);
+    for (const ChannelSlot &slot : m_channels) {
+        const AbstractSshChannel * const channel = slot.channel;
+        if (!channel)
+            continue;
+        SshChannelStatistics channelStatistics;
+        channelStatistics.localChannel = channel->localChannelId();
+        channelStatistics.queuedBytes = channel->bufferedDataSize();
+        channelStatistics.windowStalls = channel->windowStalls();
+        statistics << channelStatistics;
     }
-    const int removeCount = m_sessions.remove(it.value());
-    if (removeCount != 1) {
+    return statistics;
+}
+
+void SshChannelManager::removeChannel(quint32 channelId)
+{
+    if (channelId >= quint32(m_channels.count()) || !m_channels.at(channelId).channel) {
         throw SshClientException(SshInternalError,
-                QString::fromLatin1("Internal error: Unexpected session count %1 for channel.")
-                                 .arg(removeCount));
+                QLatin1String("Internal error: Unexpected channel lookup failure"));
     }
-    m_channels.erase(it);
+
+    // Release the session only after the slot is consistent again, as this may delete the channel.
+    ChannelSlot &slot = m_channels[channelId];
+    const QSharedPointer<QObject> session = slot.session;
+    slot.channel = nullptr;
+    slot.session.clear();
+    m_freeChannelIds.append(channelId);
+    --m_channelCount;
 }
 
 } // namespace Internal
@@ -33,15 +33,16 @@
 
 #include "sshx11displayinfo_p.h"
 
-#include <QHash>
 #include <QObject>
 #include <QSharedPointer>
+#include <QVector>
 
 namespace QSsh {
 class SftpChannel;
 class SshDirectTcpIpTunnel;
 class SshRemoteProcess;
 class SshTcpIpForwardServer;
+struct SshChannelStatistics;
 
 namespace Internal {
 
@@ -66,8 +67,13 @@ public:
             quint16 remotePort);
 
     int channelCount() const;
+    quint32 nextLocalChannelId() const {
+        return m_freeChannelIds.isEmpty() ? quint32(m_channels.count()) : m_freeChannelIds.last();
+    }
+    QList<SshChannelStatistics> channelStatistics() const;
     enum CloseAllMode { CloseAllRegular, CloseAllAndReset };
     int closeAllChannels(CloseAllMode mode);
+    void restartReplyTimeouts();
     QString x11DisplayName() const { return m_x11DisplayInfo.displayName; }
 
     void handleChannelRequest(const SshIncomingPacket &packet);
@@ -88,13 +94,16 @@ signals:
     void timeout();
 
 private:
-    typedef QHash<quint32, AbstractSshChannel *>::Iterator ChannelIterator;
+    // The public object owning the channel is kept alive by the slot until the channel is removed.
+    struct ChannelSlot {
+        AbstractSshChannel *channel = nullptr;
+        QSharedPointer<QObject> session;
+    };
 
-    ChannelIterator lookupChannelAsIterator(quint32 channelId,
-        bool allowNotFound = false);
+    quint32 allocateChannelId();
     AbstractSshChannel *lookupChannel(quint32 channelId,
         bool allowNotFound = false);
-    void removeChannel(ChannelIterator it);
+    void removeChannel(quint32 channelId);
     void insertChannel(AbstractSshChannel *priv,
         const QSharedPointer<QObject> &pub);
 
@@ -102,9 +111,12 @@ private:
     void handleChannelOpenX11(const SshChannelOpenGeneric &channelOpenGeneric);
 
     SshSendFacility &m_sendFacility;
-    QHash<quint32, AbstractSshChannel *> m_channels;
-    QHash<AbstractSshChannel *, QSharedPointer<QObject> > m_sessions;
-    quint32 m_nextLocalChannelId;
+
+    // Indexed by local channel id. Ids of removed channels go to the free list and are handed
+    // out again before the table grows, so it stays as dense as the peak number of channels.
+    QVector<ChannelSlot> m_channels;
+    QVector<quint32> m_freeChannelIds;
+    int m_channelCount;
     QList<QSharedPointer<SshTcpIpForwardServer>> m_waitingForwardServers;
     QList<QSharedPointer<SshTcpIpForwardServer>> m_listeningForwardServers;
     QList<SshRemoteProcessPrivate *> m_x11ForwardingRequests;
@@ -0,0 +1,99 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sshchunkedbuffer_p.h"
+
+#include <cstring>
+
+namespace QSsh {
+namespace Internal {
+
+void SshChunkedBuffer::append(const QByteArray &chunk)
+{
+    if (chunk.isEmpty())
+        return;
+    m_chunks << chunk;
+    m_size += chunk.size();
+}
+
+void SshChunkedBuffer::clear()
+{
+    m_chunks.clear();
+    m_size = 0;
+    m_firstChunkOffset = 0;
+}
+
+bool SshChunkedBuffer::contains(char c) const
+{
+    for (int i = 0; i < m_chunks.count(); ++i) {
+        if (m_chunks.at(i).indexOf(c, i == 0 ? m_firstChunkOffset : 0) != -1)
+            return true;
+    }
+    return false;
+}
+
+qint64 SshChunkedBuffer::read(char *data, qint64 maxlen)
+{
+    qint64 bytesRead = 0;
+    while (bytesRead < maxlen && !m_chunks.isEmpty()) {
+        const QByteArray &chunk = m_chunks.first();
+        const int bytesToCopy = qMin<qint64>(chunk.size() - m_firstChunkOffset, maxlen - bytesRead);
+        std::memcpy(data + bytesRead, chunk.constData() + m_firstChunkOffset, bytesToCopy);
+        bytesRead += bytesToCopy;
+        m_firstChunkOffset += bytesToCopy;
+        if (m_firstChunkOffset == chunk.size()) {
+            m_chunks.removeFirst();
+            m_firstChunkOffset = 0;
+        }
+    }
+    m_size -= bytesRead;
+    return bytesRead;
+}
+
+QByteArray SshChunkedBuffer::readChunk()
+{
+    if (m_chunks.isEmpty())
+        return QByteArray();
+    QByteArray chunk = m_chunks.takeFirst();
+    if (m_firstChunkOffset > 0) {
+        chunk = chunk.mid(m_firstChunkOffset);
+        m_firstChunkOffset = 0;
+    }
+    m_size -= chunk.size();
+    return chunk;
+}
+
+QByteArray SshChunkedBuffer::readAll()
+{
+    if (m_chunks.count() == 1)
+        return readChunk();
+    QByteArray data;
+    data.resize(m_size);
+    read(data.data(), data.size());
+    return data;
+}
+
+} // namespace Internal
+} // namespace QSsh
@@ -0,0 +1,61 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "ssh_global.h"
+
+#include <QByteArray>
+#include <QList>
+
+namespace QSsh {
+namespace Internal {
+
+// A FIFO of byte arrays. Incoming data is kept in the chunks it arrived in, so appending
+// never reallocates and consuming data never moves the remainder around.
+class QSSH_EXPORT SshChunkedBuffer
+{
+public:
+    SshChunkedBuffer() : m_size(0), m_firstChunkOffset(0) { }
+
+    void append(const QByteArray &chunk);
+    void clear();
+
+    qint64 size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    bool contains(char c) const;
+
+    qint64 read(char *data, qint64 maxlen);
+    QByteArray readChunk();
+    QByteArray readAll();
+
+private:
+    QList<QByteArray> m_chunks;
+    qint64 m_size;
+    int m_firstChunkOffset;
+};
+
+} // namespace Internal
+} // namespace QSsh
@@ -40,6 +40,8 @@
 #include "sshtcpipforwardserver.h"
 #include "sshexception_p.h"
 #include "sshkeyexchange_p.h"
+#include "sshpacketparser_p.h"
+#include "sshpackettrace_p.h"
 #include "sshremoteprocess.h"
 #include "sshlogging_p.h"
 
@@ -49,15 +51,29 @@
 #include <QNetworkProxy>
 #include <QRegularExpression>
 #include <QTcpSocket>
+#include <QThread>
+
+#include <limits>
 
 namespace QSsh {
 
 namespace {
 const QByteArray ClientId("SSH-2.0-QtCreator\r\n");
+
+// The agent keys that servers accepted in the past, so we can skip querying them.
+QMutex agentKeyCacheMutex;
+QHash<QString, QByteArray> acceptedAgentKeys;
+
+QString agentKeyCacheKey(const SshConnectionParameters &params)
+{
+    return params.userName() + QLatin1Char('@') + params.host() + QLatin1Char(':')
+            + QString::number(params.port());
+}
 }
 
 SshConnectionParameters::SshConnectionParameters() :
-    timeout(0), authenticationType(AuthenticationTypePublicKey),
+    timeout(0), rekeyByteLimit(Q_UINT64_C(1) << 30), rekeyInterval(3600), keepAliveInterval(10),
+    authenticationType(AuthenticationTypePublicKey),
     hostKeyCheckingMode(SshHostKeyCheckingNone)
 {
     url.setPort(0);
@@ -71,7 +87,11 @@ static inline bool equals(const SshConnectionParameters &p1, const SshConnection
             && p1.authenticationType == p2.authenticationType
             && p1.privateKeyFile == p2.privateKeyFile
             && p1.hostKeyCheckingMode == p2.hostKeyCheckingMode
-            && p1.timeout == p2.timeout;
+            && p1.timeout == p2.timeout
+            && p1.rekeyByteLimit == p2.rekeyByteLimit
+            && p1.rekeyInterval == p2.rekeyInterval
+            && p1.keepAliveInterval == p2.keepAliveInterval
+            && p1.packetTraceFile == p2.packetTraceFile;
 }
 
 bool operator==(const SshConnectionParameters &p1, const SshConnectionParameters &p2)
@@ -93,6 +113,8 @@ SshConnection::SshConnection(const SshConnectionParameters &serverInfo, QObject
     qRegisterMetaType<QSsh::SftpError>("QSsh::SftpError");
     qRegisterMetaType<QSsh::SftpError>("SftpError");
     qRegisterMetaType<QList <QSsh::SftpFileInfo> >("QList<QSsh::SftpFileInfo>");
+    qRegisterMetaType<QSsh::SftpJobStatistics>("QSsh::SftpJobStatistics");
+    qRegisterMetaType<QSsh::SshConnectionStatistics>("QSsh::SshConnectionStatistics");
 
     d = new Internal::SshConnectionPrivate(this, serverInfo);
     connect(d, &Internal::SshConnectionPrivate::connected, this, &SshConnection::connected,
@@ -103,6 +125,8 @@ SshConnection::SshConnection(const SshConnectionParameters &serverInfo, QObject
         Qt::QueuedConnection);
     connect(d, &Internal::SshConnectionPrivate::error, this,
             &SshConnection::error, Qt::QueuedConnection);
+    connect(d, &Internal::SshConnectionPrivate::statisticsUpdated, this,
+            &SshConnection::statisticsUpdated);
 }
 
 const QByteArray &SshConnection::hostKeyFingerprint() const
@@ -156,6 +180,23 @@ SshConnectionInfo SshConnection::connectionInfo() const
         d->m_socket->peerAddress(), d->m_socket->peerPort());
 }
 
+bool SshConnection::isResponsive() const
+{
+    return d->isResponsive();
+}
+
+bool SshConnection::canCreateChannels() const
+{
+    switch (state()) {
+    case Connected:
+        return true;
+    case Connecting:
+        return d->m_connParams.options.testFlag(SshOptimisticAuthentication);
+    default:
+        return false;
+    }
+}
+
 SshConnection::~SshConnection()
 {
     disconnect();
@@ -165,33 +206,33 @@ SshConnection::~SshConnection()
 
 QSharedPointer<SshRemoteProcess> SshConnection::createRemoteProcess(const QByteArray &command)
 {
-    QSSH_ASSERT_AND_RETURN_VALUE(state() == Connected, QSharedPointer<SshRemoteProcess>());
+    QSSH_ASSERT_AND_RETURN_VALUE(canCreateChannels(), QSharedPointer<SshRemoteProcess>());
     return d->createRemoteProcess(command);
 }
 
 QSharedPointer<SshRemoteProcess> SshConnection::createRemoteShell()
 {
-    QSSH_ASSERT_AND_RETURN_VALUE(state() == Connected, QSharedPointer<SshRemoteProcess>());
+    QSSH_ASSERT_AND_RETURN_VALUE(canCreateChannels(), QSharedPointer<SshRemoteProcess>());
     return d->createRemoteShell();
 }
 
 QSharedPointer<SftpChannel> SshConnection::createSftpChannel()
 {
-    QSSH_ASSERT_AND_RETURN_VALUE(state() == Connected, QSharedPointer<SftpChannel>());
+    QSSH_ASSERT_AND_RETURN_VALUE(canCreateChannels(), QSharedPointer<SftpChannel>());
     return d->createSftpChannel();
 }
 
 SshDirectTcpIpTunnel::Ptr SshConnection::createDirectTunnel(const QString &originatingHost,
         quint16 originatingPort, const QString &remoteHost, quint16 remotePort)
 {
-    QSSH_ASSERT_AND_RETURN_VALUE(state() == Connected, SshDirectTcpIpTunnel::Ptr());
+    QSSH_ASSERT_AND_RETURN_VALUE(canCreateChannels(), SshDirectTcpIpTunnel::Ptr());
     return d->createDirectTunnel(originatingHost, originatingPort, remoteHost, remotePort);
 }
 
 QSharedPointer<SshTcpIpForwardServer> SshConnection::createForwardServer(const QString &remoteHost,
         quint16 remotePort)
 {
-    QSSH_ASSERT_AND_RETURN_VALUE(state() == Connected, SshTcpIpForwardServer::Ptr());
+    QSSH_ASSERT_AND_RETURN_VALUE(canCreateChannels(), SshTcpIpForwardServer::Ptr());
     return d->createForwardServer(remoteHost, remotePort);
 }
 
@@ -215,6 +256,26 @@ QString SshConnection::x11DisplayName() const
     return d->m_channelManager->x11DisplayName();
 }
 
+SshConnectionStatistics SshConnection::statistics() const
+{
+    return d->statistics();
+}
+
+void SshConnection::setStatisticsInterval(int msecs)
+{
+    d->setStatisticsInterval(msecs);
+}
+
+int SshConnection::statisticsInterval() const
+{
+    return d->statisticsInterval();
+}
+
+bool SshConnection::savePacketTrace(const QString &filePath) const
+{
+    return d->savePacketTrace(filePath);
+}
+
 namespace Internal {
 
 SshConnectionPrivate::SshConnectionPrivate(SshConnection *conn,
@@ -222,10 +283,16 @@ SshConnectionPrivate::SshConnectionPrivate(SshConnection *conn,
     : m_socket(new QTcpSocket(this)), m_state(SocketUnconnected),
       m_sendFacility(m_socket),
       m_channelManager(new SshChannelManager(m_sendFacility, this)),
-      m_connParams(serverInfo), m_error(SshNoError), m_ignoreNextPacket(false),
-      m_conn(conn)
+      m_connParams(serverInfo), m_error(SshNoError),
+      m_bytesReceivedWithCurrentKeys(0), m_packetsReceivedWithCurrentKeys(0),
+      m_totalBytesReceived(0), m_payloadBytesReceived(0), m_packetsReceived(0),
+      m_rekeyCount(0), m_lastRekeyDuration(0), m_tcpConnectTime(-1), m_keyExchangeTime(-1),
+      m_authenticationTime(-1), m_queuedChannelBytes(0), m_handshakePhaseStart(0),
+      m_ignoreNextPacket(false),
+      m_conn(conn), m_extensionInfoReceived(false), m_authRequestPipelined(false),
+      m_usingCachedAgentKey(false)
 {
-    setupPacketHandlers();
+    m_sendFacility.setPacketTracer(&m_packetTracer);
 
     if (m_connParams.options & SshLowDelaySocket) {
         m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
@@ -238,7 +305,15 @@ SshConnectionPrivate::SshConnectionPrivate(SshConnection *conn,
     m_timeoutTimer.setInterval(m_connParams.timeout * 1000);
     m_keepAliveTimer.setTimerType(Qt::VeryCoarseTimer);
     m_keepAliveTimer.setSingleShot(true);
-    m_keepAliveTimer.setInterval(10000);
+    m_keepAliveTimer.setInterval(qMax(1, m_connParams.keepAliveInterval) * 1000);
+    m_rekeyTimer.setTimerType(Qt::VeryCoarseTimer);
+    m_rekeyTimer.setSingleShot(true);
+    m_rekeyTimer.setInterval(int(qMin<qint64>(m_connParams.rekeyInterval * qint64(1000),
+                                              std::numeric_limits<int>::max())));
+    connect(&m_rekeyTimer, &QTimer::timeout, this, &SshConnectionPrivate::initiateKeyExchange);
+    m_statisticsTimer.setTimerType(Qt::VeryCoarseTimer);
+    m_statisticsTimer.setInterval(1000);
+    connect(&m_statisticsTimer, &QTimer::timeout, this, &SshConnectionPrivate::publishStatistics);
     connect(m_channelManager, &SshChannelManager::timeout,
             this, &SshConnectionPrivate::handleTimeout);
 }
@@ -248,93 +323,64 @@ SshConnectionPrivate::~SshConnectionPrivate()
     disconnect();
 }
 
-void SshConnectionPrivate::setupPacketHandlers()
+constexpr SshConnectionPrivate::PacketHandlerTable SshConnectionPrivate::packetHandlerTable()
 {
     typedef SshConnectionPrivate This;
-
-    setupPacketHandler(SSH_MSG_KEXINIT, StateList() << SocketConnected
-        << ConnectionEstablished, &This::handleKeyExchangeInitPacket);
-    setupPacketHandler(SSH_MSG_KEXDH_REPLY, StateList() << SocketConnected
-        << ConnectionEstablished, &This::handleKeyExchangeReplyPacket);
-
-    setupPacketHandler(SSH_MSG_NEWKEYS, StateList() << SocketConnected
-        << ConnectionEstablished, &This::handleNewKeysPacket);
-    setupPacketHandler(SSH_MSG_SERVICE_ACCEPT,
-        StateList() << UserAuthServiceRequested,
-        &This::handleServiceAcceptPacket);
-    if (m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypePassword
-            || m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypeTryAllPasswordBasedMethods) {
-        setupPacketHandler(SSH_MSG_USERAUTH_PASSWD_CHANGEREQ,
-                StateList() << UserAuthRequested, &This::handlePasswordExpiredPacket);
-    }
-    setupPacketHandler(SSH_MSG_GLOBAL_REQUEST,
-        StateList() << ConnectionEstablished, &This::handleGlobalRequest);
-
-    const StateList authReqList = StateList() << UserAuthRequested;
-    setupPacketHandler(SSH_MSG_USERAUTH_BANNER, authReqList,
-        &This::handleUserAuthBannerPacket);
-    setupPacketHandler(SSH_MSG_USERAUTH_SUCCESS, authReqList,
-        &This::handleUserAuthSuccessPacket);
-    setupPacketHandler(SSH_MSG_USERAUTH_FAILURE, authReqList,
-        &This::handleUserAuthFailurePacket);
-    if (m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypeKeyboardInteractive
-            || m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypeTryAllPasswordBasedMethods) {
-        setupPacketHandler(SSH_MSG_USERAUTH_INFO_REQUEST, authReqList,
-                &This::handleUserAuthInfoRequestPacket);
-    }
-    setupPacketHandler(SSH_MSG_USERAUTH_PK_OK, authReqList, &This::handleUserAuthKeyOkPacket);
-
-    const StateList connectedList
-        = StateList() << ConnectionEstablished;
-    setupPacketHandler(SSH_MSG_CHANNEL_REQUEST, connectedList,
-        &This::handleChannelRequest);
-    setupPacketHandler(SSH_MSG_CHANNEL_OPEN, connectedList,
-        &This::handleChannelOpen);
-    setupPacketHandler(SSH_MSG_CHANNEL_OPEN_FAILURE, connectedList,
-        &This::handleChannelOpenFailure);
-    setupPacketHandler(SSH_MSG_CHANNEL_OPEN_CONFIRMATION, connectedList,
-        &This::handleChannelOpenConfirmation);
-    setupPacketHandler(SSH_MSG_CHANNEL_SUCCESS, connectedList,
-        &This::handleChannelSuccess);
-    setupPacketHandler(SSH_MSG_CHANNEL_FAILURE, connectedList,
-        &This::handleChannelFailure);
-    setupPacketHandler(SSH_MSG_CHANNEL_WINDOW_ADJUST, connectedList,
-        &This::handleChannelWindowAdjust);
-    setupPacketHandler(SSH_MSG_CHANNEL_DATA, connectedList,
-        &This::handleChannelData);
-    setupPacketHandler(SSH_MSG_CHANNEL_EXTENDED_DATA, connectedList,
-        &This::handleChannelExtendedData);
-
-    const StateList connectedOrClosedList
-        = StateList() << SocketUnconnected << ConnectionEstablished;
-    setupPacketHandler(SSH_MSG_CHANNEL_EOF, connectedOrClosedList,
-        &This::handleChannelEof);
-    setupPacketHandler(SSH_MSG_CHANNEL_CLOSE, connectedOrClosedList,
-        &This::handleChannelClose);
-
-    setupPacketHandler(SSH_MSG_DISCONNECT, StateList() << SocketConnected << WaitingForAgentKeys
-        << UserAuthServiceRequested << UserAuthRequested
-        << ConnectionEstablished, &This::handleDisconnect);
-
-    setupPacketHandler(SSH_MSG_UNIMPLEMENTED,
-        StateList() << ConnectionEstablished, &This::handleUnimplementedPacket);
-
-    setupPacketHandler(SSH_MSG_REQUEST_SUCCESS, connectedList,
-        &This::handleRequestSuccess);
-    setupPacketHandler(SSH_MSG_REQUEST_FAILURE, connectedList,
-        &This::handleRequestFailure);
-}
-
-void SshConnectionPrivate::setupPacketHandler(SshPacketType type,
-    const SshConnectionPrivate::StateList &states,
-    SshConnectionPrivate::PacketHandler handler)
-{
-    m_packetHandlers.insert(type, HandlerInStates(states, handler));
-}
+    static_assert(ConnectionEstablished < 32, "SshStateInternal does not fit into the state mask");
+
+    const quint32 authRequested = stateBit(UserAuthRequested);
+    const quint32 connected = stateBit(ConnectionEstablished);
+    const quint32 connectedOrClosed = stateBit(SocketUnconnected) | connected;
+
+    PacketHandlerTable table{};
+    table.entries[SSH_MSG_KEXINIT] = {stateBit(SocketConnected) | connected,
+                                      &This::handleKeyExchangeInitPacket};
+    table.entries[SSH_MSG_KEXDH_REPLY] = {stateBit(SocketConnected) | connected,
+                                          &This::handleKeyExchangeReplyPacket};
+    table.entries[SSH_MSG_NEWKEYS] = {stateBit(SocketConnected)
+            | stateBit(UserAuthServiceRequested) | connected, &This::handleNewKeysPacket};
+    table.entries[SSH_MSG_SERVICE_ACCEPT] = {stateBit(UserAuthServiceRequested),
+                                             &This::handleServiceAcceptPacket};
+    table.entries[SSH_MSG_EXT_INFO] = {stateBit(UserAuthServiceRequested)
+            | stateBit(WaitingForAgentKeys) | authRequested, &This::handleExtensionInfoPacket};
+    table.entries[SSH_MSG_GLOBAL_REQUEST] = {connected, &This::handleGlobalRequest};
+
+    table.entries[SSH_MSG_USERAUTH_BANNER] = {authRequested, &This::handleUserAuthBannerPacket};
+    table.entries[SSH_MSG_USERAUTH_SUCCESS] = {authRequested, &This::handleUserAuthSuccessPacket};
+    table.entries[SSH_MSG_USERAUTH_FAILURE] = {authRequested, &This::handleUserAuthFailurePacket};
+    table.entries[SSH_MSG_USERAUTH_PK_OK] = {authRequested, &This::handleAuthMethodSpecificPacket};
+
+    table.entries[SSH_MSG_CHANNEL_REQUEST] = {connected, &This::handleChannelRequest};
+    table.entries[SSH_MSG_CHANNEL_OPEN] = {connected, &This::handleChannelOpen};
+    table.entries[SSH_MSG_CHANNEL_OPEN_FAILURE] = {connected, &This::handleChannelOpenFailure};
+    table.entries[SSH_MSG_CHANNEL_OPEN_CONFIRMATION] = {connected,
+                                                        &This::handleChannelOpenConfirmation};
+    table.entries[SSH_MSG_CHANNEL_SUCCESS] = {connected, &This::handleChannelSuccess};
+    table.entries[SSH_MSG_CHANNEL_FAILURE] = {connected, &This::handleChannelFailure};
+    table.entries[SSH_MSG_CHANNEL_WINDOW_ADJUST] = {connected, &This::handleChannelWindowAdjust};
+    table.entries[SSH_MSG_CHANNEL_DATA] = {connected, &This::handleChannelData};
+    table.entries[SSH_MSG_CHANNEL_EXTENDED_DATA] = {connected, &This::handleChannelExtendedData};
+    table.entries[SSH_MSG_CHANNEL_EOF] = {connectedOrClosed, &This::handleChannelEof};
+    table.entries[SSH_MSG_CHANNEL_CLOSE] = {connectedOrClosed, &This::handleChannelClose};
+
+    table.entries[SSH_MSG_DISCONNECT] = {stateBit(SocketConnected) | stateBit(WaitingForAgentKeys)
+            | stateBit(UserAuthServiceRequested) | authRequested | connected,
+            &This::handleDisconnect};
+    table.entries[SSH_MSG_UNIMPLEMENTED] = {connected, &This::handleUnimplementedPacket};
+    table.entries[SSH_MSG_REQUEST_SUCCESS] = {connected, &This::handleRequestSuccess};
+    table.entries[SSH_MSG_REQUEST_FAILURE] = {connected, &This::handleRequestFailure};
+    return table;
+}
+
+const SshConnectionPrivate::PacketHandlerTable SshConnectionPrivate::PacketHandlers
+        = SshConnectionPrivate::packetHandlerTable();
 
 void SshConnectionPrivate::handleSocketConnected()
 {
     m_state = SocketConnected;
+    m_tcpConnectTime.store(finishHandshakePhase(), std::memory_order_relaxed);
+    if (m_statisticsTimer.interval() > 0)
+        m_statisticsTimer.start();
     sendData(ClientId);
 }
 
@@ -346,11 +392,15 @@ void SshConnectionPrivate::handleIncomingData()
     try {
         if (!canUseSocket())
             return;
-        m_incomingData += m_socket->readAll();
+        const QByteArray newData = m_socket->readAll();
+        m_bytesReceivedWithCurrentKeys += newData.size();
+        m_totalBytesReceived.fetch_add(newData.size(), std::memory_order_relaxed);
+        m_incomingData += newData;
         qCDebug(sshLog, "state = %d, remote data size = %d", int(m_state), int(m_incomingData.count()));
         if (m_serverId.isEmpty())
             handleServerId();
         handlePackets();
+        checkRekeyLimits();
     } catch (const SshServerException &e) {
         closeConnection(e.error, SshProtocolError, e.errorStringServer,
             tr("SSH Protocol error: %1").arg(e.errorStringUser));
@@ -459,22 +509,36 @@ void SshConnectionPrivate::handleCurrentPacket()
     Q_ASSERT(m_incomingPacket.isComplete());
     Q_ASSERT(m_keyExchangeState == DhInitSent || !m_ignoreNextPacket);
 
+    ++m_packetsReceivedWithCurrentKeys;
+    m_packetsReceived.fetch_add(1, std::memory_order_relaxed);
+    m_payloadBytesReceived.fetch_add(m_incomingPacket.payLoadSize(), std::memory_order_relaxed);
+    if (m_packetTracer.isActive()) {
+        m_packetTracer.recordIncoming(m_incomingPacket.serverSeqNr() - 1,
+                                      m_incomingPacket.payLoadView());
+    }
     if (m_ignoreNextPacket) {
         m_ignoreNextPacket = false;
         return;
     }
 
-    QHash<SshPacketType, HandlerInStates>::ConstIterator it
-        = m_packetHandlers.constFind(m_incomingPacket.type());
-    if (it == m_packetHandlers.constEnd()) {
+    const SshPacketType type = m_incomingPacket.type();
+
+    // By far the most frequent case; spare it the indirect call.
+    if (type == SSH_MSG_CHANNEL_DATA && m_state == ConnectionEstablished) {
+        m_channelManager->handleChannelData(m_incomingPacket);
+        return;
+    }
+
+    const PacketHandlerEntry &entry = PacketHandlers.entries[quint8(type)];
+    if (!entry.handler) {
         m_sendFacility.sendMsgUnimplementedPacket(m_incomingPacket.serverSeqNr());
         return;
     }
-    if (!it.value().first.contains(m_state)) {
+    if (!(entry.states & stateBit(m_state))) {
         handleUnexpectedPacket();
         return;
     }
-    (this->*it.value().second)();
+    (this->*entry.handler)();
 }
 
 void SshConnectionPrivate::handleKeyExchangeInitPacket()
@@ -486,10 +550,12 @@ void SshConnectionPrivate::handleKeyExchangeInitPacket()
             .arg(m_incomingPacket.type()));
     }
 
-    // Server-initiated re-exchange.
+    // Server-initiated re-exchange. We know the server's list already, so there is nothing to guess.
     if (m_keyExchangeState == NoKeyExchange) {
         m_keyExchange.reset(new SshKeyExchange(m_connParams, m_sendFacility));
-        m_keyExchange->sendKexInitPacket(m_serverId);
+        m_keyExchange->sendKexInitPacket(m_serverId, false);
+        if (m_state == ConnectionEstablished)
+            m_keyExchangeTimer.start();
     }
 
     // If the server sends a guessed packet, the guess must be wrong,
@@ -515,6 +581,12 @@ void SshConnectionPrivate::handleKeyExchangeReplyPacket()
     m_hostFingerprint = m_keyExchange->hostKeyFingerprint();
     m_sendFacility.recreateKeys(*m_keyExchange);
     m_keyExchangeState = NewKeysSent;
+
+    if (m_state == SocketConnected && (m_connParams.options & SshOptimisticAuthentication)) {
+        m_sendFacility.sendUserAuthServiceRequestPacket();
+        m_state = UserAuthServiceRequested;
+        sendPipelinedAuthRequest();
+    }
 }
 
 void SshConnectionPrivate::handleNewKeysPacket()
@@ -528,15 +600,103 @@ void SshConnectionPrivate::handleNewKeysPacket()
     m_incomingPacket.recreateKeys(*m_keyExchange);
     m_keyExchange.reset();
     m_keyExchangeState = NoKeyExchange;
+    m_bytesReceivedWithCurrentKeys = 0;
+    m_packetsReceivedWithCurrentKeys = 0;
+    if (m_keyExchangeTime.load(std::memory_order_relaxed) < 0)
+        m_keyExchangeTime.store(finishHandshakePhase(), std::memory_order_relaxed);
 
     if (m_state == SocketConnected) {
         m_sendFacility.sendUserAuthServiceRequestPacket();
         m_state = UserAuthServiceRequested;
+    } else if (m_state == ConnectionEstablished && m_keyExchangeTimer.isValid()) {
+        const int rekeyCount = m_rekeyCount.fetch_add(1, std::memory_order_relaxed) + 1;
+        const qint64 rekeyDuration = m_keyExchangeTimer.elapsed();
+        m_lastRekeyDuration.store(rekeyDuration, std::memory_order_relaxed);
+        m_keyExchangeTimer.invalidate();
+        qCDebug(sshLog, "Key re-exchange #%d took %lld ms", rekeyCount,
+                static_cast<long long>(rekeyDuration));
+        if (m_connParams.rekeyInterval > 0)
+            m_rekeyTimer.start();
+    }
+}
+
+void SshConnectionPrivate::handleExtensionInfoPacket()
+{
+    const SshExtensionInfo &msg = m_incomingPacket.extractExtensionInfo();
+    const QByteArray sigAlgs = msg.extensions.value(SshCapabilities::ServerSigAlgsExtension);
+    if (sigAlgs.isEmpty())
+        return;
+    qCDebug(sshLog, "server accepts signature algorithms %s", sigAlgs.constData());
+    m_sendFacility.setServerSignatureAlgorithms(sigAlgs.split(','));
+    m_extensionInfoReceived = true;
+
+    // We might have held back the authentication request because of the signature algorithm.
+    if (m_state == UserAuthServiceRequested && !m_authRequestPipelined
+            && (m_connParams.options & SshOptimisticAuthentication)) {
+        sendPipelinedAuthRequest();
+    }
+}
+
+// Sends the authentication request right behind the service request, if we can do so
+// without the server's help. Otherwise, we wait for SSH_MSG_SERVICE_ACCEPT as usual.
+void SshConnectionPrivate::sendPipelinedAuthRequest()
+{
+    switch (m_connParams.authenticationType) {
+    case SshConnectionParameters::AuthenticationTypePassword:
+        m_sendFacility.sendUserAuthByPasswordRequestPacket(m_connParams.userName().toUtf8(),
+                SshCapabilities::SshConnectionService, m_connParams.password().toUtf8());
+        break;
+    case SshConnectionParameters::AuthenticationTypePublicKey:
+        if (!signatureAlgorithmIsFinal(m_sendFacility.authenticationAlgorithmName()))
+            return;
+        authenticateWithPublicKey();
+        break;
+    case SshConnectionParameters::AuthenticationTypeAgent: {
+        if (!(m_connParams.options & SshRememberAcceptedAgentKeys))
+            return;
+        QByteArray key;
+        {
+            QMutexLocker locker(&agentKeyCacheMutex);
+            key = acceptedAgentKeys.value(agentKeyCacheKey(m_connParams));
+        }
+        if (key.isEmpty() || !SshAgent::publicKeys().contains(key))
+            return;
+        const QByteArray keyType = SshPacketParser::asString(key, quint32(0));
+        if (!signatureAlgorithmIsFinal(m_sendFacility.signatureAlgorithmName(keyType)))
+            return;
+
+        // The server accepted this key before, so we skip the query. If it does not anymore,
+        // we fall back to trying all keys.
+        qCDebug(sshLog) << "requesting signature for previously accepted key from agent";
+        m_usingCachedAgentKey = true;
+        m_agentKeyToUse = key;
+        m_sendFacility.prepareAgentSignature(m_connParams.userName().toUtf8(),
+                SshCapabilities::SshConnectionService, key);
+        SshAgent::requestSignature(key, tokenForAgent());
+        m_authRequestPipelined = true;
+        return;
+    }
+    default:
+        return; // These need more than one round trip anyway.
     }
+
+    m_authRequestPipelined = true;
+}
+
+// Before the server has told us otherwise, RSA keys have to be used with SHA-1,
+// which many servers reject these days.
+bool SshConnectionPrivate::signatureAlgorithmIsFinal(const QByteArray &algorithm) const
+{
+    return m_extensionInfoReceived || algorithm != SshCapabilities::PubKeyRsa;
 }
 
 void SshConnectionPrivate::handleServiceAcceptPacket()
 {
+    if (m_authRequestPipelined) {
+        m_state = UserAuthRequested;
+        return;
+    }
+
     switch (m_connParams.authenticationType) {
     case SshConnectionParameters::AuthenticationTypeTryAllPasswordBasedMethods:
         m_triedAllPasswordBasedMethods = false;
@@ -567,6 +727,30 @@ void SshConnectionPrivate::handleServiceAcceptPacket()
     m_state = UserAuthRequested;
 }
 
+// RFC 4252, 7 and RFC 4256, 3.2: The meaning of message 60 depends on the authentication method.
+void SshConnectionPrivate::handleAuthMethodSpecificPacket()
+{
+    switch (m_connParams.authenticationType) {
+    case SshConnectionParameters::AuthenticationTypePassword:
+        handlePasswordExpiredPacket();
+        break;
+    case SshConnectionParameters::AuthenticationTypeKeyboardInteractive:
+        handleUserAuthInfoRequestPacket();
+        break;
+    case SshConnectionParameters::AuthenticationTypeTryAllPasswordBasedMethods:
+        // "keyboard-interactive" is only attempted after "password" has failed.
+        if (m_triedAllPasswordBasedMethods)
+            handleUserAuthInfoRequestPacket();
+        else
+            handlePasswordExpiredPacket();
+        break;
+    case SshConnectionParameters::AuthenticationTypePublicKey:
+    case SshConnectionParameters::AuthenticationTypeAgent:
+        handleUserAuthKeyOkPacket();
+        break;
+    }
+}
+
 void SshConnectionPrivate::handlePasswordExpiredPacket()
 {
     if (m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypeTryAllPasswordBasedMethods
@@ -619,16 +803,46 @@ void SshConnectionPrivate::handleGlobalRequest()
 
 void SshConnectionPrivate::handleUserAuthSuccessPacket()
 {
+    if (m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypeAgent
+            && !m_agentKeyToUse.isEmpty()) {
+        disconnect(&SshAgent::instance(), nullptr, this, nullptr);
+        if (m_connParams.options & SshRememberAcceptedAgentKeys) {
+            QMutexLocker locker(&agentKeyCacheMutex);
+            acceptedAgentKeys.insert(agentKeyCacheKey(m_connParams), m_agentKeyToUse);
+        }
+    }
+
     m_state = ConnectionEstablished;
+    m_authenticationTime.store(finishHandshakePhase(), std::memory_order_relaxed);
     m_timeoutTimer.stop();
+    if (m_connParams.options & SshOptimisticAuthentication) {
+        // Channels opened while we were waiting for the server go first.
+        m_sendFacility.releaseConnectionPackets();
+        m_channelManager->restartReplyTimeouts();
+    }
     emit connected();
     m_lastInvalidMsgSeqNr = InvalidSeqNr;
     connect(&m_keepAliveTimer, &QTimer::timeout, this, &SshConnectionPrivate::sendKeepAlivePacket);
     m_keepAliveTimer.start();
+    if (m_connParams.rekeyInterval > 0)
+        m_rekeyTimer.start();
 }
 
 void SshConnectionPrivate::handleUserAuthFailurePacket()
 {
+    if (m_usingCachedAgentKey) {
+        qCDebug(sshLog) << "server no longer accepts the key, trying all agent keys";
+        {
+            QMutexLocker locker(&agentKeyCacheMutex);
+            acceptedAgentKeys.remove(agentKeyCacheKey(m_connParams));
+        }
+        m_usingCachedAgentKey = false;
+        m_agentKeyToUse.clear();
+        m_agentSignature.clear();
+        tryAllAgentKeys();
+        return;
+    }
+
     if (!m_pendingKeyChecks.isEmpty()) {
         const QByteArray key = m_pendingKeyChecks.dequeue();
         SshAgent::removeDataToSign(key, tokenForAgent());
@@ -795,6 +1009,14 @@ uint SshConnectionPrivate::tokenForAgent() const
     return qHash(m_sendFacility.sessionId());
 }
 
+void SshConnectionPrivate::handleSocketBytesWritten()
+{
+    if (m_state == ConnectionEstablished) {
+        m_sendFacility.sendScheduledChannelData();
+        checkRekeyLimits();
+    }
+}
+
 void SshConnectionPrivate::handleSocketDisconnected()
 {
     closeConnection(SSH_DISCONNECT_CONNECTION_LOST, SshClosedByServerError,
@@ -829,9 +1051,57 @@ void SshConnectionPrivate::sendKeepAlivePacket()
     Q_ASSERT(m_lastInvalidMsgSeqNr == InvalidSeqNr);
     m_lastInvalidMsgSeqNr = m_sendFacility.nextClientSeqNr();
     m_sendFacility.sendInvalidPacket();
+    m_keepAliveProbeTimer.start();
     m_timeoutTimer.start();
 }
 
+void SshConnectionPrivate::checkRekeyLimits()
+{
+    if (m_state != ConnectionEstablished || m_keyExchangeState != NoKeyExchange)
+        return;
+
+    // RFC 4344, 3.1: Rekey at the latest after 2^31 packets in either direction.
+    const quint32 maxPacketsPerKey = 1u << 31;
+    const quint64 byteLimit = m_connParams.rekeyByteLimit;
+    if ((byteLimit > 0 && (m_sendFacility.bytesSentWithCurrentKeys() >= byteLimit
+                           || m_bytesReceivedWithCurrentKeys >= byteLimit))
+            || m_sendFacility.packetsSentWithCurrentKeys() >= maxPacketsPerKey
+            || m_packetsReceivedWithCurrentKeys >= maxPacketsPerKey) {
+        initiateKeyExchange();
+    }
+}
+
+// Channel traffic is not interrupted: Whatever gets sent while the exchange is in progress
+// is held back by the send facility and goes out under the new keys.
+void SshConnectionPrivate::initiateKeyExchange()
+{
+    if (m_state != ConnectionEstablished || m_keyExchangeState != NoKeyExchange)
+        return;
+
+    qCDebug(sshLog, "Initiating key re-exchange");
+    m_rekeyTimer.stop();
+    try {
+        m_keyExchange.reset(new SshKeyExchange(m_connParams, m_sendFacility));
+        m_keyExchange->sendKexInitPacket(m_serverId);
+        m_keyExchangeState = KexInitSent;
+        m_keyExchangeTimer.start();
+    } catch (const std::exception &e) {
+        closeConnection(SSH_DISCONNECT_BY_APPLICATION, SshInternalError, "",
+            tr("Botan library exception: %1").arg(QString::fromLocal8Bit(e.what())));
+    }
+}
+
+bool SshConnectionPrivate::isResponsive() const
+{
+    // A healthy server answers our keep-alive probes within a few seconds,
+    // and certainly before the next one would be due.
+    static const qint64 MaxProbeReplyTime = 5000;
+    return m_state == ConnectionEstablished
+            && (m_lastInvalidMsgSeqNr == InvalidSeqNr
+                || m_keepAliveProbeTimer.elapsed() < qMin<qint64>(MaxProbeReplyTime,
+                                                                  m_keepAliveTimer.interval()));
+}
+
 void SshConnectionPrivate::handleAgentKeysUpdated()
 {
     m_agentKeysUpToDate = true;
@@ -874,8 +1144,10 @@ void SshConnectionPrivate::authenticateWithPublicKey()
     QByteArray key;
     QByteArray signature;
     if (m_connParams.authenticationType == SshConnectionParameters::AuthenticationTypeAgent) {
-        // Agent is not needed anymore after this point.
-        disconnect(&SshAgent::instance(), nullptr, this, nullptr);
+        // Agent is not needed anymore after this point, unless the server rejects
+        // a key that it accepted before.
+        if (!m_usingCachedAgentKey)
+            disconnect(&SshAgent::instance(), nullptr, this, nullptr);
 
         key = m_agentKeyToUse;
         signature = m_agentSignature;
@@ -899,6 +1171,8 @@ void SshConnectionPrivate::connectToHost()
     m_incomingData.clear();
     m_incomingPacket.reset();
     m_sendFacility.reset();
+    if (m_connParams.options & SshOptimisticAuthentication)
+        m_sendFacility.holdBackConnectionPackets();
     m_error = SshNoError;
     m_ignoreNextPacket = false;
     m_errorString.clear();
@@ -908,6 +1182,25 @@ void SshConnectionPrivate::connectToHost()
     m_agentKeysUpToDate = false;
     m_pendingKeyChecks.clear();
     m_agentKeyToUse.clear();
+    m_extensionInfoReceived = false;
+    m_authRequestPipelined = false;
+    m_usingCachedAgentKey = false;
+    m_bytesReceivedWithCurrentKeys = 0;
+    m_packetsReceivedWithCurrentKeys = 0;
+    m_totalBytesReceived = 0;
+    m_payloadBytesReceived = 0;
+    m_packetsReceived = 0;
+    m_rekeyCount = 0;
+    m_lastRekeyDuration = 0;
+    m_tcpConnectTime = -1;
+    m_keyExchangeTime = -1;
+    m_authenticationTime = -1;
+    m_queuedChannelBytes = 0;
+    m_keyExchangeTimer.invalidate();
+    m_handshakeTimer.start();
+    m_handshakePhaseStart = 0;
+    if ((m_connParams.options & SshTracePackets) || !m_connParams.packetTraceFile.isEmpty())
+        m_packetTracer.start(m_connParams.packetTraceFile);
 
     switch (m_connParams.authenticationType) {
     case SshConnectionParameters::AuthenticationTypePublicKey:
@@ -941,6 +1234,8 @@ void SshConnectionPrivate::connectToHost()
             this, &SshConnectionPrivate::handleSocketConnected);
     connect(m_socket, &QIODevice::readyRead,
             this, &SshConnectionPrivate::handleIncomingData);
+    connect(m_socket, &QIODevice::bytesWritten,
+            this, &SshConnectionPrivate::handleSocketBytesWritten);
     connect(m_socket, &QAbstractSocket::errorOccurred, this, &SshConnectionPrivate::handleSocketError);
     connect(m_socket, &QAbstractSocket::disconnected,
             this, &SshConnectionPrivate::handleSocketDisconnected);
@@ -966,8 +1261,12 @@ void SshConnectionPrivate::closeConnection(SshErrorCode sshError,
     disconnect(&m_timeoutTimer, nullptr, this, nullptr);
     m_keepAliveTimer.stop();
     disconnect(&m_keepAliveTimer, nullptr, this, nullptr);
+    m_rekeyTimer.stop();
+    m_statisticsTimer.stop();
+    m_queuedChannelBytes = 0;
     try {
         m_channelManager->closeAllChannels(SshChannelManager::CloseAllAndReset);
+        m_sendFacility.discardHeldBackPackets();
 
         // Crypto initialization failed
         if (m_sendFacility.encrypterIsValid()) {
@@ -983,6 +1282,77 @@ void SshConnectionPrivate::closeConnection(SshErrorCode sshError,
     m_state = SocketUnconnected;
 }
 
+bool SshConnectionPrivate::savePacketTrace(const QString &filePath) const
+{
+    if (!m_packetTracer.isActive())
+        return false;
+    QString error;
+    if (!m_packetTracer.save(filePath, &error)) {
+        qCWarning(sshLog, "Cannot write packet trace to \"%s\": %s", qPrintable(filePath),
+                  qPrintable(error));
+        return false;
+    }
+    return true;
+}
+
+SshConnectionStatistics SshConnectionPrivate::statistics() const
+{
+    SshConnectionStatistics statistics;
+    statistics.bytesSent = m_sendFacility.totalBytesSent();
+    statistics.bytesReceived = m_totalBytesReceived.load(std::memory_order_relaxed);
+    statistics.payloadBytesSent = m_sendFacility.payloadBytesSent();
+    statistics.payloadBytesReceived = m_payloadBytesReceived.load(std::memory_order_relaxed);
+    statistics.packetsSent = m_sendFacility.packetsSent();
+    statistics.packetsReceived = m_packetsReceived.load(std::memory_order_relaxed);
+    statistics.encryptionTime = m_sendFacility.encryptionTime();
+    statistics.decryptionTime = m_incomingPacket.decryptionTime();
+    statistics.macTime = m_sendFacility.macTime() + m_incomingPacket.macTime();
+    statistics.tcpConnectTime = m_tcpConnectTime.load(std::memory_order_relaxed);
+    statistics.keyExchangeTime = m_keyExchangeTime.load(std::memory_order_relaxed);
+    statistics.authenticationTime = m_authenticationTime.load(std::memory_order_relaxed);
+    statistics.rekeyCount = m_rekeyCount.load(std::memory_order_relaxed);
+    statistics.lastRekeyDuration = m_lastRekeyDuration.load(std::memory_order_relaxed);
+    statistics.windowStalls = m_sendFacility.windowStalls();
+
+    // The channels themselves must not be touched from other threads.
+    if (QThread::currentThread() == thread()) {
+        statistics.channels = m_channelManager->channelStatistics();
+        for (const SshChannelStatistics &channel : qAsConst(statistics.channels))
+            statistics.queuedBytes += channel.queuedBytes;
+    } else {
+        statistics.queuedBytes = m_queuedChannelBytes.load(std::memory_order_relaxed);
+    }
+    return statistics;
+}
+
+void SshConnectionPrivate::setStatisticsInterval(int msecs)
+{
+    QSSH_ASSERT_AND_RETURN(msecs >= 0);
+    if (msecs == 0)
+        m_statisticsTimer.stop();
+    m_statisticsTimer.setInterval(msecs);
+    if (msecs > 0 && !m_statisticsTimer.isActive() && m_state != SocketUnconnected
+            && m_state != SocketConnecting) {
+        m_statisticsTimer.start();
+    }
+}
+
+void SshConnectionPrivate::publishStatistics()
+{
+    const SshConnectionStatistics statistics = this->statistics();
+    m_queuedChannelBytes.store(statistics.queuedBytes, std::memory_order_relaxed);
+    emit statisticsUpdated(statistics);
+}
+
+// Returns the milliseconds since the previous handshake phase ended.
+qint64 SshConnectionPrivate::finishHandshakePhase()
+{
+    const qint64 now = m_handshakeTimer.elapsed();
+    const qint64 phaseDuration = now - m_handshakePhaseStart;
+    m_handshakePhaseStart = now;
+    return phaseDuration;
+}
+
 bool SshConnectionPrivate::canUseSocket() const
 {
     return m_socket->isValid()
@@ -38,6 +38,7 @@
 
 #include <QByteArray>
 #include <QFlags>
+#include <QList>
 #include <QMetaType>
 #include <QObject>
 #include <QSharedPointer>
@@ -52,7 +53,9 @@ class SshRemoteProcess;
 class SshTcpIpForwardServer;
 
 namespace Internal {
+class SshConnectionManager;
 class SshConnectionPrivate;
+class SshPacketReplayer;
 } // namespace Internal
 
 /*!
@@ -66,7 +69,23 @@ enum SshConnectionOption {
     SshEnableStrictConformanceChecks = 0x2,
 
     /// Set the QAbstractSocket::LowDelayOption, which is the same as TCP_NODELAY
-    SshLowDelaySocket = 0x4
+    SshLowDelaySocket = 0x4,
+
+    /// Send the authentication requests without waiting for each server reply.
+    /// With password or key file authentication, the request goes out right behind the
+    /// service request. connected() is still only emitted once the server has accepted it,
+    /// but channels can be created before, see SshConnection::canCreateChannels().
+    SshOptimisticAuthentication = 0x8,
+
+    /// Keep a compact record of the most recent packets, see SshConnection::savePacketTrace().
+    /// Setting SshConnectionParameters::packetTraceFile implies this.
+    SshTracePackets = 0x10,
+
+    /// With ssh-agent and SshOptimisticAuthentication, remember which agent key a server
+    /// accepted and offer it right away the next time, without querying all keys first.
+    /// The record is kept per user, host and port for the lifetime of the process and is
+    /// shared by all connections that set this option.
+    SshRememberAcceptedAgentKeys = 0x20
 };
 
 Q_DECLARE_FLAGS(SshConnectionOptions, SshConnectionOption)
@@ -165,10 +184,27 @@ public:
     QUrl url;
     QString privateKeyFile;
     int timeout; // In seconds.
+
+    /// A new key exchange is started once this many bytes have been sent or received
+    /// with the current keys. 0 disables the limit.
+    quint64 rekeyByteLimit;
+
+    /// A new key exchange is started after this many seconds. 0 disables the limit.
+    int rekeyInterval;
+
+    /// An established connection probes the server every this many seconds,
+    /// see SshConnection::isResponsive().
+    int keepAliveInterval;
+
     AuthenticationType authenticationType;
     SshConnectionOptions options;
     SshHostKeyCheckingMode hostKeyCheckingMode;
     SshHostKeyDatabasePtr hostKeyDatabase;
+
+    /// If set, every packet is recorded into this file, together with the decrypted payloads
+    /// of the incoming ones, so that qssh-replay can replay the session. The file is thus as
+    /// sensitive as the session itself.
+    QString packetTraceFile;
 };
 
 /// @cond
@@ -192,6 +228,42 @@ public:
     quint16 peerPort;
 };
 
+struct SshChannelStatistics
+{
+    quint32 localChannel = 0;
+    quint32 queuedBytes = 0;  // Waiting for the scheduler or for the remote window.
+    quint32 windowStalls = 0; // Times the remote window ran out while data was queued.
+};
+
+/*!
+ * \brief Transport counters of one connection, see SshConnection::statistics()
+ * Compression is never negotiated, so the payload counts stand in for the uncompressed
+ * traffic: they leave out the length field, padding and MAC that the byte counts include.
+ */
+struct SshConnectionStatistics
+{
+    quint64 bytesSent = 0;
+    quint64 bytesReceived = 0;
+    quint64 payloadBytesSent = 0;
+    quint64 payloadBytesReceived = 0;
+    quint64 packetsSent = 0;
+    quint64 packetsReceived = 0;
+
+    qint64 encryptionTime = 0; // In nanoseconds, as are the two below.
+    qint64 decryptionTime = 0;
+    qint64 macTime = 0;        // Generating and verifying MACs.
+
+    qint64 tcpConnectTime = -1; // Handshake phases in milliseconds; -1 until completed.
+    qint64 keyExchangeTime = -1;
+    qint64 authenticationTime = -1;
+
+    int rekeyCount = 0;
+    qint64 lastRekeyDuration = 0; // In milliseconds.
+
+    quint64 queuedBytes = 0;  // Summed over all open channels.
+    quint64 windowStalls = 0; // Summed over all channels this connection has had.
+    QList<SshChannelStatistics> channels;
+};
 
 /*!
     \class QSsh::SshConnection
@@ -236,6 +308,22 @@ public:
     QString errorString() const;
     SshConnectionParameters connectionParameters() const;
     SshConnectionInfo connectionInfo() const;
+
+    /*!
+     * \brief Whether the server still answers
+     * An established connection probes the server every few seconds, see
+     * SshConnectionParameters::keepAliveInterval. If the answer to such a probe is overdue,
+     * the connection is most likely dead, even if the socket does not know it yet.
+     */
+    bool isResponsive() const;
+
+    /*!
+     * \brief Whether the create functions below may be called now
+     * This is the case once the connection is established or, with SshOptimisticAuthentication,
+     * as soon as connectToHost() has been called. The requests of channels created early are
+     * held back until the server has accepted the credentials, and dropped if it does not.
+     */
+    bool canCreateChannels() const;
     ~SshConnection();
 
     /*!
@@ -265,6 +353,29 @@ public:
      */
     QString x11DisplayName() const;
 
+    /*!
+     * \brief Returns the connection's transport counters
+     * Unlike the rest of this class, this may be called from any thread; it does not lock.
+     * From other threads, the channel figures are those of the last statisticsUpdated()
+     * and \a channels stays empty.
+     */
+    SshConnectionStatistics statistics() const;
+
+    /*!
+     * \brief How often statisticsUpdated() is emitted while connected
+     * \param msecs Interval in milliseconds; 0 stops the updates. The default is one second.
+     */
+    void setStatisticsInterval(int msecs);
+    int statisticsInterval() const;
+
+    /*!
+     * \brief Writes the packets recorded since connectToHost() to a file
+     * Only the most recent 4096 packets are kept, and only their headers: type, sequence number,
+     * channel, size and time. Requires \ref SshTracePackets.
+     * \return false if tracing is off or the file cannot be written.
+     */
+    bool savePacketTrace(const QString &filePath) const;
+
 signals:
     /*!
      * \brief Emitted when ready for use
@@ -287,12 +398,21 @@ signals:
      */
     void error(QSsh::SshError);
 
+    /*!
+     * \brief Emitted periodically while connected, see setStatisticsInterval()
+     */
+    void statisticsUpdated(const QSsh::SshConnectionStatistics &statistics);
+
 private:
+    friend class Internal::SshConnectionManager;
+    friend class Internal::SshPacketReplayer;
+
     Internal::SshConnectionPrivate *d;
 };
 
 } // namespace QSsh
 
 Q_DECLARE_METATYPE(QSsh::SshConnectionParameters::AuthenticationType)
+Q_DECLARE_METATYPE(QSsh::SshConnectionStatistics)
 
 #endif // SSHCONNECTION_H
@@ -34,8 +34,10 @@
 #include "sshconnection.h"
 #include "sshexception_p.h"
 #include "sshincomingpacket_p.h"
+#include "sshpackettrace_p.h"
 #include "sshsendfacility_p.h"
 
+#include <QElapsedTimer>
 #include <QHash>
 #include <QList>
 #include <QQueue>
@@ -44,6 +46,8 @@
 #include <QScopedPointer>
 #include <QTimer>
 
+#include <atomic>
+
 QT_BEGIN_NAMESPACE
 class QTcpSocket;
 QT_END_NAMESPACE
@@ -57,7 +61,7 @@ class SshTcpIpForwardServer;
 namespace Internal {
 class SshChannelManager;
 
-// NOTE: When you add stuff here, don't forget to update m_packetHandlers.
+// NOTE: When you add stuff here, don't forget to update packetHandlerTable().
 enum SshStateInternal {
     SocketUnconnected, // initial and after disconnect
     SocketConnecting, // After connectToHost()
@@ -81,6 +85,7 @@ class SshConnectionPrivate : public QObject
 {
     Q_OBJECT
     friend class QSsh::SshConnection;
+    friend class SshPacketReplayer;
 public:
     SshConnectionPrivate(SshConnection *conn,
         const SshConnectionParameters &serverInfo);
@@ -98,28 +103,44 @@ public:
             quint16 remotePort);
 
     SshStateInternal state() const { return m_state; }
+    bool isResponsive() const;
+    quint64 bytesTransferred() const {
+        return m_sendFacility.totalBytesSent() + m_totalBytesReceived;
+    }
     SshError errorState() const { return m_error; }
     QString errorString() const { return m_errorString; }
     const QByteArray &hostKeyFingerprint() const { return m_hostFingerprint; }
+    SshConnectionStatistics statistics() const;
+    void setStatisticsInterval(int msecs);
+    int statisticsInterval() const { return m_statisticsTimer.interval(); }
+    bool savePacketTrace(const QString &filePath) const;
 
 signals:
     void connected();
     void disconnected();
     void dataAvailable(const QString &message);
     void error(QSsh::SshError);
+    void statisticsUpdated(const QSsh::SshConnectionStatistics &statistics);
 
 private:
     void handleSocketConnected();
     void handleIncomingData();
+    void handleSocketBytesWritten();
     void handleSocketError();
     void handleSocketDisconnected();
     void handleTimeout();
     void sendKeepAlivePacket();
+    void checkRekeyLimits();
+    void initiateKeyExchange();
+    void publishStatistics();
+    qint64 finishHandshakePhase();
 
     void handleAgentKeysUpdated();
     void handleSignatureFromAgent(const QByteArray &key, const QByteArray &signature, uint token);
     void tryAllAgentKeys();
     void authenticateWithPublicKey();
+    void sendPipelinedAuthRequest();
+    bool signatureAlgorithmIsFinal(const QByteArray &algorithm) const;
     void setAgentError();
 
     void handleServerId();
@@ -129,6 +150,7 @@ private:
     void handleKeyExchangeReplyPacket();
     void handleNewKeysPacket();
     void handleServiceAcceptPacket();
+    void handleExtensionInfoPacket();
     void handlePasswordExpiredPacket();
     void handleUserAuthInfoRequestPacket();
     void handleUserAuthSuccessPacket();
@@ -162,13 +184,18 @@ private:
     uint tokenForAgent() const;
 
     typedef void (SshConnectionPrivate::*PacketHandler)();
-    typedef QList<SshStateInternal> StateList;
-    void setupPacketHandlers();
-    void setupPacketHandler(SshPacketType type, const StateList &states,
-        PacketHandler handler);
-
-    typedef QPair<StateList, PacketHandler> HandlerInStates;
-    QHash<SshPacketType, HandlerInStates> m_packetHandlers;
+    struct PacketHandlerEntry {
+        quint32 states; // Bit n set <=> the packet is expected in SshStateInternal n.
+        PacketHandler handler;
+    };
+    struct PacketHandlerTable {
+        PacketHandlerEntry entries[256]; // Indexed by message type; no handler means unimplemented.
+    };
+    static constexpr quint32 stateBit(SshStateInternal state) { return 1u << state; }
+    static constexpr PacketHandlerTable packetHandlerTable();
+    static const PacketHandlerTable PacketHandlers;
+
+    void handleAuthMethodSpecificPacket();
 
     static const quint64 InvalidSeqNr;
 
@@ -186,6 +213,26 @@ private:
     QByteArray m_hostFingerprint;
     QTimer m_timeoutTimer;
     QTimer m_keepAliveTimer;
+    QElapsedTimer m_keepAliveProbeTimer;
+    QTimer m_rekeyTimer;
+    QElapsedTimer m_keyExchangeTimer;
+    quint64 m_bytesReceivedWithCurrentKeys;
+    quint32 m_packetsReceivedWithCurrentKeys;
+
+    // For statistics(), which may be called from other threads.
+    std::atomic<quint64> m_totalBytesReceived;
+    std::atomic<quint64> m_payloadBytesReceived;
+    std::atomic<quint64> m_packetsReceived;
+    std::atomic<int> m_rekeyCount;
+    std::atomic<qint64> m_lastRekeyDuration; // In milliseconds.
+    std::atomic<qint64> m_tcpConnectTime;
+    std::atomic<qint64> m_keyExchangeTime;
+    std::atomic<qint64> m_authenticationTime;
+    std::atomic<quint64> m_queuedChannelBytes; // As of the last publishStatistics().
+    QElapsedTimer m_handshakeTimer;
+    qint64 m_handshakePhaseStart;
+    QTimer m_statisticsTimer;
+    SshPacketTracer m_packetTracer;
     bool m_ignoreNextPacket;
     SshConnection *m_conn;
     quint64 m_lastInvalidMsgSeqNr;
@@ -196,6 +243,9 @@ private:
     bool m_serverHasSentDataBeforeId;
     bool m_triedAllPasswordBasedMethods;
     bool m_agentKeysUpToDate;
+    bool m_extensionInfoReceived;
+    bool m_authRequestPipelined;
+    bool m_usingCachedAgentKey;
 };
 
 } // namespace Internal
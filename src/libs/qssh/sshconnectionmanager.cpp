@@ -31,29 +31,134 @@
 #include "sshconnectionmanager.h"
 
 #include "sshconnection.h"
+#include "sshconnection_p.h"
 
 #include <QCoreApplication>
+#include <QHash>
 #include <QList>
 #include <QMutex>
-#include <QMutexLocker>
 #include <QObject>
+#include <QPointer>
+#include <QQueue>
 #include <QThread>
 #include <QTimer>
 
+#include <atomic>
+
 namespace QSsh {
 namespace Internal {
-class UnaquiredConnection {
+
+namespace {
+const int MaintenanceInterval = 5000;
+
+// Idle connections are removed after two of these periods without being used,
+// i.e. after five minutes at the most.
+const int ReapingPeriod = 150000 / MaintenanceInterval;
+
+// After failed attempts to pre-warm a connection, we skip twice as many maintenance runs
+// as before, but never more than this many, i.e. a minute's worth.
+const int MaxPrewarmBackoff = 60000 / MaintenanceInterval;
+} // anonymous namespace
+
+static QString hostKey(const SshConnectionParameters &sshParams)
+{
+    return sshParams.userName() + QLatin1Char('@') + sshParams.host() + QLatin1Char(':')
+            + QString::number(sshParams.port());
+}
+
+struct Waiter
+{
+    SshConnectionParameters parameters;
+    QPointer<QObject> context;
+    std::function<void(SshConnection *)> callback;
+};
+
+// All connections to the same user, host and port. Clients only share a connection
+// if their parameters are identical, though. Lives as long as the manager, so that
+// the shards can refer to it without taking the lock.
+class HostState
+{
+public:
+    explicit HostState(const QString &key) : key(key) {}
+
+    bool isFull() const { return maxConnections > 0 && connectionCount >= maxConnections; }
+
+    const QString key;
+
+    // Written with the lock held, but also read without it.
+    std::atomic<int> maxSessionsPerConnection{10}; // OpenSSH's default for MaxSessions.
+    std::atomic<int> minIdleConnections{0};
+    std::atomic<int> idleConnections{0}; // Including pre-warmed ones that are still connecting.
+
+    // Only accessed with the lock held.
+    int connectionCount = 0;
+    int maxConnections = 0;
+    SshConnectionParameters prewarmParameters;
+    int prewarmFailures = 0; // In a row.
+    int prewarmBackoff = 0;  // Maintenance runs left until the next attempt.
+    QQueue<Waiter> waiters;
+};
+
+class ConnectionRecord
+{
+public:
+    ConnectionRecord(SshConnection *connection, HostState *host)
+        : connection(connection), host(host) {}
+
+    SshConnection * const connection;
+    HostState * const host;
+
+    // Only accessed in the connection's thread.
+    int clients = 0;
+    bool scheduledForRemoval = false;
+    bool prewarming = false; // Opened in the background and not established yet.
+    quint64 trafficSample = 0; // Total traffic when the connection was last considered for sharing.
+    QList<QMetaObject::Connection> watches;
+
+    // Also read by other threads looking for a connection to take over.
+    std::atomic<bool> idle{false};
+    std::atomic<bool> deprecated{false};
+};
+
+// The connections living in one thread. Only that thread accesses it, so that handing out
+// and releasing connections does not need the lock in the common case.
+class ThreadShard
+{
 public:
-    UnaquiredConnection(SshConnection *conn) : connection(conn), scheduledForRemoval(false) {}
+    ThreadShard();
+    void startMaintenance();
 
-    SshConnection *connection;
-    bool scheduledForRemoval;
+    QHash<QString, QList<ConnectionRecord *>> records;
+    QTimer maintenanceTimer;
+    int ticks = 0;
+    QMetaObject::Connection teardownWatch;
 };
-bool operator==(UnaquiredConnection c1, UnaquiredConnection c2) {
-    return c1.connection == c2.connection;
+
+// Not a thread_local object: Its destructor would run too late for the main thread,
+// after QCoreApplication is gone. See localShard().
+static ThreadShard *&currentShard()
+{
+    thread_local ThreadShard *shard = nullptr;
+    return shard;
 }
-bool operator!=(UnaquiredConnection c1, UnaquiredConnection c2) {
-    return !(c1 == c2);
+
+static void tearDownLocalShard();
+
+static ThreadShard &localShard()
+{
+    ThreadShard *&shard = currentShard();
+    if (!shard) {
+        shard = new ThreadShard;
+        QThread * const thread = QThread::currentThread();
+        if (thread == QCoreApplication::instance()->thread()) {
+            shard->teardownWatch = QObject::connect(QCoreApplication::instance(),
+                    &QCoreApplication::aboutToQuit, &tearDownLocalShard);
+        } else {
+            shard->teardownWatch = QObject::connect(thread, &QThread::finished,
+                                                    &tearDownLocalShard);
+        }
+    }
+    return *shard;
 }
 
 class SshConnectionManager : public QObject
@@ -64,211 +169,655 @@ public:
     SshConnectionManager()
     {
         moveToThread(QCoreApplication::instance()->thread());
-        connect(&m_removalTimer, &QTimer::timeout,
-                this, &SshConnectionManager::removeInactiveConnections);
-        m_removalTimer.setTimerType(Qt::VeryCoarseTimer);
-        m_removalTimer.start(150000); // For a total timeout of five minutes.
     }
 
     ~SshConnectionManager()
     {
-        for (const UnaquiredConnection &connection : m_unacquiredConnections) {
-            disconnect(connection.connection, nullptr, this, nullptr);
-            delete connection.connection;
+        // Unused connections can be left over from threads whose shards were never torn down.
+        int acquiredConnections = 0;
+        for (ConnectionRecord * const record : qAsConst(m_records)) {
+            if (record->clients > 0) {
+                ++acquiredConnections;
+                continue;
+            }
+            for (const QMetaObject::Connection &watch : qAsConst(record->watches))
+                disconnect(watch);
+            delete record->connection;
+            delete record;
         }
-
-        QSSH_ASSERT(m_acquiredConnections.isEmpty());
-        QSSH_ASSERT(m_deprecatedConnections.isEmpty());
+        QSSH_ASSERT(acquiredConnections == 0);
+        qDeleteAll(m_hosts);
     }
 
     SshConnection *acquireConnection(const SshConnectionParameters &sshParams)
     {
-        QMutexLocker locker(&m_listMutex);
+        ThreadShard &shard = localShard();
+        QList<ConnectionRecord *> &records = shard.records[hostKey(sshParams)];
+        if (SshConnection * const connection = reuseConnection(records, sshParams, false)) {
+            ++m_fastPathAcquisitions;
+            return connection;
+        }
 
-        // Check in-use connections:
-        for (SshConnection * const connection : m_acquiredConnections) {
-            if (connection->connectionParameters() != sshParams)
-                continue;
+        Locker locker(this);
+        ++m_lockedAcquisitions;
+        HostState * const host = hostState(sshParams);
 
-            if (connection->thread() != QThread::currentThread())
-                continue;
+        // We cannot wait here, so rather overload a connection than exceed the limit.
+        if (host->isFull()) {
+            if (SshConnection * const connection = reuseConnection(records, sshParams, true))
+                return connection;
+        }
+        return createConnection(shard, records, host, sshParams)->connection;
+    }
 
-            if (m_deprecatedConnections.contains(connection)) // we were asked to no longer use this one...
-                continue;
+    void acquireConnection(const SshConnectionParameters &sshParams, QObject *context,
+                           const std::function<void(SshConnection *)> &callback)
+    {
+        const Waiter waiter{sshParams, context, callback};
+        QMetaObject::invokeMethod(context, [this, waiter] { serveWaiter(waiter, false); },
+                                  Qt::QueuedConnection);
+    }
 
-            m_acquiredConnections.append(connection);
-            return connection;
+    void releaseConnection(SshConnection *connection)
+    {
+        QList<ConnectionRecord *> &records
+                = localShard().records[hostKey(connection->connectionParameters())];
+        ConnectionRecord * const record = findRecord(records, connection);
+        QSSH_ASSERT_AND_RETURN(record && record->clients > 0);
+        if (--record->clients > 0)
+            return;
+
+        if (record->deprecated || connection->state() != SshConnection::Connected) {
+            discardConnection(records, record);
+            return;
         }
 
-        // Check cached open connections:
-        for (const UnaquiredConnection &c : m_unacquiredConnections) {
-            SshConnection * const connection = c.connection;
-            if (connection->state() != SshConnection::Connected
-                    || connection->connectionParameters() != sshParams)
-                continue;
+        connection->closeAllChannels(); // Clean up after neglectful clients.
+        offerConnection(records, record);
+    }
+
+    // Connections in use elsewhere are only marked here. Their threads get rid of them
+    // once they are released, or, if they are idle, during the next maintenance run.
+    void forceNewConnection(const SshConnectionParameters &sshParams)
+    {
+        Locker locker(this);
+        for (ConnectionRecord * const record : qAsConst(m_records)) {
+            if (record->connection->connectionParameters() == sshParams)
+                record->deprecated = true;
+        }
+    }
+
+    void setConnectionPoolLimits(const SshConnectionParameters &sshParams,
+                                 int minIdleConnections, int maxConnections)
+    {
+        Locker locker(this);
+        HostState * const host = hostState(sshParams);
+        host->prewarmParameters = sshParams;
+        host->minIdleConnections = qMax(0, minIdleConnections);
+        host->maxConnections = qMax(0, maxConnections);
+        host->prewarmFailures = 0;
+        host->prewarmBackoff = 0;
+        wakeWaiter(host);
+
+        // Pre-warmed connections are created in our thread.
+        QMetaObject::invokeMethod(this, [this] {
+            ThreadShard &shard = localShard();
+            shard.startMaintenance();
+            maintainShard(shard);
+        }, Qt::QueuedConnection);
+    }
 
-            if (connection->thread() != QThread::currentThread()) {
-                if (connection->channelCount() != 0)
+    void setMaxSessionsPerConnection(const SshConnectionParameters &sshParams, int maxSessions)
+    {
+        Locker locker(this);
+        HostState * const host = hostState(sshParams);
+        host->maxSessionsPerConnection = qMax(1, maxSessions);
+        wakeWaiter(host);
+    }
+
+    SshConnectionPoolStatistics statistics()
+    {
+        SshConnectionPoolStatistics stats;
+        stats.fastPathAcquisitions = m_fastPathAcquisitions;
+        stats.lockedAcquisitions = m_lockedAcquisitions;
+        stats.lockContentions = m_lockContentions;
+        stats.crossThreadHandoffs = m_crossThreadHandoffs;
+        stats.queuedRequests = m_queuedRequests;
+
+        Locker locker(this);
+        for (const HostState * const host : qAsConst(m_hosts)) {
+            stats.openConnections += host->connectionCount;
+            stats.idleConnections += host->idleConnections;
+            stats.waitingRequests += host->waiters.count();
+        }
+        return stats;
+    }
+
+    void maintainShard(ThreadShard &shard)
+    {
+        const bool reap = ++shard.ticks % ReapingPeriod == 0;
+        for (auto it = shard.records.begin(); it != shard.records.end(); ++it) {
+            QList<ConnectionRecord *> &records = it.value();
+            for (int i = records.count() - 1; i >= 0; --i) {
+                ConnectionRecord * const record = records.at(i);
+                if (record->clients > 0)
+                    continue;
+
+                // Evict dead connections before anyone gets to see them.
+                SshConnection * const connection = record->connection;
+                const SshConnection::State state = connection->state();
+                if (record->deprecated || state == SshConnection::Unconnected
+                        || (state == SshConnection::Connected && !connection->isResponsive())) {
+                    discardConnection(records, record);
                     continue;
-                QMetaObject::invokeMethod(this, "switchToCallerThread",
-                    Qt::BlockingQueuedConnection,
-                    Q_ARG(SshConnection *, connection),
-                    Q_ARG(QObject *, QThread::currentThread()));
+                }
+
+                if (!reap || state != SshConnection::Connected)
+                    continue;
+                if (!record->scheduledForRemoval)
+                    record->scheduledForRemoval = true;
+                else if (record->host->idleConnections > record->host->minIdleConnections)
+                    discardConnection(records, record);
             }
+        }
 
-            m_unacquiredConnections.removeOne(c);
-            m_acquiredConnections.append(connection);
-            return connection;
+        if (QThread::currentThread() == thread())
+            maintainHosts(shard);
+    }
+
+    // Removes the connections nobody uses. When the thread ends, there must not be any others.
+    void clearShard(ThreadShard &shard, bool threadEnding)
+    {
+        shard.maintenanceTimer.stop();
+        for (QList<ConnectionRecord *> &records : shard.records) {
+            for (int i = records.count() - 1; i >= 0; --i) {
+                ConnectionRecord * const record = records.at(i);
+                if (record->clients > 0 && !threadEnding)
+                    continue;
+                QSSH_ASSERT(record->clients == 0);
+                records.removeAt(i);
+                unregister(record);
+                delete record->connection; // The event loop is done, so no deleteLater().
+                delete record;
+            }
         }
+    }
 
-        // create a new connection:
-        SshConnection * const connection = new SshConnection(sshParams);
-        connect(connection, &SshConnection::disconnected,
-                this, &SshConnectionManager::cleanup);
-        m_acquiredConnections.append(connection);
+private:
+    // Like QMutexLocker, but keeps track of how often we had to wait for the lock.
+    class Locker
+    {
+    public:
+        explicit Locker(SshConnectionManager *manager) : m_mutex(manager->m_mutex)
+        {
+            if (!m_mutex.tryLock()) {
+                ++manager->m_lockContentions;
+                m_mutex.lock();
+            }
+        }
+        ~Locker() { if (m_locked) m_mutex.unlock(); }
+        void unlock() { m_mutex.unlock(); m_locked = false; }
+
+    private:
+        QMutex &m_mutex;
+        bool m_locked = true;
+    };
+
+    struct ConnectionLoad {
+        int channels = 0;
+        quint64 recentBytes = 0;
 
-        return connection;
+        bool operator<(const ConnectionLoad &other) const {
+            return channels < other.channels
+                    || (channels == other.channels && recentBytes < other.recentBytes);
+        }
+    };
+
+    // Must be called with the lock held.
+    HostState *hostState(const SshConnectionParameters &sshParams)
+    {
+        const QString key = hostKey(sshParams);
+        HostState *&host = m_hosts[key];
+        if (!host)
+            host = new HostState(key);
+        return host;
     }
 
-    void releaseConnection(SshConnection *connection)
+    static ConnectionRecord *findRecord(const QList<ConnectionRecord *> &records,
+                                        const SshConnection *connection)
     {
-        QMutexLocker locker(&m_listMutex);
+        for (ConnectionRecord * const record : records) {
+            if (record->connection == connection)
+                return record;
+        }
+        return nullptr;
+    }
 
-        const bool wasAquired = m_acquiredConnections.removeOne(connection);
-        QSSH_ASSERT_AND_RETURN(wasAquired);
-        if (m_acquiredConnections.contains(connection))
-            return;
+    // Spreads the clients over this thread's connections to the host: An idle connection
+    // is preferred, then the least loaded one in use. Saturated connections are only shared
+    // if allowed.
+    SshConnection *reuseConnection(QList<ConnectionRecord *> &records,
+                                   const SshConnectionParameters &sshParams, bool allowSaturated)
+    {
+        for (ConnectionRecord * const record : qAsConst(records)) {
+            if (record->clients > 0 || record->deprecated
+                    || record->connection->state() != SshConnection::Connected
+                    || record->connection->connectionParameters() != sshParams) {
+                continue;
+            }
 
-        bool doDelete = false;
-        connection->moveToThread(QCoreApplication::instance()->thread());
-        if (m_deprecatedConnections.removeOne(connection)
-                || connection->state() != SshConnection::Connected) {
-            doDelete = true;
-        } else {
-            QSSH_ASSERT_AND_RETURN(!m_unacquiredConnections.contains(UnaquiredConnection(connection)));
-
-            // It can happen that two or more connections with the same parameters were acquired
-            // if the clients were running in different threads. Only keep one of them in
-            // such a case.
-            bool haveConnection = false;
-            for (const UnaquiredConnection &c : m_unacquiredConnections) {
-                if (c.connection->connectionParameters() == connection->connectionParameters()) {
-                    haveConnection = true;
-                    break;
-                }
+            // Do not hand out connections that stopped answering; maintenance removes them.
+            if (!record->connection->isResponsive()) {
+                record->deprecated = true;
+                continue;
             }
-            if (!haveConnection) {
-                connection->closeAllChannels(); // Clean up after neglectful clients.
-                m_unacquiredConnections.append(UnaquiredConnection(connection));
-            } else {
-                doDelete = true;
+
+            record->clients = 1;
+            record->scheduledForRemoval = false;
+            if (record->idle) {
+                record->idle = false;
+                --record->host->idleConnections;
             }
+            return record->connection;
         }
 
-        if (doDelete) {
-            disconnect(connection, nullptr, this, nullptr);
-            m_deprecatedConnections.removeAll(connection);
-            connection->deleteLater();
+        ConnectionRecord *best = nullptr;
+        ConnectionLoad bestLoad;
+        for (ConnectionRecord * const record : qAsConst(records)) {
+            if (record->clients == 0 || record->deprecated // we were asked to no longer use this one...
+                    || record->connection->connectionParameters() != sshParams) {
+                continue;
+            }
+
+            const ConnectionLoad load = connectionLoad(record);
+            if (!allowSaturated && load.channels >= record->host->maxSessionsPerConnection)
+                continue;
+            if (!best || load < bestLoad) {
+                best = record;
+                bestLoad = load;
+            }
         }
+        if (!best)
+            return nullptr;
+        ++best->clients;
+        return best->connection;
     }
 
-    void forceNewConnection(const SshConnectionParameters &sshParams)
+    // Every client is expected to open at least one channel, even if it has not done so yet.
+    // The traffic is what the connection has moved since we last looked.
+    ConnectionLoad connectionLoad(ConnectionRecord *record)
+    {
+        ConnectionLoad load;
+        load.channels = qMax(record->connection->channelCount(), record->clients);
+        const quint64 bytesTransferred = record->connection->d->bytesTransferred();
+        load.recentBytes = bytesTransferred - qMin(record->trafficSample, bytesTransferred);
+        record->trafficSample = bytesTransferred;
+        return load;
+    }
+
+    // Must be called with the lock held.
+    ConnectionRecord *createConnection(ThreadShard &shard, QList<ConnectionRecord *> &records,
+                                       HostState *host, const SshConnectionParameters &sshParams)
+    {
+        ConnectionRecord * const record
+                = new ConnectionRecord(new SshConnection(sshParams), host);
+        record->clients = 1;
+        registerConnection(shard, records, record);
+        return record;
+    }
+
+    // Must be called with the lock held.
+    void registerConnection(ThreadShard &shard, QList<ConnectionRecord *> &records,
+                            ConnectionRecord *record)
+    {
+        SshConnection * const connection = record->connection;
+        const auto handleConnectionLost = [this, connection] {
+            QList<ConnectionRecord *> &records
+                    = localShard().records[hostKey(connection->connectionParameters())];
+            ConnectionRecord * const record = findRecord(records, connection);
+            if (record && record->clients == 0)
+                discardConnection(records, record);
+        };
+        record->watches << connect(connection, &SshConnection::disconnected, connection,
+                                   handleConnectionLost)
+                        << connect(connection, &SshConnection::error, connection,
+                                   handleConnectionLost);
+        ++record->host->connectionCount;
+        m_records.insert(connection, record);
+        records.append(record);
+        shard.startMaintenance();
+    }
+
+    void unregister(ConnectionRecord *record)
+    {
+        for (const QMetaObject::Connection &watch : qAsConst(record->watches))
+            disconnect(watch);
+
+        Locker locker(this);
+        m_records.remove(record->connection);
+        --record->host->connectionCount;
+        if (record->idle)
+            --record->host->idleConnections;
+        wakeWaiter(record->host);
+    }
+
+    void discardConnection(QList<ConnectionRecord *> &records, ConnectionRecord *record)
     {
-        QMutexLocker locker(&m_listMutex);
-
-        for (int i = 0; i < m_unacquiredConnections.count(); ++i) {
-            SshConnection * const connection = m_unacquiredConnections.at(i).connection;
-            if (connection->connectionParameters() == sshParams) {
-                disconnect(connection, nullptr, this, nullptr);
-                delete connection;
-                m_unacquiredConnections.removeAt(i);
-                break;
+        records.removeOne(record);
+        unregister(record);
+        record->connection->deleteLater();
+        delete record;
+    }
+
+    // Passes the connection on to a waiting client or keeps it for later.
+    void offerConnection(QList<ConnectionRecord *> &records, ConnectionRecord *record)
+    {
+        Locker locker(this);
+        HostState * const host = record->host;
+        const SshConnectionParameters sshParams = record->connection->connectionParameters();
+        for (int i = 0; i < host->waiters.count(); ++i) {
+            const Waiter waiter = host->waiters.at(i);
+            if (!waiter.context) {
+                host->waiters.removeAt(i--);
+                continue;
             }
+            if (waiter.parameters != sshParams)
+                continue;
+            host->waiters.removeAt(i);
+            locker.unlock();
+            handOver(records, record, waiter);
+            return;
         }
 
-        for (SshConnection * const connection : m_acquiredConnections) {
-            if (connection->connectionParameters() == sshParams) {
-                if (!m_deprecatedConnections.contains(connection))
-                    m_deprecatedConnections.append(connection);
-            }
+        if (record->idle)
+            return;
+
+        // It can happen that two or more connections with the same parameters were acquired
+        // if the clients were running in different threads. Only keep as many of them
+        // as the pool is supposed to hold ready.
+        int idleCount = 0;
+        for (const ConnectionRecord * const r : qAsConst(records)) {
+            if (r->clients == 0 && r->connection->connectionParameters() == sshParams)
+                ++idleCount;
         }
+        --idleCount; // That's the record itself.
+        if (idleCount > 0 && idleCount >= host->minIdleConnections) {
+            locker.unlock();
+            discardConnection(records, record);
+            return;
+        }
+        record->idle = true;
+        ++host->idleConnections;
     }
 
-private:
-    Q_INVOKABLE void switchToCallerThread(SshConnection *connection, QObject *threadObj)
+    void handOver(QList<ConnectionRecord *> &records, ConnectionRecord *record,
+                  const Waiter &waiter)
     {
-        connection->moveToThread(qobject_cast<QThread *>(threadObj));
+        if (record->idle) {
+            record->idle = false;
+            --record->host->idleConnections;
+        }
+        record->scheduledForRemoval = false;
+
+        QThread * const thread = waiter.context->thread();
+        if (thread == QThread::currentThread()) {
+            record->clients = 1;
+            deliver(record->connection, waiter);
+            return;
+        }
+
+        // The connection travels on its own; the target thread picks it up.
+        ++m_crossThreadHandoffs;
+        records.removeOne(record);
+        record->connection->moveToThread(thread);
+        QMetaObject::invokeMethod(record->connection, [this, record, waiter] {
+            ThreadShard &shard = localShard();
+            QList<ConnectionRecord *> &records = shard.records[record->host->key];
+            records.append(record);
+            shard.startMaintenance();
+            record->clients = 1;
+            deliver(record->connection, waiter);
+        }, Qt::QueuedConnection);
+    }
+
+    // Posted to the connection, so the client's reference cannot get lost
+    // if the waiter goes away in the meantime.
+    void deliver(SshConnection *connection, const Waiter &waiter)
+    {
+        QMetaObject::invokeMethod(connection, [this, connection, waiter] {
+            if (waiter.context)
+                waiter.callback(connection);
+            else
+                releaseConnection(connection);
+        }, Qt::QueuedConnection);
     }
 
-    void cleanup()
+    // Runs in the thread of the waiter's context.
+    void serveWaiter(const Waiter &waiter, bool fromQueue)
     {
-        QMutexLocker locker(&m_listMutex);
+        if (!waiter.context)
+            return;
 
-        SshConnection *currentConnection = qobject_cast<SshConnection *>(sender());
-        if (!currentConnection)
+        ThreadShard &shard = localShard();
+        QList<ConnectionRecord *> &records = shard.records[hostKey(waiter.parameters)];
+        if (SshConnection * const connection = reuseConnection(records, waiter.parameters, false)) {
+            ++m_fastPathAcquisitions;
+            waiter.callback(connection);
             return;
+        }
+
+        Locker locker(this);
+        ++m_lockedAcquisitions;
+        HostState * const host = hostState(waiter.parameters);
 
-        if (m_unacquiredConnections.removeOne(UnaquiredConnection(currentConnection))) {
-            disconnect(currentConnection, nullptr, this, nullptr);
-            currentConnection->deleteLater();
+        // Do not overtake earlier requests.
+        if ((fromQueue || host->waiters.isEmpty()) && !host->isFull()) {
+            ConnectionRecord * const record
+                    = createConnection(shard, records, host, waiter.parameters);
+            locker.unlock();
+            waiter.callback(record->connection);
+            return;
         }
+
+        if (fromQueue) {
+            host->waiters.prepend(waiter);
+        } else {
+            ++m_queuedRequests;
+            host->waiters.enqueue(waiter);
+        }
+        requestHandoff(host, waiter.parameters);
     }
 
-    void removeInactiveConnections()
+    // Another thread might have an idle connection it can pass on.
+    // Must be called with the lock held.
+    void requestHandoff(HostState *host, const SshConnectionParameters &sshParams)
     {
-        QMutexLocker locker(&m_listMutex);
-        for (int i = m_unacquiredConnections.count() - 1; i >= 0; --i) {
-            UnaquiredConnection &c = m_unacquiredConnections[i];
-            if (c.scheduledForRemoval) {
-                disconnect(c.connection, nullptr, this, nullptr);
-                c.connection->deleteLater();
-                m_unacquiredConnections.removeAt(i);
-            } else {
-                c.scheduledForRemoval = true;
+        for (ConnectionRecord * const record : qAsConst(m_records)) {
+            SshConnection * const connection = record->connection;
+            if (record->host != host || !record->idle || record->deprecated
+                    || connection->thread() == QThread::currentThread()
+                    || connection->connectionParameters() != sshParams) {
+                continue;
             }
+
+            // The record might be gone by the time this runs, so look it up again.
+            QMetaObject::invokeMethod(connection, [this, connection] {
+                QList<ConnectionRecord *> &records
+                        = localShard().records[hostKey(connection->connectionParameters())];
+                ConnectionRecord * const record = findRecord(records, connection);
+                if (record && record->clients == 0
+                        && connection->state() == SshConnection::Connected) {
+                    offerConnection(records, record);
+                }
+            }, Qt::QueuedConnection);
+            return;
         }
     }
 
-private:
-    // We expect the number of concurrently open connections to be small.
-    // If that turns out to not be the case, we can still use a data
-    // structure with faster access.
-    QList<UnaquiredConnection> m_unacquiredConnections;
+    // Lets the first waiter try again, e.g. because a connection went away.
+    // Must be called with the lock held.
+    void wakeWaiter(HostState *host)
+    {
+        while (!host->waiters.isEmpty()) {
+            const Waiter waiter = host->waiters.dequeue();
+            if (!waiter.context)
+                continue;
+            QMetaObject::invokeMethod(waiter.context.data(),
+                                      [this, waiter] { serveWaiter(waiter, true); },
+                                      Qt::QueuedConnection);
+            return;
+        }
+    }
 
-    // Can contain the same connection more than once; this acts as a reference count.
-    QList<SshConnection *> m_acquiredConnections;
+    // Runs in our own thread: Keeps the configured number of connections ready and
+    // gives waiters another chance, as channels might have been closed in the meantime.
+    void maintainHosts(ThreadShard &shard)
+    {
+        QList<SshConnection *> newConnections;
+        Locker locker(this);
+        for (HostState * const host : qAsConst(m_hosts)) {
+            wakeWaiter(host);
+
+            // Do not keep hammering a host that is unreachable.
+            if (host->prewarmBackoff > 0) {
+                --host->prewarmBackoff;
+                continue;
+            }
 
-    QList<SshConnection *> m_deprecatedConnections;
-    QMutex m_listMutex;
-    QTimer m_removalTimer;
-};
+            QList<ConnectionRecord *> &records = shard.records[host->key];
+            while (host->idleConnections < host->minIdleConnections && !host->isFull()) {
+                ConnectionRecord * const record
+                        = new ConnectionRecord(new SshConnection(host->prewarmParameters), host);
+                SshConnection * const connection = record->connection;
+                record->idle = true;
+                record->prewarming = true;
+                ++host->idleConnections;
+                record->watches << connect(connection, &SshConnection::connected, connection,
+                                           [this, connection] {
+                    QList<ConnectionRecord *> &records
+                            = localShard().records[hostKey(connection->connectionParameters())];
+                    ConnectionRecord * const record = findRecord(records, connection);
+                    if (!record)
+                        return;
+                    record->prewarming = false;
+                    {
+                        Locker locker(this);
+                        record->host->prewarmFailures = 0;
+                    }
+                    if (record->clients == 0)
+                        offerConnection(records, record);
+                });
+
+                // Must come before the watch set up in registerConnection(), which removes
+                // the record.
+                record->watches << connect(connection, &SshConnection::error, connection,
+                                           [this, connection] {
+                    QList<ConnectionRecord *> &records
+                            = localShard().records[hostKey(connection->connectionParameters())];
+                    ConnectionRecord * const record = findRecord(records, connection);
+                    if (!record || !record->prewarming)
+                        return;
+                    Locker locker(this);
+                    HostState * const host = record->host;
+                    ++host->prewarmFailures;
+                    host->prewarmBackoff = qMin(1 << qMin(host->prewarmFailures - 1, 8),
+                                                MaxPrewarmBackoff);
+                });
+                registerConnection(shard, records, record);
+                newConnections << connection;
+            }
+        }
+        locker.unlock();
 
-} // namespace Internal
+        // Failures are reported back to us, which needs the lock.
+        for (SshConnection * const connection : qAsConst(newConnections))
+            connection->connectToHost();
+    }
 
-static QMutex instanceMutex;
+    // Only accessed with the lock held.
+    QHash<QString, HostState *> m_hosts;
+    QHash<SshConnection *, ConnectionRecord *> m_records;
+    QMutex m_mutex;
 
-static Internal::SshConnectionManager &instance()
+    std::atomic<quint64> m_fastPathAcquisitions{0};
+    std::atomic<quint64> m_lockedAcquisitions{0};
+    std::atomic<quint64> m_lockContentions{0};
+    std::atomic<quint64> m_crossThreadHandoffs{0};
+    std::atomic<quint64> m_queuedRequests{0};
+};
+
+static SshConnectionManager &instance()
 {
-    static Internal::SshConnectionManager manager;
+    static SshConnectionManager manager;
     return manager;
 }
 
+// Runs when the shard's thread finishes or, for the main thread, when the application is
+// about to quit. Connections of the main thread still in use stay with its shard until released.
+static void tearDownLocalShard()
+{
+    ThreadShard *&shard = currentShard();
+    if (!shard)
+        return;
+    const bool threadEnding = QThread::currentThread() != QCoreApplication::instance()->thread();
+    instance().clearShard(*shard, threadEnding);
+    if (threadEnding) {
+        QObject::disconnect(shard->teardownWatch);
+        delete shard;
+        shard = nullptr;
+    }
+}
+
+ThreadShard::ThreadShard()
+{
+    maintenanceTimer.setTimerType(Qt::VeryCoarseTimer);
+    QObject::connect(&maintenanceTimer, &QTimer::timeout, &maintenanceTimer,
+                     [this] { instance().maintainShard(*this); });
+}
+
+void ThreadShard::startMaintenance()
+{
+    if (!maintenanceTimer.isActive())
+        maintenanceTimer.start(MaintenanceInterval);
+}
+
+} // namespace Internal
+
 SshConnection *acquireConnection(const SshConnectionParameters &sshParams)
 {
-    QMutexLocker locker(&instanceMutex);
-    return instance().acquireConnection(sshParams);
+    return Internal::instance().acquireConnection(sshParams);
+}
+
+void acquireConnection(const SshConnectionParameters &sshParams, QObject *context,
+                       const std::function<void(SshConnection *)> &callback)
+{
+    Internal::instance().acquireConnection(sshParams, context, callback);
 }
 
 void releaseConnection(SshConnection *connection)
 {
-    QMutexLocker locker(&instanceMutex);
-    instance().releaseConnection(connection);
+    Internal::instance().releaseConnection(connection);
 }
 
 void forceNewConnection(const SshConnectionParameters &sshParams)
 {
-    QMutexLocker locker(&instanceMutex);
-    instance().forceNewConnection(sshParams);
+    Internal::instance().forceNewConnection(sshParams);
+}
+
+void setConnectionPoolLimits(const SshConnectionParameters &sshParams, int minIdleConnections,
+                             int maxConnections)
+{
+    Internal::instance().setConnectionPoolLimits(sshParams, minIdleConnections, maxConnections);
+}
+
+void setMaxSessionsPerConnection(const SshConnectionParameters &sshParams, int maxSessions)
+{
+    Internal::instance().setMaxSessionsPerConnection(sshParams, maxSessions);
+}
+
+SshConnectionPoolStatistics connectionPoolStatistics()
+{
+    return Internal::instance().statistics();
 }
 
 } // namespace QSsh
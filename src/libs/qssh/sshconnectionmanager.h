@@ -33,6 +33,12 @@
 
 #include "ssh_global.h"
 
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+class QObject;
+QT_END_NAMESPACE
+
 namespace QSsh {
 
 class SshConnection;
@@ -40,11 +46,25 @@ class SshConnectionParameters;
 
 /*!
  * \brief Creates a new connection or returns an existing one if there already is one with identical sshParams
+ * Only connections living in the calling thread are shared; this never waits for other threads.
  * \param sshParams Parameters used during connection
  * \return A connection
  */
 QSSH_EXPORT SshConnection *acquireConnection(const SshConnectionParameters &sshParams);
 
+/*!
+ * \brief Like acquireConnection(), but waits if the connection limit for the host has been reached
+ * \param sshParams Parameters used during connection
+ * \param context The callback is invoked in this object's thread; if it gets destroyed
+ *        while waiting, the request is dropped
+ * \param callback Receives the connection, which must be released with releaseConnection() as usual
+ * Idle connections of other threads, including pre-warmed ones, are moved over to the
+ * context's thread if there is nothing to share there.
+ * \sa setConnectionPoolLimits()
+ */
+QSSH_EXPORT void acquireConnection(const SshConnectionParameters &sshParams, QObject *context,
+        const std::function<void(SshConnection *)> &callback);
+
 /*!
  * \brief Call this when you are done with a connection, might be disconnected and destroyed if there are no others who have called acquireConnection()
  * \param connection The connection to be released
@@ -58,6 +78,45 @@ QSSH_EXPORT void releaseConnection(SshConnection *connection);
  */
 QSSH_EXPORT void forceNewConnection(const SshConnectionParameters &sshParams);
 
+/*!
+ * \brief Configures the pool of connections to the user, host and port given in sshParams
+ * \param sshParams Parameters used for the connections opened in the background
+ * \param minIdleConnections Number of established connections kept ready for new clients.
+ *        Idle connections that stop answering keep-alive probes are replaced.
+ * \param maxConnections Upper limit for connections to the host, 0 for none. Only the
+ *        callback variant of acquireConnection() waits for a free slot.
+ */
+QSSH_EXPORT void setConnectionPoolLimits(const SshConnectionParameters &sshParams,
+        int minIdleConnections, int maxConnections);
+
+/*!
+ * \brief Sets how many channels a pooled connection to the host should carry at most
+ * New clients go to the least loaded connection; once all of them carry this many channels,
+ * another connection is opened, within the limit set by setConnectionPoolLimits().
+ * This should match the server's MaxSessions setting, which defaults to 10 for OpenSSH.
+ * \param sshParams Identifies the host (user, host and port)
+ * \param maxSessions Maximum number of channels per connection
+ */
+QSSH_EXPORT void setMaxSessionsPerConnection(const SshConnectionParameters &sshParams,
+        int maxSessions);
+
+struct SshConnectionPoolStatistics
+{
+    quint64 fastPathAcquisitions = 0; // Served from the calling thread's own connections, without locking.
+    quint64 lockedAcquisitions = 0;   // Needed the pool's global lock.
+    quint64 lockContentions = 0;      // Times anyone had to wait for the global lock.
+    quint64 crossThreadHandoffs = 0;  // Idle connections moved to another thread.
+    quint64 queuedRequests = 0;       // Requests that had to wait for a connection.
+    int openConnections = 0;
+    int idleConnections = 0;
+    int waitingRequests = 0;
+};
+
+/*!
+ * \brief Returns counters for all hosts that show how well the connection pool copes with its load
+ */
+QSSH_EXPORT SshConnectionPoolStatistics connectionPoolStatistics();
+
 } // namespace QSsh
 
 #endif // SSHCONNECTIONMANAGER_H
@@ -48,8 +48,10 @@
 #include <botan/pubkey.h>
 #include <botan/filters.h>
 #include <botan/ecdsa.h>
+#include <botan/ed25519.h>
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QList>
 
 #include <string>
@@ -60,12 +62,18 @@ namespace QSsh {
 namespace Internal {
 
 SshAbstractCryptoFacility::SshAbstractCryptoFacility()
-    : m_cipherBlockSize(0), m_macLength(0)
+    : m_cipherBlockSize(0), m_macLength(0), m_cipherTime(0), m_macTime(0)
 {
 }
 
 SshAbstractCryptoFacility::~SshAbstractCryptoFacility() {}
 
+void SshAbstractCryptoFacility::resetTimings()
+{
+    m_cipherTime.store(0, std::memory_order_relaxed);
+    m_macTime.store(0, std::memory_order_relaxed);
+}
+
 void SshAbstractCryptoFacility::clearKeys()
 {
     m_cipherBlockSize = 0;
@@ -91,21 +99,41 @@ void SshAbstractCryptoFacility::recreateKeys(const SshKeyExchange &kex)
 
     if (m_sessionId.isEmpty())
         m_sessionId = kex.h();
-   const QByteArray &rfcCryptAlgoName = cryptAlgoName(kex);
+    createKeys(cryptAlgoName(kex), hMacAlgoName(kex), [this, &kex](char c, quint32 length) {
+        return generateHash(kex, c, length);
+    });
+}
+
+#ifdef QSSH_BENCHMARK_HOOKS
+void SshAbstractCryptoFacility::setFixedKeys(const QByteArray &rfcCryptAlgoName,
+                                             const QByteArray &rfcHMacAlgoName)
+{
+    checkInvariant();
+
+    m_sessionId = QByteArray(32, 's');
+    createKeys(rfcCryptAlgoName, rfcHMacAlgoName, [](char, quint32 length) {
+        return QByteArray(static_cast<int>(length), 'k');
+    });
+}
+#endif
 
+void SshAbstractCryptoFacility::createKeys(const QByteArray &rfcCryptAlgoName,
+        const QByteArray &rfcHMacAlgoName,
+        const std::function<QByteArray(char, quint32)> &deriveKey)
+{
    { // Don't know how else to get this with the new botan API
        std::unique_ptr<BlockCipher> cipher
                = BlockCipher::create_or_throw(botanCryptAlgoName(rfcCryptAlgoName));
        m_cipherBlockSize = static_cast<quint32>(cipher->block_size());
    }
-    const QByteArray ivData = generateHash(kex, ivChar(), m_cipherBlockSize);
+    const QByteArray ivData = deriveKey(ivChar(), m_cipherBlockSize);
     const InitializationVector iv(convertByteArray(ivData), m_cipherBlockSize);
 
     Keyed_Filter * const cipherMode
             = makeCipherMode(botanCipherAlgoName(rfcCryptAlgoName), getMode(rfcCryptAlgoName));
 
     const quint32 keySize = static_cast<quint32>(cipherMode->key_spec().maximum_keylength());
-    const QByteArray cryptKeyData = generateHash(kex, keyChar(), keySize);
+    const QByteArray cryptKeyData = deriveKey(keyChar(), keySize);
     SymmetricKey cryptKey(convertByteArray(cryptKeyData), keySize);
 
     cipherMode->set_key(cryptKey);
@@ -113,10 +141,10 @@ void SshAbstractCryptoFacility::recreateKeys(const SshKeyExchange &kex)
 
     m_pipe.reset(new Pipe(cipherMode));
 
-    m_macLength = botanHMacKeyLen(hMacAlgoName(kex));
-    const QByteArray hMacKeyData = generateHash(kex, macChar(), macLength());
+    m_macLength = botanHMacKeyLen(rfcHMacAlgoName);
+    const QByteArray hMacKeyData = deriveKey(macChar(), macLength());
     SymmetricKey hMacKey(convertByteArray(hMacKeyData), macLength());
-    m_hMac = MessageAuthenticationCode::create_or_throw("HMAC(" + std::string(botanHMacAlgoName(hMacAlgoName(kex))) + ")");
+    m_hMac = MessageAuthenticationCode::create_or_throw("HMAC(" + std::string(botanHMacAlgoName(rfcHMacAlgoName)) + ")");
     m_hMac->set_key(hMacKey);
 }
 
@@ -134,11 +162,14 @@ void SshAbstractCryptoFacility::convert(QByteArray &data, quint32 offset,
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Invalid packet size");
     }
+    QElapsedTimer timer;
+    timer.start();
     m_pipe->process_msg(reinterpret_cast<const byte *>(data.constData()) + offset,
         dataSize);
      // Can't use Pipe::LAST_MESSAGE because of a VC bug.
     quint32 bytesRead = static_cast<quint32>(m_pipe->read(
           reinterpret_cast<byte *>(data.data()) + offset, dataSize, m_pipe->message_count() - 1));
+    m_cipherTime.fetch_add(timer.nsecsElapsed(), std::memory_order_relaxed);
     if (bytesRead != dataSize) {
         throw SshClientException(SshInternalError,
                 QLatin1String("Internal error: Botan::Pipe::read() returned unexpected value"));
@@ -154,10 +185,14 @@ Keyed_Filter *SshAbstractCryptoFacility::makeCtrCipherMode(const QByteArray &cip
 QByteArray SshAbstractCryptoFacility::generateMac(const QByteArray &data,
     quint32 dataSize) const
 {
-    return m_sessionId.isEmpty()
-        ? QByteArray()
-        : convertByteArray(m_hMac->process(reinterpret_cast<const byte *>(data.constData()),
-              dataSize));
+    if (m_sessionId.isEmpty())
+        return QByteArray();
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray mac = convertByteArray(m_hMac->process(
+            reinterpret_cast<const byte *>(data.constData()), dataSize));
+    m_macTime.fetch_add(timer.nsecsElapsed(), std::memory_order_relaxed);
+    return mac;
 }
 
 QByteArray SshAbstractCryptoFacility::generateHash(const SshKeyExchange &kex,
@@ -255,7 +290,11 @@ void SshEncryptionFacility::createAuthenticationKey(const QByteArray &privKeyFil
 
     m_authPubKeyBlob = AbstractSshPacket::encodeString(m_authKeyAlgoName);
     auto * const ecdsaKey = dynamic_cast<ECDSA_PrivateKey *>(m_authKey.data());
-    if (ecdsaKey) {
+    auto * const ed25519Key = dynamic_cast<Ed25519_PrivateKey *>(m_authKey.data());
+    if (ed25519Key) {
+        m_authPubKeyBlob += AbstractSshPacket::encodeString(
+                    convertByteArray(ed25519Key->get_public_key()));
+    } else if (ecdsaKey) {
         m_authPubKeyBlob += AbstractSshPacket::encodeString(m_authKeyAlgoName.mid(11)); // Without "ecdsa-sha2-" prefix.
         m_authPubKeyBlob += AbstractSshPacket::encodeString(
                     convertByteArray(ecdsaKey->public_point().encode(PointGFp::UNCOMPRESSED)));
@@ -291,6 +330,8 @@ bool SshEncryptionFacility::createAuthenticationKeyFromPKCS8(const QByteArray &p
             pubKeyParams << ecdsaKey->public_point().get_affine_x()
                          << ecdsaKey->public_point().get_affine_y();
             allKeyParams << pubKeyParams << value;
+        } else if (dynamic_cast<Ed25519_PrivateKey *>(m_authKey.data())) {
+            m_authKeyAlgoName = SshCapabilities::PubKeyEd25519;
         } else {
             qCWarning(sshLog, "%s: Unexpected code flow, expected success or exception.",
                       Q_FUNC_INFO);
@@ -391,16 +432,32 @@ bool SshEncryptionFacility::createAuthenticationKeyFromOpenSSL(const QByteArray
 QByteArray SshEncryptionFacility::authenticationAlgorithmName() const
 {
     Q_ASSERT(m_authKey);
-    return m_authKeyAlgoName;
+    return signatureAlgorithmName(m_authKeyAlgoName);
+}
+
+QByteArray SshEncryptionFacility::signatureAlgorithmName(const QByteArray &keyType) const
+{
+    if (keyType != SshCapabilities::PubKeyRsa)
+        return keyType;
+
+    // Without "server-sig-algs", we cannot know whether the server accepts SHA-2 signatures
+    // for RSA keys, so we stay with plain "ssh-rsa" (RFC 8332, 3.3).
+    for (const QByteArray &algo : {SshCapabilities::PubKeyRsaSha512,
+                                   SshCapabilities::PubKeyRsaSha256}) {
+        if (m_serverSignatureAlgorithms.contains(algo))
+            return algo;
+    }
+    return keyType;
 }
 
 QByteArray SshEncryptionFacility::authenticationKeySignature(const QByteArray &data) const
 {
     Q_ASSERT(m_authKey);
 
+    const QByteArray signatureAlgoName = authenticationAlgorithmName();
     QScopedPointer<PK_Signer> signer(new PK_Signer(*m_authKey,
         m_rng,
-        botanEmsaAlgoName(m_authKeyAlgoName)));
+        botanEmsaAlgoName(signatureAlgoName)));
     QByteArray dataToSign = AbstractSshPacket::encodeString(sessionId()) + data;
     QByteArray signature
         = convertByteArray(signer->sign_message(convertByteArray(dataToSign),
@@ -412,7 +469,7 @@ QByteArray SshEncryptionFacility::authenticationKeySignature(const QByteArray &d
         const BigInt s = BigInt::decode(convertByteArray(signature.mid(halfSize)), halfSize);
         signature = AbstractSshPacket::encodeMpInt(r) + AbstractSshPacket::encodeMpInt(s);
     }
-    return AbstractSshPacket::encodeString(m_authKeyAlgoName)
+    return AbstractSshPacket::encodeString(signatureAlgoName)
         + AbstractSshPacket::encodeString(signature);
 }
 
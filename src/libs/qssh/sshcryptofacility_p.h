@@ -38,21 +38,34 @@
 #include <botan/pk_keys.h>
 #include <botan/auto_rng.h>
 
+#include "ssh_global.h"
+
 #include <QByteArray>
+#include <QList>
 #include <QScopedPointer>
 
+#include <atomic>
+#include <functional>
+
 namespace QSsh {
 namespace Internal {
 
 class SshKeyExchange;
 
-class SshAbstractCryptoFacility
+class QSSH_EXPORT SshAbstractCryptoFacility
 {
 public:
     virtual ~SshAbstractCryptoFacility();
 
     void clearKeys();
     void recreateKeys(const SshKeyExchange &kex);
+
+#ifdef QSSH_BENCHMARK_HOOKS
+    // Keys the facility without a key exchange, for benchmarks only. The keys do not
+    // depend on the direction, so a decryption facility set up like this reads what an
+    // encryption facility with the same algorithms wrote.
+    void setFixedKeys(const QByteArray &cryptAlgoName, const QByteArray &hMacAlgoName);
+#endif
     QByteArray generateMac(const QByteArray &data, quint32 dataSize) const;
     quint32 cipherBlockSize() const { return m_cipherBlockSize; }
     quint32 macLength() const { return m_macLength; }
@@ -60,6 +73,12 @@ public:
 
     bool isValid() const { return m_hMac && m_pipe; } // TODO: probably more, but this stops segfaulting
 
+    // Accumulated time spent in the cipher and the MAC, in nanoseconds. Safe to read
+    // from any thread.
+    qint64 cipherTime() const { return m_cipherTime.load(std::memory_order_relaxed); }
+    qint64 macTime() const { return m_macTime.load(std::memory_order_relaxed); }
+    void resetTimings();
+
 protected:
     enum Mode { CbcMode, CtrMode };
 
@@ -78,6 +97,8 @@ private:
     virtual char keyChar() const = 0;
     virtual char macChar() const = 0;
 
+    void createKeys(const QByteArray &rfcCryptAlgoName, const QByteArray &rfcHMacAlgoName,
+                    const std::function<QByteArray(char, quint32)> &deriveKey);
     QByteArray generateHash(const SshKeyExchange &kex, char c, quint32 length);
     void checkInvariant() const;
     static Mode getMode(const QByteArray &algoName);
@@ -87,15 +108,23 @@ private:
     std::unique_ptr<Botan::MessageAuthenticationCode> m_hMac;
     quint32 m_cipherBlockSize;
     quint32 m_macLength;
+    mutable std::atomic<qint64> m_cipherTime;
+    mutable std::atomic<qint64> m_macTime;
 };
 
-class SshEncryptionFacility : public SshAbstractCryptoFacility
+class QSSH_EXPORT SshEncryptionFacility : public SshAbstractCryptoFacility
 {
 public:
     void encrypt(QByteArray &data) const;
 
     void createAuthenticationKey(const QByteArray &privKeyFileContents);
     QByteArray authenticationAlgorithmName() const;
+
+    // From the "server-sig-algs" extension; selects the signature algorithm for RSA keys.
+    void setServerSignatureAlgorithms(const QList<QByteArray> &algorithms) {
+        m_serverSignatureAlgorithms = algorithms;
+    }
+    QByteArray signatureAlgorithmName(const QByteArray &keyType) const;
     QByteArray authenticationPublicKey() const { return m_authPubKeyBlob; }
     QByteArray authenticationKeySignature(const QByteArray &data) const;
     QByteArray getRandomNumbers(int count) const;
@@ -125,6 +154,7 @@ private:
     QByteArray m_authKeyAlgoName;
     QByteArray m_authPubKeyBlob;
     QByteArray m_cachedPrivKeyContents;
+    QList<QByteArray> m_serverSignatureAlgorithms;
     QScopedPointer<Botan::Private_Key> m_authKey;
     mutable Botan::AutoSeeded_RNG m_rng;
 };
@@ -0,0 +1,365 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sshdirectorytransfer.h"
+#include "sshdirectorytransfer_p.h"
+
+#include "sshconnection.h"
+#include "sshlogging_p.h"
+#include "sshtararchive_p.h"
+
+#include <QDir>
+
+namespace QSsh {
+namespace Internal {
+namespace {
+
+QByteArray shellQuote(const QString &argument)
+{
+    QString quoted = argument;
+    quoted.replace(QLatin1Char('\''), QLatin1String("'\\''"));
+    return '\'' + quoted.toUtf8() + '\'';
+}
+
+} // anonymous namespace
+
+SshDirectoryTransferJob::SshDirectoryTransferJob(Direction direction, const QString &localDirPath,
+        const QString &remoteDirPath, SftpOverwriteMode mode, bool sftpFallback, QObject *parent)
+    : QObject(parent),
+      m_direction(direction),
+      m_localDirPath(localDirPath),
+      m_remoteDirPath(remoteDirPath),
+      m_mode(mode),
+      m_sftpFallback(sftpFallback),
+      m_connection(nullptr),
+      m_workerThread(nullptr),
+      m_packer(nullptr),
+      m_extractor(nullptr),
+      m_sftpJob(SftpInvalidJob),
+      m_totalSize(0),
+      m_chunksInFlight(0),
+      m_uploadStarted(false),
+      m_remoteFinished(false),
+      m_endOfDataSent(false),
+      m_finished(false)
+{
+}
+
+SshDirectoryTransferJob::~SshDirectoryTransferJob()
+{
+    if (!m_finished) {
+        if (m_process) {
+            m_process->disconnect(this);
+            m_process->close();
+        }
+        if (m_sftp)
+            m_sftp->closeChannel();
+    }
+    deleteWorkers();
+}
+
+void SshDirectoryTransferJob::start(SshConnection *connection, QThread *workerThread)
+{
+    m_connection = connection;
+    m_workerThread = workerThread;
+
+    m_process = m_connection->createRemoteProcess(remoteCommand());
+    connect(m_process.data(), &SshRemoteProcess::started,
+            this, &SshDirectoryTransferJob::handleProcessStarted);
+    connect(m_process.data(), &SshRemoteProcess::closed,
+            this, &SshDirectoryTransferJob::handleProcessClosed);
+    if (m_direction == Upload) {
+        connect(m_process.data(), &QIODevice::bytesWritten,
+                this, &SshDirectoryTransferJob::requestUploadData);
+    } else {
+        connect(m_process.data(), &SshRemoteProcess::readyReadStandardOutput,
+                this, &SshDirectoryTransferJob::feedExtractor);
+        m_process->setReadBufferSize(MaxBufferedData);
+    }
+    m_process->start();
+}
+
+QByteArray SshDirectoryTransferJob::remoteCommand() const
+{
+    QByteArray command = "command -v tar >/dev/null 2>&1 || exit "
+            + QByteArray::number(TarNotFoundExitCode) + "; exec tar ";
+    if (m_direction == Upload)
+        command += "-xf - -C " + shellQuote(m_remoteDirPath);
+    else
+        command += "-cf - -C " + shellQuote(m_remoteDirPath) + " .";
+    return command;
+}
+
+void SshDirectoryTransferJob::handleProcessStarted()
+{
+    if (m_direction == Upload) {
+        m_packer = new SshTarPacker(m_localDirPath);
+        m_packer->moveToThread(m_workerThread);
+        connect(this, &SshDirectoryTransferJob::packerStartRequested,
+                m_packer, &SshTarPacker::start);
+        connect(this, &SshDirectoryTransferJob::produceRequested,
+                m_packer, &SshTarPacker::produce);
+        connect(m_packer, &SshTarPacker::started, this, [this](quint64 totalSize) {
+            m_totalSize = totalSize;
+            m_uploadStarted = true;
+            requestUploadData();
+        });
+        connect(m_packer, &SshTarPacker::dataAvailable,
+                this, &SshDirectoryTransferJob::handleUploadData);
+        connect(m_packer, &SshTarPacker::finished,
+                m_process.data(), &SshRemoteProcess::closeWriteChannel);
+        connect(m_packer, &SshTarPacker::error, this, [this](const QString &message) {
+            finish(SftpError::GenericFailure, message);
+        });
+        emit packerStartRequested();
+    } else {
+        m_extractor = new SshTarExtractor(m_localDirPath, m_mode);
+        m_extractor->moveToThread(m_workerThread);
+        connect(this, &SshDirectoryTransferJob::dataReceived,
+                m_extractor, &SshTarExtractor::extract);
+        connect(this, &SshDirectoryTransferJob::endOfData,
+                m_extractor, &SshTarExtractor::finish);
+        connect(m_extractor, &SshTarExtractor::chunkProcessed, this, [this](quint64 progress) {
+            --m_chunksInFlight;
+            emit this->progress(progress, 0);
+            feedExtractor();
+        });
+        connect(m_extractor, &SshTarExtractor::finished, this, [this] {
+            finish(SftpError::NoError);
+        });
+        connect(m_extractor, &SshTarExtractor::error, this, [this](const QString &message) {
+            finish(SftpError::GenericFailure, message);
+        });
+        feedExtractor();
+    }
+}
+
+void SshDirectoryTransferJob::handleProcessClosed(int exitStatus)
+{
+    if (m_finished)
+        return;
+
+    const bool tarMissing = exitStatus == SshRemoteProcess::FailedToStart
+            || (exitStatus == SshRemoteProcess::NormalExit
+                && m_process->exitCode() == TarNotFoundExitCode);
+    if (tarMissing) {
+        if (m_sftpFallback) {
+            startSftpFallback();
+            return;
+        }
+        finish(SftpError::UnsupportedOperation,
+               tr("Cannot run tar on the remote host: %1").arg(m_process->errorString()));
+        return;
+    }
+
+    if (exitStatus != SshRemoteProcess::NormalExit || m_process->exitCode() != 0) {
+        const QString errorOutput
+                = QString::fromLocal8Bit(m_process->readAllStandardError()).trimmed();
+        finish(SftpError::GenericFailure, tr("Remote tar failed: %1")
+               .arg(errorOutput.isEmpty() ? m_process->errorString() : errorOutput));
+        return;
+    }
+
+    if (m_direction == Upload) {
+        emit progress(m_totalSize, m_totalSize);
+        finish(SftpError::NoError);
+    } else {
+        m_remoteFinished = true;
+        feedExtractor();
+    }
+}
+
+void SshDirectoryTransferJob::requestUploadData()
+{
+    if (!m_uploadStarted || m_finished)
+        return;
+    while (m_chunksInFlight < MaxChunksInFlight && m_process->bytesToWrite() < MaxBufferedData) {
+        ++m_chunksInFlight;
+        emit produceRequested();
+    }
+}
+
+void SshDirectoryTransferJob::handleUploadData(const QByteArray &data, quint64 progress)
+{
+    --m_chunksInFlight;
+    if (!m_process->isRunning())
+        return;
+    m_process->write(data);
+    emit this->progress(progress, m_totalSize);
+    requestUploadData();
+}
+
+void SshDirectoryTransferJob::feedExtractor()
+{
+    if (!m_extractor || m_finished)
+        return;
+    while (m_chunksInFlight < MaxChunksInFlight) {
+        const QByteArray chunk = m_process->readChunk();
+        if (chunk.isEmpty())
+            break;
+        ++m_chunksInFlight;
+        emit dataReceived(chunk);
+    }
+    if (m_remoteFinished && m_chunksInFlight == 0 && !m_endOfDataSent) {
+        m_endOfDataSent = true;
+        emit endOfData();
+    }
+}
+
+void SshDirectoryTransferJob::startSftpFallback()
+{
+    qCDebug(sshLog, "tar not available on remote host, using SFTP for directory transfer");
+    deleteWorkers();
+    m_process->disconnect(this);
+
+    m_sftp = m_connection->createSftpChannel();
+    connect(m_sftp.data(), &SftpChannel::initialized, this, [this] {
+        m_sftpJob = m_direction == Upload
+                ? m_sftp->uploadDir(m_localDirPath, m_remoteDirPath)
+                : m_sftp->downloadDir(m_remoteDirPath, m_localDirPath, m_mode);
+        if (m_sftpJob == SftpInvalidJob)
+            finish(SftpError::GenericFailure, tr("Failed to start SFTP transfer."));
+    });
+    connect(m_sftp.data(), &SftpChannel::channelError, this, [this](const QString &reason) {
+        finish(SftpError::GenericFailure, reason);
+    });
+    connect(m_sftp.data(), &SftpChannel::finished,
+            this, [this](SftpJobId job, SftpError errorType, const QString &error) {
+        if (job == m_sftpJob)
+            finish(errorType, error);
+    });
+
+    // The channel is ours alone, so all progress reports belong to this job.
+    connect(m_sftp.data(), &SftpChannel::transferProgress,
+            this, [this](SftpJobId, quint64 progress, quint64 total) {
+        emit this->progress(progress, total);
+    });
+    m_sftp->initialize();
+}
+
+void SshDirectoryTransferJob::deleteWorkers()
+{
+    if (m_packer) {
+        m_packer->disconnect();
+        m_packer->deleteLater();
+        m_packer = nullptr;
+    }
+    if (m_extractor) {
+        m_extractor->disconnect();
+        m_extractor->deleteLater();
+        m_extractor = nullptr;
+    }
+}
+
+void SshDirectoryTransferJob::finish(SftpError errorType, const QString &error)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    if (m_process) {
+        m_process->disconnect(this);
+        m_process->close();
+    }
+    if (m_sftp) {
+        m_sftp->disconnect(this);
+        m_sftp->closeChannel();
+    }
+    deleteWorkers();
+    emit finished(errorType, error);
+}
+
+} // namespace Internal
+
+using namespace Internal;
+
+SshDirectoryTransfer::SshDirectoryTransfer(SshConnection *connection, QObject *parent)
+    : QObject(parent), d(new SshDirectoryTransferPrivate)
+{
+    d->m_connection = connection;
+    d->m_nextJobId = 0;
+    d->m_sftpFallback = true;
+}
+
+SshDirectoryTransfer::~SshDirectoryTransfer()
+{
+    qDeleteAll(d->m_jobs);
+    d->m_workerThread.quit();
+    d->m_workerThread.wait();
+    delete d;
+}
+
+void SshDirectoryTransfer::setSftpFallbackEnabled(bool enabled)
+{
+    d->m_sftpFallback = enabled;
+}
+
+bool SshDirectoryTransfer::isSftpFallbackEnabled() const
+{
+    return d->m_sftpFallback;
+}
+
+SftpJobId SshDirectoryTransfer::uploadDir(const QString &localDirPath,
+                                          const QString &remoteParentDirPath)
+{
+    QSSH_ASSERT_AND_RETURN_VALUE(d->m_connection->state() == SshConnection::Connected,
+                                 SftpInvalidJob);
+    const QDir localDir(localDirPath);
+    if (!localDir.exists() || !localDir.isReadable())
+        return SftpInvalidJob;
+    return startJob(new SshDirectoryTransferJob(SshDirectoryTransferJob::Upload, localDirPath,
+            remoteParentDirPath, SftpOverwriteExisting, d->m_sftpFallback, this));
+}
+
+SftpJobId SshDirectoryTransfer::downloadDir(const QString &remoteDirPath,
+                                            const QString &localDirPath, SftpOverwriteMode mode)
+{
+    QSSH_ASSERT_AND_RETURN_VALUE(d->m_connection->state() == SshConnection::Connected,
+                                 SftpInvalidJob);
+    if (!QDir().mkpath(localDirPath))
+        return SftpInvalidJob;
+    return startJob(new SshDirectoryTransferJob(SshDirectoryTransferJob::Download, localDirPath,
+            remoteDirPath, mode, d->m_sftpFallback, this));
+}
+
+SftpJobId SshDirectoryTransfer::startJob(SshDirectoryTransferJob *job)
+{
+    const SftpJobId jobId = ++d->m_nextJobId;
+    d->m_jobs.insert(jobId, job);
+    connect(job, &SshDirectoryTransferJob::progress, this, [this, jobId](quint64 progress,
+                                                                          quint64 total) {
+        emit transferProgress(jobId, progress, total);
+    });
+    connect(job, &SshDirectoryTransferJob::finished, this, [this, jobId](SftpError errorType,
+                                                                          const QString &error) {
+        d->m_jobs.take(jobId)->deleteLater();
+        emit finished(jobId, errorType, error);
+    });
+    if (!d->m_workerThread.isRunning())
+        d->m_workerThread.start();
+    job->start(d->m_connection, &d->m_workerThread);
+    return jobId;
+}
+
+} // namespace QSsh
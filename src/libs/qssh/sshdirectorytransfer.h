@@ -0,0 +1,100 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "sftpdefs.h"
+#include "ssh_global.h"
+
+#include <QObject>
+
+namespace QSsh {
+class SshConnection;
+
+namespace Internal {
+class SshDirectoryTransferJob;
+class SshDirectoryTransferPrivate;
+} // namespace Internal
+
+/*!
+    \class QSsh::SshDirectoryTransfer
+
+    \brief Transfers whole directory trees by streaming a tar archive through a remote process.
+
+    This avoids the per-file round trips of SftpChannel::uploadDir() and
+    SftpChannel::downloadDir(), which dominate when there are many small files.
+    The archive is packed and unpacked on the fly in a worker thread.
+    If the remote host has no tar, the job transparently falls back to SFTP,
+    unless that is disabled via setSftpFallbackEnabled().
+
+    The signals have the same meaning as their counterparts in SftpChannel.
+    For downloads, the total passed to transferProgress() is 0, as the size of
+    the archive is not known in advance.
+ */
+class QSSH_EXPORT SshDirectoryTransfer : public QObject
+{
+    Q_OBJECT
+public:
+    /*!
+     * \param connection An established connection. It must outlive this object.
+     */
+    explicit SshDirectoryTransfer(SshConnection *connection, QObject *parent = nullptr);
+    ~SshDirectoryTransfer();
+
+    void setSftpFallbackEnabled(bool enabled);
+    bool isSftpFallbackEnabled() const;
+
+    /*!
+     * \brief Uploads a local directory (recursively), like SftpChannel::uploadDir()
+     * \param localDirPath The path to an existing local directory
+     * \param remoteParentDirPath The remote path to upload it to, the name of the local directory will be appended to this
+     * \return A unique ID identifying this job
+     */
+    SftpJobId uploadDir(const QString &localDirPath, const QString &remoteParentDirPath);
+
+    /*!
+     * \brief Downloads a remote directory (recursively), like SftpChannel::downloadDir()
+     * \param remoteDirPath The remote path of an existing directory to download
+     * \param localDirPath The local path to download the directory to
+     * \param mode Controls what happens if a local file already exists
+     * \return A unique ID identifying this job
+     */
+    SftpJobId downloadDir(const QString &remoteDirPath, const QString &localDirPath,
+                          SftpOverwriteMode mode);
+
+signals:
+    /// error.isEmpty means it finished successfully
+    void finished(QSsh::SftpJobId job, const SftpError errorType = SftpError::NoError, const QString &error = QString());
+
+    /// Emitted during upload or download
+    void transferProgress(QSsh::SftpJobId job, quint64 progress, quint64 total);
+
+private:
+    SftpJobId startJob(Internal::SshDirectoryTransferJob *job);
+
+    Internal::SshDirectoryTransferPrivate * const d;
+};
+
+} // namespace QSsh
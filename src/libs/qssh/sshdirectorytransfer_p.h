@@ -0,0 +1,111 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "sftpchannel.h"
+#include "sshdirectorytransfer.h"
+#include "sshremoteprocess.h"
+
+#include <QHash>
+#include <QThread>
+
+namespace QSsh {
+namespace Internal {
+class SshTarExtractor;
+class SshTarPacker;
+
+class SshDirectoryTransferJob : public QObject
+{
+    Q_OBJECT
+public:
+    enum Direction { Upload, Download };
+
+    SshDirectoryTransferJob(Direction direction, const QString &localDirPath,
+                            const QString &remoteDirPath, SftpOverwriteMode mode,
+                            bool sftpFallback, QObject *parent);
+    ~SshDirectoryTransferJob();
+
+    void start(SshConnection *connection, QThread *workerThread);
+
+    static const int TarNotFoundExitCode = 127;
+    static const int MaxChunksInFlight = 2;
+    static const qint64 MaxBufferedData = 1024 * 1024;
+
+signals:
+    void progress(quint64 progress, quint64 total);
+    void finished(QSsh::SftpError errorType, const QString &error);
+
+    // For the worker thread.
+    void packerStartRequested();
+    void produceRequested();
+    void dataReceived(const QByteArray &data);
+    void endOfData();
+
+private:
+    QByteArray remoteCommand() const;
+    void handleProcessStarted();
+    void handleProcessClosed(int exitStatus);
+    void requestUploadData();
+    void handleUploadData(const QByteArray &data, quint64 progress);
+    void feedExtractor();
+    void startSftpFallback();
+    void deleteWorkers();
+    void finish(SftpError errorType, const QString &error = QString());
+
+    const Direction m_direction;
+    const QString m_localDirPath;
+    const QString m_remoteDirPath; // Parent directory for uploads.
+    const SftpOverwriteMode m_mode;
+    const bool m_sftpFallback;
+
+    SshConnection *m_connection;
+    QThread *m_workerThread;
+    SshRemoteProcess::Ptr m_process;
+    SshTarPacker *m_packer;
+    SshTarExtractor *m_extractor;
+    SftpChannel::Ptr m_sftp;
+    SftpJobId m_sftpJob;
+
+    quint64 m_totalSize;
+    int m_chunksInFlight;
+    bool m_uploadStarted;
+    bool m_remoteFinished;
+    bool m_endOfDataSent;
+    bool m_finished;
+};
+
+class SshDirectoryTransferPrivate
+{
+public:
+    SshConnection *m_connection;
+    QThread m_workerThread;
+    QHash<SftpJobId, SshDirectoryTransferJob *> m_jobs;
+    SftpJobId m_nextJobId;
+    bool m_sftpFallback;
+};
+
+} // namespace Internal
+} // namespace QSsh
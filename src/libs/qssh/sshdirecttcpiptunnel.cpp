@@ -92,6 +92,11 @@ bool SshDirectTcpIpTunnel::canReadLine() const
     return QIODevice::canReadLine() || d->m_data.contains('\n');
 }
 
+qint64 SshDirectTcpIpTunnel::bytesToWrite() const
+{
+    return d->bufferedDataSize();
+}
+
 void SshDirectTcpIpTunnel::close()
 {
     d->closeChannel();
@@ -104,7 +109,7 @@ void SshDirectTcpIpTunnel::initialize()
 
     try {
         QIODevice::open(QIODevice::ReadWrite);
-        d->m_sendFacility.sendDirectTcpIpPacket(d->localChannelId(), SshDirectTcpIpTunnelPrivate::initialWindowSize(),
+        d->m_sendFacility.sendDirectTcpIpPacket(d->localChannelId(), d->openingWindowSize(),
             SshDirectTcpIpTunnelPrivate::maxPacketSize(), d->m_remoteHost.toUtf8(), d->m_remotePort,
             d->m_originatingHost.toUtf8(), d->m_originatingPort);
         d->setChannelState(AbstractSshChannel::SessionRequested);
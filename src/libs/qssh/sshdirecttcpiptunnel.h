@@ -63,6 +63,7 @@ public:
     bool atEnd() const;
     qint64 bytesAvailable() const;
     bool canReadLine() const;
+    qint64 bytesToWrite() const;
     void close();
     bool isSequential() const { return true; }
 
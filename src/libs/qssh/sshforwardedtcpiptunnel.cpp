@@ -44,7 +44,7 @@ void SshForwardedTcpIpTunnelPrivate::handleOpenSuccessInternal()
 
     try {
         m_sendFacility.sendChannelOpenConfirmationPacket(remoteChannel(), localChannelId(),
-                                                         initialWindowSize(), maxPacketSize());
+                                                         openingWindowSize(), maxPacketSize());
     } catch (const std::exception &e) { // Won't happen, but let's play it safe.
         qCWarning(sshLog, "Botan error: %s", e.what());
         closeChannel();
@@ -81,6 +81,11 @@ bool SshForwardedTcpIpTunnel::canReadLine() const
     return QIODevice::canReadLine() || d->m_data.contains('\n');
 }
 
+qint64 SshForwardedTcpIpTunnel::bytesToWrite() const
+{
+    return d->bufferedDataSize();
+}
+
 void SshForwardedTcpIpTunnel::close()
 {
     d->closeChannel();
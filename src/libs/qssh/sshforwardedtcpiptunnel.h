@@ -51,6 +51,7 @@ public:
     bool atEnd() const override;
     qint64 bytesAvailable() const override;
     bool canReadLine() const override;
+    qint64 bytesToWrite() const override;
     void close() override;
     bool isSequential() const override { return true; }
 
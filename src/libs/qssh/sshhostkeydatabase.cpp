@@ -30,35 +30,137 @@
 #include "sshhostkeydatabase.h"
 
 #include "sshlogging_p.h"
+#include "sshpacket_p.h"
+#include "sshpacketparser_p.h"
 
 #include <QByteArray>
 #include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
 #include <QHash>
+#include <QMessageAuthenticationCode>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
 #include <QString>
+#include <QVector>
+
+#include <cstring>
 
 namespace QSsh {
+namespace {
 
-class SshHostKeyDatabase::SshHostKeyDatabasePrivate
+const quint16 DefaultPort = 22;
+
+// OpenSSH's notation: just the host for the default port, "[host]:port" otherwise.
+QString hostEntryName(const QString &hostName, quint16 port)
 {
-public:
-    QHash<QString, QByteArray> hostKeys;
-};
+    const QString host = hostName.toLower();
+    if (port == DefaultPort)
+        return host;
+    return QLatin1Char('[') + host + QLatin1String("]:") + QString::number(port);
+}
 
-SshHostKeyDatabase::SshHostKeyDatabase() : d(new SshHostKeyDatabasePrivate)
+// Supports '*' and '?', like OpenSSH's match_pattern().
+bool wildcardMatch(const char *pattern, const char *string)
 {
+    const char *patternAfterStar = nullptr;
+    const char *stringAtStar = nullptr;
+    while (*string) {
+        if (*pattern == '*') {
+            patternAfterStar = ++pattern;
+            stringAtStar = string;
+        } else if (*pattern == '?' || *pattern == *string) {
+            ++pattern;
+            ++string;
+        } else if (patternAfterStar) {
+            pattern = patternAfterStar;
+            string = ++stringAtStar;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*')
+        ++pattern;
+    return !*pattern;
 }
 
-SshHostKeyDatabase::~SshHostKeyDatabase()
+// A negated pattern that matches rules out the whole entry.
+bool patternsMatch(const QList<QByteArray> &patterns, const QByteArray &name)
 {
-    delete d;
+    bool matched = false;
+    for (const QByteArray &pattern : patterns) {
+        if (pattern.startsWith('!')) {
+            if (wildcardMatch(pattern.constData() + 1, name.constData()))
+                return false;
+        } else if (wildcardMatch(pattern.constData(), name.constData())) {
+            matched = true;
+        }
+    }
+    return matched;
 }
 
-bool SshHostKeyDatabase::load(const QString &filePath, QString *error)
+QByteArray keyType(const QByteArray &key)
+{
+    try {
+        return Internal::SshPacketParser::asString(
+                    Internal::SshPacketParser::asString(key, quint32(0)), quint32(0));
+    } catch (const Internal::SshPacketParseException &) {
+        return QByteArray();
+    }
+}
+
+} // anonymous namespace
+
+class SshHostKeyDatabase::SshHostKeyDatabasePrivate
+{
+public:
+    enum Marker { NoMarker, CertAuthority, Revoked };
+
+    class Entry
+    {
+    public:
+        Marker marker = NoMarker;
+        bool anyPort = false; // From the old format, which did not know about ports.
+        QByteArray keyType;
+        QByteArray encodedKey; // Base64; only decoded when needed.
+        QByteArray key;
+        QByteArray salt; // Hashed host names.
+        QByteArray hash;
+        QList<QByteArray> patterns; // Host names with wildcards or negations.
+    };
+
+    bool load(const QString &filePath, QString *error, bool missingFileIsOk);
+    void clear();
+    void parseLine(const char *begin, const char *end, const QString &filePath);
+    void addEntry(const Entry &entry, const QList<QByteArray> &names);
+    const QByteArray &decodedKey(Entry &entry);
+    QVector<int> candidates(const QString &name, const QString &anyPortName);
+    KeyLookupResult match(const QVector<int> &candidates, const QByteArray &key);
+    QByteArray retrieve(const QVector<int> &candidates);
+    void insert(const QString &name, bool anyPort, const QByteArray &key,
+                KeyLookupResult lookupResult);
+
+    QVector<Entry> entries;
+    QHash<QString, QVector<int>> hostIndex;
+    QVector<int> hashedEntries;
+    QVector<int> patternEntries;
+    QHash<QString, QVector<int>> resolvedHashedEntries;
+
+    QString knownHostsFilePath;
+    QMutex mutex;
+};
+
+bool SshHostKeyDatabase::SshHostKeyDatabasePrivate::load(const QString &filePath, QString *error,
+                                                         bool missingFileIsOk)
 {
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
+        if (missingFileIsOk && !file.exists()) {
+            clear();
+            return true;
+        }
         if (error) {
             *error = QCoreApplication::translate("QSsh::Ssh",
                                                  "Failed to open key file \"%1\" for reading: %2")
@@ -67,27 +169,281 @@ bool SshHostKeyDatabase::load(const QString &filePath, QString *error)
         return false;
     }
 
-    d->hostKeys.clear();
-    const QByteArray content = file.readAll().trimmed();
-    if (content.isEmpty())
-        return true;
-    for (const QByteArray &line : content.split('\n')) {
-        const QList<QByteArray> &lineData = line.trimmed().split(' ');
-        if (lineData.count() != 2) {
-            qCDebug(Internal::sshLog, "Unexpected line \"%s\" in file \"%s\".", line.constData(),
-                   qPrintable(filePath));
+    // The entries copy what they need, so the mapping is gone once we are done. Otherwise,
+    // truncating the file, e.g. by storing to it, would pull the data from under our feet.
+    clear();
+    QByteArray fileContents; // If the file could not be mapped.
+    const char *data = nullptr;
+    qint64 size = file.size();
+    if (!file.isSequential() && size > 0)
+        data = reinterpret_cast<const char *>(file.map(0, size));
+    if (!data) {
+        fileContents = file.readAll();
+        data = fileContents.constData();
+        size = fileContents.size();
+    }
+
+    const char * const end = data + size;
+    for (const char *line = data; line < end;) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', end - line));
+        if (!lineEnd)
+            lineEnd = end;
+        parseLine(line, lineEnd, filePath);
+        line = lineEnd + 1;
+    }
+    return true;
+}
+
+void SshHostKeyDatabase::SshHostKeyDatabasePrivate::clear()
+{
+    entries.clear();
+    hostIndex.clear();
+    hashedEntries.clear();
+    patternEntries.clear();
+    resolvedHashedEntries.clear();
+}
+
+// The fields point into the file's data, so whatever the entry keeps must be copied.
+void SshHostKeyDatabase::SshHostKeyDatabasePrivate::parseLine(const char *begin, const char *end,
+                                                              const QString &filePath)
+{
+    // Marker, host names, key type and key; anything after that is a comment.
+    QList<QByteArray> fields;
+    for (const char *p = begin; p < end && fields.count() < 4;) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            ++p;
+        if (p == end)
+            break;
+        const char * const fieldStart = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+            ++p;
+        fields << QByteArray::fromRawData(fieldStart, int(p - fieldStart));
+    }
+    if (fields.isEmpty() || fields.first().startsWith('#'))
+        return;
+
+    Entry entry;
+    if (fields.first().startsWith('@')) {
+        if (fields.first() == "@cert-authority") {
+            entry.marker = CertAuthority;
+        } else if (fields.first() == "@revoked") {
+            entry.marker = Revoked;
+        } else {
+            qCDebug(Internal::sshLog, "Unknown marker in line \"%s\".",
+                    QByteArray(begin, int(end - begin)).constData());
+            return;
+        }
+        fields.removeFirst();
+    }
+
+    QList<QByteArray> names;
+    if (fields.count() == 2 && entry.marker == NoMarker) {
+        // Our own format: "hostname hexkey".
+        entry.anyPort = true;
+        entry.key = QByteArray::fromHex(fields.last());
+        entry.keyType = keyType(entry.key);
+        names << fields.first().toLower();
+    } else if (fields.count() >= 3) {
+        const QByteArray &hosts = fields.at(0);
+        entry.keyType = QByteArray(fields.at(1).constData(), fields.at(1).size());
+        entry.encodedKey = QByteArray(fields.at(2).constData(), fields.at(2).size());
+        if (hosts.startsWith("|1|")) {
+            const QList<QByteArray> saltAndHash = hosts.mid(3).split('|');
+            if (saltAndHash.count() != 2)
+                return;
+            entry.salt = QByteArray::fromBase64(saltAndHash.first());
+            entry.hash = QByteArray::fromBase64(saltAndHash.last());
+        } else {
+            names = hosts.toLower().split(',');
+            for (const QByteArray &name : qAsConst(names)) {
+                if (name.startsWith('!') || name.contains('*') || name.contains('?')) {
+                    entry.patterns = names;
+                    names.clear();
+                    break;
+                }
+            }
+        }
+    } else {
+        qCDebug(Internal::sshLog, "Unexpected line \"%s\" in file \"%s\".",
+                QByteArray(begin, int(end - begin)).constData(),
+                qPrintable(filePath));
+        return;
+    }
+    addEntry(entry, names);
+}
+
+void SshHostKeyDatabase::SshHostKeyDatabasePrivate::addEntry(const Entry &entry,
+                                                             const QList<QByteArray> &names)
+{
+    const int index = entries.count();
+    entries << entry;
+    if (!entry.salt.isEmpty()) {
+        hashedEntries << index;
+        resolvedHashedEntries.clear();
+        return;
+    }
+    if (!entry.patterns.isEmpty()) {
+        patternEntries << index;
+        return;
+    }
+
+    for (const QByteArray &name : names) {
+        QVector<int> &indexes = hostIndex[QString::fromUtf8(name)];
+
+        // Files only ever grow, so a later key of the same type replaces the earlier one.
+        if (entry.marker == NoMarker) {
+            for (auto it = indexes.begin(); it != indexes.end();) {
+                const Entry &other = entries.at(*it);
+                if (other.marker == NoMarker && other.keyType == entry.keyType
+                        && other.anyPort == entry.anyPort) {
+                    it = indexes.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        indexes << index;
+    }
+}
+
+const QByteArray &SshHostKeyDatabase::SshHostKeyDatabasePrivate::decodedKey(Entry &entry)
+{
+    if (entry.key.isEmpty() && !entry.encodedKey.isEmpty()) {
+        const QByteArray blob = QByteArray::fromBase64(entry.encodedKey);
+        if (!blob.isEmpty())
+            entry.key = Internal::AbstractSshPacket::encodeString(blob);
+        entry.encodedKey.clear();
+    }
+    return entry.key;
+}
+
+QVector<int> SshHostKeyDatabase::SshHostKeyDatabasePrivate::candidates(const QString &name,
+        const QString &anyPortName)
+{
+    QVector<int> result = hostIndex.value(name);
+    if (!anyPortName.isEmpty() && anyPortName != name) {
+        for (const int index : hostIndex.value(anyPortName)) {
+            if (entries.at(index).anyPort)
+                result << index;
+        }
+    }
+
+    const QByteArray utf8Name = name.toUtf8();
+    if (!hashedEntries.isEmpty()) {
+        // Every hashed entry has its own salt, so we have to try them all, but only once per name.
+        auto it = resolvedHashedEntries.constFind(name);
+        if (it == resolvedHashedEntries.constEnd()) {
+            QVector<int> matching;
+            for (const int index : qAsConst(hashedEntries)) {
+                const Entry &entry = entries.at(index);
+                if (QMessageAuthenticationCode::hash(utf8Name, entry.salt, QCryptographicHash::Sha1)
+                        == entry.hash) {
+                    matching << index;
+                }
+            }
+            it = resolvedHashedEntries.insert(name, matching);
+        }
+        result += it.value();
+    }
+
+    for (const int index : qAsConst(patternEntries)) {
+        if (patternsMatch(entries.at(index).patterns, utf8Name))
+            result << index;
+    }
+    return result;
+}
+
+SshHostKeyDatabase::KeyLookupResult SshHostKeyDatabase::SshHostKeyDatabasePrivate::match(
+        const QVector<int> &candidates, const QByteArray &key)
+{
+    KeyLookupResult result = KeyLookupNoMatch;
+    for (const int index : candidates) {
+        Entry &entry = entries[index];
+        if (entry.marker == CertAuthority)
             continue;
+        const bool sameKey = decodedKey(entry) == key;
+        if (entry.marker == Revoked) {
+            if (sameKey)
+                return KeyLookupRevoked;
+        } else if (sameKey) {
+            result = KeyLookupMatch;
+        } else if (result == KeyLookupNoMatch) {
+            result = KeyLookupMismatch;
         }
-        d->hostKeys.insert(QString::fromUtf8(lineData.first()),
-                           QByteArray::fromHex(lineData.last()));
     }
+    return result;
+}
+
+QByteArray SshHostKeyDatabase::SshHostKeyDatabasePrivate::retrieve(const QVector<int> &candidates)
+{
+    for (int i = candidates.count() - 1; i >= 0; --i) {
+        Entry &entry = entries[candidates.at(i)];
+        if (entry.marker == NoMarker && !decodedKey(entry).isEmpty())
+            return entry.key;
+    }
+    return QByteArray();
+}
+
+// Revoked keys stay out. Keys replacing a different one are only kept in memory, so that
+// the file never ends up trusting a key the user did not get to see.
+void SshHostKeyDatabase::SshHostKeyDatabasePrivate::insert(const QString &name, bool anyPort,
+        const QByteArray &key, KeyLookupResult lookupResult)
+{
+    if (lookupResult == KeyLookupMatch || lookupResult == KeyLookupRevoked)
+        return;
+
+    Entry entry;
+    entry.anyPort = anyPort;
+    entry.key = key;
+    entry.keyType = keyType(key);
+    addEntry(entry, QList<QByteArray>() << name.toUtf8());
+
+    if (lookupResult != KeyLookupNoMatch || knownHostsFilePath.isEmpty()
+            || entry.keyType.isEmpty()) {
+        return;
+    }
+    QFile knownHostsFile(knownHostsFilePath);
+    if (!knownHostsFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCWarning(Internal::sshLog, "Failed to append to \"%s\": %s", qPrintable(knownHostsFilePath),
+                  qPrintable(knownHostsFile.errorString()));
+        return;
+    }
+    const QByteArray blob = Internal::SshPacketParser::asString(key, quint32(0));
+    knownHostsFile.write(name.toUtf8() + ' ' + entry.keyType + ' ' + blob.toBase64() + '\n');
+}
+
+SshHostKeyDatabase::SshHostKeyDatabase() : d(new SshHostKeyDatabasePrivate)
+{
+}
+
+SshHostKeyDatabase::~SshHostKeyDatabase()
+{
+    delete d;
+}
 
+bool SshHostKeyDatabase::load(const QString &filePath, QString *error)
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->load(filePath, error, false))
+        return false;
+    d->knownHostsFilePath.clear();
     return true;
 }
 
+bool SshHostKeyDatabase::openKnownHosts(const QString &filePath, QString *error)
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->load(filePath, error, true))
+        return false;
+    d->knownHostsFilePath = filePath;
+    return true;
+}
+
+// Host names only; hashed and wildcard entries cannot be represented in this format.
+// The file is replaced as a whole, so a reader never sees it half written.
 bool SshHostKeyDatabase::store(const QString &filePath, QString *error) const
 {
-    QFile file(filePath);
+    QSaveFile file(filePath);
     if (!file.open(QIODevice::WriteOnly)) {
         if (error) {
             *error = QCoreApplication::translate("QSsh::Ssh",
@@ -97,31 +453,68 @@ bool SshHostKeyDatabase::store(const QString &filePath, QString *error) const
         return false;
     }
 
-    file.resize(0);
-    for (auto it = d->hostKeys.constBegin(); it != d->hostKeys.constEnd(); ++it)
-        file.write(it.key().toUtf8() + ' ' + it.value().toHex() + '\n');
+    {
+        QMutexLocker locker(&d->mutex);
+        for (auto it = d->hostIndex.constBegin(); it != d->hostIndex.constEnd(); ++it) {
+            for (const int index : it.value()) {
+                SshHostKeyDatabasePrivate::Entry &entry = d->entries[index];
+                if (entry.marker == SshHostKeyDatabasePrivate::NoMarker
+                        && !d->decodedKey(entry).isEmpty()) {
+                    file.write(it.key().toUtf8() + ' ' + entry.key.toHex() + '\n');
+                }
+            }
+        }
+    }
+    if (!file.commit()) {
+        if (error) {
+            *error = QCoreApplication::translate("QSsh::Ssh",
+                                                 "Failed to write key file \"%1\": %2")
+                    .arg(QDir::toNativeSeparators(filePath), file.errorString());
+        }
+        return false;
+    }
     return true;
 }
 
+SshHostKeyDatabase::KeyLookupResult SshHostKeyDatabase::matchHostKey(const QString &hostName,
+        quint16 port, const QByteArray &key) const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->match(d->candidates(hostEntryName(hostName, port), hostName.toLower()), key);
+}
+
+void SshHostKeyDatabase::insertHostKey(const QString &hostName, quint16 port,
+                                       const QByteArray &key)
+{
+    QMutexLocker locker(&d->mutex);
+    const QString name = hostEntryName(hostName, port);
+    d->insert(name, false, key, d->match(d->candidates(name, hostName.toLower()), key));
+}
+
+QByteArray SshHostKeyDatabase::retrieveHostKey(const QString &hostName, quint16 port) const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->retrieve(d->candidates(hostEntryName(hostName, port), hostName.toLower()));
+}
+
 SshHostKeyDatabase::KeyLookupResult SshHostKeyDatabase::matchHostKey(const QString &hostName,
                                                                      const QByteArray &key) const
 {
-    auto it = d->hostKeys.constFind(hostName);
-    if (it == d->hostKeys.constEnd())
-        return KeyLookupNoMatch;
-    if (it.value() == key)
-        return KeyLookupMatch;
-    return KeyLookupMismatch;
+    QMutexLocker locker(&d->mutex);
+    return d->match(d->candidates(hostName.toLower(), QString()), key);
 }
 
 void SshHostKeyDatabase::insertHostKey(const QString &hostName, const QByteArray &key)
 {
-    d->hostKeys.insert(hostName, key);
+    QMutexLocker locker(&d->mutex);
+    const QString name = hostName.toLower();
+    d->insert(name, true, key, d->match(d->candidates(name, QString()), key));
 }
 
 QByteArray SshHostKeyDatabase::retrieveHostKey(const QString &hostName)
 {
-   return d->hostKeys.value(hostName);
+    QMutexLocker locker(&d->mutex);
+    return d->retrieve(d->candidates(hostName.toLower(), QString()));
 }
 
 } // namespace QSsh
@@ -45,6 +45,19 @@ class SshHostKeyDatabase;
 /// Convenience typedef
 typedef QSharedPointer<SshHostKeyDatabase> SshHostKeyDatabasePtr;
 
+/*!
+    \class QSsh::SshHostKeyDatabase
+
+    \brief Keeps track of the host keys we have seen.
+
+    Reads both OpenSSH's known_hosts format, including hashed host names, "[host]:port"
+    entries, wildcards and the @revoked marker, and the simpler "hostname hexkey" format
+    written by store(). Host certificates are not supported, so @cert-authority lines
+    are ignored.
+
+    Keys are given in wire format, i.e. as the string wrapping the key blob.
+*/
+
 class QSSH_EXPORT SshHostKeyDatabase
 {
     friend class QSharedPointer<SshHostKeyDatabase>; // To give create() access to our constructor.
@@ -53,7 +66,8 @@ public:
     enum KeyLookupResult {
         KeyLookupMatch,
         KeyLookupNoMatch,
-        KeyLookupMismatch
+        KeyLookupMismatch,
+        KeyLookupRevoked
     };
 
     SshHostKeyDatabase();
@@ -61,6 +75,19 @@ public:
 
     bool load(const QString &filePath, QString *error = nullptr);
     bool store(const QString &filePath, QString *error = nullptr) const;
+
+    // Like load(), but also appends keys for hosts without any known key to the file as they
+    // get inserted. A missing file is not an error; it is created on the first insertion.
+    // Revoked keys are never inserted, and keys replacing another one are not written out.
+    bool openKnownHosts(const QString &filePath, QString *error = nullptr);
+
+    // Keys for ports other than 22 are looked up as "[hostName]:port", as OpenSSH does.
+    KeyLookupResult matchHostKey(const QString &hostName, quint16 port,
+                                 const QByteArray &key) const;
+    void insertHostKey(const QString &hostName, quint16 port, const QByteArray &key);
+    QByteArray retrieveHostKey(const QString &hostName, quint16 port) const;
+
+    // These consider the host name only, whatever the port.
     KeyLookupResult matchHostKey(const QString &hostName, const QByteArray &key) const;
     void insertHostKey(const QString &hostName, const QByteArray &key);
     QByteArray retrieveHostKey(const QString &hostName);
@@ -43,6 +43,7 @@ const QByteArray SshIncomingPacket::ExitSignalType("exit-signal");
 const QByteArray SshIncomingPacket::ForwardedTcpIpType("forwarded-tcpip");
 
 SshIncomingPacket::SshIncomingPacket() : m_serverSeqNr(0) { }
+SshIncomingPacket::~SshIncomingPacket() = default;
 
 quint32 SshIncomingPacket::cipherBlockSize() const
 {
@@ -64,6 +65,7 @@ void SshIncomingPacket::reset()
     clear();
     m_serverSeqNr = 0;
     m_decrypter.clearKeys();
+    m_decrypter.resetTimings();
 }
 
 void SshIncomingPacket::consumeData(QByteArray &newData)
@@ -120,7 +122,7 @@ void SshIncomingPacket::decrypt()
 void SshIncomingPacket::moveFirstBytes(QByteArray &target, QByteArray &source,
     int n)
 {
-    target.append(source.left(n));
+    target.append(source.constData(), n);
     source.remove(0, n);
 }
 
@@ -165,23 +167,25 @@ SshKeyExchangeInit SshIncomingPacket::extractKeyExchangeInitData() const
 }
 
 static void getHostKeySpecificReplyData(SshKeyExchangeReply &replyData,
-                                        const QByteArray &hostKeyAlgo, const QByteArray &input)
+                                        const QByteArray &hostKeyType, const QByteArray &input)
 {
     quint32 offset = 0;
-    if (hostKeyAlgo == SshCapabilities::PubKeyDss || hostKeyAlgo == SshCapabilities::PubKeyRsa) {
+    if (hostKeyType == SshCapabilities::PubKeyDss || hostKeyType == SshCapabilities::PubKeyRsa) {
         // DSS: p and q, RSA: e and n
         replyData.hostKeyParameters << SshPacketParser::asBigInt(input, &offset);
         replyData.hostKeyParameters << SshPacketParser::asBigInt(input, &offset);
 
         // g and y
-        if (hostKeyAlgo == SshCapabilities::PubKeyDss) {
+        if (hostKeyType == SshCapabilities::PubKeyDss) {
             replyData.hostKeyParameters << SshPacketParser::asBigInt(input, &offset);
             replyData.hostKeyParameters << SshPacketParser::asBigInt(input, &offset);
         }
+    } else if (hostKeyType == SshCapabilities::PubKeyEd25519) {
+        replyData.q = SshPacketParser::asString(input, &offset);
     } else {
-        QSSH_ASSERT_AND_RETURN(hostKeyAlgo.startsWith(SshCapabilities::PubKeyEcdsaPrefix));
+        QSSH_ASSERT_AND_RETURN(hostKeyType.startsWith(SshCapabilities::PubKeyEcdsaPrefix));
         if (SshPacketParser::asString(input, &offset)
-                != hostKeyAlgo.mid(11)) { // Without "ecdsa-sha2-" prefix.
+                != hostKeyType.mid(11)) { // Without "ecdsa-sha2-" prefix.
             throw SshPacketParseException();
         }
         replyData.q = SshPacketParser::asString(input, &offset);
@@ -203,16 +207,19 @@ SshKeyExchangeReply SshIncomingPacket::extractKeyExchangeReply(const QByteArray
         SshKeyExchangeReply replyData;
         quint32 topLevelOffset = TypeOffset + 1;
         replyData.k_s = SshPacketParser::asString(m_data, &topLevelOffset);
+        // For the RFC 8332 algorithms, the key is still of type "ssh-rsa".
+        const QByteArray hostKeyType = SshCapabilities::publicKeyType(hostKeyAlgo);
         quint32 k_sOffset = 0;
-        if (SshPacketParser::asString(replyData.k_s, &k_sOffset) != hostKeyAlgo)
+        if (SshPacketParser::asString(replyData.k_s, &k_sOffset) != hostKeyType)
             throw SshPacketParseException();
-        getHostKeySpecificReplyData(replyData, hostKeyAlgo, replyData.k_s.mid(k_sOffset));
+        getHostKeySpecificReplyData(replyData, hostKeyType, replyData.k_s.mid(k_sOffset));
 
         if (kexAlgo == SshCapabilities::DiffieHellmanGroup1Sha1
                 || kexAlgo == SshCapabilities::DiffieHellmanGroup14Sha1) {
             replyData.f = SshPacketParser::asBigInt(m_data, &topLevelOffset);
         } else {
-            QSSH_ASSERT_AND_RETURN_VALUE(kexAlgo.startsWith(SshCapabilities::EcdhKexNamePrefix),
+            QSSH_ASSERT_AND_RETURN_VALUE(kexAlgo.startsWith(SshCapabilities::EcdhKexNamePrefix)
+                                         || kexAlgo.startsWith(SshCapabilities::Curve25519KexNamePrefix),
                                          SshKeyExchangeReply());
             replyData.q_s = SshPacketParser::asString(m_data, &topLevelOffset);
         }
@@ -260,6 +267,26 @@ SshDisconnect SshIncomingPacket::extractDisconnect() const
     return msg;
 }
 
+SshExtensionInfo SshIncomingPacket::extractExtensionInfo() const
+{
+    Q_ASSERT(isComplete());
+    Q_ASSERT(type() == SSH_MSG_EXT_INFO);
+
+    try {
+        SshExtensionInfo msg;
+        quint32 offset = TypeOffset + 1;
+        const quint32 count = SshPacketParser::asUint32(m_data, &offset);
+        for (quint32 i = 0; i < count; ++i) {
+            const QByteArray name = SshPacketParser::asString(m_data, &offset);
+            msg.extensions.insert(name, SshPacketParser::asString(m_data, &offset));
+        }
+        return msg;
+    } catch (const SshPacketParseException &) {
+        throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
+            "Invalid SSH_MSG_EXT_INFO.");
+    }
+}
+
 SshUserAuthBanner SshIncomingPacket::extractUserAuthBanner() const
 {
     Q_ASSERT(isComplete());
@@ -492,7 +519,7 @@ SshChannelData SshIncomingPacket::extractChannelData() const
     try {
         quint32 offset = TypeOffset + 1;
         data.localChannel = SshPacketParser::asUint32(m_data, &offset);
-        data.data = SshPacketParser::asString(m_data, &offset);
+        data.data = SshPacketParser::asStringView(m_data, &offset);
     } catch (const SshPacketParseException &) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Invalid SSH_MSG_CHANNEL_DATA packet.");
@@ -510,7 +537,7 @@ SshChannelExtendedData SshIncomingPacket::extractChannelExtendedData() const
         quint32 offset = TypeOffset + 1;
         data.localChannel = SshPacketParser::asUint32(m_data, &offset);
         data.type = SshPacketParser::asUint32(m_data, &offset);
-        data.data = SshPacketParser::asString(m_data, &offset);
+        data.data = SshPacketParser::asStringView(m_data, &offset);
     } catch (const SshPacketParseException &) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Invalid SSH_MSG_CHANNEL_EXTENDED_DATA packet.");
@@ -527,7 +554,7 @@ SshChannelExitStatus SshIncomingPacket::extractChannelExitStatus() const
     try {
         quint32 offset = TypeOffset + 1;
         exitStatus.localChannel = SshPacketParser::asUint32(m_data, &offset);
-        const QByteArray &type = SshPacketParser::asString(m_data, &offset);
+        const SshByteView type = SshPacketParser::asStringView(m_data, &offset);
         Q_ASSERT(type == ExitStatusType);
         Q_UNUSED(type);
         if (SshPacketParser::asBool(m_data, &offset))
@@ -549,7 +576,7 @@ SshChannelExitSignal SshIncomingPacket::extractChannelExitSignal() const
     try {
         quint32 offset = TypeOffset + 1;
         exitSignal.localChannel = SshPacketParser::asUint32(m_data, &offset);
-        const QByteArray &type = SshPacketParser::asString(m_data, &offset);
+        const SshByteView type = SshPacketParser::asStringView(m_data, &offset);
         Q_ASSERT(type == ExitSignalType);
         Q_UNUSED(type);
         if (SshPacketParser::asBool(m_data, &offset))
@@ -578,7 +605,7 @@ quint32 SshIncomingPacket::extractRecipientChannel() const
     }
 }
 
-QByteArray SshIncomingPacket::extractChannelRequestType() const
+SshByteView SshIncomingPacket::extractChannelRequestType() const
 {
     Q_ASSERT(isComplete());
     Q_ASSERT(type() == SSH_MSG_CHANNEL_REQUEST);
@@ -586,7 +613,7 @@ QByteArray SshIncomingPacket::extractChannelRequestType() const
     try {
         quint32 offset = TypeOffset + 1;
         SshPacketParser::asUint32(m_data, &offset);
-        return SshPacketParser::asString(m_data, &offset);
+        return SshPacketParser::asStringView(m_data, &offset);
     } catch (const SshPacketParseException &) {
         throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_PROTOCOL_ERROR,
             "Invalid SSH_MSG_CHANNEL_REQUEST packet.");
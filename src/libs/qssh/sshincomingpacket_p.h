@@ -36,6 +36,7 @@
 #include "sshcryptofacility_p.h"
 #include "sshpacketparser_p.h"
 
+#include <QHash>
 #include <QStringList>
 
 namespace QSsh {
@@ -63,7 +64,7 @@ struct SshKeyExchangeReply
 {
     QByteArray k_s;
     QList<Botan::BigInt> hostKeyParameters; // DSS: p, q, g, y. RSA: e, n.
-    QByteArray q; // For ECDSA host keys only.
+    QByteArray q; // For ECDSA and Ed25519 host keys only.
     Botan::BigInt f; // For DH only.
     QByteArray q_s; // For ECDH only.
     QByteArray signatureBlob;
@@ -104,6 +105,11 @@ struct SshDebug
     QByteArray language;
 };
 
+struct SshExtensionInfo
+{
+    QHash<QByteArray, QByteArray> extensions; // Name -> value.
+};
+
 struct SshUnimplemented
 {
     quint32 invalidMsgSeqNr;
@@ -166,17 +172,18 @@ struct SshChannelWindowAdjust
     quint32 bytesToAdd;
 };
 
+// The data members of these two point into the packet they were extracted from.
 struct SshChannelData
 {
     quint32 localChannel;
-    QByteArray data;
+    SshByteView data;
 };
 
 struct SshChannelExtendedData
 {
     quint32 localChannel;
     quint32 type;
-    QByteArray data;
+    SshByteView data;
 };
 
 struct SshChannelExitStatus
@@ -194,13 +201,19 @@ struct SshChannelExitSignal
     QByteArray language;
 };
 
-class SshIncomingPacket : public AbstractSshPacket
+class QSSH_EXPORT SshIncomingPacket : public AbstractSshPacket
 {
 public:
     SshIncomingPacket();
+    ~SshIncomingPacket() override;
 
     void consumeData(QByteArray &data);
     void recreateKeys(const SshKeyExchange &keyExchange);
+#ifdef QSSH_BENCHMARK_HOOKS
+    void setFixedKeys(const QByteArray &cryptAlgoName, const QByteArray &hMacAlgoName) {
+        m_decrypter.setFixedKeys(cryptAlgoName, hMacAlgoName); // See SshAbstractCryptoFacility.
+    }
+#endif
     void reset();
 
     SshKeyExchangeInit extractKeyExchangeInitData() const;
@@ -211,6 +224,7 @@ public:
     SshUserAuthInfoRequestPacket extractUserAuthInfoRequest() const;
     SshUserAuthPkOkPacket extractUserAuthPkOk() const;
     SshDebug extractDebug() const;
+    SshExtensionInfo extractExtensionInfo() const;
     SshRequestSuccess extractRequestSuccess() const;
     SshUnimplemented extractUnimplemented() const;
 
@@ -226,9 +240,18 @@ public:
     SshChannelExitStatus extractChannelExitStatus() const;
     SshChannelExitSignal extractChannelExitSignal() const;
     quint32 extractRecipientChannel() const;
-    QByteArray extractChannelRequestType() const;
+    SshByteView extractChannelRequestType() const;
 
     quint32 serverSeqNr() const { return m_serverSeqNr; }
+    quint32 payLoadSize() const { return length() - paddingLength() - 1; }
+    SshByteView payLoadView() const {
+        return SshByteView(m_data.constData() + PayloadOffset, payLoadSize());
+    }
+
+    // Accumulated decryption and MAC verification time in nanoseconds; see
+    // SshAbstractCryptoFacility::cipherTime().
+    qint64 decryptionTime() const { return m_decrypter.cipherTime(); }
+    qint64 macTime() const { return m_decrypter.macTime(); }
 
     static const QByteArray ExitStatusType;
     static const QByteArray ExitSignalType;
@@ -37,7 +37,9 @@
 #include "sshexception_p.h"
 #include "sshincomingpacket_p.h"
 #include "sshlogging_p.h"
+#include "sshpacketparser_p.h"
 
+#include <botan/curve25519.h>
 #include <botan/dl_group.h>
 #include <botan/dh.h>
 #include <botan/numthry.h>
@@ -47,6 +49,10 @@
 #include <botan/pk_ops.h>
 #include <botan/ecdh.h>
 #include <botan/ecdsa.h>
+#include <botan/ed25519.h>
+
+#include <QHash>
+#include <QMutex>
 
 #ifdef CREATOR_SSH_DEBUG
 #include <iostream>
@@ -75,6 +81,28 @@ namespace {
                 data.toHex().constData());
     }
 
+    // What servers preferred the last time we talked to them. A guessed key exchange packet
+    // is only accepted if both sides list the same algorithms first.
+    struct KexGuess
+    {
+        QByteArray keyExchangeAlgorithm;
+        QByteArray hostKeyAlgorithm;
+    };
+
+    QMutex kexGuessCacheMutex;
+    QHash<QString, KexGuess> kexGuessCache;
+
+    QString kexGuessCacheKey(const SshConnectionParameters &params)
+    {
+        return params.host() + QLatin1Char(':') + QString::number(params.port());
+    }
+
+    void moveToFront(QList<QByteArray> &list, const QByteArray &value)
+    {
+        list.removeOne(value);
+        list.prepend(value);
+    }
+
 } // anonymous namespace
 
 SshKeyExchange::SshKeyExchange(const SshConnectionParameters &connParams,
@@ -85,10 +113,36 @@ SshKeyExchange::SshKeyExchange(const SshConnectionParameters &connParams,
 
 SshKeyExchange::~SshKeyExchange() {}
 
-void SshKeyExchange::sendKexInitPacket(const QByteArray &serverId)
+void SshKeyExchange::sendKexInitPacket(const QByteArray &serverId, bool allowGuess)
 {
     m_serverId = serverId;
-    m_clientKexInitPayload = m_sendFacility.sendKeyExchangeInitPacket();
+    m_hostKeyAlgorithms = hostKeyAlgorithms();
+    m_keyExchangeMethods = SshCapabilities::KeyExchangeMethods;
+
+    KexGuess guess;
+    if (allowGuess) {
+        QMutexLocker locker(&kexGuessCacheMutex);
+        guess = kexGuessCache.value(kexGuessCacheKey(m_connParams));
+    }
+
+    // The host key type must not change, as that would look like a different host.
+    if (!guess.keyExchangeAlgorithm.isEmpty()
+            && m_keyExchangeMethods.contains(guess.keyExchangeAlgorithm)
+            && m_hostKeyAlgorithms.contains(guess.hostKeyAlgorithm)
+            && SshCapabilities::publicKeyType(guess.hostKeyAlgorithm)
+                == SshCapabilities::publicKeyType(m_hostKeyAlgorithms.first())) {
+        moveToFront(m_keyExchangeMethods, guess.keyExchangeAlgorithm);
+        moveToFront(m_hostKeyAlgorithms, guess.hostKeyAlgorithm);
+        m_guessedKexAlgoName = guess.keyExchangeAlgorithm;
+    }
+
+    m_clientKexInitPayload = m_sendFacility.sendKeyExchangeInitPacket(m_keyExchangeMethods,
+            m_hostKeyAlgorithms, !m_guessedKexAlgoName.isEmpty());
+    if (!m_guessedKexAlgoName.isEmpty()) {
+        qCDebug(sshLog, "guessing key exchange algorithm %s", m_guessedKexAlgoName.constData());
+        m_kexAlgoName = m_guessedKexAlgoName;
+        sendClientKexPacket();
+    }
 }
 
 bool SshKeyExchange::sendDhInitPacket(const SshIncomingPacket &serverKexInit)
@@ -110,11 +164,13 @@ bool SshKeyExchange::sendDhInitPacket(const SshIncomingPacket &serverKexInit)
     printNameList("Languages server to client", kexInitParams.languagesServerToClient);
     qCDebug(sshLog, "First packet follows: %d", kexInitParams.firstKexPacketFollows);
 
-    m_kexAlgoName = SshCapabilities::findBestMatch(SshCapabilities::KeyExchangeMethods,
-                                                   kexInitParams.keyAlgorithms.names,
+    const QList<QByteArray> &serverKexAlgorithms = kexInitParams.keyAlgorithms.names;
+    const QList<QByteArray> &serverHostKeyAlgorithms = kexInitParams.serverHostKeyAlgorithms.names;
+    // The client's list decides, i.e. the one we sent, with a guess moved to the front.
+    m_kexAlgoName = SshCapabilities::findBestMatch(m_keyExchangeMethods, serverKexAlgorithms,
                                                    "KeyExchange");
-    m_serverHostKeyAlgo = SshCapabilities::findBestMatch(SshCapabilities::PublicKeyAlgorithms,
-            kexInitParams.serverHostKeyAlgorithms.names, "HostKey");
+    m_serverHostKeyAlgo = SshCapabilities::findBestMatch(m_hostKeyAlgorithms,
+            serverHostKeyAlgorithms, "HostKey");
     determineHashingAlgorithm(kexInitParams, true);
     determineHashingAlgorithm(kexInitParams, false);
 
@@ -129,17 +185,54 @@ bool SshKeyExchange::sendDhInitPacket(const SshIncomingPacket &serverKexInit)
     SshCapabilities::findBestMatch(SshCapabilities::CompressionAlgorithms,
         kexInitParams.compressionAlgorithmsServerToClient.names, "Compression Server to Client");
 
+    const QByteArray serverPreferredKexAlgo = serverKexAlgorithms.value(0);
+    const QByteArray serverPreferredHostKeyAlgo = serverHostKeyAlgorithms.value(0);
+    {
+        // Guessing only makes sense if we can do what the server likes best.
+        QMutexLocker locker(&kexGuessCacheMutex);
+        if (SshCapabilities::KeyExchangeMethods.contains(serverPreferredKexAlgo)
+                && SshCapabilities::PublicKeyAlgorithms.contains(serverPreferredHostKeyAlgo)) {
+            kexGuessCache.insert(kexGuessCacheKey(m_connParams),
+                                 KexGuess{serverPreferredKexAlgo, serverPreferredHostKeyAlgo});
+        } else {
+            kexGuessCache.remove(kexGuessCacheKey(m_connParams));
+        }
+    }
+
+    if (!m_guessedKexAlgoName.isEmpty()) {
+        if (serverPreferredKexAlgo == m_guessedKexAlgoName
+                && serverPreferredHostKeyAlgo == m_hostKeyAlgorithms.first()) {
+            qCDebug(sshLog, "server accepts our guessed key exchange packet");
+            m_serverKexInitPayload = serverKexInit.payLoad();
+            return kexInitParams.firstKexPacketFollows;
+        }
+
+        // The server ignores the packet we already sent.
+        qCDebug(sshLog, "wrong key exchange guess, server prefers %s",
+                serverPreferredKexAlgo.constData());
+        m_x25519Key.reset();
+        m_ecdhKey.reset();
+        m_dhKey.reset();
+    }
+    sendClientKexPacket();
+
+    m_serverKexInitPayload = serverKexInit.payLoad();
+    return kexInitParams.firstKexPacketFollows;
+}
+
+void SshKeyExchange::sendClientKexPacket()
+{
     AutoSeeded_RNG rng;
-    if (m_kexAlgoName.startsWith(SshCapabilities::EcdhKexNamePrefix)) {
+    if (m_kexAlgoName.startsWith(SshCapabilities::Curve25519KexNamePrefix)) {
+        m_x25519Key.reset(new Curve25519_PrivateKey(rng));
+        m_sendFacility.sendKeyEcdhInitPacket(convertByteArray(m_x25519Key->public_value()));
+    } else if (m_kexAlgoName.startsWith(SshCapabilities::EcdhKexNamePrefix)) {
         m_ecdhKey.reset(new ECDH_PrivateKey(rng, EC_Group(botanKeyExchangeAlgoName(m_kexAlgoName))));
         m_sendFacility.sendKeyEcdhInitPacket(convertByteArray(m_ecdhKey->public_value()));
     } else {
         m_dhKey.reset(new DH_PrivateKey(rng, DL_Group(botanKeyExchangeAlgoName(m_kexAlgoName))));
         m_sendFacility.sendKeyDhInitPacket(m_dhKey->get_y());
     }
-
-    m_serverKexInitPayload = serverKexInit.payLoad();
-    return kexInitParams.firstKexPacketFollows;
 }
 
 void SshKeyExchange::sendNewKeysPacket(const SshIncomingPacket &dhReply,
@@ -178,6 +271,27 @@ void SshKeyExchange::sendNewKeysPacket(const SshIncomingPacket &dhReply,
         printData("y", AbstractSshPacket::encodeMpInt(m_dhKey->get_y()));
         printData("f", AbstractSshPacket::encodeMpInt(reply.f));
         m_dhKey.reset();
+    } else if (m_x25519Key) {
+        // RFC 8731, 3.1: Q_S must be exactly 32 bytes and the shared secret must not be zero.
+        if (reply.q_s.count() != 32) {
+            throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_KEY_EXCHANGE_FAILED,
+                "Server sent invalid Q_S.");
+        }
+        concatenatedData // Q_C.
+                += AbstractSshPacket::encodeString(convertByteArray(m_x25519Key->public_value()));
+        concatenatedData += AbstractSshPacket::encodeString(reply.q_s);
+        std::unique_ptr<PK_Ops::Key_Agreement> x25519Op
+                = m_x25519Key->create_key_agreement_op(rng, "Raw", "base");
+        encodedK = x25519Op->agree(0, convertByteArray(reply.q_s), reply.q_s.count(), nullptr, 0);
+        m_x25519Key.reset();
+
+        byte allBits = 0;
+        for (const byte b : encodedK)
+            allBits |= b;
+        if (allBits == 0) {
+            throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_KEY_EXCHANGE_FAILED,
+                "Key exchange produced an all-zero shared secret.");
+        }
     } else {
         Q_ASSERT(m_ecdhKey);
         concatenatedData // Q_C.
@@ -204,16 +318,23 @@ void SshKeyExchange::sendNewKeysPacket(const SshIncomingPacket &dhReply,
     printData("H", m_h);
 
     QScopedPointer<Public_Key> sigKey;
-    if (m_serverHostKeyAlgo == SshCapabilities::PubKeyDss) {
+    const QByteArray hostKeyType = SshCapabilities::publicKeyType(m_serverHostKeyAlgo);
+    if (hostKeyType == SshCapabilities::PubKeyDss) {
         const DL_Group group(reply.hostKeyParameters.at(0), reply.hostKeyParameters.at(1),
             reply.hostKeyParameters.at(2));
         DSA_PublicKey * const dsaKey
             = new DSA_PublicKey(group, reply.hostKeyParameters.at(3));
         sigKey.reset(dsaKey);
-    } else if (m_serverHostKeyAlgo == SshCapabilities::PubKeyRsa) {
+    } else if (hostKeyType == SshCapabilities::PubKeyRsa) {
         RSA_PublicKey * const rsaKey
             = new RSA_PublicKey(reply.hostKeyParameters.at(1), reply.hostKeyParameters.at(0));
         sigKey.reset(rsaKey);
+    } else if (hostKeyType == SshCapabilities::PubKeyEd25519) {
+        if (reply.q.count() != 32) {
+            throw SSH_SERVER_EXCEPTION(SSH_DISCONNECT_KEY_EXCHANGE_FAILED,
+                "Server sent invalid Ed25519 host key.");
+        }
+        sigKey.reset(new Ed25519_PublicKey(convertByteArray(reply.q), reply.q.count()));
     } else {
         QSSH_ASSERT_AND_RETURN(m_serverHostKeyAlgo.startsWith(SshCapabilities::PubKeyEcdsaPrefix));
         const EC_Group domain(SshCapabilities::oid(m_serverHostKeyAlgo));
@@ -240,6 +361,8 @@ void SshKeyExchange::sendNewKeysPacket(const SshIncomingPacket &dhReply,
 
 QByteArray SshKeyExchange::hashAlgoForKexAlgo() const
 {
+    if (m_kexAlgoName.startsWith(SshCapabilities::Curve25519KexNamePrefix))
+        return SshCapabilities::HMacSha256;
     if (m_kexAlgoName == SshCapabilities::EcdhNistp256)
         return SshCapabilities::HMacSha256;
     if (m_kexAlgoName == SshCapabilities::EcdhNistp384)
@@ -249,6 +372,39 @@ QByteArray SshKeyExchange::hashAlgoForKexAlgo() const
     return SshCapabilities::HMacSha1;
 }
 
+QList<QByteArray> SshKeyExchange::hostKeyAlgorithms() const
+{
+    QList<QByteArray> algorithms = SshCapabilities::PublicKeyAlgorithms;
+    if (!m_connParams.hostKeyDatabase)
+        return algorithms;
+
+    // Like OpenSSH, prefer the algorithms matching the key we already know for this host.
+    // Otherwise, a server that also has a key of a type we prefer would present that one,
+    // which would look like a host key change.
+    const QByteArray knownKey = m_connParams.hostKeyDatabase->retrieveHostKey(m_connParams.host(),
+                                                                                m_connParams.port());
+    if (knownKey.isEmpty())
+        return algorithms;
+    QByteArray knownKeyType;
+    try {
+        // The database has K_S in wire format, i.e. as a string wrapping the key blob.
+        const QByteArray keyBlob = SshPacketParser::asString(knownKey, quint32(0));
+        knownKeyType = SshPacketParser::asString(keyBlob, quint32(0));
+    } catch (const SshPacketParseException &) {
+        return algorithms;
+    }
+    QList<QByteArray> matchingAlgorithms;
+    for (auto it = algorithms.begin(); it != algorithms.end();) {
+        if (SshCapabilities::publicKeyType(*it) == knownKeyType) {
+            matchingAlgorithms << *it;
+            it = algorithms.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return matchingAlgorithms + algorithms;
+}
+
 void SshKeyExchange::determineHashingAlgorithm(const SshKeyExchangeInit &kexInit,
                                                bool serverToClient)
 {
@@ -263,31 +419,35 @@ void SshKeyExchange::determineHashingAlgorithm(const SshKeyExchangeInit &kexInit
 
 void SshKeyExchange::checkHostKey(const QByteArray &hostKey)
 {
-    if (m_connParams.hostKeyCheckingMode == SshHostKeyCheckingNone) {
-        if (m_connParams.hostKeyDatabase)
-            m_connParams.hostKeyDatabase->insertHostKey(m_connParams.host(), hostKey);
-        return;
-    }
-
-    if (!m_connParams.hostKeyDatabase) {
+    SshHostKeyDatabase * const database = m_connParams.hostKeyDatabase.data();
+    if (!database) {
+        if (m_connParams.hostKeyCheckingMode == SshHostKeyCheckingNone)
+            return;
         throw SshClientException(SshInternalError,
                                  SSH_TR("Host key database must exist "
                                         "if host key checking is enabled."));
     }
 
-    switch (m_connParams.hostKeyDatabase->matchHostKey(m_connParams.host(), hostKey)) {
+    // A revoked key is never acceptable, not even without host key checking.
+    switch (database->matchHostKey(m_connParams.host(), m_connParams.port(), hostKey)) {
     case SshHostKeyDatabase::KeyLookupMatch:
         return; // Nothing to do.
     case SshHostKeyDatabase::KeyLookupMismatch:
-        if (m_connParams.hostKeyCheckingMode != SshHostKeyCheckingAllowMismatch)
+        if (m_connParams.hostKeyCheckingMode != SshHostKeyCheckingNone
+                && m_connParams.hostKeyCheckingMode != SshHostKeyCheckingAllowMismatch) {
             throwHostKeyException();
+        }
         break;
     case SshHostKeyDatabase::KeyLookupNoMatch:
         if (m_connParams.hostKeyCheckingMode == SshHostKeyCheckingStrict)
             throwHostKeyException();
         break;
+    case SshHostKeyDatabase::KeyLookupRevoked:
+        throw SshServerException(SSH_DISCONNECT_HOST_KEY_NOT_VERIFIABLE, "Host key revoked",
+                                 SSH_TR("Host key of machine \"%1\" has been revoked.")
+                                 .arg(m_connParams.host()));
     }
-    m_connParams.hostKeyDatabase->insertHostKey(m_connParams.host(), hostKey);
+    database->insertHostKey(m_connParams.host(), m_connParams.port(), hostKey);
 }
 
 void SshKeyExchange::throwHostKeyException()
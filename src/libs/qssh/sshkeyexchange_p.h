@@ -39,6 +39,7 @@
 #include <memory>
 
 namespace Botan {
+class Curve25519_PrivateKey;
 class DH_PrivateKey;
 class ECDH_PrivateKey;
 class HashFunction;
@@ -58,7 +59,10 @@ public:
     ~SshKeyExchange();
 
     const QByteArray &hostKeyFingerprint() { return m_hostFingerprint; }
-    void sendKexInitPacket(const QByteArray &serverId);
+
+    // If we talked to the host before, we guess the outcome of the negotiation
+    // and send our key exchange packet right away (RFC 4253, 7).
+    void sendKexInitPacket(const QByteArray &serverId, bool allowGuess = true);
 
     // Returns true <=> the server sends a guessed package.
     bool sendDhInitPacket(const SshIncomingPacket &serverKexInit);
@@ -75,7 +79,9 @@ public:
     QByteArray hMacAlgoServerToClient() const { return m_s2cHMacAlgo; }
 
 private:
+    void sendClientKexPacket();
     QByteArray hashAlgoForKexAlgo() const;
+    QList<QByteArray> hostKeyAlgorithms() const;
     void determineHashingAlgorithm(const SshKeyExchangeInit &kexInit, bool serverToClient);
     void checkHostKey(const QByteArray &hostKey);
     Q_NORETURN void throwHostKeyException();
@@ -85,10 +91,14 @@ private:
     QByteArray m_serverKexInitPayload;
     QScopedPointer<Botan::DH_PrivateKey> m_dhKey;
     QScopedPointer<Botan::ECDH_PrivateKey> m_ecdhKey;
+    QScopedPointer<Botan::Curve25519_PrivateKey> m_x25519Key;
     QByteArray m_kexAlgoName;
+    QByteArray m_guessedKexAlgoName;
     QByteArray m_k;
     QByteArray m_h;
     QByteArray m_serverHostKeyAlgo;
+    QList<QByteArray> m_keyExchangeMethods;
+    QList<QByteArray> m_hostKeyAlgorithms;
     QByteArray m_encryptionAlgo;
     QByteArray m_decryptionAlgo;
     QByteArray m_c2sHMacAlgo;
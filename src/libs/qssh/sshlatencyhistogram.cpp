@@ -0,0 +1,60 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sshlatencyhistogram.h"
+
+#include <QtGlobal>
+
+namespace QSsh {
+
+void SshLatencyHistogram::add(qint64 value)
+{
+    value = qMax<qint64>(0, value);
+    int bucket = 0;
+    for (qint64 v = value; v > 0 && bucket < BucketCount - 1; v >>= 1)
+        ++bucket;
+    ++m_buckets[bucket];
+
+    m_min = m_count == 0 ? value : qMin(m_min, value);
+    m_max = qMax(m_max, value);
+    m_sum += value;
+    ++m_count;
+}
+
+qint64 SshLatencyHistogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0;
+    const qint64 rank = qMax<qint64>(1, qint64(qBound(0.0, p, 100.0) / 100 * m_count + 0.5));
+    qint64 seen = 0;
+    for (int bucket = 0; bucket < BucketCount - 1; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen >= rank)
+            return qMin(bucketUpperBound(bucket), m_max);
+    }
+    return m_max;
+}
+
+} // namespace QSsh
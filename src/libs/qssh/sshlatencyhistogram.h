@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "ssh_global.h"
+
+namespace QSsh {
+
+/*!
+    \class QSsh::SshLatencyHistogram
+
+    \brief Latency distribution with power-of-two buckets.
+
+    The unit is up to the owner; e.g. SshBatchStatistics records milliseconds,
+    SftpJobStatistics microseconds. Bucket 0 holds values below one unit,
+    bucket n values from 2^(n-1) to 2^n - 1.
+*/
+
+class QSSH_EXPORT SshLatencyHistogram
+{
+public:
+    static const int BucketCount = 32; // The last one takes everything from 2^30.
+
+    void add(qint64 value);
+
+    int count() const { return m_count; }
+    int bucketCount(int bucket) const { return m_buckets[bucket]; }
+    static qint64 bucketUpperBound(int bucket) { return (qint64(1) << bucket) - 1; }
+
+    qint64 min() const { return m_min; }
+    qint64 max() const { return m_max; }
+    qint64 mean() const { return m_count == 0 ? 0 : m_sum / m_count; }
+
+    // Upper bound of the bucket containing the given percentile (0 to 100), capped at max().
+    qint64 percentile(double p) const;
+
+private:
+    int m_buckets[BucketCount] = {};
+    int m_count = 0;
+    qint64 m_sum = 0;
+    qint64 m_min = 0;
+    qint64 m_max = 0;
+};
+
+} // namespace QSsh
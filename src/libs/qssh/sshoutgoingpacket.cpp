@@ -35,6 +35,7 @@
 #include "sshcryptofacility_p.h"
 #include "sshlogging_p.h"
 #include "sshpacketparser_p.h"
+#include "sshpackettrace_p.h"
 
 #include <QtEndian>
 
@@ -56,12 +57,14 @@ quint32 SshOutgoingPacket::macLength() const
     return m_encrypter.macLength();
 }
 
-QByteArray SshOutgoingPacket::generateKeyExchangeInitPacket()
+QByteArray SshOutgoingPacket::generateKeyExchangeInitPacket(
+        const QList<QByteArray> &keyExchangeMethods, const QList<QByteArray> &hostKeyAlgorithms,
+        bool firstKexPacketFollows)
 {
-    const QByteArray &supportedkeyExchangeMethods
-        = encodeNameList(SshCapabilities::KeyExchangeMethods);
-    const QByteArray &supportedPublicKeyAlgorithms
-        = encodeNameList(SshCapabilities::PublicKeyAlgorithms);
+    // "ext-info-c" is not a real method; it asks the server for SSH_MSG_EXT_INFO (RFC 8308).
+    const QByteArray &supportedkeyExchangeMethods = encodeNameList(
+            QList<QByteArray>(keyExchangeMethods) << SshCapabilities::ExtInfoClient);
+    const QByteArray &supportedPublicKeyAlgorithms = encodeNameList(hostKeyAlgorithms);
     const QByteArray &supportedEncryptionAlgorithms
         = encodeNameList(SshCapabilities::EncryptionAlgorithms);
     const QByteArray &supportedMacAlgorithms
@@ -80,7 +83,7 @@ QByteArray SshOutgoingPacket::generateKeyExchangeInitPacket()
     m_data.append(supportedCompressionAlgorithms)
         .append(supportedCompressionAlgorithms);
     m_data.append(supportedLanguages).append(supportedLanguages);
-    appendBool(false); // No guessed packet.
+    appendBool(firstKexPacketFollows);
     m_data.append(QByteArray(4, 0)); // Reserved.
     QByteArray payload = m_data.mid(PayloadOffset);
     finalize();
@@ -129,7 +132,7 @@ void SshOutgoingPacket::generateUserAuthByPublicKeyRequestPacket(const QByteArra
     init(SSH_MSG_USERAUTH_REQUEST).appendString(user).appendString(service)
         .appendString("publickey").appendBool(true);
     if (!key.isEmpty()) {
-        appendString(SshPacketParser::asString(key, quint32(0)));
+        appendString(m_encrypter.signatureAlgorithmName(SshPacketParser::asString(key, quint32(0))));
         appendString(key);
         appendString(signature);
     } else {
@@ -143,20 +146,29 @@ void SshOutgoingPacket::generateUserAuthByPublicKeyRequestPacket(const QByteArra
 
 void SshOutgoingPacket::generateQueryPublicKeyPacket(const QByteArray &user,
         const QByteArray &service, const QByteArray &publicKey)
+{
+    const QByteArray algoName = storeDataToSignForAgent(user, service, publicKey);
+    init(SSH_MSG_USERAUTH_REQUEST).appendString(user).appendString(service)
+            .appendString("publickey").appendBool(false).appendString(algoName)
+            .appendString(publicKey).finalize();
+}
+
+QByteArray SshOutgoingPacket::storeDataToSignForAgent(const QByteArray &user,
+        const QByteArray &service, const QByteArray &publicKey) const
 {
     // Name extraction cannot fail, we already verified this when receiving the key
     // from the agent.
-    const QByteArray algoName = SshPacketParser::asString(publicKey, quint32(0));
+    const QByteArray algoName
+            = m_encrypter.signatureAlgorithmName(SshPacketParser::asString(publicKey, quint32(0)));
     SshOutgoingPacket packetToSign(m_encrypter, m_seqNr);
     packetToSign.init(SSH_MSG_USERAUTH_REQUEST).appendString(user).appendString(service)
             .appendString("publickey").appendBool(true).appendString(algoName)
             .appendString(publicKey);
     const QByteArray &dataToSign
             = encodeString(m_encrypter.sessionId()) + packetToSign.m_data.mid(PayloadOffset);
-    SshAgent::storeDataToSign(publicKey, dataToSign, qHash(m_encrypter.sessionId()));
-    init(SSH_MSG_USERAUTH_REQUEST).appendString(user).appendString(service)
-            .appendString("publickey").appendBool(false).appendString(algoName)
-            .appendString(publicKey).finalize();
+    SshAgent::storeDataToSign(publicKey, dataToSign, SshAgent::signatureFlags(algoName),
+                              qHash(m_encrypter.sessionId()));
+    return algoName;
 }
 
 void SshOutgoingPacket::generateUserAuthByKeyboardInteractiveRequestPacket(const QByteArray &user,
@@ -388,8 +400,27 @@ SshOutgoingPacket &SshOutgoingPacket::encrypt()
     return *this;
 }
 
+void SshOutgoingPacket::finalizeHeldBackPacket(const QByteArray &unfinalizedData)
+{
+    QSSH_ASSERT_AND_RETURN(!m_holdBackNonKexPackets);
+    m_data = unfinalizedData;
+    finalize();
+}
+
 void SshOutgoingPacket::finalize()
 {
+    const int type = m_data.at(TypeOffset);
+    m_isHeldBack = (m_holdBackNonKexPackets
+                    && !(type >= SSH_MSG_DISCONNECT && type <= SSH_MSG_DEBUG)
+                    && !(type >= SSH_MSG_KEXINIT && type <= 49)) // 30-49: Key exchange method specific.
+            || (m_holdBackConnectionPackets && type >= SSH_MSG_GLOBAL_REQUEST);
+    if (m_isHeldBack)
+        return;
+
+    m_payLoadSize = m_data.size() - TypeOffset;
+    m_payLoadType = quint8(type);
+    m_payLoadChannel = SshPacketTracer::channelOf(
+                SshByteView(m_data.constData() + TypeOffset, m_payLoadSize));
     setPadding();
     setLengthField(m_data);
     m_length = m_data.size() - 4;
@@ -42,13 +42,14 @@ namespace Internal {
 
 class SshEncryptionFacility;
 
-class SshOutgoingPacket : public AbstractSshPacket
+class QSSH_EXPORT SshOutgoingPacket : public AbstractSshPacket
 {
 public:
     SshOutgoingPacket(const SshEncryptionFacility &encrypter,
         const quint32 &seqNr);
 
-    QByteArray generateKeyExchangeInitPacket(); // Returns payload.
+    QByteArray generateKeyExchangeInitPacket(const QList<QByteArray> &keyExchangeMethods,
+            const QList<QByteArray> &hostKeyAlgorithms, bool firstKexPacketFollows); // Returns payload.
     void generateKeyDhInitPacket(const Botan::BigInt &e);
     void generateKeyEcdhInitPacket(const QByteArray &clientQ);
     void generateNewKeysPacket();
@@ -62,6 +63,11 @@ public:
         const QByteArray &service, const QByteArray &key, const QByteArray &signature);
     void generateQueryPublicKeyPacket(const QByteArray &user, const QByteArray &service,
                                       const QByteArray &publicKey);
+
+    // Hands the agent what it has to sign for a public key authentication request.
+    // Returns the signature algorithm name.
+    QByteArray storeDataToSignForAgent(const QByteArray &user, const QByteArray &service,
+                                       const QByteArray &publicKey) const;
     void generateUserAuthByKeyboardInteractiveRequestPacket(const QByteArray &user,
         const QByteArray &service);
     void generateUserAuthInfoResponsePacket(const QStringList &responses);
@@ -96,6 +102,26 @@ public:
     void generateChannelOpenFailurePacket(quint32 remoteChannel, quint32 reason,
         const QByteArray &reasonString);
 
+    // RFC 4253, 7.1: Between our SSH_MSG_KEXINIT and SSH_MSG_NEWKEYS, only packets belonging
+    // to the key exchange may be sent. While this is set, all other packets are left
+    // unencrypted, so they can be held back and finalized once the new keys are in place.
+    void setHoldBackNonKexPackets(bool holdBack) { m_holdBackNonKexPackets = holdBack; }
+    bool holdsBackNonKexPackets() const { return m_holdBackNonKexPackets; }
+
+    // RFC 4252, 5: Connection protocol packets must wait until the server has accepted our
+    // credentials. With optimistic authentication, they can be created before that.
+    void setHoldBackConnectionPackets(bool holdBack) { m_holdBackConnectionPackets = holdBack; }
+    bool holdsBackConnectionPackets() const { return m_holdBackConnectionPackets; }
+    bool isHeldBack() const { return m_isHeldBack; }
+    void finalizeHeldBackPacket(const QByteArray &unfinalizedData);
+
+    // Size of the last finalized packet without framing, padding and MAC.
+    quint32 payLoadSize() const { return m_payLoadSize; }
+
+    // Type and channel of the last finalized packet, for SshPacketTracer.
+    quint8 payLoadType() const { return m_payLoadType; }
+    quint32 payLoadChannel() const { return m_payLoadChannel; }
+
 private:
     virtual quint32 cipherBlockSize() const;
     virtual quint32 macLength() const;
@@ -117,6 +143,12 @@ private:
 
     const SshEncryptionFacility &m_encrypter;
     const quint32 &m_seqNr;
+    bool m_holdBackNonKexPackets = false;
+    bool m_holdBackConnectionPackets = false;
+    bool m_isHeldBack = false;
+    quint32 m_payLoadSize = 0;
+    quint8 m_payLoadType = 0;
+    quint32 m_payLoadChannel = 0;
 };
 
 } // namespace Internal
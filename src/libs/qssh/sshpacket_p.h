@@ -31,6 +31,7 @@
 #ifndef SSHPACKET_P_H
 #define SSHPACKET_P_H
 
+#include "ssh_global.h"
 #include "sshexception_p.h"
 
 #include <QtEndian>
@@ -49,6 +50,7 @@ enum SshPacketType {
     SSH_MSG_DEBUG = 4,
     SSH_MSG_SERVICE_REQUEST = 5,
     SSH_MSG_SERVICE_ACCEPT = 6,
+    SSH_MSG_EXT_INFO = 7,
 
     SSH_MSG_KEXINIT = 20,
     SSH_MSG_NEWKEYS = 21,
@@ -101,7 +103,7 @@ enum SshExtendedDataType { SSH_EXTENDED_DATA_STDERR = 1 };
 
 class SshAbstractCryptoFacility;
 
-class AbstractSshPacket
+class QSSH_EXPORT AbstractSshPacket
 {
     Q_DISABLE_COPY(AbstractSshPacket)
 
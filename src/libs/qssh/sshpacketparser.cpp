@@ -30,24 +30,25 @@
 
 #include "sshpacketparser_p.h"
 
-#include <cctype>
+#include <QVarLengthArray>
 #include <QtEndian>
 
+#include <cctype>
+
 namespace QSsh {
 namespace Internal {
 
 namespace { quint32 size(const QByteArray &data) { return data.size(); } }
 
-QString SshPacketParser::asUserString(const QByteArray &rawString)
+QString SshPacketParser::asUserString(const SshByteView &rawString)
 {
-    QByteArray filteredString;
-    filteredString.resize(rawString.size());
-    for (int i = 0; i < rawString.size(); ++i) {
-        const char c = rawString.at(i);
+    QVarLengthArray<char, 256> filteredString(rawString.size());
+    for (quint32 i = 0; i < rawString.size(); ++i) {
+        const char c = rawString.data()[i];
         filteredString[i]
             = std::isprint(c) || c == '\n' || c == '\r' || c == '\t' ? c : '?';
     }
-    return QString::fromUtf8(filteredString);
+    return QString::fromUtf8(filteredString.constData(), filteredString.size());
 }
 
 bool SshPacketParser::asBool(const QByteArray &data, quint32 offset)
@@ -99,18 +100,28 @@ QByteArray SshPacketParser::asString(const QByteArray &data, quint32 offset)
 }
 
 QByteArray SshPacketParser::asString(const QByteArray &data, quint32 *offset)
+{
+    return asStringView(data, offset).toByteArray();
+}
+
+SshByteView SshPacketParser::asStringView(const QByteArray &data, quint32 offset)
+{
+    return asStringView(data, &offset);
+}
+
+SshByteView SshPacketParser::asStringView(const QByteArray &data, quint32 *offset)
 {
     const quint32 length = asUint32(data, offset);
-    if (size(data) < *offset + length)
+    if (size(data) - *offset < length)
         throw SshPacketParseException();
-    const QByteArray &string = data.mid(*offset, length);
+    const SshByteView string(data.constData() + *offset, length);
     *offset += length;
     return string;
 }
 
 QString SshPacketParser::asUserString(const QByteArray &data, quint32 *offset)
 {
-    return asUserString(asString(data, offset));
+    return asUserString(asStringView(data, offset));
 }
 
 SshNameList SshPacketParser::asNameList(const QByteArray &data, quint32 *offset)
@@ -136,13 +147,11 @@ SshNameList SshPacketParser::asNameList(const QByteArray &data, quint32 *offset)
 
 Botan::BigInt SshPacketParser::asBigInt(const QByteArray &data, quint32 *offset)
 {
-    const quint32 length = asUint32(data, offset);
-    if (length == 0)
+    const SshByteView number = asStringView(data, offset);
+    if (number.isEmpty())
         return Botan::BigInt();
-    const Botan::byte *numberStart
-        = reinterpret_cast<const Botan::byte *>(data.constData() + *offset);
-    *offset += length;
-    return Botan::BigInt::decode(numberStart, length);
+    return Botan::BigInt::decode(reinterpret_cast<const Botan::byte *>(number.data()),
+                                 number.size());
 }
 
 } // namespace Internal
@@ -31,6 +31,9 @@
 #ifndef SSHPACKETPARSER_P_H
 #define SSHPACKETPARSER_P_H
 
+#include "ssh_global.h"
+#include "sshbyteview_p.h"
+
 #include <botan/bigint.h>
 
 #include <QByteArray>
@@ -57,7 +60,8 @@ class SshPacketParseException { };
 // For convenience, some have also versions that don't update the offset,
 // so they can be called with rvalues if the new value is not needed.
 // If they fail, they throw an SshPacketParseException.
-class SshPacketParser
+// The ...View() variants do not copy anything; see SshByteView for the lifetime rules.
+class QSSH_EXPORT SshPacketParser
 {
 public:
     static bool asBool(const QByteArray &data, quint32 offset);
@@ -70,11 +74,13 @@ public:
     static quint32 asUint32(const QByteArray &data, quint32 *offset);
     static QByteArray asString(const QByteArray &data, quint32 offset);
     static QByteArray asString(const QByteArray &data, quint32 *offset);
+    static SshByteView asStringView(const QByteArray &data, quint32 offset);
+    static SshByteView asStringView(const QByteArray &data, quint32 *offset);
     static QString asUserString(const QByteArray &data, quint32 *offset);
     static SshNameList asNameList(const QByteArray &data, quint32 *offset);
     static Botan::BigInt asBigInt(const QByteArray &data, quint32 *offset);
 
-    static QString asUserString(const QByteArray &rawString);
+    static QString asUserString(const SshByteView &rawString);
 };
 
 } // namespace Internal
@@ -0,0 +1,357 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sshpackettrace_p.h"
+
+#include "sshchannelmanager_p.h"
+#include "sshconnection_p.h"
+#include "sshlogging_p.h"
+#include "sshpacket_p.h"
+#include "sshremoteprocess.h"
+
+#include <QHash>
+#include <QSet>
+#include <QtEndian>
+
+namespace QSsh {
+namespace Internal {
+
+namespace {
+const quint32 TraceMagic = 0x51535054; // "QSPT"
+const quint16 TraceVersion = 1;
+
+bool readUint32(const SshByteView &data, quint32 offset, quint32 *value)
+{
+    if (offset > data.size() || data.size() - offset < 4)
+        return false;
+    *value = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.data() + offset));
+    return true;
+}
+
+bool openTraceFile(QFile &file, QDataStream &stream, QString *error)
+{
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = file.errorString();
+        return false;
+    }
+    stream.setDevice(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << TraceMagic << TraceVersion;
+    return true;
+}
+
+void writeRecord(QDataStream &stream, const SshPacketTraceRecord &record)
+{
+    stream << record.timestamp << record.seqNr << record.channel << record.payloadSize
+           << quint8(record.direction) << record.type << record.payload;
+}
+
+// Unencrypted framing, which is what an incoming packet without keys expects (RFC 4253, 6).
+QByteArray framePayload(const QByteArray &payload)
+{
+    const int headerSize = 5;
+    const int blockSize = 8;
+    int padding = blockSize - (headerSize + payload.size()) % blockSize;
+    if (padding < 4)
+        padding += blockSize;
+    if (headerSize + payload.size() + padding < 16)
+        padding += blockSize;
+
+    QByteArray packet(4, 0);
+    packet += char(padding);
+    packet += payload;
+    packet += QByteArray(padding, 0);
+    AbstractSshPacket::setLengthField(packet);
+    return packet;
+}
+} // anonymous namespace
+
+SshPacketTracer::SshPacketTracer() = default;
+
+SshPacketTracer::~SshPacketTracer()
+{
+    stop();
+}
+
+bool SshPacketTracer::start(const QString &filePath, int capacity)
+{
+    stop();
+    m_ring.clear();
+    m_ring.resize(qMax(1, capacity));
+    m_next = 0;
+    m_wrapped = false;
+    m_active = true;
+    m_clock.start();
+    if (filePath.isEmpty())
+        return true;
+
+    m_file.setFileName(filePath);
+    QString error;
+    if (!openTraceFile(m_file, m_stream, &error)) {
+        qCWarning(sshLog, "Cannot write packet trace to \"%s\": %s", qPrintable(filePath),
+                  qPrintable(error));
+        return false;
+    }
+    return true;
+}
+
+void SshPacketTracer::stop()
+{
+    m_active = false;
+    if (m_file.isOpen()) {
+        m_stream.setDevice(nullptr);
+        m_file.close();
+    }
+}
+
+void SshPacketTracer::recordIncoming(quint32 seqNr, const SshByteView &payload)
+{
+    SshPacketTraceRecord record;
+    record.seqNr = seqNr;
+    record.channel = channelOf(payload);
+    record.payloadSize = payload.size();
+    record.direction = SshPacketTraceRecord::Incoming;
+    record.type = payload.isEmpty() ? 0 : quint8(payload.data()[0]);
+    if (m_file.isOpen())
+        record.payload = payload.toByteArray();
+    append(std::move(record));
+}
+
+void SshPacketTracer::recordOutgoing(quint32 seqNr, quint8 type, quint32 channel,
+                                     quint32 payloadSize)
+{
+    SshPacketTraceRecord record;
+    record.seqNr = seqNr;
+    record.channel = channel;
+    record.payloadSize = payloadSize;
+    record.direction = SshPacketTraceRecord::Outgoing;
+    record.type = type;
+    append(std::move(record));
+}
+
+void SshPacketTracer::append(SshPacketTraceRecord &&record)
+{
+    if (!m_active)
+        return;
+    record.timestamp = m_clock.nsecsElapsed();
+    if (m_file.isOpen()) {
+        writeRecord(m_stream, record);
+        record.payload.clear(); // The ring only keeps the headers.
+    }
+    m_ring[m_next] = std::move(record);
+    if (++m_next == m_ring.size()) {
+        m_next = 0;
+        m_wrapped = true;
+    }
+}
+
+QList<SshPacketTraceRecord> SshPacketTracer::records() const
+{
+    QList<SshPacketTraceRecord> records;
+    if (m_wrapped) {
+        for (int i = m_next; i < m_ring.size(); ++i)
+            records << m_ring.at(i);
+    }
+    for (int i = 0; i < m_next; ++i)
+        records << m_ring.at(i);
+    return records;
+}
+
+bool SshPacketTracer::save(const QString &filePath, QString *error) const
+{
+    QFile file(filePath);
+    QDataStream stream;
+    if (!openTraceFile(file, stream, error))
+        return false;
+    for (const SshPacketTraceRecord &record : records())
+        writeRecord(stream, record);
+    stream.setDevice(nullptr);
+    if (!file.flush()) {
+        *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+quint32 SshPacketTracer::channelOf(const SshByteView &payload)
+{
+    if (payload.isEmpty())
+        return SshPacketTraceRecord::NoChannel;
+
+    quint32 channel = SshPacketTraceRecord::NoChannel;
+    const quint8 type = quint8(payload.data()[0]);
+    if (type == SSH_MSG_CHANNEL_OPEN) {
+        quint32 typeNameSize;
+        if (readUint32(payload, 1, &typeNameSize) && typeNameSize <= payload.size())
+            readUint32(payload, 5 + typeNameSize, &channel);
+    } else if (type >= SSH_MSG_CHANNEL_OPEN_CONFIRMATION && type <= SSH_MSG_CHANNEL_FAILURE) {
+        readUint32(payload, 1, &channel);
+    }
+    return channel;
+}
+
+bool SshPacketTraceReader::open(const QString &filePath, QString *error)
+{
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        *error = m_file.errorString();
+        return false;
+    }
+    m_stream.setDevice(&m_file);
+    m_stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic;
+    quint16 version;
+    m_stream >> magic >> version;
+    if (m_stream.status() != QDataStream::Ok || magic != TraceMagic) {
+        *error = SSH_TR("Not a packet trace.");
+        return false;
+    }
+    if (version != TraceVersion) {
+        *error = SSH_TR("Unsupported packet trace version %1.").arg(version);
+        return false;
+    }
+    return true;
+}
+
+bool SshPacketTraceReader::atEnd() const
+{
+    return m_stream.atEnd();
+}
+
+bool SshPacketTraceReader::readNext(SshPacketTraceRecord *record, QString *error)
+{
+    quint8 direction;
+    m_stream >> record->timestamp >> record->seqNr >> record->channel >> record->payloadSize
+             >> direction >> record->type >> record->payload;
+    if (m_stream.status() != QDataStream::Ok || direction > SshPacketTraceRecord::Outgoing) {
+        *error = SSH_TR("Packet trace is truncated or corrupt.");
+        return false;
+    }
+    record->direction = SshPacketTraceRecord::Direction(direction);
+    return true;
+}
+
+bool SshPacketReplayer::load(const QString &filePath, QString *error)
+{
+    m_records.clear();
+    SshPacketTraceReader reader;
+    if (!reader.open(filePath, error))
+        return false;
+    while (!reader.atEnd()) {
+        SshPacketTraceRecord record;
+        if (!reader.readNext(&record, error))
+            return false;
+        m_records << record;
+    }
+    return true;
+}
+
+int SshPacketReplayer::replayablePacketCount() const
+{
+    int count = 0;
+    for (const SshPacketTraceRecord &record : m_records) {
+        if (isReplayable(record))
+            ++count;
+    }
+    return count;
+}
+
+bool SshPacketReplayer::isReplayable(const SshPacketTraceRecord &record)
+{
+    if (record.direction != SshPacketTraceRecord::Incoming || record.payload.isEmpty())
+        return false;
+    return record.type == SSH_MSG_IGNORE || record.type == SSH_MSG_DEBUG
+            || record.type >= SSH_MSG_GLOBAL_REQUEST;
+}
+
+bool SshPacketReplayer::replay(QString *error) const
+{
+    SshConnection connection{SshConnectionParameters()};
+    SshConnectionPrivate * const d = connection.d;
+    d->m_state = ConnectionEstablished;
+    d->m_keyExchangeState = NoKeyExchange;
+
+    // Channel ids in the trace are those of the traced session; map them to ours.
+    QHash<quint32, quint32> channelIds;
+
+    // Our stand-in processes make a single channel request, but the traced session may have
+    // made several (a pty and a shell, say). Only the first reply can go through.
+    QSet<quint32> answeredChannels;
+    QList<QSharedPointer<SshRemoteProcess>> processes;
+    try {
+        for (const SshPacketTraceRecord &record : m_records) {
+            if (record.direction == SshPacketTraceRecord::Outgoing) {
+                if (record.type != SSH_MSG_CHANNEL_OPEN)
+                    continue;
+                channelIds.insert(record.channel, d->m_channelManager->nextLocalChannelId());
+                const QSharedPointer<SshRemoteProcess> process
+                        = d->createRemoteProcess("replay");
+                SshRemoteProcess * const p = process.data();
+                QObject::connect(p, &SshRemoteProcess::readyReadStandardOutput,
+                                 [p] { p->readAllStandardOutput(); });
+                QObject::connect(p, &SshRemoteProcess::readyReadStandardError,
+                                 [p] { p->readAllStandardError(); });
+                process->start();
+                processes << process;
+                continue;
+            }
+            if (!isReplayable(record))
+                continue;
+
+            QByteArray payload = record.payload;
+            const quint32 channel = SshPacketTracer::channelOf(payload);
+            if (record.type == SSH_MSG_CHANNEL_SUCCESS || record.type == SSH_MSG_CHANNEL_FAILURE) {
+                if (answeredChannels.contains(channel))
+                    continue;
+                answeredChannels.insert(channel);
+            }
+            if (channel != SshPacketTraceRecord::NoChannel && record.type != SSH_MSG_CHANNEL_OPEN) {
+                const quint32 ourChannel = channelIds.value(channel, channel);
+                qToBigEndian(ourChannel, reinterpret_cast<uchar *>(payload.data() + 1));
+            }
+            d->m_incomingData += framePayload(payload);
+            d->handlePackets();
+            if (d->m_state != ConnectionEstablished) {
+                *error = d->m_errorString.isEmpty()
+                        ? SSH_TR("The connection was closed at packet %1.").arg(record.seqNr)
+                        : d->m_errorString;
+                return false;
+            }
+        }
+    } catch (const SshServerException &e) {
+        *error = e.errorStringUser;
+        return false;
+    } catch (const SshClientException &e) {
+        *error = e.errorString;
+        return false;
+    } catch (const std::exception &e) {
+        *error = QString::fromLocal8Bit(e.what());
+        return false;
+    }
+    return true;
+}
+
+} // namespace Internal
+} // namespace QSsh
@@ -0,0 +1,130 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "ssh_global.h"
+#include "sshbyteview_p.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QVector>
+
+namespace QSsh {
+namespace Internal {
+
+struct SshPacketTraceRecord
+{
+    enum Direction : quint8 { Incoming, Outgoing };
+    static const quint32 NoChannel = 0xffffffff;
+
+    qint64 timestamp = 0; // Nanoseconds since the trace was started.
+    quint32 seqNr = 0;
+    quint32 channel = NoChannel; // The recipient channel; for channel open requests, the sender's.
+    quint32 payloadSize = 0;
+    Direction direction = Incoming;
+    quint8 type = 0;
+    QByteArray payload; // Decrypted; only kept for incoming packets traced to a file.
+};
+
+/*
+ * Records one fixed-size entry per packet into a ring buffer that holds the most recent ones.
+ * With a file attached, all entries also go there, along with the decrypted payloads of
+ * incoming packets, which is what SshPacketReplayer needs. Nothing is ever formatted as text,
+ * so this stays cheap enough to leave on while measuring.
+ */
+class QSSH_EXPORT SshPacketTracer
+{
+    Q_DISABLE_COPY(SshPacketTracer)
+public:
+    static const int DefaultCapacity = 4096;
+
+    SshPacketTracer();
+    ~SshPacketTracer();
+
+    // An empty path means memory only. Returns false if the file could not be created,
+    // in which case only the ring buffer is used.
+    bool start(const QString &filePath, int capacity = DefaultCapacity);
+    void stop();
+    bool isActive() const { return m_active; }
+
+    void recordIncoming(quint32 seqNr, const SshByteView &payload);
+    void recordOutgoing(quint32 seqNr, quint8 type, quint32 channel, quint32 payloadSize);
+
+    QList<SshPacketTraceRecord> records() const; // Oldest first.
+    bool save(const QString &filePath, QString *error) const;
+
+    static quint32 channelOf(const SshByteView &payload);
+
+private:
+    void append(SshPacketTraceRecord &&record);
+
+    QVector<SshPacketTraceRecord> m_ring;
+    int m_next = 0;
+    bool m_wrapped = false;
+    bool m_active = false;
+    QElapsedTimer m_clock;
+    QFile m_file;
+    QDataStream m_stream;
+};
+
+class QSSH_EXPORT SshPacketTraceReader
+{
+public:
+    bool open(const QString &filePath, QString *error);
+    bool atEnd() const;
+    bool readNext(SshPacketTraceRecord *record, QString *error);
+
+private:
+    QFile m_file;
+    QDataStream m_stream;
+};
+
+/*
+ * Feeds the incoming packets of a trace through SshConnectionPrivate::handlePackets() of an
+ * unconnected connection, so that packet handling can be profiled without a server.
+ * The replay starts in the established state: the key exchange and the authentication cannot
+ * be repeated without the original secrets, so those packets are skipped. For every channel
+ * the traced session opened, a remote process is opened in its place; SFTP and tunnel traffic
+ * then goes through the channel layer like any other data. Everything sent is dropped.
+ */
+class QSSH_EXPORT SshPacketReplayer
+{
+public:
+    bool load(const QString &filePath, QString *error);
+    int replayablePacketCount() const;
+    bool replay(QString *error) const;
+
+    static bool isReplayable(const SshPacketTraceRecord &record);
+
+private:
+    QList<SshPacketTraceRecord> m_records;
+};
+
+} // namespace Internal
+} // namespace QSsh
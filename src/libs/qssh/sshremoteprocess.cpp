@@ -86,7 +86,7 @@ bool SshRemoteProcess::atEnd() const
 
 qint64 SshRemoteProcess::bytesAvailable() const
 {
-    return QIODevice::bytesAvailable() + d->data().count();
+    return QIODevice::bytesAvailable() + d->data().size();
 }
 
 bool SshRemoteProcess::canReadLine() const
@@ -94,6 +94,11 @@ bool SshRemoteProcess::canReadLine() const
     return QIODevice::canReadLine() || d->data().contains('\n');
 }
 
+qint64 SshRemoteProcess::bytesToWrite() const
+{
+    return d->bufferedDataSize();
+}
+
 QByteArray SshRemoteProcess::readAllStandardOutput()
 {
     return readAllFromChannel(QProcess::StandardOutput);
@@ -104,6 +109,49 @@ QByteArray SshRemoteProcess::readAllStandardError()
     return readAllFromChannel(QProcess::StandardError);
 }
 
+QByteArray SshRemoteProcess::readChunk()
+{
+    if (QIODevice::bytesAvailable() > 0)
+        return read(QIODevice::bytesAvailable());
+    const QByteArray chunk = d->data().readChunk();
+    d->handleDataConsumed();
+    return chunk;
+}
+
+void SshRemoteProcess::setReadBufferSize(qint64 size)
+{
+    d->m_readBufferSize = size;
+    d->handleDataConsumed();
+}
+
+qint64 SshRemoteProcess::readBufferSize() const
+{
+    return d->m_readBufferSize;
+}
+
+void SshRemoteProcess::setStandardOutputFile(const QString &fileName, QIODevice::OpenMode mode)
+{
+    QSSH_ASSERT_AND_RETURN(d->channelState() == Internal::SshRemoteProcessPrivate::Inactive);
+    delete d->m_stdoutFile;
+    d->m_stdoutFile = new QFile(fileName, d);
+    d->m_stdoutFileMode = mode;
+    setStandardOutputDevice(d->m_stdoutFile);
+}
+
+void SshRemoteProcess::setStandardOutputDevice(QIODevice *device)
+{
+    QSSH_ASSERT_AND_RETURN(d->channelState() == Internal::SshRemoteProcessPrivate::Inactive);
+    if (d->m_stdoutDevice)
+        d->m_stdoutDevice->disconnect(d);
+    d->m_stdoutDevice = device;
+    if (device) {
+        connect(device, &QIODevice::bytesWritten, d, [this] {
+            d->writeStandardOutputToDevice();
+            d->handleDataConsumed();
+        });
+    }
+}
+
 QByteArray SshRemoteProcess::readAllFromChannel(QProcess::ProcessChannel channel)
 {
     const QProcess::ProcessChannel currentReadChannel = readChannel();
@@ -121,9 +169,8 @@ void SshRemoteProcess::close()
 
 qint64 SshRemoteProcess::readData(char *data, qint64 maxlen)
 {
-    const qint64 bytesRead = qMin(qint64(d->data().count()), maxlen);
-    memcpy(data, d->data().constData(), bytesRead);
-    d->data().remove(0, bytesRead);
+    const qint64 bytesRead = d->data().read(data, maxlen);
+    d->handleDataConsumed();
     return bytesRead;
 }
 
@@ -160,6 +207,8 @@ void SshRemoteProcess::init()
             this, &SshRemoteProcess::closed, Qt::QueuedConnection);
     connect(d, &Internal::SshRemoteProcessPrivate::eof,
             this, &SshRemoteProcess::readChannelFinished, Qt::QueuedConnection);
+    connect(d, &Internal::SshRemoteProcessPrivate::bytesWritten,
+            this, &SshRemoteProcess::bytesWritten, Qt::QueuedConnection);
 }
 
 void SshRemoteProcess::addToEnvironment(const QByteArray &var, const QByteArray &value)
@@ -178,6 +227,7 @@ void SshRemoteProcess::requestTerminal(const SshPseudoTerminal &terminal)
     QSSH_ASSERT_AND_RETURN(d->channelState() == Internal::SshRemoteProcessPrivate::Inactive);
     d->m_useTerminal = true;
     d->m_terminal = terminal;
+    d->setPriority(Internal::AbstractSshChannel::InteractivePriority);
 }
 
 void SshRemoteProcess::requestX11Forwarding(const QString &displayName)
@@ -190,11 +240,23 @@ void SshRemoteProcess::start()
 {
     if (d->channelState() == Internal::SshRemoteProcessPrivate::Inactive) {
         qCDebug(Internal::sshLog, "process start requested, channel id = %u", d->localChannelId());
+        if (d->m_stdoutFile && d->m_stdoutDevice == d->m_stdoutFile
+                && !d->m_stdoutFile->open(QIODevice::WriteOnly | d->m_stdoutFileMode)) {
+            d->failToStart(tr("Failed to open file \"%1\" for writing: %2")
+                           .arg(d->m_stdoutFile->fileName(), d->m_stdoutFile->errorString()));
+            return;
+        }
         QIODevice::open(QIODevice::ReadWrite);
         d->requestSessionStart();
     }
 }
 
+void SshRemoteProcess::closeWriteChannel()
+{
+    if (isRunning())
+        d->sendEof();
+}
+
 void SshRemoteProcess::sendSignal(Signal signal)
 {
     try {
@@ -241,6 +303,7 @@ SshRemoteProcessPrivate::SshRemoteProcessPrivate(const QByteArray &command,
       m_command(command),
       m_isShell(false),
       m_useTerminal(false),
+      m_stdoutFile(nullptr),
       m_proc(proc)
 {
     init();
@@ -251,9 +314,11 @@ SshRemoteProcessPrivate::SshRemoteProcessPrivate(quint32 channelId, SshSendFacil
     : AbstractSshChannel(channelId, sendFacility),
       m_isShell(true),
       m_useTerminal(true),
+      m_stdoutFile(nullptr),
       m_proc(proc)
 {
     init();
+    setPriority(InteractivePriority);
 }
 
 void SshRemoteProcessPrivate::init()
@@ -263,6 +328,7 @@ void SshRemoteProcessPrivate::init()
     m_exitCode = 0;
     m_readChannel = QProcess::StandardOutput;
     m_signal = SshRemoteProcess::NoSignal;
+    m_readBufferSize = 0;
 }
 
 void SshRemoteProcessPrivate::setProcState(ProcessState newState)
@@ -277,13 +343,65 @@ void SshRemoteProcessPrivate::setProcState(ProcessState newState)
     }
 }
 
-QByteArray &SshRemoteProcessPrivate::data()
+SshChunkedBuffer &SshRemoteProcessPrivate::data()
 {
     return m_readChannel == QProcess::StandardOutput ? m_stdout : m_stderr;
 }
 
+qint64 SshRemoteProcessPrivate::receiveBufferLimit() const
+{
+    if (m_readBufferSize > 0)
+        return m_readBufferSize;
+    return m_stdoutDevice ? OutputDeviceBufferSize : -1;
+}
+
+qint64 SshRemoteProcessPrivate::receiveBufferedSize() const
+{
+    // Data the output device has not written yet still counts against the limit.
+    qint64 size = m_stdout.size();
+    if (m_stdoutDevice)
+        size += m_stdoutDevice->bytesToWrite();
+    if (m_readBufferSize > 0)
+        size += m_stderr.size();
+    return size;
+}
+
+void SshRemoteProcessPrivate::handleDataConsumed()
+{
+    try {
+        adjustLocalWindow();
+    } catch (const std::exception &e) {
+        qCWarning(sshLog, "Botan error: %s", e.what());
+        closeChannel();
+    }
+}
+
+void SshRemoteProcessPrivate::writeStandardOutputToDevice()
+{
+    while (m_stdoutDevice && !m_stdout.isEmpty()
+           && m_stdoutDevice->bytesToWrite() < OutputDeviceBufferSize) {
+        const QByteArray chunk = m_stdout.readChunk();
+        if (m_stdoutDevice->write(chunk) != chunk.size()) {
+            m_proc->setErrorString(tr("Failed to write standard output: %1")
+                                   .arg(m_stdoutDevice->errorString()));
+            m_stdout.clear();
+            closeChannel();
+            return;
+        }
+    }
+
+    // Files do not emit bytesWritten(), so push their buffer out right away rather than
+    // waiting for it to fill up. Other devices must emit bytesWritten() once they drain.
+    if (QFileDevice * const file = qobject_cast<QFileDevice *>(m_stdoutDevice.data()))
+        file->flush();
+}
+
 void SshRemoteProcessPrivate::closeHook()
 {
+    if (m_stdoutFile && m_stdoutFile->isOpen()) {
+        writeStandardOutputToDevice();
+        m_stdoutFile->close();
+    }
     if (m_wasRunning) {
         if (m_signal != SshRemoteProcess::NoSignal)
             emit closed(SshRemoteProcess::CrashExit);
@@ -352,21 +470,25 @@ void SshRemoteProcessPrivate::handleChannelFailure()
     closeChannel();
 }
 
-void SshRemoteProcessPrivate::handleChannelDataInternal(const QByteArray &data)
+void SshRemoteProcessPrivate::handleChannelDataInternal(const SshByteView &data)
 {
-    m_stdout += data;
+    m_stdout.append(data.toByteArray());
+    if (m_stdoutDevice) {
+        writeStandardOutputToDevice();
+        return;
+    }
     emit readyReadStandardOutput();
     if (m_readChannel == QProcess::StandardOutput)
         emit readyRead();
 }
 
 void SshRemoteProcessPrivate::handleChannelExtendedDataInternal(quint32 type,
-    const QByteArray &data)
+    const SshByteView &data)
 {
     if (type != SSH_EXTENDED_DATA_STDERR) {
         qCWarning(sshLog, "Unknown extended data type %u", type);
     } else {
-        m_stderr += data;
+        m_stderr.append(data.toByteArray());
         emit readyReadStandardError();
         if (m_readChannel == QProcess::StandardError)
             emit readyRead();
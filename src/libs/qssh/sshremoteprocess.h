@@ -83,6 +83,7 @@ public:
     bool atEnd() const;
     qint64 bytesAvailable() const;
     bool canReadLine() const;
+    qint64 bytesToWrite() const;
     void close();
     bool isSequential() const { return true; }
 
@@ -100,6 +101,9 @@ public:
     void requestX11Forwarding(const QString &displayName);
     void start();
 
+    // Sends EOF to the remote process once all data written so far has been transmitted.
+    void closeWriteChannel();
+
     bool isRunning() const;
     int exitCode() const;
     Signal exitSignal() const;
@@ -107,6 +111,28 @@ public:
     QByteArray readAllStandardOutput();
     QByteArray readAllStandardError();
 
+    /*
+     * Returns the next block of data from the current read channel as it came in from
+     * the server, without copying it.
+     */
+    QByteArray readChunk();
+
+    /*
+     * Once this much data is waiting to be read on a channel, the server is not granted any
+     * more window space until the data has been consumed. 0 means unlimited (the default).
+     */
+    void setReadBufferSize(qint64 size);
+    qint64 readBufferSize() const;
+
+    /*
+     * Redirects standard output to a file or device. Redirected data is not available
+     * via read(), and the remote side is throttled if the device cannot keep up.
+     * Must be called before start(). The device is not owned by this object.
+     */
+    void setStandardOutputFile(const QString &fileName,
+                               QIODevice::OpenMode mode = QIODevice::Truncate);
+    void setStandardOutputDevice(QIODevice *device);
+
     // Note: This is ignored by the OpenSSH server.
     void sendSignal(Signal signal);
     void kill() { sendSignal(KillSignal); }
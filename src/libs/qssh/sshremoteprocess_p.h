@@ -34,9 +34,12 @@
 #include "sshpseudoterminal.h"
 
 #include "sshchannel_p.h"
+#include "sshchunkedbuffer_p.h"
 
+#include <QFile>
 #include <QList>
 #include <QPair>
+#include <QPointer>
 #include <QProcess>
 
 namespace QSsh {
@@ -77,17 +80,22 @@ private:
 
     virtual void handleOpenSuccessInternal();
     virtual void handleOpenFailureInternal(const QString &reason);
-    virtual void handleChannelDataInternal(const QByteArray &data);
+    virtual void handleChannelDataInternal(const SshByteView &data);
     virtual void handleChannelExtendedDataInternal(quint32 type,
-        const QByteArray &data);
+        const SshByteView &data);
     virtual void handleExitStatus(const SshChannelExitStatus &exitStatus);
     virtual void handleExitSignal(const SshChannelExitSignal &signal);
 
     virtual void closeHook();
 
+    virtual qint64 receiveBufferLimit() const;
+    virtual qint64 receiveBufferedSize() const;
+
     void init();
     void setProcState(ProcessState newState);
-    QByteArray &data();
+    SshChunkedBuffer &data();
+    void handleDataConsumed();
+    void writeStandardOutputToDevice();
 
     QProcess::ProcessChannel m_readChannel;
 
@@ -106,8 +114,14 @@ private:
 
     QString m_x11DisplayName;
 
-    QByteArray m_stdout;
-    QByteArray m_stderr;
+    SshChunkedBuffer m_stdout;
+    SshChunkedBuffer m_stderr;
+    qint64 m_readBufferSize;
+
+    static const qint64 OutputDeviceBufferSize = 1024 * 1024;
+    QPointer<QIODevice> m_stdoutDevice;
+    QFile *m_stdoutFile;
+    QIODevice::OpenMode m_stdoutFileMode;
 
     SshRemoteProcess *m_proc;
 };
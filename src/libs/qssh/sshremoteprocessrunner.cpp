@@ -109,13 +109,14 @@ void SshRemoteProcessRunner::runInternal(const QByteArray &command,
             this, &SshRemoteProcessRunner::handleConnectionError);
     connect(d->m_connection, &SshConnection::disconnected,
             this, &SshRemoteProcessRunner::handleDisconnected);
-    if (d->m_connection->state() == SshConnection::Connected) {
+    if (d->m_connection->state() == SshConnection::Unconnected)
+        d->m_connection->connectToHost();
+
+    // With optimistic authentication, the channel request can queue up behind the credentials.
+    if (d->m_connection->canCreateChannels())
         handleConnected();
-    } else {
+    else
         connect(d->m_connection, &SshConnection::connected, this, &SshRemoteProcessRunner::handleConnected);
-        if (d->m_connection->state() == SshConnection::Unconnected)
-            d->m_connection->connectToHost();
-    }
 }
 
 void SshRemoteProcessRunner::handleConnected()
@@ -33,37 +33,212 @@
 #include "sshkeyexchange_p.h"
 #include "sshlogging_p.h"
 #include "sshoutgoingpacket_p.h"
+#include "sshpackettrace_p.h"
 
 #include <QTcpSocket>
 
 namespace QSsh {
 namespace Internal {
 
+namespace {
+// Kept small on purpose: Everything in here has to go out before newly scheduled
+// interactive data can follow.
+const qint64 MaxSocketBacklog = 64 * 1024;
+
+// Packets are collected until the end of the current event loop iteration
+// or until this many bytes have accumulated, whichever comes first.
+const int WriteBatchSize = 32 * 1024;
+
+quint32 schedulingQuantum(int priority)
+{
+    return priority == AbstractSshChannel::InteractivePriority ? 64 * 1024 : 16 * 1024;
+}
+} // anonymous namespace
+
 SshSendFacility::SshSendFacility(QTcpSocket *socket)
-    : m_clientSeqNr(0), m_socket(socket),
-      m_outgoingPacket(m_encrypter, m_clientSeqNr)
+    : m_clientSeqNr(0), m_bytesSentWithCurrentKeys(0), m_packetsSentWithCurrentKeys(0),
+      m_totalBytesSent(0), m_payloadBytesSent(0), m_packetsSent(0), m_windowStalls(0),
+      m_socket(socket),
+      m_outgoingPacket(m_encrypter, m_clientSeqNr),
+      m_sendingScheduledData(false)
 {
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(0);
+    QObject::connect(&m_flushTimer, &QTimer::timeout, m_socket, [this] { flushWriteBuffer(); });
 }
 
 void SshSendFacility::sendPacket()
+{
+    if (m_outgoingPacket.isHeldBack()) {
+        qCDebug(sshLog, "Key exchange or authentication in progress, holding back packet");
+        m_heldBackPackets << m_outgoingPacket.rawData();
+        return;
+    }
+    writePacket(m_outgoingPacket.rawData());
+}
+
+void SshSendFacility::writePacket(const QByteArray &data)
 {
     qCDebug(sshLog, "Sending packet, client seq nr is %u", m_clientSeqNr);
     if (m_socket->isValid()
         && m_socket->state() == QAbstractSocket::ConnectedState) {
-        m_socket->write(m_outgoingPacket.rawData());
+        m_writeBuffer += data;
+        if (m_packetTracer && m_packetTracer->isActive()) {
+            m_packetTracer->recordOutgoing(m_clientSeqNr, m_outgoingPacket.payLoadType(),
+                    m_outgoingPacket.payLoadChannel(), m_outgoingPacket.payLoadSize());
+        }
         ++m_clientSeqNr;
+        m_bytesSentWithCurrentKeys += data.size();
+        m_totalBytesSent.fetch_add(data.size(), std::memory_order_relaxed);
+        m_payloadBytesSent.fetch_add(m_outgoingPacket.payLoadSize(), std::memory_order_relaxed);
+        m_packetsSent.fetch_add(1, std::memory_order_relaxed);
+        ++m_packetsSentWithCurrentKeys;
+        if (m_writeBuffer.size() >= WriteBatchSize)
+            flushWriteBuffer();
+        else if (!m_flushTimer.isActive())
+            m_flushTimer.start();
     }
 }
 
+void SshSendFacility::flushWriteBuffer()
+{
+    m_flushTimer.stop();
+    if (m_writeBuffer.isEmpty())
+        return;
+    if (m_socket->isValid() && m_socket->state() == QAbstractSocket::ConnectedState)
+        m_socket->write(m_writeBuffer);
+    m_writeBuffer.clear();
+}
+
+bool SshSendFacility::socketCanTakeData() const
+{
+    // If the socket is gone, the data gets dropped in sendPacket() anyway.
+    return m_socket->state() != QAbstractSocket::ConnectedState
+            || m_socket->bytesToWrite() + m_writeBuffer.size() < MaxSocketBacklog;
+}
+
 void SshSendFacility::reset()
 {
     m_clientSeqNr = 0;
+    m_bytesSentWithCurrentKeys = 0;
+    m_packetsSentWithCurrentKeys = 0;
+    m_totalBytesSent = 0;
+    m_payloadBytesSent = 0;
+    m_packetsSent = 0;
+    m_windowStalls = 0;
     m_encrypter.clearKeys();
+    m_encrypter.resetTimings();
+    m_encrypter.setServerSignatureAlgorithms(QList<QByteArray>());
+    for (QQueue<ScheduledChannel> &queue : m_scheduledChannels) {
+        for (const ScheduledChannel &scheduled : qAsConst(queue))
+            scheduled.channel->m_scheduled = false;
+        queue.clear();
+    }
+    m_flushTimer.stop();
+    m_writeBuffer.clear();
+    m_outgoingPacket.setHoldBackNonKexPackets(false);
+    m_outgoingPacket.setHoldBackConnectionPackets(false);
+    m_heldBackPackets.clear();
+}
+
+void SshSendFacility::releaseConnectionPackets()
+{
+    m_outgoingPacket.setHoldBackConnectionPackets(false);
+
+    // Otherwise, the new keys release them.
+    if (!m_outgoingPacket.holdsBackNonKexPackets())
+        sendHeldBackPackets();
+}
+
+void SshSendFacility::discardHeldBackPackets()
+{
+    m_outgoingPacket.setHoldBackNonKexPackets(false);
+    m_outgoingPacket.setHoldBackConnectionPackets(false);
+    m_heldBackPackets.clear();
+}
+
+void SshSendFacility::scheduleChannel(AbstractSshChannel *channel)
+{
+    if (channel->sendableDataSize() == 0)
+        return;
+    if (!channel->m_scheduled) {
+        channel->m_scheduled = true;
+        m_scheduledChannels[channel->priority()].enqueue(ScheduledChannel(channel));
+    }
+
+    // If we get here via a callback from within the loop, the channel gets picked up there.
+    if (!m_sendingScheduledData)
+        sendScheduledChannelData();
+}
+
+void SshSendFacility::unscheduleChannel(AbstractSshChannel *channel)
+{
+    if (!channel->m_scheduled)
+        return;
+    channel->m_scheduled = false;
+    for (QQueue<ScheduledChannel> &queue : m_scheduledChannels) {
+        for (int i = 0; i < queue.count(); ++i) {
+            if (queue.at(i).channel == channel) {
+                queue.removeAt(i);
+                return;
+            }
+        }
+    }
+}
+
+void SshSendFacility::sendScheduledChannelData()
+{
+    // During a key exchange or the authentication, the data is better off in the channels'
+    // buffers. We get called again once the held back packets are released.
+    if (m_outgoingPacket.holdsBackNonKexPackets() || m_outgoingPacket.holdsBackConnectionPackets())
+        return;
+
+    m_sendingScheduledData = true;
+    bool dataWasSent = true;
+    while (dataWasSent && socketCanTakeData()) {
+        dataWasSent = false;
+
+        // One round: Every queued channel gets its quantum, interactive ones first.
+        for (int priority = 0; priority < AbstractSshChannel::PriorityCount; ++priority) {
+            QQueue<ScheduledChannel> &queue = m_scheduledChannels[priority];
+            for (int i = queue.count(); i > 0 && !queue.isEmpty() && socketCanTakeData(); --i) {
+                ScheduledChannel next = queue.dequeue();
+                next.deficit += schedulingQuantum(priority);
+                // The channel stays marked while it is served, so that callbacks from
+                // within flushSendBuffer() do not queue it a second time.
+                const quint32 bytesSent = next.channel->flushSendBuffer(next.deficit);
+                next.deficit -= bytesSent;
+                if (bytesSent > 0)
+                    dataWasSent = true;
+                next.channel->m_scheduled = next.channel->sendableDataSize() > 0;
+                if (next.channel->m_scheduled)
+                    queue.enqueue(next);
+            }
+        }
+    }
+    m_sendingScheduledData = false;
 }
 
 void SshSendFacility::recreateKeys(const SshKeyExchange &keyExchange)
 {
     m_encrypter.recreateKeys(keyExchange);
+    m_bytesSentWithCurrentKeys = 0;
+    m_packetsSentWithCurrentKeys = 0;
+
+    m_outgoingPacket.setHoldBackNonKexPackets(false);
+    sendHeldBackPackets();
+}
+
+void SshSendFacility::sendHeldBackPackets()
+{
+    // Connection protocol packets may still have to wait for the authentication.
+    const QList<QByteArray> heldBackPackets = m_heldBackPackets;
+    m_heldBackPackets.clear();
+    for (const QByteArray &packet : heldBackPackets) {
+        m_outgoingPacket.finalizeHeldBackPacket(packet);
+        sendPacket();
+    }
+    sendScheduledChannelData();
 }
 
 void SshSendFacility::createAuthenticationKey(const QByteArray &privKeyFileContents)
@@ -71,10 +246,13 @@ void SshSendFacility::createAuthenticationKey(const QByteArray &privKeyFileConte
     m_encrypter.createAuthenticationKey(privKeyFileContents);
 }
 
-QByteArray SshSendFacility::sendKeyExchangeInitPacket()
+QByteArray SshSendFacility::sendKeyExchangeInitPacket(const QList<QByteArray> &keyExchangeMethods,
+        const QList<QByteArray> &hostKeyAlgorithms, bool firstKexPacketFollows)
 {
-    const QByteArray &payLoad = m_outgoingPacket.generateKeyExchangeInitPacket();
+    const QByteArray &payLoad = m_outgoingPacket.generateKeyExchangeInitPacket(keyExchangeMethods,
+            hostKeyAlgorithms, firstKexPacketFollows);
     sendPacket();
+    m_outgoingPacket.setHoldBackNonKexPackets(true);
     return payLoad;
 }
 
@@ -101,7 +279,8 @@ void SshSendFacility::sendDisconnectPacket(SshErrorCode reason,
 {
     m_outgoingPacket.generateDisconnectPacket(reason, reasonString);
     sendPacket();
-    }
+    flushWriteBuffer(); // The socket gets closed right after this.
+}
 
 void SshSendFacility::sendMsgUnimplementedPacket(quint32 serverSeqNr)
 {
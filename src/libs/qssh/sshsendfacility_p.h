@@ -31,10 +31,13 @@
 #ifndef SSHCONNECTIONOUTSTATE_P_H
 #define SSHCONNECTIONOUTSTATE_P_H
 
+#include "sshchannel_p.h"
 #include "sshcryptofacility_p.h"
 #include "sshoutgoingpacket_p.h"
 
+#include <QQueue>
 #include <QStringList>
+#include <QTimer>
 
 QT_BEGIN_NAMESPACE
 class QTcpSocket;
@@ -46,18 +49,35 @@ class SshPseudoTerminal;
 
 namespace Internal {
 class SshKeyExchange;
+class SshPacketTracer;
 
-class SshSendFacility
+class QSSH_EXPORT SshSendFacility
 {
 public:
     SshSendFacility(QTcpSocket *socket);
     void reset();
     void recreateKeys(const SshKeyExchange &keyExchange);
+
+    // With optimistic authentication, channels may be opened before the server has accepted
+    // our credentials. Their packets are held back until then, and discarded if it never does.
+    void holdBackConnectionPackets() { m_outgoingPacket.setHoldBackConnectionPackets(true); }
+    void releaseConnectionPackets();
+    void discardHeldBackPackets();
     void createAuthenticationKey(const QByteArray &privKeyFileContents);
+    void setServerSignatureAlgorithms(const QList<QByteArray> &algorithms) {
+        m_encrypter.setServerSignatureAlgorithms(algorithms);
+    }
 
     QByteArray sessionId() const { return m_encrypter.sessionId(); }
+    QByteArray authenticationAlgorithmName() const {
+        return m_encrypter.authenticationAlgorithmName();
+    }
+    QByteArray signatureAlgorithmName(const QByteArray &keyType) const {
+        return m_encrypter.signatureAlgorithmName(keyType);
+    }
 
-    QByteArray sendKeyExchangeInitPacket();
+    QByteArray sendKeyExchangeInitPacket(const QList<QByteArray> &keyExchangeMethods,
+            const QList<QByteArray> &hostKeyAlgorithms, bool firstKexPacketFollows);
     void sendKeyDhInitPacket(const Botan::BigInt &e);
     void sendKeyEcdhInitPacket(const QByteArray &clientQ);
     void sendNewKeysPacket();
@@ -71,6 +91,10 @@ public:
         const QByteArray &service, const QByteArray &key, const QByteArray &signature);
     void sendQueryPublicKeyPacket(const QByteArray &user, const QByteArray &service,
                                   const QByteArray &publicKey);
+    void prepareAgentSignature(const QByteArray &user, const QByteArray &service,
+                               const QByteArray &publicKey) {
+        m_outgoingPacket.storeDataToSignForAgent(user, service, publicKey);
+    }
     void sendUserAuthByKeyboardInteractiveRequestPacket(const QByteArray &user,
         const QByteArray &service);
     void sendUserAuthInfoResponsePacket(const QStringList &responses);
@@ -105,15 +129,69 @@ public:
         const QByteArray &reasonString);
     quint32 nextClientSeqNr() const { return m_clientSeqNr; }
 
+    // Traffic since the last key (re-)exchange; used to decide when to rekey.
+    quint64 bytesSentWithCurrentKeys() const { return m_bytesSentWithCurrentKeys; }
+    quint32 packetsSentWithCurrentKeys() const { return m_packetsSentWithCurrentKeys; }
+
+    // Counters for SshConnection::statistics(). Unlike everything else here, these
+    // may be read from any thread.
+    quint64 totalBytesSent() const { return m_totalBytesSent.load(std::memory_order_relaxed); }
+    quint64 payloadBytesSent() const { return m_payloadBytesSent.load(std::memory_order_relaxed); }
+    quint64 packetsSent() const { return m_packetsSent.load(std::memory_order_relaxed); }
+    quint64 windowStalls() const { return m_windowStalls.load(std::memory_order_relaxed); }
+    qint64 encryptionTime() const { return m_encrypter.cipherTime(); }
+    qint64 macTime() const { return m_encrypter.macTime(); }
+    void countWindowStall() { m_windowStalls.fetch_add(1, std::memory_order_relaxed); }
+
     bool encrypterIsValid() const { return m_encrypter.isValid(); }
 
+    // Sent packets are recorded here while the tracer is active.
+    void setPacketTracer(SshPacketTracer *tracer) { m_packetTracer = tracer; }
+
+    /*
+     * Channel data does not go to the socket directly. Instead, channels with pending
+     * data get queued here and are served in deficit round-robin order, interactive
+     * channels first, whenever the socket's write buffer has room.
+     */
+    void scheduleChannel(AbstractSshChannel *channel);
+    void unscheduleChannel(AbstractSshChannel *channel);
+    void sendScheduledChannelData();
+
+    // Packets are collected and handed to the socket in batches; this forces out the current one.
+    void flushWriteBuffer();
+
 private:
+    struct ScheduledChannel {
+        ScheduledChannel(AbstractSshChannel *c = nullptr) : channel(c), deficit(0) {}
+        AbstractSshChannel *channel;
+        quint32 deficit;
+    };
+
     void sendPacket();
+    void sendHeldBackPackets();
+    void writePacket(const QByteArray &data);
+    bool socketCanTakeData() const;
 
     quint32 m_clientSeqNr;
+    quint64 m_bytesSentWithCurrentKeys;
+    quint32 m_packetsSentWithCurrentKeys;
+    std::atomic<quint64> m_totalBytesSent;
+    std::atomic<quint64> m_payloadBytesSent;
+    std::atomic<quint64> m_packetsSent;
+    std::atomic<quint64> m_windowStalls;
     SshEncryptionFacility m_encrypter;
     QTcpSocket *m_socket;
     SshOutgoingPacket m_outgoingPacket;
+    QQueue<ScheduledChannel> m_scheduledChannels[AbstractSshChannel::PriorityCount];
+    bool m_sendingScheduledData;
+    QByteArray m_writeBuffer;
+    QTimer m_flushTimer;
+    SshPacketTracer *m_packetTracer = nullptr;
+
+    // Non-KEX packets created during a key exchange or connection protocol packets created
+    // before the authentication has succeeded, not yet finalized. They go out under the
+    // then current keys, in their original order.
+    QList<QByteArray> m_heldBackPackets;
 };
 
 } // namespace Internal
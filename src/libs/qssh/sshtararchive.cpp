@@ -0,0 +1,587 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "sshtararchive_p.h"
+
+#include "sshlogging_p.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstring>
+
+namespace QSsh {
+namespace Internal {
+namespace {
+
+const int BlockSize = 512;
+const int RecordSize = 20 * BlockSize;
+const int MaxExtendedHeaderSize = 1024 * 1024;
+
+const struct {
+    QFile::Permission permission;
+    int mode;
+} permissionMap[] = {
+    {QFile::ReadOwner, 0400}, {QFile::WriteOwner, 0200}, {QFile::ExeOwner, 0100},
+    {QFile::ReadGroup, 040}, {QFile::WriteGroup, 020}, {QFile::ExeGroup, 010},
+    {QFile::ReadOther, 04}, {QFile::WriteOther, 02}, {QFile::ExeOther, 01}
+};
+
+int permissionsToMode(QFile::Permissions permissions)
+{
+    int mode = 0;
+    for (const auto &entry : permissionMap) {
+        if (permissions & entry.permission)
+            mode |= entry.mode;
+    }
+    return mode;
+}
+
+QFile::Permissions modeToPermissions(int mode)
+{
+    QFile::Permissions permissions;
+    for (const auto &entry : permissionMap) {
+        if (mode & entry.mode)
+            permissions |= entry.permission;
+    }
+    if (mode & 0400)
+        permissions |= QFile::ReadUser;
+    if (mode & 0200)
+        permissions |= QFile::WriteUser;
+    if (mode & 0100)
+        permissions |= QFile::ExeUser;
+    return permissions;
+}
+
+// Octal with a terminating NUL if the value fits, GNU base-256 encoding otherwise.
+void writeNumber(char *field, int length, quint64 value)
+{
+    if (value < (quint64(1) << (3 * (length - 1)))) {
+        for (int i = length - 2; i >= 0; --i) {
+            field[i] = char('0' + (value & 7));
+            value >>= 3;
+        }
+        field[length - 1] = '\0';
+    } else {
+        for (int i = length - 1; i > 0; --i) {
+            field[i] = char(value & 0xff);
+            value >>= 8;
+        }
+        field[0] = char(0x80);
+    }
+}
+
+quint64 readNumber(const char *field, int length)
+{
+    quint64 value = 0;
+    if (uchar(field[0]) & 0x80) {
+        for (int i = 1; i < length; ++i)
+            value = (value << 8) | uchar(field[i]);
+        return value;
+    }
+    int i = 0;
+    while (i < length && field[i] == ' ')
+        ++i;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i)
+        value = value * 8 + (field[i] - '0');
+    return value;
+}
+
+QString readString(const char *field, int length)
+{
+    return QString::fromUtf8(field, int(qstrnlen(field, length)));
+}
+
+quint32 headerChecksum(const char *header)
+{
+    quint32 checksum = 0;
+    for (int i = 0; i < BlockSize; ++i)
+        checksum += (i >= 148 && i < 156) ? quint32(' ') : uchar(header[i]);
+    return checksum;
+}
+
+QByteArray createHeader(const QByteArray &name, char type, quint64 size, int mode, qint64 mtime)
+{
+    QByteArray header(BlockSize, '\0');
+    char * const h = header.data();
+    std::memcpy(h, name.constData(), qMin<int>(name.size(), 100));
+    writeNumber(h + 100, 8, mode);
+    writeNumber(h + 108, 8, 0); // uid
+    writeNumber(h + 116, 8, 0); // gid
+    writeNumber(h + 124, 12, size);
+    writeNumber(h + 136, 12, quint64(qMax<qint64>(mtime, 0)));
+    h[156] = type;
+    std::memcpy(h + 257, "ustar  ", 8); // GNU magic and version, needed for the long name extension.
+    std::memset(h + 148, ' ', 8);
+    writeNumber(h + 148, 7, headerChecksum(h));
+    return header;
+}
+
+} // anonymous namespace
+
+SshTarPacker::SshTarPacker(const QString &localDirPath)
+    : m_localDirPath(localDirPath),
+      m_nextEntry(0),
+      m_fileBytesLeft(0),
+      m_progress(0),
+      m_archiveSize(0),
+      m_done(false)
+{
+}
+
+void SshTarPacker::start()
+{
+    // Same selection of files as SftpChannel::uploadDir(): no hidden files, links are followed.
+    const QFileInfo rootInfo(m_localDirPath);
+    m_entries << Entry{rootInfo.absoluteFilePath(), QDir(m_localDirPath).dirName(), true, 0,
+                       rootInfo.permissions(), rootInfo.lastModified().toSecsSinceEpoch()};
+    quint64 totalSize = 0;
+    for (int i = 0; i < m_entries.count(); ++i) {
+        if (!m_entries.at(i).isDir)
+            continue;
+        const QDir dir(m_entries.at(i).localPath);
+        const QString archiveDir = m_entries.at(i).archivePath + QLatin1Char('/');
+        const QFileInfoList &fileInfos
+                = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+        for (const QFileInfo &fileInfo : fileInfos) {
+            const Entry entry{fileInfo.absoluteFilePath(), archiveDir + fileInfo.fileName(),
+                        fileInfo.isDir(), fileInfo.isDir() ? 0 : quint64(fileInfo.size()),
+                        fileInfo.permissions(), fileInfo.lastModified().toSecsSinceEpoch()};
+            totalSize += entry.size;
+            m_entries << entry;
+        }
+    }
+    emit started(totalSize);
+}
+
+void SshTarPacker::produce()
+{
+    if (m_done)
+        return;
+
+    QByteArray chunk;
+    chunk.reserve(ChunkSize + 3 * BlockSize);
+    while (chunk.size() < ChunkSize) {
+        if (m_file.isOpen()) {
+            if (!appendFileData(chunk))
+                return;
+            continue;
+        }
+        if (m_nextEntry < m_entries.count()) {
+            const Entry &entry = m_entries.at(m_nextEntry++);
+            appendHeader(chunk, entry);
+            if (!entry.isDir && entry.size > 0) {
+                m_file.setFileName(entry.localPath);
+                if (!m_file.open(QIODevice::ReadOnly)) {
+                    fail(tr("Could not open local file \"%1\": %2")
+                         .arg(entry.localPath, m_file.errorString()));
+                    return;
+                }
+                m_fileBytesLeft = entry.size;
+            }
+            continue;
+        }
+
+        // End of archive: Two zero blocks, padded to a full record.
+        const qint64 archiveSize = m_archiveSize + chunk.size() + 2 * BlockSize;
+        chunk.append(int(2 * BlockSize + (RecordSize - archiveSize % RecordSize) % RecordSize), '\0');
+        m_done = true;
+        break;
+    }
+
+    m_archiveSize += chunk.size();
+    emit dataAvailable(chunk, m_progress);
+    if (m_done)
+        emit finished();
+}
+
+void SshTarPacker::appendHeader(QByteArray &chunk, const Entry &entry)
+{
+    QByteArray name = entry.archivePath.toUtf8();
+    if (entry.isDir)
+        name += '/';
+    if (name.size() > 100) {
+        const QByteArray longName = name + '\0';
+        chunk += createHeader("././@LongLink", 'L', longName.size(), 0644, 0);
+        chunk += longName;
+        chunk.append(int((BlockSize - longName.size() % BlockSize) % BlockSize), '\0');
+    }
+    chunk += createHeader(name, entry.isDir ? '5' : '0', entry.size,
+                          permissionsToMode(entry.permissions), entry.mtime);
+}
+
+bool SshTarPacker::appendFileData(QByteArray &chunk)
+{
+    const int oldSize = chunk.size();
+    const qint64 bytesToRead = qMin<quint64>(m_fileBytesLeft, ChunkSize - oldSize);
+    chunk.resize(oldSize + bytesToRead);
+    if (m_file.read(chunk.data() + oldSize, bytesToRead) != bytesToRead) {
+        fail(tr("Error reading local file \"%1\": %2")
+             .arg(m_file.fileName(), m_file.errorString()));
+        return false;
+    }
+    m_fileBytesLeft -= bytesToRead;
+    m_progress += bytesToRead;
+    if (m_fileBytesLeft == 0) {
+        m_file.close();
+        const qint64 archiveSize = m_archiveSize + chunk.size();
+        chunk.append(int((BlockSize - archiveSize % BlockSize) % BlockSize), '\0');
+    }
+    return true;
+}
+
+void SshTarPacker::fail(const QString &message)
+{
+    m_done = true;
+    m_file.close();
+    emit error(message);
+}
+
+
+SshTarExtractor::SshTarExtractor(const QString &localDirPath, SftpOverwriteMode mode)
+    : m_localDirPath(localDirPath),
+      m_mode(mode),
+      m_state(ReadingHeader),
+      m_entryKind(SkippedEntry),
+      m_bytesLeft(0),
+      m_padding(0),
+      m_progress(0)
+{
+}
+
+void SshTarExtractor::extract(const QByteArray &data)
+{
+    const char *pos = data.constData();
+    int bytesLeft = data.size();
+    while (bytesLeft > 0 && m_state != Done && m_state != Failed) {
+        int bytesConsumed = 0;
+        switch (m_state) {
+        case ReadingHeader:
+            bytesConsumed = qMin<int>(BlockSize - m_header.size(), bytesLeft);
+            m_header.append(pos, bytesConsumed);
+            if (m_header.size() == BlockSize) {
+                handleHeader();
+                m_header.clear();
+            }
+            break;
+        case ReadingData:
+            bytesConsumed = int(qMin<quint64>(m_bytesLeft, bytesLeft));
+            handleEntryData(pos, bytesConsumed);
+            m_bytesLeft -= bytesConsumed;
+            if (m_bytesLeft == 0 && m_state != Failed)
+                finishEntry();
+            break;
+        case ReadingPadding:
+            bytesConsumed = int(qMin<quint64>(m_padding, bytesLeft));
+            m_padding -= bytesConsumed;
+            if (m_padding == 0)
+                m_state = ReadingHeader;
+            break;
+        case Done:
+        case Failed:
+            break;
+        }
+        pos += bytesConsumed;
+        bytesLeft -= bytesConsumed;
+    }
+    if (m_state != Failed)
+        emit chunkProcessed(m_progress);
+}
+
+void SshTarExtractor::finish()
+{
+    if (m_state == Failed)
+        return;
+    if (m_state != Done && (m_state != ReadingHeader || !m_header.isEmpty())) {
+        fail(tr("Unexpected end of tar archive."));
+        return;
+    }
+    emit finished();
+}
+
+void SshTarExtractor::handleHeader()
+{
+    const char * const header = m_header.constData();
+    if (std::all_of(header, header + BlockSize, [](char c) { return c == '\0'; })) {
+        m_state = Done;
+        return;
+    }
+    if (headerChecksum(header) != readNumber(header + 148, 8)) {
+        fail(tr("Invalid tar header."));
+        return;
+    }
+
+    const char type = header[156];
+    m_bytesLeft = readNumber(header + 124, 12);
+    m_padding = (BlockSize - m_bytesLeft % BlockSize) % BlockSize;
+    m_entryKind = SkippedEntry;
+
+    switch (type) {
+    case 'L':
+        m_entryKind = LongNameEntry;
+        break;
+    case 'K':
+        m_entryKind = LongLinkEntry;
+        break;
+    case 'x':
+        m_entryKind = PaxEntry;
+        break;
+    case 'g':
+        break;
+    default: {
+        QString name = m_longName;
+        if (name.isEmpty()) {
+            name = readString(header, 100);
+            if (std::memcmp(header + 257, "ustar\0", 6) == 0) { // POSIX format has a name prefix.
+                const QString prefix = readString(header + 345, 155);
+                if (!prefix.isEmpty())
+                    name = prefix + QLatin1Char('/') + name;
+            }
+        }
+        const QString linkTarget = m_longLink.isEmpty() ? readString(header + 157, 100)
+                                                        : m_longLink;
+        m_longName.clear();
+        m_longLink.clear();
+
+        QString path;
+        if (!localPath(name, &path))
+            return;
+        if (path.isEmpty())
+            break; // The top-level directory itself.
+
+        switch (type) {
+        case '5':
+            if (!resolvesInsideRoot(path))
+                return;
+            if (!QDir().mkpath(path)) {
+                fail(tr("Could not create local directory \"%1\".").arg(path));
+                return;
+            }
+            break;
+        case '0':
+        case '\0':
+        case '7':
+            if (!resolvesInsideRoot(path))
+                return;
+            startFile(path, modeToPermissions(int(readNumber(header + 100, 8))));
+            if (m_state == Failed)
+                return;
+            break;
+        case '2': {
+            if (!checkLinkTarget(name, linkTarget))
+                return;
+            const QFileInfo linkInfo(path);
+            if (linkInfo.exists() || linkInfo.isSymLink()) {
+                if (m_mode == SftpSkipExisting)
+                    break;
+                QFile::remove(path);
+            }
+            if (!QDir().mkpath(linkInfo.absolutePath()) || !QFile::link(linkTarget, path)) {
+                fail(tr("Could not create symbolic link \"%1\".").arg(path));
+                return;
+            }
+
+            // The lexical check cannot see through links created earlier.
+            if (QFileInfo::exists(path) && !resolvesInsideRoot(path)) {
+                QFile::remove(path);
+                return;
+            }
+            break;
+        }
+        default:
+            qCDebug(sshLog, "Skipping tar entry '%s' of type '%c'.", qPrintable(name), type);
+            break;
+        }
+    }
+    }
+
+    if (m_entryKind != SkippedEntry && m_entryKind != FileEntry
+            && m_bytesLeft > quint64(MaxExtendedHeaderSize)) {
+        fail(tr("Invalid tar header."));
+        return;
+    }
+    if (m_bytesLeft > 0)
+        m_state = ReadingData;
+    else
+        finishEntry();
+}
+
+void SshTarExtractor::handleEntryData(const char *data, int size)
+{
+    switch (m_entryKind) {
+    case FileEntry:
+        if (m_file.write(data, size) != size) {
+            fail(tr("Could not write local file \"%1\": %2")
+                 .arg(m_file.fileName(), m_file.errorString()));
+            return;
+        }
+        m_progress += size;
+        break;
+    case LongNameEntry:
+    case LongLinkEntry:
+    case PaxEntry:
+        m_extendedData.append(data, size);
+        break;
+    case SkippedEntry:
+        break;
+    }
+}
+
+void SshTarExtractor::finishEntry()
+{
+    switch (m_entryKind) {
+    case FileEntry:
+        m_file.close();
+        if (m_filePermissions)
+            m_file.setPermissions(m_filePermissions);
+        break;
+    case LongNameEntry:
+        m_longName = QString::fromUtf8(m_extendedData.constData());
+        break;
+    case LongLinkEntry:
+        m_longLink = QString::fromUtf8(m_extendedData.constData());
+        break;
+    case PaxEntry: {
+        // Records are of the form "<length> <key>=<value>\n".
+        int pos = 0;
+        while (pos < m_extendedData.size()) {
+            const int spacePos = m_extendedData.indexOf(' ', pos);
+            const int length = spacePos == -1 ? 0 : m_extendedData.mid(pos, spacePos - pos).toInt();
+            if (length <= 0 || pos + length > m_extendedData.size())
+                break;
+            const QByteArray record = m_extendedData.mid(spacePos + 1, pos + length - spacePos - 2);
+            const int equalsPos = record.indexOf('=');
+            if (equalsPos != -1) {
+                const QByteArray key = record.left(equalsPos);
+                if (key == "path")
+                    m_longName = QString::fromUtf8(record.mid(equalsPos + 1));
+                else if (key == "linkpath")
+                    m_longLink = QString::fromUtf8(record.mid(equalsPos + 1));
+            }
+            pos += length;
+        }
+        break;
+    }
+    case SkippedEntry:
+        break;
+    }
+    m_extendedData.clear();
+    m_entryKind = SkippedEntry;
+    m_state = m_padding > 0 ? ReadingPadding : ReadingHeader;
+}
+
+void SshTarExtractor::startFile(const QString &path, QFile::Permissions permissions)
+{
+    QIODevice::OpenMode openMode = QIODevice::WriteOnly;
+    if (QFileInfo::exists(path)) {
+        switch (m_mode) {
+        case SftpSkipExisting:
+            return;
+        case SftpAppendToExisting:
+            openMode |= QIODevice::Append;
+            break;
+        case SftpOverwriteExisting:
+            openMode |= QIODevice::Truncate;
+            break;
+        }
+    }
+    m_file.setFileName(path);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath()) || !m_file.open(openMode)) {
+        fail(tr("Could not open local file \"%1\": %2").arg(path, m_file.errorString()));
+        return;
+    }
+    m_entryKind = FileEntry;
+    m_filePermissions = permissions;
+}
+
+bool SshTarExtractor::localPath(const QString &archivePath, QString *result)
+{
+    const QString cleanPath = QDir::cleanPath(archivePath);
+    if (cleanPath.isEmpty() || cleanPath == QLatin1String(".")) {
+        result->clear();
+        return true;
+    }
+    if (QDir::isAbsolutePath(cleanPath) || cleanPath == QLatin1String("..")
+            || cleanPath.startsWith(QLatin1String("../"))) {
+        fail(tr("Refusing to extract \"%1\" outside of the target directory.").arg(archivePath));
+        return false;
+    }
+    *result = m_localDirPath + QLatin1Char('/') + cleanPath;
+
+    // The name may still lead elsewhere through a symbolic link in the target directory.
+    return resolvesInsideRoot(QFileInfo(*result).absolutePath());
+}
+
+// Checks the part of the path that already exists, with all symbolic links resolved.
+// Whatever does not exist yet is going to be created as a plain directory or file.
+bool SshTarExtractor::resolvesInsideRoot(const QString &path)
+{
+    if (m_canonicalRoot.isEmpty()) {
+        QDir().mkpath(m_localDirPath);
+        m_canonicalRoot = QFileInfo(m_localDirPath).canonicalFilePath();
+        if (m_canonicalRoot.isEmpty()) {
+            fail(tr("Could not create local directory \"%1\".").arg(m_localDirPath));
+            return false;
+        }
+    }
+
+    QFileInfo existing(path);
+    while (!existing.exists() && !existing.isSymLink() && !existing.isRoot())
+        existing.setFile(existing.absolutePath());
+    const QString resolvedPath = existing.canonicalFilePath(); // Empty for dangling links.
+    if (resolvedPath.isEmpty() || (resolvedPath != m_canonicalRoot
+            && !resolvedPath.startsWith(m_canonicalRoot + QLatin1Char('/')))) {
+        fail(tr("Refusing to extract \"%1\" outside of the target directory.").arg(path));
+        return false;
+    }
+    return true;
+}
+
+bool SshTarExtractor::checkLinkTarget(const QString &archivePath, const QString &linkTarget)
+{
+    const QString linkDir = QFileInfo(QDir::cleanPath(archivePath)).path();
+    const QString resolvedTarget = QDir::cleanPath(linkDir + QLatin1Char('/') + linkTarget);
+    if (linkTarget.isEmpty() || QDir::isAbsolutePath(linkTarget)
+            || resolvedTarget == QLatin1String("..")
+            || resolvedTarget.startsWith(QLatin1String("../"))) {
+        fail(tr("Refusing to create symbolic link \"%1\" pointing to \"%2\" "
+                "outside of the target directory.").arg(archivePath, linkTarget));
+        return false;
+    }
+    return true;
+}
+
+void SshTarExtractor::fail(const QString &message)
+{
+    m_state = Failed;
+    if (m_file.isOpen())
+        m_file.close();
+    emit error(message);
+}
+
+} // namespace Internal
+} // namespace QSsh
@@ -0,0 +1,127 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include "sftpdefs.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+namespace QSsh {
+namespace Internal {
+
+// Streams a local directory tree as a tar archive. Lives in a worker thread; every call to
+// produce() results in one dataAvailable() signal, so the consumer controls the pace.
+class QSSH_EXPORT SshTarPacker : public QObject
+{
+    Q_OBJECT
+public:
+    SshTarPacker(const QString &localDirPath);
+
+    void start();
+    void produce();
+
+    static const int ChunkSize = 256 * 1024;
+
+signals:
+    void started(quint64 totalSize);
+    void dataAvailable(const QByteArray &data, quint64 progress);
+    void finished();
+    void error(const QString &message);
+
+private:
+    struct Entry {
+        QString localPath;
+        QString archivePath;
+        bool isDir;
+        quint64 size;
+        QFile::Permissions permissions;
+        qint64 mtime;
+    };
+
+    void appendHeader(QByteArray &chunk, const Entry &entry);
+    bool appendFileData(QByteArray &chunk);
+    void fail(const QString &message);
+
+    const QString m_localDirPath;
+    QList<Entry> m_entries;
+    int m_nextEntry;
+    QFile m_file;
+    quint64 m_fileBytesLeft;
+    quint64 m_progress;
+    quint64 m_archiveSize;
+    bool m_done;
+};
+
+// Unpacks a tar archive into a local directory as its data comes in. Lives in a worker thread.
+class QSSH_EXPORT SshTarExtractor : public QObject
+{
+    Q_OBJECT
+public:
+    SshTarExtractor(const QString &localDirPath, SftpOverwriteMode mode);
+
+    void extract(const QByteArray &data);
+    void finish();
+
+signals:
+    void chunkProcessed(quint64 progress);
+    void finished();
+    void error(const QString &message);
+
+private:
+    enum State { ReadingHeader, ReadingData, ReadingPadding, Done, Failed };
+    enum EntryKind { FileEntry, SkippedEntry, LongNameEntry, LongLinkEntry, PaxEntry };
+
+    void handleHeader();
+    void handleEntryData(const char *data, int size);
+    void finishEntry();
+    void startFile(const QString &path, QFile::Permissions permissions);
+    bool localPath(const QString &archivePath, QString *result);
+    bool resolvesInsideRoot(const QString &path);
+    bool checkLinkTarget(const QString &archivePath, const QString &linkTarget);
+    void fail(const QString &message);
+
+    const QString m_localDirPath;
+    QString m_canonicalRoot;
+    const SftpOverwriteMode m_mode;
+    State m_state;
+    EntryKind m_entryKind;
+    QByteArray m_header;
+    QByteArray m_extendedData;
+    QString m_longName;
+    QString m_longLink;
+    QFile m_file;
+    QFile::Permissions m_filePermissions;
+    quint64 m_bytesLeft;
+    quint64 m_padding;
+    quint64 m_progress;
+};
+
+} // namespace Internal
+} // namespace QSsh
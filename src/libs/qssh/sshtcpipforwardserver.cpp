@@ -29,6 +29,8 @@
 #include "sshlogging_p.h"
 #include "sshsendfacility_p.h"
 
+#include <QTcpSocket>
+
 namespace QSsh {
 namespace Internal {
 
@@ -37,7 +39,9 @@ SshTcpIpForwardServerPrivate::SshTcpIpForwardServerPrivate(const QString &bindAd
     : m_sendFacility(sendFacility),
       m_bindAddress(bindAddress),
       m_bindPort(bindPort),
-      m_state(SshTcpIpForwardServer::Inactive)
+      m_state(SshTcpIpForwardServer::Inactive),
+      m_maxConnections(0),
+      m_targetPort(0)
 {
 }
 
@@ -68,12 +72,87 @@ void SshTcpIpForwardServer::setClosed()
     emit stateChanged(Inactive);
 }
 
+bool SshTcpIpForwardServer::acceptsConnection() const
+{
+    return d->m_maxConnections <= 0 || connectionCount() < d->m_maxConnections;
+}
+
 void SshTcpIpForwardServer::setNewConnection(const SshForwardedTcpIpTunnel::Ptr &connection)
 {
+    SshForwardedTcpIpTunnel * const tunnel = connection.data();
+    d->m_openConnections.insert(tunnel);
+    const auto forgetConnection = [this, tunnel] { d->m_openConnections.remove(tunnel); };
+    connect(tunnel, &QIODevice::aboutToClose, this, forgetConnection);
+    connect(tunnel, &QObject::destroyed, this, forgetConnection);
+
+    if (!d->m_targetHost.isEmpty()) {
+        relayConnection(connection);
+        return;
+    }
     d->m_pendingConnections.append(connection);
     emit newConnection();
 }
 
+void SshTcpIpForwardServer::relayConnection(const SshForwardedTcpIpTunnel::Ptr &connection)
+{
+    SshForwardedTcpIpTunnel * const tunnel = connection.data();
+    d->m_relayedConnections.insert(tunnel, connection);
+
+    // Both directions are bounded: The socket's read buffer limits what the local peer can push
+    // at us. We take data from the tunnel only while the socket's write buffer has room, and
+    // the tunnel stops extending the server's window once its own buffer is full.
+    // Either way, a slow side throttles the fast one instead of data piling up here.
+    QTcpSocket * const socket = new QTcpSocket(tunnel);
+    socket->setReadBufferSize(SshTcpIpForwardServerPrivate::RelayBufferSize);
+
+    const auto tunnelToSocket = [tunnel, socket] {
+        while (socket->state() == QAbstractSocket::ConnectedState && tunnel->bytesAvailable() > 0
+               && socket->bytesToWrite() < SshTcpIpForwardServerPrivate::RelayBufferSize) {
+            socket->write(tunnel->read(SshTcpIpForwardServerPrivate::RelayBufferSize
+                                       - socket->bytesToWrite()));
+        }
+    };
+    const auto socketToTunnel = [tunnel, socket] {
+        while (tunnel->isOpen() && socket->bytesAvailable() > 0
+               && tunnel->bytesToWrite() < SshTcpIpForwardServerPrivate::RelayBufferSize) {
+            tunnel->write(socket->read(SshTcpIpForwardServerPrivate::RelayBufferSize
+                                       - tunnel->bytesToWrite()));
+        }
+    };
+    connect(socket, &QTcpSocket::connected, tunnel, tunnelToSocket);
+    connect(tunnel, &QIODevice::readyRead, socket, tunnelToSocket);
+    connect(socket, &QIODevice::bytesWritten, tunnel, tunnelToSocket);
+    connect(socket, &QIODevice::readyRead, tunnel, socketToTunnel);
+    connect(tunnel, &QIODevice::bytesWritten, socket, socketToTunnel);
+    connect(socket, &QTcpSocket::errorOccurred, tunnel, [tunnel, socket] {
+        if (socket->error() == QAbstractSocket::RemoteHostClosedError)
+            return; // Handled via disconnected().
+        qCDebug(sshLog, "Closing relayed connection: %s", qPrintable(socket->errorString()));
+        tunnel->close();
+    });
+
+    // When one side goes away, whatever the other one has not taken yet is still passed on;
+    // the tunnel sends its queued data before the EOF, and the socket before disconnecting.
+    connect(socket, &QTcpSocket::disconnected, tunnel, [tunnel, socket] {
+        if (tunnel->isOpen() && socket->bytesAvailable() > 0)
+            tunnel->write(socket->readAll());
+        tunnel->close();
+    });
+    connect(tunnel, &QIODevice::aboutToClose, socket, [tunnel, socket] {
+        socket->disconnect();
+        if (socket->state() == QAbstractSocket::ConnectedState && tunnel->bytesAvailable() > 0)
+            socket->write(tunnel->readAll());
+        socket->disconnectFromHost();
+    });
+
+    // Release our reference only once the tunnel's signal emission is over.
+    connect(tunnel, &QIODevice::aboutToClose, this, [this, tunnel] {
+        d->m_relayedConnections.remove(tunnel);
+    }, Qt::QueuedConnection);
+
+    socket->connectToHost(d->m_targetHost, d->m_targetPort);
+}
+
 SshTcpIpForwardServer::~SshTcpIpForwardServer()
 {
     delete d;
@@ -134,4 +213,35 @@ SshForwardedTcpIpTunnel::Ptr SshTcpIpForwardServer::nextPendingConnection()
     return d->m_pendingConnections.takeFirst();
 }
 
+void SshTcpIpForwardServer::setMaxConnections(int maxConnections)
+{
+    d->m_maxConnections = maxConnections;
+}
+
+int SshTcpIpForwardServer::maxConnections() const
+{
+    return d->m_maxConnections;
+}
+
+int SshTcpIpForwardServer::connectionCount() const
+{
+    return d->m_openConnections.count();
+}
+
+void SshTcpIpForwardServer::setLocalTarget(const QString &host, quint16 port)
+{
+    d->m_targetHost = host;
+    d->m_targetPort = port;
+}
+
+QString SshTcpIpForwardServer::localTargetHost() const
+{
+    return d->m_targetHost;
+}
+
+quint16 SshTcpIpForwardServer::localTargetPort() const
+{
+    return d->m_targetPort;
+}
+
 } // namespace QSsh
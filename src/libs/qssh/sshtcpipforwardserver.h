@@ -63,9 +63,22 @@ public:
 
     SshForwardedTcpIpTunnel::Ptr nextPendingConnection();
 
+    // Forwarded connections beyond this limit are rejected with SSH_OPEN_RESOURCE_SHORTAGE.
+    // Pending connections count as well. 0 means unlimited, which is the default.
+    void setMaxConnections(int maxConnections);
+    int maxConnections() const;
+    int connectionCount() const;
+
+    // If a local target is set, incoming connections are relayed to it automatically
+    // and newConnection() is not emitted.
+    void setLocalTarget(const QString &host, quint16 port);
+    QString localTargetHost() const;
+    quint16 localTargetPort() const;
+
 signals:
     void error(const QString &reason);
     void newConnection();
+    void connectionRejected();
     void stateChanged(State state);
 
 private:
@@ -73,7 +86,9 @@ private:
                           Internal::SshSendFacility &sendFacility);
     void setListening(quint16 port);
     void setClosed();
+    bool acceptsConnection() const;
     void setNewConnection(const SshForwardedTcpIpTunnel::Ptr &connection);
+    void relayConnection(const SshForwardedTcpIpTunnel::Ptr &connection);
 
     Internal::SshTcpIpForwardServerPrivate * const d;
 };
@@ -26,7 +26,9 @@
 #pragma once
 
 #include "sshtcpipforwardserver.h"
+#include <QHash>
 #include <QList>
+#include <QSet>
 #include <QTimer>
 
 namespace QSsh {
@@ -36,6 +38,7 @@ class SshTcpIpForwardServerPrivate
 {
 public:
     static const int ReplyTimeout = 10000; // milli seconds
+    static const int RelayBufferSize = 1024 * 1024;
 
     SshTcpIpForwardServerPrivate(const QString &bindAddress, quint16 bindPort,
                                  SshSendFacility &sendFacility);
@@ -48,6 +51,12 @@ public:
     SshTcpIpForwardServer::State m_state;
 
     QList<SshForwardedTcpIpTunnel::Ptr> m_pendingConnections;
+    QSet<SshForwardedTcpIpTunnel *> m_openConnections;
+    QHash<SshForwardedTcpIpTunnel *, SshForwardedTcpIpTunnel::Ptr> m_relayedConnections;
+    int m_maxConnections;
+
+    QString m_targetHost;
+    quint16 m_targetPort;
 };
 
 } // namespace Internal
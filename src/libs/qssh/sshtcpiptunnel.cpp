@@ -64,17 +64,17 @@ void SshTcpIpTunnelPrivate::handleOpenFailureInternal(const QString &reason)
     closeChannel();
 }
 
-void SshTcpIpTunnelPrivate::handleChannelDataInternal(const QByteArray &data)
+void SshTcpIpTunnelPrivate::handleChannelDataInternal(const SshByteView &data)
 {
-    m_data += data;
+    m_data.append(data.data(), data.size());
     emit readyRead();
 }
 
 void SshTcpIpTunnelPrivate::handleChannelExtendedDataInternal(quint32 type,
-                                                                           const QByteArray &data)
+                                                                           const SshByteView &data)
 {
     qCWarning(sshLog, "%s: Unexpected extended channel data. Type is %u, content is '%s'.",
-              Q_FUNC_INFO, type, data.constData());
+              Q_FUNC_INFO, type, data.toByteArray().constData());
 }
 
 void SshTcpIpTunnelPrivate::handleExitStatus(const SshChannelExitStatus &exitStatus)
@@ -107,6 +107,14 @@ qint64 SshTcpIpTunnelPrivate::readData(char *data, qint64 maxlen)
     const qint64 bytesRead = qMin(qint64(m_data.count()), maxlen);
     memcpy(data, m_data.constData(), bytesRead);
     m_data.remove(0, bytesRead);
+    if (bytesRead > 0) {
+        try {
+            adjustLocalWindow();
+        } catch (const std::exception &e) {
+            qCWarning(sshLog, "Botan error: %s", e.what());
+            closeChannel();
+        }
+    }
     return bytesRead;
 }
 
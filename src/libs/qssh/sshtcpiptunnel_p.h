@@ -47,12 +47,17 @@ public:
                 q, &SshTcpIpTunnel::close, Qt::QueuedConnection);
         connect(this, &SshTcpIpTunnelPrivate::readyRead,
                 q, &SshTcpIpTunnel::readyRead, Qt::QueuedConnection);
+        connect(this, &SshTcpIpTunnelPrivate::bytesWritten,
+                q, &SshTcpIpTunnel::bytesWritten, Qt::QueuedConnection);
         connect(this, &SshTcpIpTunnelPrivate::error, q, [q](const QString &reason) {
             q->setErrorString(reason);
             emit q->error(reason);
         }, Qt::QueuedConnection);
     }
 
+    // The server may send this much before the client has to read some of it.
+    static const qint64 ReceiveBufferSize = 1024 * 1024;
+
     void handleChannelSuccess() override;
     void handleChannelFailure() override;
 
@@ -66,11 +71,13 @@ signals:
 
 protected:
     void handleOpenFailureInternal(const QString &reason) override;
-    void handleChannelDataInternal(const QByteArray &data) override;
-    void handleChannelExtendedDataInternal(quint32 type, const QByteArray &data) override;
+    void handleChannelDataInternal(const SshByteView &data) override;
+    void handleChannelExtendedDataInternal(quint32 type, const SshByteView &data) override;
     void handleExitStatus(const SshChannelExitStatus &exitStatus) override;
     void handleExitSignal(const SshChannelExitSignal &signal) override;
     void closeHook() override;
+    qint64 receiveBufferLimit() const override { return ReceiveBufferSize; }
+    qint64 receiveBufferedSize() const override { return m_data.size(); }
 
     QByteArray m_data;
 
@@ -116,6 +116,7 @@ SshX11Channel::SshX11Channel(const X11DisplayInfo &displayInfo, quint32 channelI
       m_displayInfo(displayInfo)
 {
     setChannelState(SessionRequested); // Invariant for parent class.
+    setPriority(InteractivePriority);
 }
 
 void SshX11Channel::handleChannelSuccess()
@@ -158,14 +159,15 @@ void SshX11Channel::handleOpenFailureInternal(const QString &reason)
     qCWarning(sshLog) << "unexpected channel open failure message for X11 channel:" << reason;
 }
 
-void SshX11Channel::handleChannelDataInternal(const QByteArray &data)
+void SshX11Channel::handleChannelDataInternal(const SshByteView &data)
 {
-    handleRemoteData(data);
+    handleRemoteData(data.toByteArray());
 }
 
-void SshX11Channel::handleChannelExtendedDataInternal(quint32 type, const QByteArray &data)
+void SshX11Channel::handleChannelExtendedDataInternal(quint32 type, const SshByteView &data)
 {
-    qCWarning(sshLog) << "unexpected extended data for X11 channel" << type << data;
+    qCWarning(sshLog) << "unexpected extended data for X11 channel" << type
+                      << data.toByteArray();
 }
 
 void SshX11Channel::handleExitStatus(const SshChannelExitStatus &exitStatus)
@@ -55,8 +55,8 @@ private:
 
     void handleOpenSuccessInternal() override;
     void handleOpenFailureInternal(const QString &reason) override;
-    void handleChannelDataInternal(const QByteArray &data) override;
-    void handleChannelExtendedDataInternal(quint32 type, const QByteArray &data) override;
+    void handleChannelDataInternal(const SshByteView &data) override;
+    void handleChannelExtendedDataInternal(quint32 type, const SshByteView &data) override;
     void handleExitStatus(const SshChannelExitStatus &exitStatus) override;
     void handleExitSignal(const SshChannelExitSignal &signal) override;
     void closeHook() override;
@@ -0,0 +1,5 @@
+QT = core network
+LIBS += -lQSsh
+include(../qttest.pri)
+
+SOURCES += tst_packetparser.cpp
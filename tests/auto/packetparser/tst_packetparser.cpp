@@ -0,0 +1,154 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include <qssh/sftpincomingpacket_p.h>
+#include <qssh/sshincomingpacket_p.h>
+
+#include <QtEndian>
+#include <QtTest>
+
+#include <cstdlib>
+
+using namespace QSsh;
+
+#ifdef __GLIBC__
+// Lets tests count the heap allocations the current thread makes in a piece of code.
+// Qt containers use malloc() directly, so overriding operator new would not be enough.
+// This replaces the allocator for the whole executable, hence the separate test.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static thread_local int *allocationCount = nullptr;
+
+extern "C" void *malloc(size_t size) __THROW
+{
+    if (allocationCount)
+        ++*allocationCount;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) __THROW
+{
+    if (allocationCount)
+        ++*allocationCount;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) __THROW
+{
+    if (allocationCount)
+        ++*allocationCount;
+    return __libc_realloc(ptr, size);
+}
+
+class AllocationCounter
+{
+public:
+    AllocationCounter() { allocationCount = &m_count; }
+    ~AllocationCounter() { stop(); }
+    int stop() { allocationCount = nullptr; return m_count; }
+
+private:
+    int m_count = 0;
+};
+#endif // __GLIBC__
+
+static QByteArray sshUint32(quint32 value)
+{
+    QByteArray data(4, 0);
+    qToBigEndian<quint32>(value, reinterpret_cast<uchar *>(data.data()));
+    return data;
+}
+
+static QByteArray sshString(const QByteArray &data)
+{
+    return sshUint32(data.size()) + data;
+}
+
+class tst_PacketParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void allocations();
+};
+
+// The hot packet types must be parsed without copying their payload.
+void tst_PacketParser::allocations()
+{
+#ifndef __GLIBC__
+    QSKIP("Allocations can only be counted with glibc.");
+#else
+    const QByteArray data(16 * 1024, 'x');
+
+    // An unencrypted SSH_MSG_CHANNEL_DATA packet, as before the first key exchange.
+    const QByteArray payload = QByteArray(1, Internal::SSH_MSG_CHANNEL_DATA) + sshUint32(7)
+            + sshString(data);
+    const int paddingLength = 4 + (8 - (9 + payload.size()) % 8) % 8;
+    QByteArray sshData = sshUint32(1 + payload.size() + paddingLength) + char(paddingLength)
+            + payload + QByteArray(paddingLength, 0);
+    Internal::SshIncomingPacket sshPacket;
+    sshPacket.consumeData(sshData);
+    QVERIFY(sshPacket.isComplete());
+    AllocationCounter sshCounter;
+    const Internal::SshChannelData channelData = sshPacket.extractChannelData();
+    QCOMPARE(sshCounter.stop(), 0);
+    QCOMPARE(channelData.localChannel, 7u);
+    QVERIFY(channelData.data == data);
+
+    const auto sftpPacket = [](Internal::SftpPacketType type,
+                               const QByteArray &body) -> QByteArray {
+        const QByteArray packet = QByteArray(1, type) + sshUint32(1) + body;
+        return sshUint32(packet.size()) + packet;
+    };
+
+    QByteArray sftpData = sftpPacket(Internal::SSH_FXP_DATA, sshString(data));
+    Internal::SftpIncomingPacket dataPacket;
+    dataPacket.consumeData(sftpData);
+    QVERIFY(dataPacket.isComplete());
+    AllocationCounter dataCounter;
+    const Internal::SftpDataResponse dataResponse = dataPacket.asDataResponse();
+    QCOMPARE(dataCounter.stop(), 0);
+    QVERIFY(dataResponse.data == data);
+
+    // Only the list and the file names themselves may be allocated.
+    const QByteArray file = sshString("file") + sshString("-rw-r--r-- 1 user user 0 file")
+            + sshUint32(0);
+    QByteArray sftpName = sftpPacket(Internal::SSH_FXP_NAME, sshUint32(2) + file + file);
+    Internal::SftpIncomingPacket namePacket;
+    namePacket.consumeData(sftpName);
+    QVERIFY(namePacket.isComplete());
+    AllocationCounter nameCounter;
+    const Internal::SftpNameResponse nameResponse = namePacket.asNameResponse();
+    QVERIFY(nameCounter.stop() <= 3);
+    QCOMPARE(int(nameResponse.files.count()), 2);
+    QCOMPARE(nameResponse.files.first().fileName, QLatin1String("file"));
+#endif
+}
+
+QTEST_GUILESS_MAIN(tst_PacketParser)
+
+#include <tst_packetparser.moc>
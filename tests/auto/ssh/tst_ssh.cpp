@@ -24,30 +24,55 @@
 ****************************************************************************/
 
 #include <qssh/sftpchannel.h>
+#include <qssh/sftprequesttable_p.h>
+#include <qssh/sshbatchrunner.h>
+#include <qssh/sshchannel_p.h>
+#include <qssh/sshchunkedbuffer_p.h>
 #include <qssh/sshconnection.h>
+#include <qssh/sshconnectionmanager.h>
 #include <qssh/sshdirecttcpiptunnel.h>
 #include <qssh/sshforwardedtcpiptunnel.h>
+#include <qssh/sshhostkeydatabase.h>
+#include <qssh/sshpackettrace_p.h>
 #include <qssh/sshpseudoterminal.h>
 #include <qssh/sshremoteprocessrunner.h>
+#include <qssh/sshsendfacility_p.h>
+#include <qssh/sshtararchive_p.h>
 #include <qssh/sshtcpipforwardserver.h>
+#include <qssh/sshtcpiptunnel_p.h>
 #include <qssh/sshx11displayinfo_p.h>
 #include <qssh/sshx11inforetriever_p.h>
 
 #include <QDateTime>
 #include <QDir>
 #include <QEventLoop>
+#include <QMessageAuthenticationCode>
+#include <QPointer>
 #include <QStringList>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QTemporaryDir>
+#include <QThread>
 #include <QTimer>
+#include <QtEndian>
 #include <QtTest>
 
+#include <botan/auto_rng.h>
+#include <botan/curve25519.h>
+#include <botan/ecdh.h>
+#include <botan/ed25519.h>
+#include <botan/pubkey.h>
+#include <botan/stream_cipher.h>
+
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
 #include <QRandomGenerator>
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
 
 using namespace QSsh;
 
@@ -129,6 +154,41 @@ static SshConnectionParameters getParameters(TestType testType)
     return params;
 }
 
+// A POSIX tar entry: header block plus data padded to the block size.
+static QByteArray tarEntry(const QByteArray &name, char type, const QByteArray &data = QByteArray(),
+                           const QByteArray &linkTarget = QByteArray())
+{
+    QByteArray header(512, '\0');
+    char * const h = header.data();
+    std::memcpy(h, name.constData(), qMin<int>(name.size(), 100));
+    std::memcpy(h + 100, "0000644", 7);
+    std::memcpy(h + 124, QByteArray::number(data.size(), 8).rightJustified(11, '0').constData(), 11);
+    std::memcpy(h + 136, "00000000000", 11);
+    h[156] = type;
+    std::memcpy(h + 157, linkTarget.constData(), qMin<int>(linkTarget.size(), 100));
+    std::memcpy(h + 257, "ustar\0" "00", 8);
+    std::memset(h + 148, ' ', 8);
+    int checksum = 0;
+    for (const char c : header)
+        checksum += uchar(c);
+    std::memcpy(h + 148, QByteArray::number(checksum, 8).rightJustified(6, '0').constData(), 6);
+    h[154] = '\0';
+    return header + data + QByteArray((512 - data.size() % 512) % 512, '\0');
+}
+
+// Returns the error message, if any.
+static QString extractTar(const QString &localDirPath, const QByteArray &archive,
+                          SftpOverwriteMode mode = SftpOverwriteExisting)
+{
+    Internal::SshTarExtractor extractor(localDirPath, mode);
+    QString errorMessage;
+    QObject::connect(&extractor, &Internal::SshTarExtractor::error,
+                     [&errorMessage](const QString &message) { errorMessage = message; });
+    extractor.extract(archive + QByteArray(1024, '\0'));
+    extractor.finish();
+    return errorMessage;
+}
+
 #define CHECK_PARAMS(params, testType) \
     do { \
         if (params.host().isEmpty()) { \
@@ -148,16 +208,37 @@ class tst_Ssh : public QObject
     Q_OBJECT
 
 private slots:
+    void batchRunner();
+    void batchRunnerCancel();
+    void channelWindowAdjustment();
+    void chunkedBuffer();
     void directTunnel();
     void errorHandling_data();
     void errorHandling();
     void forwardTunnel();
+    void forwardTunnelRelay();
+    void hostKeyDatabase();
+    void keyExchangeCurve25519();
+    void keyExchangeGuess();
+    void optimisticAuthentication_data();
+    void optimisticAuthentication();
+    void packetTrace();
+    void pooledConnections();
+    void pooledConnectionsAcrossThreads();
     void pristineConnectionObject();
+    void rekeying();
     void remoteProcess_data();
     void remoteProcess();
     void remoteProcessChannels();
     void remoteProcessInput();
+    void scheduledChannelData();
+    void sendBackpressure();
     void sftp();
+    void sftpRequestTable();
+    void tarArchive();
+    void tarArchiveTraversal();
+    void tunnelReceiveWindow();
+    void writeBatching();
     void x11InfoRetriever_data();
     void x11InfoRetriever();
 
@@ -165,6 +246,171 @@ private:
     bool waitForConnection(SshConnection &connection);
 };
 
+void tst_Ssh::batchRunner()
+{
+    const SshConnectionParameters params = getParameters(TestType::Normal);
+    CHECK_PARAMS(params, TestType::Normal);
+
+    SshBatchRunner runner;
+    runner.setWorkerThreadCount(2);
+    runner.setMaxConcurrency(2);
+    runner.setHostTimeout((params.timeout + 5) * 1000);
+    QList<SshBatchResult> results;
+    connect(&runner, &SshBatchRunner::hostFinished,
+            [&results](const SshBatchResult &result) { results << result; });
+    QEventLoop loop;
+    connect(&runner, &SshBatchRunner::finished, &loop, &QEventLoop::quit);
+    const int hostCount = 5;
+    runner.run(QList<SshConnectionParameters>() << params << params << params << params << params,
+               "echo batch");
+    QVERIFY(runner.isRunning());
+    QTimer timer;
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    timer.setSingleShot(true);
+    timer.setInterval((params.timeout + 10) * 1000);
+    timer.start();
+    loop.exec();
+    QVERIFY(timer.isActive());
+    timer.stop();
+    QVERIFY(!runner.isRunning());
+
+    QCOMPARE(results.count(), hostCount);
+    for (const SshBatchResult &result : qAsConst(results)) {
+        QVERIFY2(result.outcome == SshBatchResult::Success, qPrintable(result.errorString));
+        QCOMPARE(result.standardOutput, QByteArray("batch\n"));
+        QVERIFY(result.startLatency >= 0);
+        QVERIFY(result.totalLatency >= result.startLatency);
+    }
+    const SshBatchStatistics stats = runner.statistics();
+    QCOMPARE(stats.outcomeCounts[SshBatchResult::Success], hostCount);
+    QCOMPARE(stats.finishedHosts, hostCount);
+    QCOMPARE(stats.totalLatencies.count(), hostCount);
+    QVERIFY(stats.totalLatencies.percentile(50) <= stats.totalLatencies.percentile(99));
+    QVERIFY(stats.totalLatencies.percentile(100) == stats.totalLatencies.max());
+}
+
+// Canceling from a hostFinished() handler must not report the end of the batch twice.
+void tst_Ssh::batchRunnerCancel()
+{
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    SshConnectionParameters params;
+    params.setHost(QLatin1String("127.0.0.1"));
+    params.setPort(server.serverPort());
+    params.setUserName(QLatin1String("test"));
+    params.timeout = 10;
+    server.close(); // Connections get refused right away.
+
+    SshBatchRunner runner;
+    runner.setMaxConcurrency(1);
+    QList<SshBatchResult> results;
+    connect(&runner, &SshBatchRunner::hostFinished,
+            [&runner, &results](const SshBatchResult &result) {
+        results << result;
+        runner.cancel();
+    });
+    QSignalSpy finishedSpy(&runner, &SshBatchRunner::finished);
+    runner.run(QList<SshConnectionParameters>() << params << params << params, "true");
+    QVERIFY(finishedSpy.wait(20000));
+    QCoreApplication::processEvents();
+    QCOMPARE(finishedSpy.count(), 1);
+    QVERIFY(!runner.isRunning());
+    QCOMPARE(results.count(), 3);
+    QVERIFY(results.first().outcome != SshBatchResult::Canceled);
+    QCOMPARE(runner.statistics().outcomeCounts[SshBatchResult::Canceled], 2);
+}
+
+void tst_Ssh::channelWindowAdjustment()
+{
+    using Internal::AbstractSshChannel;
+    const quint32 packetSize = 32 * 1024;
+
+    // Unbounded: top up by a packet whenever less than a packet is left.
+    QCOMPARE(AbstractSshChannel::windowAdjustment(packetSize, packetSize, -1, 0), 0u);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(100, packetSize, -1, 1000000), packetSize);
+
+    // Bounded: window and buffered data together never exceed the limit.
+    const qint64 limit = 4 * packetSize;
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, limit, 0), packetSize);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(100, packetSize, limit, limit - 100), 0u);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, limit, limit), 0u);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, limit, 2 * limit), 0u);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(1000, packetSize, limit, limit - packetSize - 1000),
+             packetSize);
+
+    // No tiny adjustments while the buffer is nearly full.
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, limit, limit - 10), 0u);
+
+    // A buffer smaller than a packet gets opened up once half of it is free.
+    const qint64 smallLimit = 1000;
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, smallLimit, 600), 0u);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, smallLimit, 500), 500u);
+    QCOMPARE(AbstractSshChannel::windowAdjustment(0, packetSize, smallLimit, 0), 1000u);
+
+    // Simulate a reader draining slowly: the amount in flight plus buffered never exceeds the limit.
+    quint32 window = quint32(limit);
+    qint64 buffered = 0;
+    for (int i = 0; i < 1000; ++i) {
+        const quint32 received = qMin(window, packetSize);
+        window -= received;
+        buffered += received;
+        buffered -= qMin<qint64>(buffered, packetSize / 3);
+        window += AbstractSshChannel::windowAdjustment(window, packetSize, limit, buffered);
+        QVERIFY(window + buffered <= limit);
+    }
+}
+
+void tst_Ssh::chunkedBuffer()
+{
+    Internal::SshChunkedBuffer buffer;
+    QVERIFY(buffer.isEmpty());
+    QVERIFY(buffer.readChunk().isEmpty());
+    QVERIFY(buffer.readAll().isEmpty());
+    char c;
+    QCOMPARE(buffer.read(&c, 1), qint64(0));
+
+    buffer.append("abc");
+    buffer.append(QByteArray());
+    buffer.append("de\nf");
+    buffer.append("ghij");
+    QCOMPARE(buffer.size(), qint64(10));
+    QVERIFY(buffer.contains('\n'));
+    QVERIFY(!buffer.contains('x'));
+
+    // Reads may end within a chunk and span several chunks.
+    char data[16];
+    QCOMPARE(buffer.read(data, 2), qint64(2));
+    QCOMPARE(QByteArray(data, 2), QByteArray("ab"));
+    QCOMPARE(buffer.size(), qint64(8));
+    QVERIFY(!buffer.contains('a'));
+    QCOMPARE(buffer.read(data, 5), qint64(5));
+    QCOMPARE(QByteArray(data, 5), QByteArray("cde\nf"));
+    QVERIFY(!buffer.contains('\n'));
+
+    // The partially consumed first chunk comes out without the consumed part.
+    QCOMPARE(buffer.read(data, 1), qint64(1));
+    QCOMPARE(buffer.readChunk(), QByteArray("hij"));
+    QVERIFY(buffer.isEmpty());
+
+    buffer.append("123");
+    buffer.append("456");
+    QCOMPARE(buffer.read(data, 1), qint64(1));
+    QCOMPARE(buffer.readAll(), QByteArray("23456"));
+    QVERIFY(buffer.isEmpty());
+
+    // Reading more than is there drains the buffer.
+    buffer.append("xyz");
+    QCOMPARE(buffer.read(data, sizeof data), qint64(3));
+    QCOMPARE(QByteArray(data, 3), QByteArray("xyz"));
+    QVERIFY(buffer.isEmpty());
+
+    buffer.append("tail");
+    buffer.clear();
+    QVERIFY(buffer.isEmpty());
+    QCOMPARE(buffer.size(), qint64(0));
+    QVERIFY(!buffer.contains('t'));
+}
+
 void tst_Ssh::directTunnel()
 {
     // Establish SSH connection
@@ -450,12 +696,846 @@ void tst_Ssh::forwardTunnel()
     QCOMPARE(server->state(), SshTcpIpForwardServer::Inactive);
 }
 
+void tst_Ssh::forwardTunnelRelay()
+{
+    const SshConnectionParameters params = getParameters(TestType::Tunnel);
+    CHECK_PARAMS(params, TestType::Tunnel);
+    SshConnection connection(params);
+    QVERIFY(waitForConnection(connection));
+
+    // Local echo server that the forwarded connections get relayed to
+    QTcpServer echoServer;
+    QVERIFY2(echoServer.listen(QHostAddress::LocalHost), qPrintable(echoServer.errorString()));
+    connect(&echoServer, &QTcpServer::newConnection, [&echoServer] {
+        QTcpSocket * const socket = echoServer.nextPendingConnection();
+        connect(socket, &QIODevice::readyRead, [socket] { socket->write(socket->readAll()); });
+    });
+
+    quint16 forwardPort;
+    {
+        QTcpServer server;
+        QVERIFY2(server.listen(QHostAddress::LocalHost), qPrintable(server.errorString()));
+        forwardPort = server.serverPort();
+    }
+    SshTcpIpForwardServer::Ptr server = connection.createForwardServer(QLatin1String("localhost"),
+                                                                       forwardPort);
+    server->setLocalTarget(QLatin1String("localhost"), echoServer.serverPort());
+    server->setMaxConnections(1);
+    QEventLoop loop;
+    QTimer timer;
+    connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    connect(server.data(), &SshTcpIpForwardServer::stateChanged, &loop, &QEventLoop::quit);
+    timer.setSingleShot(true);
+    timer.setInterval((params.timeout + 5) * 1000);
+    timer.start();
+    server->initialize();
+    loop.exec();
+    QVERIFY(timer.isActive());
+    timer.stop();
+    QCOMPARE(server->state(), SshTcpIpForwardServer::Listening);
+
+    // Data sent to the forwarded port must come back from the echo server
+    static const QByteArray testData("Urgsblubb?");
+    QByteArray dataReceived;
+    QTcpSocket firstSocket;
+    connect(&firstSocket, &QIODevice::readyRead, [&firstSocket, &dataReceived, &loop] {
+        dataReceived += firstSocket.readAll();
+        if (dataReceived == testData)
+            loop.quit();
+    });
+    firstSocket.connectToHost(QStringLiteral("localhost"), forwardPort);
+    firstSocket.write(testData);
+    timer.start();
+    loop.exec();
+    QVERIFY(timer.isActive());
+    timer.stop();
+    QCOMPARE(dataReceived, testData);
+    QCOMPARE(server->connectionCount(), 1);
+
+    // A second connection exceeds the limit
+    connect(server.data(), &SshTcpIpForwardServer::connectionRejected, &loop, &QEventLoop::quit);
+    QTcpSocket secondSocket;
+    secondSocket.connectToHost(QStringLiteral("localhost"), forwardPort);
+    timer.start();
+    loop.exec();
+    QVERIFY(timer.isActive());
+    timer.stop();
+    QCOMPARE(server->connectionCount(), 1);
+
+    timer.start();
+    server->close();
+    loop.exec();
+    QVERIFY(timer.isActive());
+    timer.stop();
+    QCOMPARE(server->state(), SshTcpIpForwardServer::Inactive);
+}
+
+static QByteArray sshUint32(quint32 value)
+{
+    QByteArray data(4, 0);
+    qToBigEndian<quint32>(value, reinterpret_cast<uchar *>(data.data()));
+    return data;
+}
+
+static QByteArray sshString(const QByteArray &data)
+{
+    return sshUint32(data.size()) + data;
+}
+
+static quint32 sshUint32At(const QByteArray &data, int offset)
+{
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + offset));
+}
+
+// Plays the server side of the transport layer towards an SshConnection: curve25519-sha256 or
+// ecdh-sha2-nistp256 key exchange with an ssh-ed25519 host key, then aes128-ctr and hmac-sha2-256.
+class TestSshServer
+{
+public:
+    bool listen() { return m_server.listen(QHostAddress::LocalHost); }
+
+    SshConnectionParameters connectionParameters() const
+    {
+        SshConnectionParameters params;
+        params.setHost(QLatin1String("127.0.0.1"));
+        params.setPort(m_server.serverPort());
+        params.setUserName(QLatin1String("test"));
+        params.setPassword(QLatin1String("test"));
+        params.authenticationType = SshConnectionParameters::AuthenticationTypePassword;
+        params.hostKeyCheckingMode = SshHostKeyCheckingNone;
+        params.timeout = 10;
+        return params;
+    }
+
+    // Accepts the next connection and exchanges identification strings and SSH_MSG_KEXINIT.
+    // The previous connection, if any, is left alone.
+    bool startKeyExchange(const QByteArray &keyExchangeAlgorithms = "curve25519-sha256")
+    {
+        if (!QTest::qWaitFor([this] { return m_server.hasPendingConnections(); }, 10000))
+            return false;
+        m_socket = m_server.nextPendingConnection();
+        m_encrypter.reset();
+        m_decrypter.reset();
+        m_clientSeqNr = 0;
+        m_serverSeqNr = 0;
+        m_sessionId.clear();
+        m_socket->write(QByteArray(serverId() + "\r\n"));
+        if (!QTest::qWaitFor([this] { return m_socket->canReadLine(); }, 10000))
+            return false;
+        m_clientId = m_socket->readLine().trimmed();
+        return answerKeyExchangeInit(readPacket(), keyExchangeAlgorithms);
+    }
+
+    // Sends our SSH_MSG_KEXINIT in reply to the client's. For a re-exchange, the client's
+    // packet is read by the caller.
+    bool answerKeyExchangeInit(const QByteArray &clientKexInit,
+                               const QByteArray &keyExchangeAlgorithms = "curve25519-sha256")
+    {
+        if (clientKexInit.isEmpty() || clientKexInit.at(0) != 20)
+            return false;
+        m_clientKexInit = clientKexInit;
+        m_serverKexInit = QByteArray(1, char(20)) + QByteArray(16, 'c')
+                + sshString(keyExchangeAlgorithms) + sshString("ssh-ed25519")
+                + sshString("aes128-ctr") + sshString("aes128-ctr")
+                + sshString("hmac-sha2-256") + sshString("hmac-sha2-256")
+                + sshString("none") + sshString("none") + sshString("") + sshString("")
+                + QByteArray(1, '\0') + sshUint32(0);
+        writePacket(m_serverKexInit);
+        return true;
+    }
+
+    // Answers the client's SSH_MSG_KEX_ECDH_INIT and switches to the new keys. The size of
+    // the client's public value tells which of the two methods it went for.
+    // Fails if the client does not accept the reply.
+    bool finishKeyExchange()
+    {
+        const QByteArray ecdhInit = readPacket();
+        if (ecdhInit.size() < 1 + 4 || ecdhInit.at(0) != 30) // SSH_MSG_KEX_ECDH_INIT
+            return false;
+        const QByteArray clientValue = ecdhInit.mid(5);
+
+        Botan::AutoSeeded_RNG rng;
+        if (!m_hostKey)
+            m_hostKey.reset(new Botan::Ed25519_PrivateKey(rng));
+        const Botan::Ed25519_PrivateKey &hostKey = *m_hostKey;
+        std::unique_ptr<Botan::PK_Key_Agreement_Key> serverKey;
+        if (clientValue.size() == 32)
+            serverKey.reset(new Botan::Curve25519_PrivateKey(rng));
+        else if (clientValue.size() == 65) // An uncompressed point on nistp256.
+            serverKey.reset(new Botan::ECDH_PrivateKey(rng, Botan::EC_Group("secp256r1")));
+        else
+            return false;
+        const Botan::PK_Key_Agreement agreement(*serverKey, rng, "Raw");
+        const Botan::secure_vector<uint8_t> sharedSecret = agreement.derive_key(0,
+                reinterpret_cast<const uint8_t *>(clientValue.constData()),
+                clientValue.size()).bits_of();
+
+        // RFC 8731, 3.1 and RFC 5656, 4: K is the shared secret (for ECDH, the x coordinate)
+        // as an unsigned big-endian integer.
+        QByteArray k = toByteArray(sharedSecret);
+        while (!k.isEmpty() && k.at(0) == '\0')
+            k.remove(0, 1);
+        if (!k.isEmpty() && (uchar(k.at(0)) & 0x80))
+            k.prepend('\0');
+        m_k = sshString(k);
+
+        const QByteArray q_s = toByteArray(serverKey->public_value());
+        const QByteArray k_s = sshString("ssh-ed25519")
+                + sshString(toByteArray(hostKey.get_public_key()));
+        m_h = QCryptographicHash::hash(sshString(m_clientId) + sshString(serverId())
+                + sshString(m_clientKexInit) + sshString(m_serverKexInit) + sshString(k_s)
+                + sshString(clientValue) + sshString(q_s) + m_k, QCryptographicHash::Sha256);
+        if (m_sessionId.isEmpty())
+            m_sessionId = m_h;
+        Botan::PK_Signer signer(hostKey, rng, "Pure");
+        const QByteArray signature = toByteArray(signer.sign_message(
+                reinterpret_cast<const uint8_t *>(m_h.constData()), m_h.size(), rng));
+        writePacket(QByteArray(1, char(31)) // SSH_MSG_KEX_ECDH_REPLY
+                    + sshString(k_s) + sshString(q_s)
+                    + sshString(sshString("ssh-ed25519") + sshString(signature)));
+
+        // The client only switches to the new keys if it arrived at the same H and thus K.
+        if (readPacket() != QByteArray(1, char(21))) // SSH_MSG_NEWKEYS
+            return false;
+        m_decrypter = createCipher('A', 'C');
+        m_clientMacKey = deriveKey('E');
+        writePacket(QByteArray(1, char(21)));
+        m_encrypter = createCipher('B', 'D');
+        m_serverMacKey = deriveKey('F');
+        return true;
+    }
+
+    // Runs the key exchange and lets the client in with its first password. Returns once the
+    // client has seen the SSH_MSG_USERAUTH_SUCCESS, i.e. when the connection is established.
+    bool acceptClient()
+    {
+        if (!startKeyExchange() || !finishKeyExchange())
+            return false;
+        if (readPacket() != QByteArray(QByteArray(1, char(5)) + sshString("ssh-userauth")))
+            return false;
+        writePacket(QByteArray(1, char(6)) + sshString("ssh-userauth")); // SSH_MSG_SERVICE_ACCEPT
+        const QByteArray authRequest = readPacket();
+        if (authRequest.isEmpty() || authRequest.at(0) != 50) // SSH_MSG_USERAUTH_REQUEST
+            return false;
+        writePacket(QByteArray(1, char(52))); // SSH_MSG_USERAUTH_SUCCESS
+
+        // The client answers global requests it does not know with SSH_MSG_REQUEST_FAILURE.
+        writePacket(QByteArray(1, char(80)) + sshString("ping@test") + QByteArray(1, '\1'));
+        return readPacket() == QByteArray(1, char(82));
+    }
+
+    // Confirms the client's next SSH_MSG_CHANNEL_OPEN if it is of the given type. Returns the
+    // client's channel id, or -1 if something else arrives.
+    qint64 acceptChannel(const QByteArray &channelType, quint32 serverChannel,
+                         quint32 windowSize = 16 * 1024 * 1024)
+    {
+        const QByteArray request = readPacket();
+        const QByteArray prefix = QByteArray(1, char(90)) + sshString(channelType);
+        if (!request.startsWith(prefix))
+            return -1;
+        const quint32 clientChannel = sshUint32At(request, prefix.size());
+        writePacket(QByteArray(1, char(91)) // SSH_MSG_CHANNEL_OPEN_CONFIRMATION
+                    + sshUint32(clientChannel) + sshUint32(serverChannel) + sshUint32(windowSize)
+                    + sshUint32(32 * 1024));
+        return clientChannel;
+    }
+
+    // Returns the payload, or an empty array if nothing valid arrives in time.
+    QByteArray readPacket(int timeout = 10000)
+    {
+        const int blockSize = m_decrypter ? 16 : 4;
+        if (!QTest::qWaitFor([this, blockSize] { return m_socket->bytesAvailable() >= blockSize; },
+                             timeout)) {
+            return QByteArray();
+        }
+        QByteArray packet = m_socket->read(blockSize);
+        if (m_decrypter)
+            m_decrypter->cipher1(reinterpret_cast<uint8_t *>(packet.data()), packet.size());
+        const quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(packet.constData()));
+        const int macSize = m_decrypter ? 32 : 0;
+        const qint64 bytesLeft = 4 + qint64(length) - blockSize + macSize;
+        if (length > 35000 || bytesLeft < macSize
+                || !QTest::qWaitFor([this, bytesLeft] { return m_socket->bytesAvailable() >= bytesLeft; },
+                                    10000)) {
+            return QByteArray();
+        }
+        QByteArray rest = m_socket->read(bytesLeft - macSize);
+        if (m_decrypter)
+            m_decrypter->cipher1(reinterpret_cast<uint8_t *>(rest.data()), rest.size());
+        packet += rest;
+        if (m_decrypter && m_socket->read(macSize) != mac(m_clientMacKey, m_clientSeqNr, packet))
+            return QByteArray();
+        ++m_clientSeqNr;
+        return packet.mid(5, length - 1 - uchar(packet.at(4)));
+    }
+
+    void writePacket(const QByteArray &payload)
+    {
+        const int blockSize = m_encrypter ? 16 : 8;
+        int paddingLength = blockSize - (5 + payload.size()) % blockSize;
+        if (paddingLength < 4)
+            paddingLength += blockSize;
+        QByteArray packet = sshUint32(1 + payload.size() + paddingLength) + char(paddingLength)
+                + payload + QByteArray(paddingLength, '\0');
+        if (m_encrypter) {
+            const QByteArray packetMac = mac(m_serverMacKey, m_serverSeqNr, packet);
+            m_encrypter->cipher1(reinterpret_cast<uint8_t *>(packet.data()), packet.size());
+            packet += packetMac;
+        }
+        ++m_serverSeqNr;
+        m_socket->write(packet);
+    }
+
+    // With a limit, the server stops taking data off the connection once that much has piled up.
+    void setReadBufferSize(qint64 size) { m_socket->setReadBufferSize(size); }
+
+    static QByteArray serverId() { return "SSH-2.0-TestSshServer"; }
+
+private:
+    template<typename Container> static QByteArray toByteArray(const Container &data)
+    {
+        return QByteArray(reinterpret_cast<const char *>(data.data()), int(data.size()));
+    }
+
+    // RFC 4253, 7.2. The session id is the H of the connection's first key exchange.
+    QByteArray deriveKey(char letter) const
+    {
+        return QCryptographicHash::hash(m_k + m_h + letter + m_sessionId,
+                                        QCryptographicHash::Sha256);
+    }
+
+    std::unique_ptr<Botan::StreamCipher> createCipher(char ivLetter, char keyLetter) const
+    {
+        std::unique_ptr<Botan::StreamCipher> cipher
+                = Botan::StreamCipher::create_or_throw("CTR-BE(AES-128)");
+        cipher->set_key(reinterpret_cast<const uint8_t *>(deriveKey(keyLetter).constData()), 16);
+        cipher->set_iv(reinterpret_cast<const uint8_t *>(deriveKey(ivLetter).constData()), 16);
+        return cipher;
+    }
+
+    static QByteArray mac(const QByteArray &key, quint32 seqNr, const QByteArray &packet)
+    {
+        return QMessageAuthenticationCode::hash(sshUint32(seqNr) + packet, key,
+                                                QCryptographicHash::Sha256);
+    }
+
+    QTcpServer m_server;
+    QTcpSocket *m_socket = nullptr;
+    QByteArray m_clientId;
+    QByteArray m_clientKexInit;
+    QByteArray m_serverKexInit;
+    QByteArray m_k;
+    QByteArray m_h;
+    QByteArray m_sessionId;
+    std::unique_ptr<Botan::Ed25519_PrivateKey> m_hostKey;
+    std::unique_ptr<Botan::StreamCipher> m_encrypter;
+    std::unique_ptr<Botan::StreamCipher> m_decrypter;
+    QByteArray m_clientMacKey;
+    QByteArray m_serverMacKey;
+    quint32 m_clientSeqNr = 0;
+    quint32 m_serverSeqNr = 0;
+};
+
+void tst_Ssh::hostKeyDatabase()
+{
+    const QByteArray blob1 = sshString("ssh-ed25519") + sshString(QByteArray(32, 'a'));
+    const QByteArray blob2 = sshString("ssh-ed25519") + sshString(QByteArray(32, 'b'));
+    const QByteArray blob3 = sshString("ssh-ed25519") + sshString(QByteArray(32, 'c'));
+    const QByteArray key1 = sshString(blob1);
+    const QByteArray key2 = sshString(blob2);
+    const QByteArray key3 = sshString(blob3);
+    const QByteArray salt(20, 's');
+    const QByteArray hash = QMessageAuthenticationCode::hash("hidden.example.com", salt,
+                                                             QCryptographicHash::Sha1);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.path() + QLatin1String("/known_hosts");
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("# comment\n"
+               "plain.example.com,Alias.example.com ssh-ed25519 " + blob1.toBase64() + " comment\n"
+               "[plain.example.com]:2222 ssh-ed25519 " + blob2.toBase64() + "\n"
+               "|1|" + salt.toBase64() + '|' + hash.toBase64() + " ssh-ed25519 "
+               + blob2.toBase64() + "\n"
+               "*.wild.example.com,!bad.wild.example.com ssh-ed25519 " + blob3.toBase64() + "\n"
+               "@revoked * ssh-ed25519 " + blob2.toBase64() + "\r\n");
+    file.close();
+
+    SshHostKeyDatabase db;
+    const auto match = [&db](const char *host, quint16 port, const QByteArray &key) {
+        return db.matchHostKey(QString::fromLatin1(host), port, key);
+    };
+    QString error;
+    QVERIFY2(db.openKnownHosts(filePath, &error), qPrintable(error));
+    QCOMPARE(match("plain.example.com", 22, key1), SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(match("alias.example.com", 22, key1), SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(match("plain.example.com", 22, key3), SshHostKeyDatabase::KeyLookupMismatch);
+    QCOMPARE(match("plain.example.com", 2222, key2), SshHostKeyDatabase::KeyLookupRevoked);
+    QCOMPARE(match("hidden.example.com", 22, key2), SshHostKeyDatabase::KeyLookupRevoked);
+    QCOMPARE(match("a.wild.example.com", 22, key3), SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(match("bad.wild.example.com", 22, key3), SshHostKeyDatabase::KeyLookupNoMatch);
+    QCOMPARE(match("unknown.example.com", 22, key1), SshHostKeyDatabase::KeyLookupNoMatch);
+    QCOMPARE(db.retrieveHostKey(QLatin1String("plain.example.com"), 22), key1);
+
+    // Keys of new hosts are appended to the file. Keys replacing older ones of the same type
+    // are only kept in memory, and revoked ones are not taken at all.
+    db.insertHostKey(QLatin1String("new.example.com"), 2022, key3);
+    db.insertHostKey(QLatin1String("plain.example.com"), 22, key3);
+    db.insertHostKey(QLatin1String("plain.example.com"), 2222, key2);
+    QCOMPARE(match("plain.example.com", 22, key3), SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(match("plain.example.com", 22, key1), SshHostKeyDatabase::KeyLookupMismatch);
+    QCOMPARE(match("plain.example.com", 2222, key2), SshHostKeyDatabase::KeyLookupRevoked);
+    QVERIFY2(db.openKnownHosts(filePath, &error), qPrintable(error));
+    QCOMPARE(match("new.example.com", 2022, key3), SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(match("new.example.com", 22, key3), SshHostKeyDatabase::KeyLookupNoMatch);
+    QCOMPARE(match("plain.example.com", 22, key1), SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(match("plain.example.com", 22, key3), SshHostKeyDatabase::KeyLookupMismatch);
+    QCOMPARE(match("plain.example.com", 2222, key2), SshHostKeyDatabase::KeyLookupRevoked);
+    QCOMPARE(match("alias.example.com", 22, key1), SshHostKeyDatabase::KeyLookupMatch);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll().count(blob2.toBase64()), 3);
+    file.close();
+
+    // Storing over the file that was loaded, in the simpler format that only has plain names.
+    SshHostKeyDatabase copy;
+    QVERIFY2(copy.load(filePath, &error), qPrintable(error));
+    QVERIFY2(copy.store(filePath, &error), qPrintable(error));
+    QVERIFY2(copy.load(filePath, &error), qPrintable(error));
+    QCOMPARE(copy.matchHostKey(QLatin1String("plain.example.com"), 22, key1),
+             SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(copy.matchHostKey(QLatin1String("alias.example.com"), 22, key1),
+             SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(copy.matchHostKey(QLatin1String("new.example.com"), 2022, key3),
+             SshHostKeyDatabase::KeyLookupMatch);
+    QCOMPARE(copy.matchHostKey(QLatin1String("hidden.example.com"), 22, key2),
+             SshHostKeyDatabase::KeyLookupNoMatch);
+}
+
+void tst_Ssh::keyExchangeCurve25519()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    SshConnection connection(server.connectionParameters());
+    connection.setStatisticsInterval(50);
+    QSignalSpy statisticsSpy(&connection, &SshConnection::statisticsUpdated);
+    connection.connectToHost();
+    QVERIFY(server.startKeyExchange("curve25519-sha256"));
+    QTest::qWait(20); // Gives the key exchange a measurable duration.
+    QVERIFY(server.finishKeyExchange());
+
+    // The first packet under the new keys must decrypt and authenticate.
+    QCOMPARE(server.readPacket(), QByteArray(QByteArray(1, char(5)) + sshString("ssh-userauth")));
+    QCOMPARE(connection.errorState(), SshNoError);
+
+    // SSH_MSG_KEXINIT, SSH_MSG_KEX_ECDH_REPLY and SSH_MSG_NEWKEYS came in; the client sent
+    // those three and the service request, the latter encrypted.
+    const SshConnectionStatistics statistics = connection.statistics();
+    QCOMPARE(statistics.packetsReceived, quint64(3));
+    QVERIFY(statistics.bytesReceived > statistics.payloadBytesReceived);
+    QCOMPARE(statistics.packetsSent, quint64(4));
+    QVERIFY(statistics.bytesSent > statistics.payloadBytesSent);
+    QVERIFY(statistics.payloadBytesSent > 0);
+    QVERIFY(statistics.encryptionTime > 0);
+    QVERIFY(statistics.macTime > 0);
+    QVERIFY(statistics.tcpConnectTime >= 0);
+    QVERIFY(statistics.keyExchangeTime >= 20);
+    QCOMPARE(statistics.authenticationTime, qint64(-1));
+    QCOMPARE(statistics.rekeyCount, 0);
+
+    // The updates started with the TCP connection.
+    QVERIFY(statisticsSpy.count() > 0 || statisticsSpy.wait(1000));
+    const SshConnectionStatistics published
+            = statisticsSpy.last().first().value<SshConnectionStatistics>();
+    QVERIFY(published.packetsSent > 0);
+    QVERIFY(published.bytesReceived > 0);
+}
+
+// After a wrong guess, the client's list as sent still decides the outcome of the negotiation
+// (RFC 4253, 7.1), even if the server would prefer another algorithm.
+void tst_Ssh::keyExchangeGuess()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+
+    // Nothing to guess yet, so the client's favorite is used. The server's one gets remembered.
+    {
+        SshConnection connection(server.connectionParameters());
+        connection.connectToHost();
+        QVERIFY(server.startKeyExchange("ecdh-sha2-nistp256,curve25519-sha256"));
+        QVERIFY(server.finishKeyExchange());
+        QCOMPARE(server.readPacket(), QByteArray(QByteArray(1, char(5)) + sshString("ssh-userauth")));
+    }
+
+    // Now the client moves ecdh-sha2-nistp256 to the front and sends its packet right away,
+    // but the server changed its mind.
+    SshConnection connection(server.connectionParameters());
+    connection.connectToHost();
+    QVERIFY(server.startKeyExchange("curve25519-sha256,ecdh-sha2-nistp256"));
+    const QByteArray guessedInit = server.readPacket();
+    QCOMPARE(guessedInit.size(), 1 + 4 + 65);
+    QCOMPARE(guessedInit.at(0), char(30)); // SSH_MSG_KEX_ECDH_INIT
+
+    // The guess is ignored, and the client's list says ecdh-sha2-nistp256 all the same.
+    QVERIFY(server.finishKeyExchange());
+    QCOMPARE(server.readPacket(), QByteArray(QByteArray(1, char(5)) + sshString("ssh-userauth")));
+    QCOMPARE(connection.errorState(), SshNoError);
+}
+
+void tst_Ssh::optimisticAuthentication_data()
+{
+    QTest::addColumn<bool>("accepted");
+
+    QTest::newRow("accepted") << true;
+    QTest::newRow("rejected") << false;
+}
+
+void tst_Ssh::optimisticAuthentication()
+{
+    QFETCH(bool, accepted);
+
+    TestSshServer server;
+    QVERIFY(server.listen());
+    SshConnectionParameters params = server.connectionParameters();
+    params.options |= SshOptimisticAuthentication;
+    SshConnection connection(params);
+    QSignalSpy connectedSpy(&connection, &SshConnection::connected);
+    QSignalSpy errorSpy(&connection, &SshConnection::error);
+    connection.connectToHost();
+    QVERIFY(server.startKeyExchange());
+    QVERIFY(server.finishKeyExchange());
+
+    // The password goes out right behind the service request...
+    QCOMPARE(server.readPacket(), QByteArray(QByteArray(1, char(5)) + sshString("ssh-userauth")));
+    const QByteArray authRequest = server.readPacket();
+    QCOMPARE(authRequest, QByteArray(QByteArray(1, char(50)) + sshString("test")
+                                     + sshString("ssh-connection") + sshString("password")
+                                     + QByteArray(1, '\0') + sshString("test")));
+
+    // ...but the connection is not established before the server says so.
+    QCOMPARE(connectedSpy.count(), 0);
+    QCOMPARE(connection.state(), SshConnection::Connecting);
+
+    // A channel can be opened already. Its request waits for the outcome of the authentication.
+    QVERIFY(connection.canCreateChannels());
+    const QSharedPointer<SshRemoteProcess> process = connection.createRemoteProcess("true");
+    QVERIFY(process);
+    process->start();
+    QVERIFY(server.readPacket(500).isEmpty());
+
+    server.writePacket(QByteArray(1, char(6)) + sshString("ssh-userauth")); // SSH_MSG_SERVICE_ACCEPT
+    if (accepted) {
+        server.writePacket(QByteArray(1, char(52))); // SSH_MSG_USERAUTH_SUCCESS
+        const QByteArray channelOpen = server.readPacket();
+        QVERIFY(channelOpen.startsWith(QByteArray(QByteArray(1, char(90)) + sshString("session"))));
+        QCOMPARE(connectedSpy.count(), 1);
+        QCOMPARE(connection.state(), SshConnection::Connected);
+        QCOMPARE(errorSpy.count(), 0);
+    } else {
+        server.writePacket(QByteArray(1, char(51)) // SSH_MSG_USERAUTH_FAILURE
+                           + sshString("publickey") + QByteArray(1, '\0'));
+        QVERIFY(errorSpy.wait(10000));
+        QCOMPARE(connection.errorState(), SshAuthenticationError);
+        QCOMPARE(connection.state(), SshConnection::Unconnected);
+        QCOMPARE(connectedSpy.count(), 0);
+
+        // Only the SSH_MSG_DISCONNECT goes out; the channel request is dropped.
+        const QByteArray disconnectPacket = server.readPacket();
+        QVERIFY(disconnectPacket.startsWith(char(1)));
+        QVERIFY(server.readPacket(500).isEmpty());
+    }
+}
+
+void tst_Ssh::packetTrace()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString filePath = dir.filePath(QLatin1String("trace"));
+
+    // A session that opens a channel, receives some data on it and gets it closed by the server.
+    const quint32 tracedChannel = 5;
+    Internal::SshPacketTracer tracer;
+    QVERIFY(tracer.start(filePath));
+    const QByteArray open = QByteArray(1, Internal::SSH_MSG_CHANNEL_OPEN) + sshString("session")
+            + sshUint32(tracedChannel) + sshUint32(0x100000) + sshUint32(0x4000);
+    tracer.recordOutgoing(3, Internal::SSH_MSG_CHANNEL_OPEN,
+                          Internal::SshPacketTracer::channelOf(open), open.size());
+    const QList<QByteArray> incoming = QList<QByteArray>()
+            << QByteArray(1, Internal::SSH_MSG_CHANNEL_OPEN_CONFIRMATION) + sshUint32(tracedChannel)
+               + sshUint32(0) + sshUint32(0x100000) + sshUint32(0x4000)
+            << QByteArray(1, Internal::SSH_MSG_CHANNEL_SUCCESS) + sshUint32(tracedChannel)
+            << QByteArray(1, Internal::SSH_MSG_CHANNEL_DATA) + sshUint32(tracedChannel)
+               + sshString(QByteArray(1000, 'x'))
+            << QByteArray(1, Internal::SSH_MSG_CHANNEL_CLOSE) + sshUint32(tracedChannel);
+    quint32 seqNr = 10;
+    for (const QByteArray &payload : incoming)
+        tracer.recordIncoming(seqNr++, payload);
+    const QList<Internal::SshPacketTraceRecord> records = tracer.records();
+    tracer.stop();
+
+    QCOMPARE(int(records.size()), 5);
+    QCOMPARE(records.first().direction, Internal::SshPacketTraceRecord::Outgoing);
+    QCOMPARE(records.first().channel, tracedChannel);
+    QCOMPARE(records.at(3).type, quint8(Internal::SSH_MSG_CHANNEL_DATA));
+    QCOMPARE(records.at(3).seqNr, 12u);
+    QCOMPARE(records.at(3).channel, tracedChannel);
+    QCOMPARE(records.at(3).payloadSize, quint32(incoming.at(2).size()));
+    QVERIFY(records.at(3).payload.isEmpty()); // The ring buffer only holds the headers.
+
+    Internal::SshPacketReplayer replayer;
+    QString error;
+    QVERIFY2(replayer.load(filePath, &error), qPrintable(error));
+    QCOMPARE(replayer.replayablePacketCount(), int(incoming.size()));
+    QVERIFY2(replayer.replay(&error), qPrintable(error));
+}
+
+void tst_Ssh::pooledConnections()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    const SshConnectionParameters params = server.connectionParameters();
+    const SshConnectionPoolStatistics initialStats = connectionPoolStatistics();
+
+    // Released connections are kept and handed out again.
+    SshConnection * const connection = acquireConnection(params);
+    QVERIFY(connection);
+    connection->connectToHost();
+    QVERIFY(server.acceptClient());
+    QCOMPARE(connection->state(), SshConnection::Connected);
+    releaseConnection(connection);
+    QCOMPARE(connectionPoolStatistics().idleConnections, initialStats.idleConnections + 1);
+    SshConnectionPoolStatistics stats = connectionPoolStatistics();
+    QCOMPARE(acquireConnection(params), connection);
+    QCOMPARE(connectionPoolStatistics().fastPathAcquisitions, stats.fastPathAcquisitions + 1);
+    QCOMPARE(connectionPoolStatistics().idleConnections, initialStats.idleConnections);
+
+    // Clients go to the least loaded connection. Saturated connections are only shared
+    // if the host's connection limit does not allow for another one.
+    setMaxSessionsPerConnection(params, 2);
+    setConnectionPoolLimits(params, 0, 1);
+    QCOMPARE(acquireConnection(params), connection);
+    QCOMPARE(acquireConnection(params), connection);
+    setConnectionPoolLimits(params, 0, 2);
+    SshConnection * const second = acquireConnection(params);
+    QVERIFY(second != connection);
+    QCOMPARE(acquireConnection(params), second);
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections + 2);
+    releaseConnection(second);
+    releaseConnection(second); // Never connected, so it goes away.
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections + 1);
+    releaseConnection(connection);
+    releaseConnection(connection);
+    releaseConnection(connection);
+
+    // Connections get established in advance, up to the configured number of idle ones.
+    setConnectionPoolLimits(params, 2, 0);
+    QVERIFY(server.acceptClient());
+    setConnectionPoolLimits(params, 0, 0);
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections + 2);
+    QCOMPARE(connectionPoolStatistics().idleConnections, initialStats.idleConnections + 2);
+    stats = connectionPoolStatistics();
+    QCOMPARE(acquireConnection(params), connection);
+    SshConnection * const prewarmed = acquireConnection(params);
+    QVERIFY(prewarmed != connection);
+    QCOMPARE(prewarmed->state(), SshConnection::Connected);
+    QCOMPARE(connectionPoolStatistics().fastPathAcquisitions, stats.fastPathAcquisitions + 2);
+    QCOMPARE(connectionPoolStatistics().idleConnections, initialStats.idleConnections);
+    releaseConnection(connection);
+    releaseConnection(prewarmed); // There is an idle one already.
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections + 1);
+
+    // Connections that are given up on go away once they are released.
+    QCOMPARE(acquireConnection(params), connection);
+    forceNewConnection(params);
+    releaseConnection(connection);
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections);
+
+    // Nobody answers the keep-alive probes, so the connection must neither be handed out
+    // nor kept.
+    SshConnectionParameters probingParams = params;
+    probingParams.keepAliveInterval = 1;
+    SshConnection * const probing = acquireConnection(probingParams);
+    probing->connectToHost();
+    QVERIFY(server.acceptClient());
+    releaseConnection(probing);
+    const QPointer<SshConnection> unresponsive = probing;
+    QTRY_VERIFY_WITH_TIMEOUT(unresponsive && !unresponsive->isResponsive(), 5000);
+    SshConnection * const replacement = acquireConnection(probingParams);
+    QVERIFY(replacement != unresponsive.data());
+    QTRY_VERIFY_WITH_TIMEOUT(!unresponsive, 10000);
+    releaseConnection(replacement);
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections);
+}
+
+// Waiting clients get connections from other threads, which follow them into their thread.
+// A thread's idle connections go away with it.
+void tst_Ssh::pooledConnectionsAcrossThreads()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    const SshConnectionParameters params = server.connectionParameters();
+    setConnectionPoolLimits(params, 0, 1);
+    const SshConnectionPoolStatistics initialStats = connectionPoolStatistics();
+
+    QThread worker;
+    QObject * const workerContext = new QObject;
+    workerContext->moveToThread(&worker);
+    worker.start();
+    QObject mainContext;
+    std::atomic<SshConnection *> delivered{nullptr};
+    std::atomic<QThread *> deliveryThread{nullptr};
+    const auto waitFor = [&delivered, &deliveryThread](const SshConnectionParameters &sshParams,
+                                                        QObject *context) {
+        delivered = nullptr;
+        acquireConnection(sshParams, context, [&delivered, &deliveryThread](SshConnection *c) {
+            deliveryThread = QThread::currentThread();
+            delivered = c;
+        });
+    };
+    const auto releaseInWorker = [workerContext](SshConnection *connection) {
+        QMetaObject::invokeMethod(workerContext, [connection] { releaseConnection(connection); },
+                                  Qt::BlockingQueuedConnection);
+    };
+
+    // The main thread's idle connection is requested by the worker.
+    SshConnection * const connection = acquireConnection(params);
+    connection->connectToHost();
+    QVERIFY(server.acceptClient());
+    releaseConnection(connection);
+    waitFor(params, workerContext);
+    QTRY_COMPARE(delivered.load(), connection);
+    QCOMPARE(deliveryThread.load(), &worker);
+    QCOMPARE(connection->thread(), &worker);
+    SshConnectionPoolStatistics stats = connectionPoolStatistics();
+    QCOMPARE(stats.crossThreadHandoffs, initialStats.crossThreadHandoffs + 1);
+    QCOMPARE(stats.queuedRequests, initialStats.queuedRequests + 1);
+
+    // The host is at its limit, so the main thread has to wait until the worker is done.
+    waitFor(params, &mainContext);
+    QTRY_COMPARE(connectionPoolStatistics().waitingRequests, 1);
+    QVERIFY(!delivered.load());
+    releaseInWorker(connection);
+    QTRY_COMPARE(delivered.load(), connection);
+    QCOMPARE(deliveryThread.load(), QThread::currentThread());
+    QCOMPARE(connection->thread(), QThread::currentThread());
+    stats = connectionPoolStatistics();
+    QCOMPARE(stats.crossThreadHandoffs, initialStats.crossThreadHandoffs + 2);
+    QCOMPARE(stats.queuedRequests, initialStats.queuedRequests + 2);
+    QCOMPARE(stats.waitingRequests, 0);
+
+    // Back to the worker, where it stays idle.
+    releaseConnection(connection);
+    waitFor(params, workerContext);
+    QTRY_COMPARE(delivered.load(), connection);
+    releaseInWorker(connection);
+    QCOMPARE(connectionPoolStatistics().idleConnections, initialStats.idleConnections + 1);
+
+    // Nobody can take it over with different parameters, so the next client has to wait
+    // until the worker's connections are gone with the thread.
+    SshConnectionParameters otherParams = params;
+    otherParams.timeout = params.timeout + 1;
+    waitFor(otherParams, &mainContext);
+    QTRY_COMPARE(connectionPoolStatistics().waitingRequests, 1);
+    const QPointer<SshConnection> workerConnection = connection;
+    worker.quit();
+    QVERIFY(worker.wait(10000));
+    delete workerContext;
+    QVERIFY(!workerConnection);
+    QTRY_VERIFY(delivered.load());
+    QVERIFY(delivered.load() != connection);
+    QCOMPARE(deliveryThread.load(), QThread::currentThread());
+    stats = connectionPoolStatistics();
+    QCOMPARE(stats.openConnections, initialStats.openConnections + 1);
+    QCOMPARE(stats.idleConnections, initialStats.idleConnections);
+    QCOMPARE(stats.waitingRequests, 0);
+    releaseConnection(delivered.load()); // Never connected, so it goes away.
+    QCOMPARE(connectionPoolStatistics().openConnections, initialStats.openConnections);
+    setConnectionPoolLimits(params, 0, 0);
+}
+
 void tst_Ssh::pristineConnectionObject()
 {
     QSsh::SshConnection connection((SshConnectionParameters()));
     QCOMPARE(connection.state(), SshConnection::Unconnected);
     QVERIFY(connection.createRemoteProcess("").isNull());
     QVERIFY(connection.createSftpChannel().isNull());
+
+    const SshConnectionStatistics statistics = connection.statistics();
+    QCOMPARE(statistics.bytesSent, quint64(0));
+    QCOMPARE(statistics.packetsReceived, quint64(0));
+    QCOMPARE(statistics.tcpConnectTime, qint64(-1));
+    QCOMPARE(statistics.authenticationTime, qint64(-1));
+    QVERIFY(statistics.channels.isEmpty());
+    connection.setStatisticsInterval(0);
+    QCOMPARE(connection.statisticsInterval(), 0);
+}
+
+// The byte limit triggers a key re-exchange. Nothing but its own packets may go out in the
+// meantime; the rest follows under the new keys, in order.
+void tst_Ssh::rekeying()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    SshConnectionParameters params = server.connectionParameters();
+    params.rekeyByteLimit = 64 * 1024;
+    SshConnection connection(params);
+    connection.connectToHost();
+    QVERIFY(server.acceptClient());
+    QCOMPARE(connection.statistics().rekeyCount, 0);
+
+    const SshDirectTcpIpTunnel::Ptr tunnel = connection.createDirectTunnel(
+                QLatin1String("localhost"), 1024, QLatin1String("localhost"), 2222);
+    QSignalSpy initializedSpy(tunnel.data(), &SshDirectTcpIpTunnel::initialized);
+    tunnel->initialize();
+    QVERIFY(server.acceptChannel("direct-tcpip", 0) >= 0);
+    QVERIFY(initializedSpy.wait(10000));
+
+    const auto channelDataSize = [](const QByteArray &packet) -> qint64 {
+        if (packet.size() < 9 || packet.at(0) != 94) // SSH_MSG_CHANNEL_DATA
+            return -1;
+        return sshUint32At(packet, 5);
+    };
+
+    const QByteArray data(256 * 1024, 'x');
+    QCOMPARE(tunnel->write(data), qint64(data.size()));
+    qint64 bytesReceived = 0;
+    QByteArray kexInit;
+    while (kexInit.isEmpty()) {
+        const QByteArray packet = server.readPacket();
+        QVERIFY(!packet.isEmpty());
+        if (packet.at(0) == 20) { // SSH_MSG_KEXINIT
+            kexInit = packet;
+        } else {
+            const qint64 size = channelDataSize(packet);
+            QVERIFY(size > 0);
+            bytesReceived += size;
+        }
+    }
+    QVERIFY(bytesReceived >= 64 * 1024 - 4096);
+    QVERIFY(bytesReceived < data.size());
+
+    // A channel open and more data come up while the exchange is in progress.
+    // finishKeyExchange() fails if they get in between.
+    const SshDirectTcpIpTunnel::Ptr secondTunnel = connection.createDirectTunnel(
+                QLatin1String("localhost"), 1025, QLatin1String("localhost"), 2222);
+    secondTunnel->initialize();
+    QCOMPARE(tunnel->write(data), qint64(data.size()));
+    QTest::qWait(50);
+    QVERIFY(server.answerKeyExchangeInit(kexInit));
+    QVERIFY(server.finishKeyExchange());
+
+    // The held back packet comes first, then the channel data continues.
+    QVERIFY(server.acceptChannel("direct-tcpip", 1) >= 0);
+    while (bytesReceived < 2 * data.size()) {
+        const qint64 size = channelDataSize(server.readPacket());
+        QVERIFY(size > 0);
+        bytesReceived += size;
+    }
+    QCOMPARE(bytesReceived, qint64(2 * data.size()));
+    QCOMPARE(connection.errorState(), SshNoError);
+    const SshConnectionStatistics stats = connection.statistics();
+    QCOMPARE(stats.rekeyCount, 1);
+    QVERIFY(stats.lastRekeyDuration >= 50);
 }
 
 void tst_Ssh::remoteProcess_data()
@@ -622,6 +1702,126 @@ void tst_Ssh::remoteProcessInput()
             || catProcess->exitSignal() == SshRemoteProcess::KillSignal);
 }
 
+// Interactive data overtakes a bulk transfer instead of queueing up behind it.
+void tst_Ssh::scheduledChannelData()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    SshConnection connection(server.connectionParameters());
+    connection.connectToHost();
+    QVERIFY(server.acceptClient());
+
+    const quint32 tunnelChannel = 0;
+    const SshDirectTcpIpTunnel::Ptr tunnel = connection.createDirectTunnel(
+                QLatin1String("localhost"), 1024, QLatin1String("localhost"), 2222);
+    QSignalSpy initializedSpy(tunnel.data(), &SshDirectTcpIpTunnel::initialized);
+    tunnel->initialize();
+    QVERIFY(server.acceptChannel("direct-tcpip", tunnelChannel) >= 0);
+    QVERIFY(initializedSpy.wait(10000));
+
+    const quint32 shellChannel = 1;
+    const SshRemoteProcess::Ptr shell = connection.createRemoteShell();
+    QSignalSpy startedSpy(shell.data(), &SshRemoteProcess::started);
+    shell->start();
+    const qint64 clientShellChannel = server.acceptChannel("session", shellChannel);
+    QVERIFY(clientShellChannel >= 0);
+    const QByteArray shellRequestPrefix = QByteArray(1, char(98)) + sshUint32(shellChannel);
+    QVERIFY(server.readPacket().startsWith(
+                QByteArray(shellRequestPrefix + sshString("pty-req"))));
+    QVERIFY(server.readPacket().startsWith(QByteArray(shellRequestPrefix + sshString("shell"))));
+    server.writePacket(QByteArray(1, char(99)) // SSH_MSG_CHANNEL_SUCCESS
+                       + sshUint32(quint32(clientShellChannel)));
+    QVERIFY(startedSpy.wait(10000));
+
+    // Much more than the socket takes at once. The keystroke comes right after.
+    const QByteArray bulkData(4 * 1024 * 1024, 'b');
+    QCOMPARE(tunnel->write(bulkData), qint64(bulkData.size()));
+    QCOMPARE(shell->write("ls\n"), qint64(3));
+
+    qint64 bulkBytes = 0;
+    qint64 bulkBytesBeforeInteractive = -1;
+    while (bulkBytes < bulkData.size() || bulkBytesBeforeInteractive < 0) {
+        const QByteArray packet = server.readPacket();
+        QVERIFY(!packet.isEmpty());
+        if (packet.at(0) != 94) // SSH_MSG_CHANNEL_DATA
+            continue;
+        const quint32 recipient = sshUint32At(packet, 1);
+        if (recipient == shellChannel) {
+            QCOMPARE(packet.mid(5), sshString("ls\n"));
+            bulkBytesBeforeInteractive = bulkBytes;
+        } else {
+            QCOMPARE(recipient, tunnelChannel);
+            bulkBytes += sshUint32At(packet, 5);
+        }
+    }
+    QCOMPARE(bulkBytes, qint64(bulkData.size()));
+
+    // Only what had been handed to the socket already got there first.
+    QVERIFY2(bulkBytesBeforeInteractive <= 256 * 1024,
+             qPrintable(QString::number(bulkBytesBeforeInteractive)));
+}
+
+// While the server does not read, the socket's backlog fills up and the scheduler stops
+// draining the channel. A producer that respects the channel's high water mark then stops,
+// too, and carries on once bytesWritten() tells it there is room again.
+void tst_Ssh::sendBackpressure()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    SshConnection connection(server.connectionParameters());
+    connection.connectToHost();
+    QVERIFY(server.acceptClient());
+    const SshDirectTcpIpTunnel::Ptr tunnel = connection.createDirectTunnel(
+                QLatin1String("localhost"), 1024, QLatin1String("localhost"), 2222);
+    QSignalSpy initializedSpy(tunnel.data(), &SshDirectTcpIpTunnel::initialized);
+    tunnel->initialize();
+    QVERIFY(server.acceptChannel("direct-tcpip", 0, 0x7fffffff) >= 0);
+    QVERIFY(initializedSpy.wait(10000));
+
+    // More than the kernel buffers on both ends of a loopback connection can take.
+    const qint64 totalSize = 32 * 1024 * 1024;
+    const qint64 highWaterMark = Internal::AbstractSshChannel::SendBufferHighWaterMark;
+    const QByteArray chunk(64 * 1024, 'x');
+    qint64 produced = 0;
+    const auto produce = [&] {
+        while (produced < totalSize && tunnel->bytesToWrite() < highWaterMark) {
+            QCOMPARE(tunnel->write(chunk), qint64(chunk.size()));
+            produced += chunk.size();
+        }
+    };
+    QObject producer;
+    connect(tunnel.data(), &QIODevice::bytesWritten, &producer, produce);
+
+    server.setReadBufferSize(64 * 1024);
+    produce();
+    quint64 bytesSent = 0;
+    for (int i = 0; i < 40 && connection.statistics().bytesSent != bytesSent; ++i) {
+        bytesSent = connection.statistics().bytesSent;
+        QTest::qWait(250);
+    }
+    const qint64 producedWhileStalled = produced;
+    QTest::qWait(250);
+    QCOMPARE(connection.statistics().bytesSent, bytesSent);
+    QCOMPARE(produced, producedWhileStalled);
+    QVERIFY(produced < totalSize);
+    QVERIFY(tunnel->bytesToWrite() >= highWaterMark);
+    QVERIFY(tunnel->bytesToWrite() < highWaterMark + chunk.size());
+    QVERIFY(connection.statistics().queuedBytes >= quint64(highWaterMark));
+
+    server.setReadBufferSize(0);
+    qint64 bytesReceived = 0;
+    while (bytesReceived < totalSize) {
+        const QByteArray packet = server.readPacket();
+        QVERIFY(packet.size() > 9);
+        QCOMPARE(packet.at(0), char(94)); // SSH_MSG_CHANNEL_DATA
+        bytesReceived += sshUint32At(packet, 5);
+    }
+    QCOMPARE(bytesReceived, totalSize);
+    QCOMPARE(produced, totalSize);
+    QCOMPARE(tunnel->bytesToWrite(), qint64(0));
+    QCOMPARE(connection.errorState(), SshNoError);
+}
+
 void tst_Ssh::sftp()
 {
     // Connect to server
@@ -655,6 +1855,11 @@ void tst_Ssh::sftp()
         if (jobs.empty())
             loop.quit();
     });
+    QHash<SftpJobId, SftpJobStatistics> jobStatistics;
+    connect(sftpChannel.data(), &SftpChannel::jobStatisticsAvailable,
+            [&jobStatistics](const SftpJobStatistics &statistics) {
+        jobStatistics.insert(statistics.jobId, statistics);
+    });
     QTimer timer;
     QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
     timer.setSingleShot(true);
@@ -729,6 +1934,11 @@ void tst_Ssh::sftp()
     QVERIFY2(jobError.isEmpty(), qPrintable(jobError));
     QCOMPARE(sftpChannel->state(), SftpChannel::Initialized);
     QVERIFY(jobs.empty());
+    QCOMPARE(jobStatistics.size(), 1001);
+    const SftpJobStatistics bigUploadStatistics = jobStatistics.value(uploadJob);
+    QCOMPARE(bigUploadStatistics.bytesTransferred, quint64(bigFileSize));
+    QVERIFY(bigUploadStatistics.writeLatency.count() > 0);
+    QVERIFY(bigUploadStatistics.averageRequestsInFlight > 0);
 
     // Download the uploaded files to a different location
     const QStringList allUploadedFileNames
@@ -1039,6 +2249,262 @@ static QFileInfo searchInPath(const QString &executable)
     return QFileInfo();
 }
 
+void tst_Ssh::sftpRequestTable()
+{
+    Internal::SftpRequestTable table;
+    QVERIFY(table.find(1) == table.end());
+
+    // A sliding window of requests, as during a transfer, with ids wrapping around the table.
+    const quint32 window = 50;
+    Internal::SftpRequestTable::Iterator first = table.insert(1, {});
+    first.request().offset = 1000;
+    for (quint32 id = 2; id <= 5000; ++id) {
+        table.insert(id, {}).request().offset = id;
+        if (id > window + 1)
+            table.erase(table.find(id - window));
+    }
+    QCOMPARE(table.count(), int(window + 1));
+
+    // Entries have been moved around many times, but the iterator still refers to its own.
+    QCOMPARE(first.key(), 1u);
+    QCOMPARE(first.request().offset, quint64(1000));
+    for (quint32 id = 2; id <= 5000 - window; ++id)
+        QVERIFY(table.find(id) == table.end());
+    for (quint32 id = 5001 - window; id <= 5000; ++id) {
+        const Internal::SftpRequestTable::Iterator it = table.find(id);
+        QVERIFY(it != table.end());
+        QCOMPARE(it.request().offset, quint64(id));
+    }
+
+    const QList<quint32> keys = table.keys();
+    QCOMPARE(keys.count(), int(window + 1));
+    QCOMPARE(keys.first(), 1u);
+    QVERIFY(std::is_sorted(keys.begin(), keys.end()));
+
+    // Re-inserting a key resets the bookkeeping.
+    QCOMPARE(table.insert(1, {}).request().offset, quint64(0));
+    QCOMPARE(table.count(), int(window + 1));
+
+    table.clear();
+    QVERIFY(table.isEmpty());
+    QVERIFY(table.find(5000) == table.end());
+}
+
+void tst_Ssh::tarArchive()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString sourceDirPath = tempDir.path() + QLatin1String("/source");
+    const QString longName = QString(120, QLatin1Char('n')) + QLatin1String(".txt");
+    QByteArray bigData(3 * Internal::SshTarPacker::ChunkSize / 2 + 123, '\0');
+    for (int i = 0; i < bigData.size(); ++i)
+        bigData[i] = char(i * 7);
+    const QList<QPair<QString, QByteArray>> files{
+        {QLatin1String("a.txt"), QByteArray("hello")},
+        {QLatin1String("empty"), QByteArray()},
+        {QLatin1String("sub/big.bin"), bigData},
+        {QLatin1String("sub/deeper/") + longName, QByteArray("long name")}
+    };
+    for (const auto &file : files) {
+        const QString filePath = sourceDirPath + QLatin1Char('/') + file.first;
+        QVERIFY(QDir().mkpath(QFileInfo(filePath).absolutePath()));
+        QFile f(filePath);
+        QVERIFY2(f.open(QIODevice::WriteOnly), qPrintable(f.errorString()));
+        QCOMPARE(f.write(file.second), qint64(file.second.size()));
+    }
+
+    Internal::SshTarPacker packer(sourceDirPath);
+    QByteArray archive;
+    bool packerFinished = false;
+    connect(&packer, &Internal::SshTarPacker::dataAvailable,
+            [&archive](const QByteArray &data) { archive += data; });
+    connect(&packer, &Internal::SshTarPacker::finished, [&packerFinished] { packerFinished = true; });
+    connect(&packer, &Internal::SshTarPacker::error,
+            [](const QString &message) { QFAIL(qPrintable(message)); });
+    packer.start();
+    while (!packerFinished)
+        packer.produce();
+    QCOMPARE(archive.size() % (20 * 512), 0);
+
+    // Feed the archive in pieces that do not line up with the blocks.
+    const QString targetDirPath = tempDir.path() + QLatin1String("/target");
+    Internal::SshTarExtractor extractor(targetDirPath, SftpOverwriteExisting);
+    bool extractorFinished = false;
+    connect(&extractor, &Internal::SshTarExtractor::finished,
+            [&extractorFinished] { extractorFinished = true; });
+    connect(&extractor, &Internal::SshTarExtractor::error,
+            [](const QString &message) { QFAIL(qPrintable(message)); });
+    for (int pos = 0; pos < archive.size(); pos += 1000)
+        extractor.extract(archive.mid(pos, 1000));
+    extractor.finish();
+    QVERIFY(extractorFinished);
+
+    for (const auto &file : files) {
+        QFile f(targetDirPath + QLatin1String("/source/") + file.first);
+        QVERIFY2(f.open(QIODevice::ReadOnly), qPrintable(f.fileName()));
+        QCOMPARE(f.readAll(), file.second);
+    }
+}
+
+void tst_Ssh::tarArchiveTraversal()
+{
+    QTemporaryDir tempDir;
+    QVERIFY(tempDir.isValid());
+    const QString targetDirPath = tempDir.path() + QLatin1String("/target");
+    const QString outsideDirPath = tempDir.path() + QLatin1String("/outside");
+    QVERIFY(QDir().mkpath(targetDirPath));
+    QVERIFY(QDir().mkpath(outsideDirPath));
+
+    QVERIFY(!extractTar(targetDirPath, tarEntry("../evil", '0', "x")).isEmpty());
+    QVERIFY(!extractTar(targetDirPath, tarEntry("dir/../../evil", '0', "x")).isEmpty());
+    QVERIFY(!QFileInfo::exists(tempDir.path() + QLatin1String("/evil")));
+    const QByteArray absolutePath = (outsideDirPath + QLatin1String("/evil")).toUtf8();
+    QVERIFY(!extractTar(targetDirPath, tarEntry(absolutePath, '0', "x")).isEmpty());
+    QVERIFY(!QFileInfo::exists(QString::fromUtf8(absolutePath)));
+
+#ifdef Q_OS_UNIX
+    // Links must not point out of the target directory, neither directly nor via other links.
+    QVERIFY(!extractTar(targetDirPath, tarEntry("abs", '2', QByteArray(),
+                                                outsideDirPath.toUtf8())).isEmpty());
+    QVERIFY(!extractTar(targetDirPath, tarEntry("sub/up", '2', QByteArray(),
+                                                "../../outside")).isEmpty());
+    QVERIFY(!extractTar(targetDirPath, tarEntry("self", '2', QByteArray(), ".")
+                        + tarEntry("escape", '2', QByteArray(), "self/..")).isEmpty());
+    QVERIFY(!QFileInfo(targetDirPath + QLatin1String("/abs")).isSymLink());
+    QVERIFY(!QFileInfo(targetDirPath + QLatin1String("/sub/up")).isSymLink());
+    QVERIFY(!QFileInfo(targetDirPath + QLatin1String("/escape")).isSymLink());
+
+    // Symlink, then a file through it: nothing may be written outside.
+    QVERIFY(QFile::link(outsideDirPath, targetDirPath + QLatin1String("/existing")));
+    QVERIFY(!extractTar(targetDirPath, tarEntry("existing/file", '0', "x")).isEmpty());
+    QVERIFY(!extractTar(targetDirPath, tarEntry("existing/dir/", '5')).isEmpty());
+    QVERIFY(!extractTar(targetDirPath, tarEntry("existing", '5')
+                        + tarEntry("existing/file", '0', "x"), SftpSkipExisting).isEmpty());
+    QVERIFY(QFile::link(outsideDirPath + QLatin1String("/file"),
+                        targetDirPath + QLatin1String("/existingFile")));
+    QVERIFY(!extractTar(targetDirPath, tarEntry("existingFile", '0', "x")).isEmpty());
+    QVERIFY(QDir(outsideDirPath).entryList(QDir::NoDotAndDotDot | QDir::AllEntries).isEmpty());
+
+    // Links within the target directory keep working.
+    const QString error = extractTar(targetDirPath, tarEntry("dir/", '5')
+                                     + tarEntry("link", '2', QByteArray(), "dir")
+                                     + tarEntry("link/file", '0', "inside"));
+    QVERIFY2(error.isEmpty(), qPrintable(error));
+    QFile insideFile(targetDirPath + QLatin1String("/dir/file"));
+    QVERIFY(insideFile.open(QIODevice::ReadOnly));
+    QCOMPARE(insideFile.readAll(), QByteArray("inside"));
+#endif
+}
+
+// The server may only send as much as fits into the tunnel's buffer. Once the application
+// has read the data, the window opens up again.
+void tst_Ssh::tunnelReceiveWindow()
+{
+    TestSshServer server;
+    QVERIFY(server.listen());
+    SshConnection connection(server.connectionParameters());
+    connection.connectToHost();
+    QVERIFY(server.acceptClient());
+    QCOMPARE(connection.state(), SshConnection::Connected);
+
+    const SshDirectTcpIpTunnel::Ptr tunnel = connection.createDirectTunnel(
+                QLatin1String("localhost"), 1024, QLatin1String("localhost"), 2222);
+    QSignalSpy initializedSpy(tunnel.data(), &SshDirectTcpIpTunnel::initialized);
+    tunnel->initialize();
+    const QByteArray channelType = sshString("direct-tcpip");
+    const QByteArray openRequest = server.readPacket();
+    QVERIFY(openRequest.startsWith(QByteArray(QByteArray(1, char(90)) + channelType)));
+    const quint32 clientChannel = sshUint32At(openRequest, 1 + channelType.size());
+    qint64 window = sshUint32At(openRequest, 1 + channelType.size() + 4);
+    const qint64 limit = Internal::SshTcpIpTunnelPrivate::ReceiveBufferSize;
+    QVERIFY(window <= limit);
+    server.writePacket(QByteArray(1, char(91)) // SSH_MSG_CHANNEL_OPEN_CONFIRMATION
+                       + sshUint32(clientChannel) + sshUint32(0) + sshUint32(quint32(limit))
+                       + sshUint32(32 * 1024));
+    QVERIFY(initializedSpy.wait(10000));
+
+    // Nobody reads from the tunnel, so the server runs out of window after the first megabyte.
+    const QByteArray chunk(16 * 1024, 'x');
+    qint64 sent = 0;
+    while (sent < 4 * limit) {
+        while (window > 0) {
+            const int size = int(qMin<qint64>(window, chunk.size()));
+            server.writePacket(QByteArray(1, char(94)) // SSH_MSG_CHANNEL_DATA
+                               + sshUint32(clientChannel) + sshString(chunk.left(size)));
+            sent += size;
+            window -= size;
+        }
+        const QByteArray adjust = server.readPacket(1000);
+        if (adjust.isEmpty())
+            break;
+        QCOMPARE(adjust.at(0), char(93)); // SSH_MSG_CHANNEL_WINDOW_ADJUST
+        window += sshUint32At(adjust, 5);
+    }
+    QCOMPARE(sent, limit);
+    QTRY_COMPARE(tunnel->bytesAvailable(), limit);
+    QCOMPARE(connection.errorState(), SshNoError);
+
+    QCOMPARE(tunnel->readAll(), QByteArray(int(limit), 'x'));
+    qint64 granted = 0;
+    while (granted < limit) {
+        const QByteArray adjust = server.readPacket();
+        QVERIFY(adjust.startsWith(char(93)));
+        granted += sshUint32At(adjust, 5);
+    }
+    QCOMPARE(granted, limit);
+}
+
+class WriteCountingSocket : public QTcpSocket
+{
+public:
+    int writeCount = 0;
+
+protected:
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        ++writeCount;
+        return QTcpSocket::writeData(data, size);
+    }
+};
+
+// Packets are collected and reach the socket in one write at the end of the event loop
+// iteration, or as soon as a batch is full.
+void tst_Ssh::writeBatching()
+{
+    QTcpServer server;
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    WriteCountingSocket socket;
+    socket.connectToHost(server.serverAddress(), server.serverPort());
+    QVERIFY(socket.waitForConnected(10000));
+    QVERIFY(server.waitForNewConnection(10000));
+    QTcpSocket * const peer = server.nextPendingConnection();
+    Internal::SshSendFacility sendFacility(&socket);
+
+    for (int i = 0; i < 10; ++i)
+        sendFacility.sendIgnorePacket();
+    QCOMPARE(sendFacility.packetsSent(), quint64(10));
+    QCOMPARE(socket.writeCount, 0);
+    QTRY_COMPARE(socket.writeCount, 1);
+    QTRY_COMPARE(peer->bytesAvailable(), qint64(sendFacility.totalBytesSent()));
+    QTest::qWait(50);
+    QCOMPARE(socket.writeCount, 1);
+
+    // The fourth packet completes a batch of 32 KiB.
+    const QByteArray data(8 * 1024, 'x');
+    for (int i = 0; i < 3; ++i)
+        sendFacility.sendChannelDataPacket(0, data);
+    QCOMPARE(socket.writeCount, 1);
+    sendFacility.sendChannelDataPacket(0, data);
+    QCOMPARE(socket.writeCount, 2);
+
+    sendFacility.sendIgnorePacket();
+    sendFacility.flushWriteBuffer();
+    QCOMPARE(socket.writeCount, 3);
+    sendFacility.flushWriteBuffer();
+    QTRY_COMPARE(peer->bytesAvailable(), qint64(sendFacility.totalBytesSent()));
+    QCOMPARE(socket.writeCount, 3);
+}
+
 void tst_Ssh::x11InfoRetriever_data()
 {
     QTest::addColumn<QString>("displayName");
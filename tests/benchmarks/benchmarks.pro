@@ -0,0 +1,7 @@
+TEMPLATE=subdirs
+SUBDIRS += packetcrypto qssh-replay
+
+# Needs OpenSSH's sshd and ssh-keygen at run time.
+unix {
+    SUBDIRS += qssh-bench
+}
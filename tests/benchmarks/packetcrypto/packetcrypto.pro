@@ -0,0 +1,6 @@
+QT = core network
+DEFINES += QSSH_BENCHMARK_HOOKS
+LIBS += -lQSsh
+include(../../auto/qttest.pri)
+
+SOURCES += tst_packetcrypto.cpp
@@ -0,0 +1,185 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include <qssh/sshcapabilities_p.h>
+#include <qssh/sshcryptofacility_p.h>
+#include <qssh/sshincomingpacket_p.h>
+#include <qssh/sshoutgoingpacket_p.h>
+
+#include <QElapsedTimer>
+#include <QtTest>
+
+using namespace QSsh::Internal;
+
+/*
+ * Per-packet cost of the crypto in the packet pipeline, from 64 bytes to 256 KiB of payload.
+ * The facilities are keyed with SshAbstractCryptoFacility::setFixedKeys(), so no key exchange
+ * and no server are involved. The library only has that function if it was built with
+ * QSSH_BUILD_BENCHMARKS, or with CONFIG+=qssh_benchmarks for qmake.
+ */
+class tst_PacketCrypto : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void decrypt_data();
+    void decrypt();
+    void finalize_data();
+    void finalize();
+    void generateMac_data();
+    void generateMac();
+
+private:
+    static void addCipherRows();
+};
+
+namespace {
+const int MinPayloadSize = 64;
+const int MaxPayloadSize = 256 * 1024;
+const int DecryptBytes = 32 * 1024 * 1024; // Per decrypt() row, spread over the packets.
+
+QList<int> payloadSizes()
+{
+    QList<int> sizes;
+    for (int size = MinPayloadSize; size <= MaxPayloadSize; size *= 2)
+        sizes << size;
+    return sizes;
+}
+} // anonymous namespace
+
+void tst_PacketCrypto::addCipherRows()
+{
+    QTest::addColumn<QByteArray>("cipher");
+    QTest::addColumn<QByteArray>("mac");
+    QTest::addColumn<int>("payloadSize");
+
+    for (const QByteArray &cipher : SshCapabilities::EncryptionAlgorithms) {
+        for (const QByteArray &mac : SshCapabilities::MacAlgorithms) {
+            for (const int size : payloadSizes()) {
+                const QByteArray tag = cipher + '/' + mac + '/' + QByteArray::number(size);
+                QTest::newRow(tag.constData()) << cipher << mac << size;
+            }
+        }
+    }
+}
+
+void tst_PacketCrypto::decrypt_data()
+{
+    addCipherRows();
+}
+
+void tst_PacketCrypto::decrypt()
+{
+    QFETCH(QByteArray, cipher);
+    QFETCH(QByteArray, mac);
+    QFETCH(int, payloadSize);
+
+    // The decrypter's cipher state moves on with every packet, so the same packet cannot be
+    // fed in repeatedly under QBENCHMARK. Instead, a stream of packets is encrypted up front
+    // and the time for taking it in is reported per packet.
+    SshEncryptionFacility encrypter;
+    encrypter.setFixedKeys(cipher, mac);
+    quint32 seqNr = 0;
+    SshOutgoingPacket outgoingPacket(encrypter, seqNr);
+    const QByteArray payload(payloadSize, 'x');
+    const int packetCount = qBound(16, DecryptBytes / payloadSize, 4096);
+    QList<QByteArray> packets;
+    for (; seqNr < quint32(packetCount); ++seqNr) {
+        outgoingPacket.generateChannelDataPacket(0, payload);
+        packets << outgoingPacket.rawData();
+    }
+
+    SshIncomingPacket incomingPacket;
+    incomingPacket.setFixedKeys(cipher, mac);
+    QElapsedTimer timer;
+    timer.start();
+    for (QByteArray &data : packets) {
+        incomingPacket.clear();
+        incomingPacket.consumeData(data);
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+
+    QVERIFY(incomingPacket.isComplete());
+    QCOMPARE(incomingPacket.serverSeqNr(), quint32(packetCount));
+    QCOMPARE(incomingPacket.extractChannelData().data.size(), quint32(payloadSize));
+    QTest::setBenchmarkResult(qreal(elapsed) / packetCount, QTest::WalltimeNanoseconds);
+}
+
+void tst_PacketCrypto::finalize_data()
+{
+    addCipherRows();
+}
+
+void tst_PacketCrypto::finalize()
+{
+    QFETCH(QByteArray, cipher);
+    QFETCH(QByteArray, mac);
+    QFETCH(int, payloadSize);
+
+    SshEncryptionFacility encrypter;
+    encrypter.setFixedKeys(cipher, mac);
+    const quint32 seqNr = 0;
+    SshOutgoingPacket packet(encrypter, seqNr);
+    const QByteArray payload(payloadSize, 'x');
+
+    // Building the packet is part of it, but next to padding, encryption and the MAC,
+    // appending the payload hardly shows.
+    QBENCHMARK {
+        packet.generateChannelDataPacket(0, payload);
+    }
+    QVERIFY(packet.isComplete());
+}
+
+void tst_PacketCrypto::generateMac_data()
+{
+    QTest::addColumn<QByteArray>("mac");
+    QTest::addColumn<int>("payloadSize");
+
+    for (const QByteArray &mac : SshCapabilities::MacAlgorithms) {
+        for (const int size : payloadSizes()) {
+            const QByteArray tag = mac + '/' + QByteArray::number(size);
+            QTest::newRow(tag.constData()) << mac << size;
+        }
+    }
+}
+
+void tst_PacketCrypto::generateMac()
+{
+    QFETCH(QByteArray, mac);
+    QFETCH(int, payloadSize);
+
+    SshEncryptionFacility encrypter;
+    encrypter.setFixedKeys(SshCapabilities::CryptAlgoAes128Ctr, mac);
+    const QByteArray data(payloadSize, 'x');
+    QByteArray digest;
+    QBENCHMARK {
+        digest = encrypter.generateMac(data, data.size());
+    }
+    QCOMPARE(quint32(digest.size()), encrypter.macLength());
+}
+
+QTEST_GUILESS_MAIN(tst_PacketCrypto)
+
+#include "tst_packetcrypto.moc"
@@ -0,0 +1,477 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "benchmarkrunner.h"
+#include "localsshd.h"
+
+#include <qssh/sftpchannel.h>
+#include <qssh/sshremoteprocess.h>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include <algorithm>
+
+using namespace QSsh;
+
+namespace {
+const int ConnectTimeout = 30000;    // milli seconds
+const int TransferTimeout = 3600000; // milli seconds
+const qint64 SmallFileSize = 1024;
+const qint64 SftpBytesPerSize = qint64(64) << 20;
+
+const char * const keyExchangeAlgorithms[] = {
+    "curve25519-sha256", "curve25519-sha256@libssh.org", "ecdh-sha2-nistp256",
+    "ecdh-sha2-nistp384", "ecdh-sha2-nistp521", "diffie-hellman-group14-sha1",
+    "diffie-hellman-group1-sha1"
+};
+const char * const hostKeyAlgorithms[] = {
+    "ssh-ed25519", "ecdsa-sha2-nistp256", "ecdsa-sha2-nistp384", "ecdsa-sha2-nistp521",
+    "rsa-sha2-512", "rsa-sha2-256", "ssh-rsa"
+};
+const char * const ciphers[] = {
+    "aes256-ctr", "aes192-ctr", "aes128-ctr", "3des-ctr", "aes128-cbc", "3des-cbc"
+};
+const char * const macs[] = { "hmac-sha2-256", "hmac-sha2-384", "hmac-sha2-512", "hmac-sha1" };
+const qint64 sftpFileSizes[] = {
+    qint64(1) << 10, qint64(64) << 10, qint64(1) << 20, qint64(16) << 20, qint64(128) << 20,
+    qint64(1) << 30, qint64(10) << 30
+};
+
+double megabytesPerSecond(qint64 bytes, qint64 nsecs)
+{
+    return nsecs <= 0 ? 0 : bytes / (1024.0 * 1024.0) / (nsecs / 1e9);
+}
+
+QJsonObject statisticsToJson(const SftpJobStatistics &statistics)
+{
+    QJsonObject object;
+    object.insert(QLatin1String("durationUs"), double(statistics.duration));
+    object.insert(QLatin1String("bytesTransferred"), double(statistics.bytesTransferred));
+    object.insert(QLatin1String("averageRequestsInFlight"), statistics.averageRequestsInFlight);
+    object.insert(QLatin1String("serverWaitTimeUs"), double(statistics.serverWaitTime));
+    object.insert(QLatin1String("localIoTimeUs"), double(statistics.localIoTime));
+    object.insert(QLatin1String("shortReads"), int(statistics.shortReads));
+    object.insert(QLatin1String("averageReadLatencyUs"),
+                  double(statistics.readLatency.mean()));
+    object.insert(QLatin1String("averageWriteLatencyUs"),
+                  double(statistics.writeLatency.mean()));
+    return object;
+}
+
+bool createFile(const QString &filePath, qint64 size)
+{
+    // Sparse on most file systems, so even the big sizes cost no time to set up.
+    QFile file(filePath);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.resize(size);
+}
+} // anonymous namespace
+
+BenchmarkRunner::BenchmarkRunner(LocalSshd &sshd, const BenchmarkOptions &options)
+    : m_sshd(sshd), m_options(options)
+{
+}
+
+QStringList BenchmarkRunner::groupNames()
+{
+    return QStringList() << QLatin1String("handshake") << QLatin1String("channel")
+                         << QLatin1String("sftp") << QLatin1String("smallfiles");
+}
+
+QJsonArray BenchmarkRunner::run()
+{
+    if (isSelected(QLatin1String("handshake")))
+        runHandshakes();
+    if (isSelected(QLatin1String("channel")))
+        runChannelThroughput();
+    if (isSelected(QLatin1String("sftp")))
+        runSftpTransfers();
+    if (isSelected(QLatin1String("smallfiles")))
+        runSmallFiles();
+    m_sshd.stop();
+    return m_results;
+}
+
+void BenchmarkRunner::runHandshakes()
+{
+    struct Variant { const char *keyExchange; const char *hostKey; };
+    QList<Variant> variants;
+    for (const char * const keyExchange : keyExchangeAlgorithms)
+        variants << Variant{keyExchange, nullptr};
+    for (const char * const hostKey : hostKeyAlgorithms)
+        variants << Variant{nullptr, hostKey};
+
+    for (const Variant &variant : variants) {
+        QJsonObject result;
+        result.insert(QLatin1String("benchmark"), QLatin1String("handshake"));
+        const QString keyExchange = QLatin1String(variant.keyExchange);
+        const QString hostKey = QLatin1String(variant.hostKey);
+        if (!startServer(keyExchange, hostKey, QString(), QString(), &result))
+            continue;
+
+        QList<qint64> times;
+        qint64 tcpConnectTime = 0;
+        qint64 keyExchangeTime = 0;
+        qint64 authenticationTime = 0;
+        for (int i = 0; i < m_options.handshakeIterations; ++i) {
+            SshConnection connection(m_sshd.connectionParameters());
+            QElapsedTimer timer;
+            timer.start();
+            QString error;
+            if (!connectToServer(connection, &error)) {
+                result.insert(QLatin1String("error"), error);
+                break;
+            }
+            times << timer.nsecsElapsed();
+            const SshConnectionStatistics statistics = connection.statistics();
+            tcpConnectTime += statistics.tcpConnectTime;
+            keyExchangeTime += statistics.keyExchangeTime;
+            authenticationTime += statistics.authenticationTime;
+        }
+        if (!times.isEmpty() && !result.contains(QLatin1String("error"))) {
+            std::sort(times.begin(), times.end());
+            qint64 total = 0;
+            for (const qint64 time : times)
+                total += time;
+            const double count = times.size();
+            result.insert(QLatin1String("iterations"), times.size());
+            result.insert(QLatin1String("minMs"), times.first() / 1e6);
+            result.insert(QLatin1String("medianMs"), times.at(times.size() / 2) / 1e6);
+            result.insert(QLatin1String("meanMs"), total / count / 1e6);
+            result.insert(QLatin1String("maxMs"), times.last() / 1e6);
+            result.insert(QLatin1String("tcpConnectMs"), tcpConnectTime / count);
+            result.insert(QLatin1String("keyExchangeMs"), keyExchangeTime / count);
+            result.insert(QLatin1String("authenticationMs"), authenticationTime / count);
+        }
+        addResult(result);
+    }
+}
+
+void BenchmarkRunner::runChannelThroughput()
+{
+    for (const char * const cipher : ciphers) {
+        for (const char * const mac : macs) {
+            QJsonObject result;
+            result.insert(QLatin1String("benchmark"), QLatin1String("channel"));
+            if (!startServer(QString(), QString(), QLatin1String(cipher), QLatin1String(mac),
+                             &result)) {
+                continue;
+            }
+
+            SshConnection connection(m_sshd.connectionParameters());
+            QString error;
+            if (!connectToServer(connection, &error)) {
+                result.insert(QLatin1String("error"), error);
+                addResult(result);
+                continue;
+            }
+
+            // The server produces the data, so this measures what the client can take in.
+            const QByteArray command = "head -c " + QByteArray::number(m_options.channelBytes)
+                    + " /dev/zero";
+            const QSharedPointer<SshRemoteProcess> process
+                    = connection.createRemoteProcess(command);
+            qint64 received = 0;
+            bool closed = false;
+            QElapsedTimer timer;
+            QObject::connect(process.data(), &SshRemoteProcess::started, [&timer] {
+                timer.start();
+            });
+            QObject::connect(process.data(), &SshRemoteProcess::readyReadStandardOutput,
+                             [&received, &process] {
+                received += process->readAllStandardOutput().size();
+            });
+            QObject::connect(process.data(), &SshRemoteProcess::closed, [&closed] {
+                closed = true;
+            });
+            process->start();
+            if (!waitUntil([&closed] { return closed; }, TransferTimeout)
+                    || received != m_options.channelBytes) {
+                result.insert(QLatin1String("error"),
+                              QString::fromLatin1("Received %1 of %2 bytes")
+                              .arg(received).arg(m_options.channelBytes));
+            } else {
+                const qint64 elapsed = timer.nsecsElapsed();
+                const SshConnectionStatistics statistics = connection.statistics();
+                result.insert(QLatin1String("bytes"), double(received));
+                result.insert(QLatin1String("megabytesPerSecond"),
+                              megabytesPerSecond(received, elapsed));
+                result.insert(QLatin1String("decryptionMs"), statistics.decryptionTime / 1e6);
+                result.insert(QLatin1String("macMs"), statistics.macTime / 1e6);
+            }
+            addResult(result);
+        }
+    }
+}
+
+void BenchmarkRunner::runSftpTransfers()
+{
+    QJsonObject setup;
+    setup.insert(QLatin1String("benchmark"), QLatin1String("sftp"));
+    if (!startServer(QString(), QString(), QString(), QString(), &setup))
+        return;
+
+    QTemporaryDir localDir;
+    SshConnection connection(m_sshd.connectionParameters());
+    QString error;
+    QSharedPointer<SftpChannel> channel;
+    if (!localDir.isValid() || !connectToServer(connection, &error)
+            || !(channel = openSftpChannel(connection, &error))) {
+        setup.insert(QLatin1String("error"), error.isEmpty() ? localDir.errorString() : error);
+        addResult(setup);
+        return;
+    }
+
+    for (const qint64 size : sftpFileSizes) {
+        if (size > m_options.maxFileSize)
+            break;
+        const QString fileName = QLatin1String("file-") + QString::number(size);
+        const QString localPath = localDir.filePath(fileName);
+        const QString remotePath = m_sshd.dataDirectory() + QLatin1Char('/') + fileName;
+        const QString downloadPath = localPath + QLatin1String(".download");
+        if (!createFile(localPath, size)) {
+            setup.insert(QLatin1String("error"), QLatin1String("Cannot create ") + localPath);
+            addResult(setup);
+            return;
+        }
+
+        const int repetitions = int(qBound(qint64(1), SftpBytesPerSize / size, qint64(100)));
+        for (const bool upload : {true, false}) {
+            QJsonObject result;
+            result.insert(QLatin1String("benchmark"), QLatin1String("sftp"));
+            result.insert(QLatin1String("direction"),
+                          upload ? QLatin1String("upload") : QLatin1String("download"));
+            result.insert(QLatin1String("fileSize"), double(size));
+            result.insert(QLatin1String("repetitions"), repetitions);
+
+            qint64 elapsed = 0;
+            SftpJobStatistics statistics;
+            for (int i = 0; i < repetitions; ++i) {
+                QFile::remove(downloadPath);
+                QElapsedTimer timer;
+                timer.start();
+                const bool ok = runSftpJob(*channel, [&] {
+                    return upload
+                            ? channel->uploadFile(localPath, remotePath, SftpOverwriteExisting)
+                            : channel->downloadFile(remotePath, downloadPath,
+                                                    SftpOverwriteExisting);
+                }, &statistics, &error);
+                elapsed += timer.nsecsElapsed();
+                if (!ok) {
+                    result.insert(QLatin1String("error"), error);
+                    break;
+                }
+            }
+            if (!result.contains(QLatin1String("error"))) {
+                result.insert(QLatin1String("megabytesPerSecond"),
+                              megabytesPerSecond(size * repetitions, elapsed));
+                result.insert(QLatin1String("lastJob"), statisticsToJson(statistics));
+            }
+            addResult(result);
+        }
+        QFile::remove(localPath);
+        QFile::remove(downloadPath);
+        QFile::remove(remotePath);
+    }
+}
+
+void BenchmarkRunner::runSmallFiles()
+{
+    QJsonObject result;
+    result.insert(QLatin1String("benchmark"), QLatin1String("smallfiles"));
+    result.insert(QLatin1String("fileCount"), m_options.smallFileCount);
+    result.insert(QLatin1String("fileSize"), double(SmallFileSize));
+    if (!startServer(QString(), QString(), QString(), QString(), &result))
+        return;
+
+    QTemporaryDir localDir;
+    const QString sourceDir = localDir.filePath(QLatin1String("small"));
+    bool ok = localDir.isValid() && QDir().mkpath(sourceDir);
+    for (int i = 0; ok && i < m_options.smallFileCount; ++i)
+        ok = createFile(sourceDir + QLatin1String("/f") + QString::number(i), SmallFileSize);
+    if (!ok) {
+        result.insert(QLatin1String("error"), QLatin1String("Cannot create the local files"));
+        addResult(result);
+        return;
+    }
+
+    SshConnection connection(m_sshd.connectionParameters());
+    QString error;
+    QSharedPointer<SftpChannel> channel;
+    if (!connectToServer(connection, &error) || !(channel = openSftpChannel(connection, &error))) {
+        result.insert(QLatin1String("error"), error);
+        addResult(result);
+        return;
+    }
+
+    const QString remoteDir = m_sshd.dataDirectory() + QLatin1String("/small");
+    const QString downloadDir = localDir.filePath(QLatin1String("download"));
+    SftpJobStatistics statistics;
+    QElapsedTimer timer;
+    timer.start();
+    if (!runSftpJob(*channel, [&] { return channel->uploadDir(sourceDir, m_sshd.dataDirectory()); },
+                    &statistics, &error)) {
+        result.insert(QLatin1String("error"), error);
+        addResult(result);
+        return;
+    }
+    const qint64 uploadTime = timer.nsecsElapsed();
+    result.insert(QLatin1String("uploadFilesPerSecond"),
+                  m_options.smallFileCount / (uploadTime / 1e9));
+    result.insert(QLatin1String("upload"), statisticsToJson(statistics));
+
+    timer.start();
+    if (!runSftpJob(*channel, [&] {
+                        return channel->downloadDir(remoteDir, downloadDir, SftpOverwriteExisting);
+                    }, &statistics, &error)) {
+        result.insert(QLatin1String("error"), error);
+    } else {
+        const qint64 downloadTime = timer.nsecsElapsed();
+        result.insert(QLatin1String("downloadFilesPerSecond"),
+                      m_options.smallFileCount / (downloadTime / 1e9));
+        result.insert(QLatin1String("download"), statisticsToJson(statistics));
+    }
+    addResult(result);
+    QDir(remoteDir).removeRecursively();
+}
+
+bool BenchmarkRunner::isSelected(const QString &group) const
+{
+    return m_options.groups.isEmpty() || m_options.groups.contains(group);
+}
+
+bool BenchmarkRunner::startServer(const QString &keyExchange, const QString &hostKey,
+                                  const QString &cipher, const QString &mac, QJsonObject *result)
+{
+    if (!keyExchange.isEmpty())
+        result->insert(QLatin1String("keyExchange"), keyExchange);
+    if (!hostKey.isEmpty())
+        result->insert(QLatin1String("hostKey"), hostKey);
+    if (!cipher.isEmpty())
+        result->insert(QLatin1String("cipher"), cipher);
+    if (!mac.isEmpty())
+        result->insert(QLatin1String("mac"), mac);
+
+    QString error;
+    if (m_sshd.start(SshdAlgorithms{keyExchange, hostKey, cipher, mac}, &error))
+        return true;
+    result->insert(QLatin1String("error"), error);
+    addResult(*result);
+    return false;
+}
+
+bool BenchmarkRunner::connectToServer(SshConnection &connection, QString *error)
+{
+    connection.connectToHost();
+    const bool done = waitUntil([&connection] {
+        return connection.state() == SshConnection::Connected
+                || connection.errorState() != SshNoError;
+    }, ConnectTimeout);
+    if (connection.state() == SshConnection::Connected)
+        return true;
+    *error = done ? connection.errorString() : QLatin1String("Timeout connecting");
+    return false;
+}
+
+QSharedPointer<SftpChannel> BenchmarkRunner::openSftpChannel(SshConnection &connection,
+                                                             QString *error)
+{
+    const QSharedPointer<SftpChannel> channel = connection.createSftpChannel();
+    bool failed = false;
+    QObject::connect(channel.data(), &SftpChannel::channelError,
+                     [&failed, error](const QString &reason) {
+        *error = reason;
+        failed = true;
+    });
+    channel->initialize();
+    const bool done = waitUntil([&] {
+        return failed || channel->state() == SftpChannel::Initialized;
+    }, ConnectTimeout);
+    if (channel->state() == SftpChannel::Initialized)
+        return channel;
+    if (!done)
+        *error = QLatin1String("Timeout initializing the SFTP channel");
+    return QSharedPointer<SftpChannel>();
+}
+
+bool BenchmarkRunner::runSftpJob(SftpChannel &channel, const std::function<SftpJobId()> &start,
+                                 SftpJobStatistics *statistics, QString *error)
+{
+    SftpJobId job = SftpInvalidJob;
+    bool finished = false;
+    bool haveStatistics = false;
+    QString jobError;
+    const QMetaObject::Connection finishedConnection = QObject::connect(&channel,
+            &SftpChannel::finished, [&](SftpJobId id, SftpError, const QString &message) {
+        if (id != job)
+            return;
+        finished = true;
+        jobError = message;
+    });
+    const QMetaObject::Connection statisticsConnection = QObject::connect(&channel,
+            &SftpChannel::jobStatisticsAvailable, [&](const SftpJobStatistics &jobStatistics) {
+        if (jobStatistics.jobId != job)
+            return;
+        *statistics = jobStatistics;
+        haveStatistics = true;
+    });
+
+    job = start();
+    const bool done = job != SftpInvalidJob
+            && waitUntil([&] { return finished && haveStatistics; }, TransferTimeout);
+    QObject::disconnect(finishedConnection);
+    QObject::disconnect(statisticsConnection);
+    if (job == SftpInvalidJob)
+        *error = QLatin1String("Cannot start the SFTP job");
+    else if (!done)
+        *error = QLatin1String("Timeout waiting for the SFTP job");
+    else if (!jobError.isEmpty())
+        *error = jobError;
+    return done && jobError.isEmpty();
+}
+
+void BenchmarkRunner::addResult(const QJsonObject &result)
+{
+    m_results.append(result);
+}
+
+bool BenchmarkRunner::waitUntil(const std::function<bool()> &condition, int timeoutMs)
+{
+    // The ticker makes sure WaitForMoreEvents returns to check the timeout.
+    QTimer ticker;
+    ticker.start(100);
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition()) {
+        if (timer.hasExpired(timeoutMs))
+            return false;
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+    return true;
+}
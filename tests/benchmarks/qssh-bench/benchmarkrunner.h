@@ -0,0 +1,84 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include <qssh/sshconnection.h>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <functional>
+
+class LocalSshd;
+
+namespace QSsh { class SftpChannel; }
+
+struct BenchmarkOptions
+{
+    int handshakeIterations = 10;
+    qint64 channelBytes = qint64(256) << 20;
+    qint64 maxFileSize = qint64(1) << 30;
+    int smallFileCount = 1000;
+    QStringList groups; // Empty means all of them.
+};
+
+/*
+ * Runs the individual measurements against a LocalSshd and collects one JSON object per
+ * measurement. Algorithms the server or the client does not support show up as entries
+ * with an "error" member rather than ending the run.
+ */
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(LocalSshd &sshd, const BenchmarkOptions &options);
+
+    static QStringList groupNames();
+
+    QJsonArray run();
+
+private:
+    void runHandshakes();
+    void runChannelThroughput();
+    void runSftpTransfers();
+    void runSmallFiles();
+
+    bool isSelected(const QString &group) const;
+    bool startServer(const QString &keyExchange, const QString &hostKey, const QString &cipher,
+                     const QString &mac, QJsonObject *result);
+    bool connectToServer(QSsh::SshConnection &connection, QString *error);
+    QSharedPointer<QSsh::SftpChannel> openSftpChannel(QSsh::SshConnection &connection,
+                                                      QString *error);
+    bool runSftpJob(QSsh::SftpChannel &channel, const std::function<QSsh::SftpJobId()> &start,
+                    QSsh::SftpJobStatistics *statistics, QString *error);
+    void addResult(const QJsonObject &result);
+
+    static bool waitUntil(const std::function<bool()> &condition, int timeoutMs);
+
+    LocalSshd &m_sshd;
+    const BenchmarkOptions m_options;
+    QJsonArray m_results;
+};
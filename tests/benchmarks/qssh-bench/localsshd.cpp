@@ -0,0 +1,253 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "localsshd.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHostAddress>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QThread>
+
+namespace {
+const int StartupTimeout = 5000; // milli seconds
+
+const QStringList &sbinPaths()
+{
+    static const QStringList paths = QStringList() << QLatin1String("/usr/sbin")
+            << QLatin1String("/usr/local/sbin") << QLatin1String("/sbin");
+    return paths;
+}
+
+QString findExecutable(const QString &name)
+{
+    const QString path = QStandardPaths::findExecutable(name);
+    return path.isEmpty() ? QStandardPaths::findExecutable(name, sbinPaths()) : path;
+}
+
+quint16 findFreePort()
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, 0))
+        return 0;
+    return server.serverPort();
+}
+} // anonymous namespace
+
+LocalSshd::LocalSshd() : m_port(0)
+{
+    m_process.setProcessChannelMode(QProcess::SeparateChannels);
+}
+
+LocalSshd::~LocalSshd()
+{
+    stop();
+}
+
+bool LocalSshd::setUp(QString *error)
+{
+    if (!m_dir.isValid()) {
+        *error = QLatin1String("Cannot create temporary directory: ") + m_dir.errorString();
+        return false;
+    }
+    m_sshdPath = findExecutable(QLatin1String("sshd"));
+    m_keygenPath = findExecutable(QLatin1String("ssh-keygen"));
+    if (m_sshdPath.isEmpty() || m_keygenPath.isEmpty()) {
+        *error = QLatin1String("sshd and ssh-keygen are required.");
+        return false;
+    }
+    m_userName = QString::fromLocal8Bit(qgetenv("USER"));
+    if (m_userName.isEmpty()) {
+        *error = QLatin1String("Cannot determine the user name; set USER.");
+        return false;
+    }
+
+    const QStringList keygenRuns[] = {
+        QStringList() << QLatin1String("-t") << QLatin1String("ed25519")
+                      << QLatin1String("-f") << filePath(QLatin1String("host_ed25519")),
+        QStringList() << QLatin1String("-t") << QLatin1String("ecdsa") << QLatin1String("-b")
+                      << QLatin1String("256") << QLatin1String("-f")
+                      << filePath(QLatin1String("host_ecdsa256")),
+        QStringList() << QLatin1String("-t") << QLatin1String("ecdsa") << QLatin1String("-b")
+                      << QLatin1String("384") << QLatin1String("-f")
+                      << filePath(QLatin1String("host_ecdsa384")),
+        QStringList() << QLatin1String("-t") << QLatin1String("ecdsa") << QLatin1String("-b")
+                      << QLatin1String("521") << QLatin1String("-f")
+                      << filePath(QLatin1String("host_ecdsa521")),
+        QStringList() << QLatin1String("-t") << QLatin1String("rsa") << QLatin1String("-b")
+                      << QLatin1String("3072") << QLatin1String("-f")
+                      << filePath(QLatin1String("host_rsa")),
+        QStringList() << QLatin1String("-t") << QLatin1String("ed25519")
+                      << QLatin1String("-f") << filePath(QLatin1String("client_key")),
+    };
+    for (const QStringList &arguments : keygenRuns) {
+        if (!runKeygen(arguments, error))
+            return false;
+    }
+
+    QFile publicKey(filePath(QLatin1String("client_key.pub")));
+    QFile authorizedKeys(filePath(QLatin1String("authorized_keys")));
+    if (!publicKey.open(QIODevice::ReadOnly) || !authorizedKeys.open(QIODevice::WriteOnly)
+            || authorizedKeys.write(publicKey.readAll()) <= 0) {
+        *error = QLatin1String("Cannot set up authorized_keys.");
+        return false;
+    }
+
+    if (!QDir(m_dir.path()).mkpath(QLatin1String("data"))) {
+        *error = QLatin1String("Cannot create the data directory.");
+        return false;
+    }
+    return true;
+}
+
+bool LocalSshd::start(const SshdAlgorithms &algorithms, QString *error)
+{
+    stop();
+    if (!writeConfig(algorithms, error))
+        return false;
+    m_port = findFreePort();
+    if (m_port == 0) {
+        *error = QLatin1String("No free port.");
+        return false;
+    }
+
+    m_process.start(m_sshdPath, QStringList() << QLatin1String("-D") << QLatin1String("-e")
+                    << QLatin1String("-f") << filePath(QLatin1String("sshd_config"))
+                    << QLatin1String("-p") << QString::number(m_port));
+    if (!m_process.waitForStarted()) {
+        *error = QLatin1String("Cannot start sshd: ") + m_process.errorString();
+        return false;
+    }
+
+    // sshd has no readiness notification here, so poll until it accepts connections.
+    QElapsedTimer timer;
+    timer.start();
+    while (!timer.hasExpired(StartupTimeout)) {
+        if (m_process.state() != QProcess::Running) {
+            *error = QLatin1String("sshd exited: ")
+                    + QString::fromLocal8Bit(m_process.readAllStandardError()).trimmed();
+            return false;
+        }
+        QTcpSocket probe;
+        probe.connectToHost(QHostAddress::LocalHost, m_port);
+        if (probe.waitForConnected(100))
+            return true;
+        QThread::msleep(20);
+    }
+    *error = QLatin1String("sshd did not start listening.");
+    stop();
+    return false;
+}
+
+void LocalSshd::stop()
+{
+    if (m_process.state() == QProcess::NotRunning)
+        return;
+    m_process.terminate();
+    if (!m_process.waitForFinished(StartupTimeout))
+        m_process.kill();
+    m_process.waitForFinished();
+}
+
+QSsh::SshConnectionParameters LocalSshd::connectionParameters() const
+{
+    QSsh::SshConnectionParameters parameters;
+    parameters.setHost(QLatin1String("127.0.0.1"));
+    parameters.setPort(m_port);
+    parameters.setUserName(m_userName);
+    parameters.authenticationType = QSsh::SshConnectionParameters::AuthenticationTypePublicKey;
+    parameters.privateKeyFile = filePath(QLatin1String("client_key"));
+    parameters.hostKeyCheckingMode = QSsh::SshHostKeyCheckingNone;
+    parameters.timeout = 30;
+    return parameters;
+}
+
+QString LocalSshd::dataDirectory() const
+{
+    return filePath(QLatin1String("data"));
+}
+
+bool LocalSshd::runKeygen(const QStringList &arguments, QString *error)
+{
+    QProcess keygen;
+    keygen.start(m_keygenPath, QStringList() << QLatin1String("-q") << QLatin1String("-N")
+                 << QString() << arguments);
+    if (!keygen.waitForFinished() || keygen.exitStatus() != QProcess::NormalExit
+            || keygen.exitCode() != 0) {
+        *error = QLatin1String("ssh-keygen failed: ")
+                + QString::fromLocal8Bit(keygen.readAllStandardError()).trimmed();
+        return false;
+    }
+    return true;
+}
+
+bool LocalSshd::writeConfig(const SshdAlgorithms &algorithms, QString *error)
+{
+    QFile file(filePath(QLatin1String("sshd_config")));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = QLatin1String("Cannot write sshd_config: ") + file.errorString();
+        return false;
+    }
+
+    QTextStream config(&file);
+    config << "ListenAddress 127.0.0.1\n";
+    for (const char * const key : {"host_ed25519", "host_ecdsa256", "host_ecdsa384",
+                                   "host_ecdsa521", "host_rsa"}) {
+        config << "HostKey " << filePath(QLatin1String(key)) << '\n';
+    }
+    config << "AuthorizedKeysFile " << filePath(QLatin1String("authorized_keys")) << '\n'
+           << "PidFile none\n"
+           << "UsePAM no\n"
+           << "StrictModes no\n"
+           << "PasswordAuthentication no\n"
+           << "PubkeyAuthentication yes\n"
+           << "Subsystem sftp internal-sftp\n"
+           << "MaxSessions 1000\n"
+           << "MaxStartups 1000\n"
+           << "LogLevel ERROR\n";
+    if (!algorithms.keyExchange.isEmpty())
+        config << "KexAlgorithms " << algorithms.keyExchange << '\n';
+    if (!algorithms.hostKey.isEmpty())
+        config << "HostKeyAlgorithms " << algorithms.hostKey << '\n';
+    if (!algorithms.cipher.isEmpty())
+        config << "Ciphers " << algorithms.cipher << '\n';
+    if (!algorithms.mac.isEmpty())
+        config << "MACs " << algorithms.mac << '\n';
+    config.flush();
+    if (config.status() != QTextStream::Ok) {
+        *error = QLatin1String("Cannot write sshd_config.");
+        return false;
+    }
+    return true;
+}
+
+QString LocalSshd::filePath(const QString &fileName) const
+{
+    return m_dir.filePath(fileName);
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#pragma once
+
+#include <qssh/sshconnection.h>
+
+#include <QProcess>
+#include <QString>
+#include <QTemporaryDir>
+
+// The algorithms the server offers. Empty ones are left at the sshd default.
+struct SshdAlgorithms
+{
+    QString keyExchange;
+    QString hostKey;
+    QString cipher;
+    QString mac;
+};
+
+/*
+ * Runs the system's OpenSSH server as the current user on a loopback port, with its own
+ * host keys, a client key and a throw-away configuration in a temporary directory.
+ * Restricting the server to one algorithm per category is how the benchmarks pick what
+ * gets negotiated, as the client always offers everything it supports.
+ */
+class LocalSshd
+{
+public:
+    LocalSshd();
+    ~LocalSshd();
+
+    bool setUp(QString *error);
+    bool start(const SshdAlgorithms &algorithms, QString *error);
+    void stop();
+
+    QSsh::SshConnectionParameters connectionParameters() const;
+
+    // Scratch space for the benchmarks; the SFTP server can see it, too.
+    QString dataDirectory() const;
+
+private:
+    bool runKeygen(const QStringList &arguments, QString *error);
+    bool writeConfig(const SshdAlgorithms &algorithms, QString *error);
+    QString filePath(const QString &fileName) const;
+
+    QTemporaryDir m_dir;
+    QString m_sshdPath;
+    QString m_keygenPath;
+    QString m_userName;
+    QProcess m_process;
+    quint16 m_port;
+};
@@ -0,0 +1,158 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include "benchmarkrunner.h"
+#include "localsshd.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+
+#include <iostream>
+
+namespace {
+// Accepts plain byte counts as well as K, M and G suffixes.
+bool parseSize(const QString &text, qint64 *size)
+{
+    static const QString suffixes = QLatin1String("KMG");
+    QString number = text.trimmed().toUpper();
+    int shift = 0;
+    const int suffix = number.isEmpty() ? -1 : suffixes.indexOf(number.at(number.size() - 1));
+    if (suffix >= 0) {
+        shift = 10 * (suffix + 1);
+        number.chop(1);
+    }
+    bool ok = false;
+    const qint64 value = number.toLongLong(&ok);
+    if (!ok || value <= 0)
+        return false;
+    *size = value << shift;
+    return true;
+}
+
+void fail(const QString &message)
+{
+    std::cerr << "qssh-bench: " << qPrintable(message) << std::endl;
+}
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QLatin1String("qssh-bench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Measures QSsh against a local OpenSSH "
+            "server that is started for the run; no network access is needed."));
+    parser.addHelpOption();
+    const QCommandLineOption outputOption(QStringList() << QLatin1String("o")
+            << QLatin1String("output"), QLatin1String("Write the JSON report to <file> "
+            "instead of stdout."), QLatin1String("file"));
+    const QCommandLineOption iterationsOption(QLatin1String("iterations"),
+            QLatin1String("Handshakes per algorithm (default 10)."), QLatin1String("count"));
+    const QCommandLineOption channelBytesOption(QLatin1String("channel-bytes"),
+            QLatin1String("Bytes per channel throughput run (default 256M)."),
+            QLatin1String("size"));
+    const QCommandLineOption maxFileSizeOption(QLatin1String("max-file-size"),
+            QLatin1String("Largest SFTP file size, up to 10G (default 1G)."),
+            QLatin1String("size"));
+    const QCommandLineOption smallFilesOption(QLatin1String("small-files"),
+            QLatin1String("Number of 1 KiB files in the directory benchmark (default 1000)."),
+            QLatin1String("count"));
+    const QCommandLineOption onlyOption(QLatin1String("only"),
+            QLatin1String("Run only the given benchmark group, one of: ")
+            + BenchmarkRunner::groupNames().join(QLatin1String(", "))
+            + QLatin1String(". May be repeated."), QLatin1String("group"));
+    parser.addOption(outputOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(channelBytesOption);
+    parser.addOption(maxFileSizeOption);
+    parser.addOption(smallFilesOption);
+    parser.addOption(onlyOption);
+    parser.process(app);
+
+    BenchmarkOptions options;
+    bool ok = true;
+    if (parser.isSet(iterationsOption))
+        options.handshakeIterations = parser.value(iterationsOption).toInt(&ok);
+    if (!ok || options.handshakeIterations <= 0) {
+        fail(QLatin1String("Invalid iteration count."));
+        return 1;
+    }
+    if (parser.isSet(channelBytesOption)
+            && !parseSize(parser.value(channelBytesOption), &options.channelBytes)) {
+        fail(QLatin1String("Invalid channel byte count."));
+        return 1;
+    }
+    if (parser.isSet(maxFileSizeOption)
+            && !parseSize(parser.value(maxFileSizeOption), &options.maxFileSize)) {
+        fail(QLatin1String("Invalid maximum file size."));
+        return 1;
+    }
+    if (parser.isSet(smallFilesOption))
+        options.smallFileCount = parser.value(smallFilesOption).toInt(&ok);
+    if (!ok || options.smallFileCount <= 0) {
+        fail(QLatin1String("Invalid number of small files."));
+        return 1;
+    }
+    options.groups = parser.values(onlyOption);
+    for (const QString &group : options.groups) {
+        if (!BenchmarkRunner::groupNames().contains(group)) {
+            fail(QLatin1String("Unknown benchmark group: ") + group);
+            return 1;
+        }
+    }
+
+    LocalSshd sshd;
+    QString error;
+    if (!sshd.setUp(&error)) {
+        fail(error);
+        return 1;
+    }
+
+    BenchmarkRunner runner(sshd, options);
+    QJsonObject report;
+    report.insert(QLatin1String("tool"), QLatin1String("qssh-bench"));
+    report.insert(QLatin1String("qtVersion"), QLatin1String(qVersion()));
+    report.insert(QLatin1String("timestamp"),
+                  QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    report.insert(QLatin1String("results"), runner.run());
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (!parser.isSet(outputOption)) {
+        std::cout << json.constData();
+        return 0;
+    }
+    QFile output(parser.value(outputOption));
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || output.write(json) != json.size()) {
+        fail(QLatin1String("Cannot write ") + output.fileName() + QLatin1String(": ")
+             + output.errorString());
+        return 1;
+    }
+    return 0;
+}
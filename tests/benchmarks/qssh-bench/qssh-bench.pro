@@ -0,0 +1,10 @@
+QT += core network
+
+TARGET=qssh-bench
+CONFIG += console
+SOURCES=main.cpp benchmarkrunner.cpp localsshd.cpp
+HEADERS=benchmarkrunner.h localsshd.h
+
+include(../../../qssh.pri) ## Required for IDE_LIBRARY_PATH and qtLibraryName
+
+LIBS += -L$$IDE_LIBRARY_PATH -l$$qtLibraryName(botan-2) -l$$qtLibraryName(QSsh)
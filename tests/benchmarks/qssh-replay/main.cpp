@@ -0,0 +1,145 @@
+/****************************************************************************
+**
+** Copyright (C) 2016 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of Qt Creator.
+**
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 as published by the Free Software
+** Foundation with exceptions as appearing in the file LICENSE.GPL3-EXCEPT
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+****************************************************************************/
+
+#include <qssh/sshpackettrace_p.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMap>
+
+#include <iostream>
+
+using namespace QSsh::Internal;
+
+namespace {
+struct TypeSummary
+{
+    quint64 packets = 0;
+    quint64 bytes = 0;
+};
+
+void printSummary(const QString &filePath)
+{
+    SshPacketTraceReader reader;
+    QString error;
+    if (!reader.open(filePath, &error)) {
+        std::cerr << "qssh-replay: " << qPrintable(error) << std::endl;
+        return;
+    }
+
+    QMap<int, TypeSummary> incoming;
+    QMap<int, TypeSummary> outgoing;
+    qint64 lastTimestamp = 0;
+    while (!reader.atEnd()) {
+        SshPacketTraceRecord record;
+        if (!reader.readNext(&record, &error)) {
+            std::cerr << "qssh-replay: " << qPrintable(error) << std::endl;
+            break;
+        }
+        TypeSummary &summary = record.direction == SshPacketTraceRecord::Incoming
+                ? incoming[record.type] : outgoing[record.type];
+        ++summary.packets;
+        summary.bytes += record.payloadSize;
+        lastTimestamp = record.timestamp;
+    }
+
+    std::cout << "Duration: " << lastTimestamp / 1000000 << " ms" << std::endl;
+    for (const bool in : {true, false}) {
+        const QMap<int, TypeSummary> &summaries = in ? incoming : outgoing;
+        std::cout << (in ? "Received" : "Sent") << ':' << std::endl;
+        for (auto it = summaries.cbegin(); it != summaries.cend(); ++it) {
+            std::cout << "  type " << it.key() << ": " << it.value().packets << " packets, "
+                      << it.value().bytes << " payload bytes" << std::endl;
+        }
+    }
+}
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QLatin1String("qssh-replay"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QLatin1String("Replays a packet trace recorded with "
+            "SshConnectionParameters::packetTraceFile through the packet handling code, "
+            "without a server."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QLatin1String("trace"), QLatin1String("The trace file."));
+    const QCommandLineOption summaryOption(QLatin1String("summary"),
+            QLatin1String("Only print packet counts and sizes per message type."));
+    const QCommandLineOption repeatOption(QLatin1String("repeat"),
+            QLatin1String("Replay the trace <count> times (default 1)."), QLatin1String("count"));
+    parser.addOption(summaryOption);
+    parser.addOption(repeatOption);
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+    if (arguments.size() != 1)
+        parser.showHelp(1);
+    const QString filePath = arguments.first();
+
+    if (parser.isSet(summaryOption)) {
+        printSummary(filePath);
+        return 0;
+    }
+
+    bool ok = true;
+    const int repetitions = parser.isSet(repeatOption)
+            ? parser.value(repeatOption).toInt(&ok) : 1;
+    if (!ok || repetitions <= 0) {
+        std::cerr << "qssh-replay: Invalid repeat count." << std::endl;
+        return 1;
+    }
+
+    SshPacketReplayer replayer;
+    QString error;
+    if (!replayer.load(filePath, &error)) {
+        std::cerr << "qssh-replay: " << qPrintable(error) << std::endl;
+        return 1;
+    }
+    const int packetCount = replayer.replayablePacketCount();
+    if (packetCount == 0) {
+        std::cerr << "qssh-replay: The trace has no payloads to replay; it needs to be "
+                     "recorded with SshConnectionParameters::packetTraceFile." << std::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < repetitions; ++i) {
+        if (!replayer.replay(&error)) {
+            std::cerr << "qssh-replay: " << qPrintable(error) << std::endl;
+            return 1;
+        }
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+    std::cout << "Replayed " << packetCount << " packets " << repetitions << " times in "
+              << elapsed / 1000000 << " ms, "
+              << elapsed / 1000.0 / (qint64(packetCount) * repetitions) << " us per packet"
+              << std::endl;
+    return 0;
+}
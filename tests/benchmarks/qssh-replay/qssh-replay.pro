@@ -0,0 +1,9 @@
+QT += core network
+
+TARGET=qssh-replay
+CONFIG += console
+SOURCES=main.cpp
+
+include(../../../qssh.pri) ## Required for IDE_LIBRARY_PATH and qtLibraryName
+
+LIBS += -L$$IDE_LIBRARY_PATH -l$$qtLibraryName(botan-2) -l$$qtLibraryName(QSsh)
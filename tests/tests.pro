@@ -1,2 +1,5 @@
 TEMPLATE=subdirs
 SUBDIRS += manual auto
+
+# Like QSSH_BUILD_BENCHMARKS with CMake: "qmake CONFIG+=qssh_benchmarks".
+qssh_benchmarks: SUBDIRS += benchmarks